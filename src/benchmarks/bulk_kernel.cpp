@@ -0,0 +1,137 @@
+/* Bulk kernel benchmark.
+   Copyright (C) 2013 Jarryd Beck
+
+This file is part of TransLucid.
+
+TransLucid is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+TransLucid is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with TransLucid; see the file COPYING.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+/**
+ * @file benchmarks/bulk_kernel.cpp
+ * Times an assignment of pointwise arithmetic over an array, once through
+ * the evaluator for every cell and once as a bulk kernel.
+ */
+
+#include <tl/assignment.hpp>
+#include <tl/ast.hpp>
+#include <tl/hyperdatons/arrayhd.hpp>
+#include <tl/system.hpp>
+#include <tl/types/intmp.hpp>
+#include <tl/types/range.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+namespace TL = TransLucid;
+
+namespace
+{
+  //assign out [0 : 0..n-1, 1 : 0..n-1] := #.0 * #.0 + #.1 * 3 - 7
+  double
+  run(size_t n, bool bulk, TL::ArrayHD& out)
+  {
+    namespace Tree = TL::Tree;
+
+    TL::System s;
+    s.enableBulkKernels(bulk);
+
+    s.addDeclaration(TL::Parser::RawInput{U"benchmark", 1, 1,
+      U"fun plus!a!b = intmp_plus.(a,b);;"});
+    s.addDeclaration(TL::Parser::RawInput{U"benchmark", 2, 1,
+      U"fun minus!a!b = intmp_minus.(a,b);;"});
+    s.addDeclaration(TL::Parser::RawInput{U"benchmark", 3, 1,
+      U"fun times!a!b = intmp_times.(a,b);;"});
+
+    TL::dimension_index d0 =
+      s.getDimensionIndex(TL::Types::Intmp::create(0));
+    TL::dimension_index d1 =
+      s.getDimensionIndex(TL::Types::Intmp::create(1));
+
+    out.initialise({{d0, n}, {d1, n}});
+    s.addOutputHyperdaton(U"out", &out);
+
+    mpz_class zero = 0, last = n - 1;
+
+    auto binary = [] (const TL::u32string& op, Tree::Expr lhs,
+      Tree::Expr rhs) -> Tree::Expr
+    {
+      return Tree::LambdaAppExpr(
+        Tree::LambdaAppExpr(Tree::IdentExpr(op), lhs), rhs);
+    };
+
+    Tree::Expr i = Tree::HashExpr(mpz_class(0));
+    Tree::Expr j = Tree::HashExpr(mpz_class(1));
+
+    s.addAssignment(TL::Parser::Equation
+    (
+      U"out",
+      Tree::RegionExpr(
+      {
+        Tree::RegionExpr::Entry
+        {
+          mpz_class(0), TL::Region::Containment::IN,
+          TL::Types::Range::create(TL::Range(&zero, &last))
+        },
+        Tree::RegionExpr::Entry
+        {
+          mpz_class(1), TL::Region::Containment::IN,
+          TL::Types::Range::create(TL::Range(&zero, &last))
+        }
+      }),
+      Tree::Expr(),
+      binary(U"minus",
+        binary(U"plus",
+          binary(U"times", i, i),
+          binary(U"times", j, mpz_class(3))),
+        mpz_class(7))
+    ));
+
+    auto start = std::chrono::steady_clock::now();
+    s.go();
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::milli>(end - start).count();
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  size_t n = argc > 1 ? std::atoi(argv[1]) : 256;
+
+  TL::ArrayHD pointwise;
+  TL::ArrayHD bulk;
+
+  double pointwiseTime = run(n, false, pointwise);
+  double bulkTime = run(n, true, bulk);
+
+  //make sure that both of them computed the same thing
+  const TL::Constant* p = pointwise.begin();
+  for (const TL::Constant& c : bulk)
+  {
+    if (!(c == *p))
+    {
+      std::cerr << "bulk kernel and evaluator disagree" << std::endl;
+      return 1;
+    }
+    ++p;
+  }
+
+  std::cout << "cells: " << n * n << std::endl;
+  std::cout << "pointwise: " << pointwiseTime << " ms" << std::endl;
+  std::cout << "bulk: " << bulkTime << " ms" << std::endl;
+  std::cout << "speedup: " << pointwiseTime / bulkTime << std::endl;
+
+  return 0;
+}
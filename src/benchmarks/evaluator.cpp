@@ -0,0 +1,1100 @@
+/* Evaluator benchmarks.
+   Copyright (C) 2013 Jarryd Beck
+
+This file is part of TransLucid.
+
+TransLucid is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+TransLucid is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with TransLucid; see the file COPYING.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+/**
+ * @file benchmarks/evaluator.cpp
+ * Runs a set of representative programs through the System in the same
+ * way as tltext, and reports the latency, throughput and constant pool
+ * blocks of each one. The compile workloads time compiling the
+ * header and the tltext tests instead of evaluating them, and infer_header
+ * times type inference over the type inference header. fork_instant runs
+ * what-if instants on forked copies of a system with the header loaded.
+ * The results can be saved as JSON, and a saved file can be used as a
+ * baseline to check for regressions. Times are compared relative to
+ * compile_header from the same run, so that the baseline doesn't depend
+ * on how fast the machine is, and a baseline from a build with different
+ * optimisation is refused.
+ */
+
+#include <tl/closure_cache.hpp>
+#include <tl/constant_pool.hpp>
+#include <tl/fixed_indexes.hpp>
+#include <tl/hyperdaton.hpp>
+#include <tl/hyperdatons/arrayhd.hpp>
+#include <tl/line_tokenizer.hpp>
+#include <tl/parser_iterator.hpp>
+#include <tl/range.hpp>
+#include <tl/system.hpp>
+#include <tl/system_fork.hpp>
+#include <tl/types/range.hpp>
+#include <tl/types/string.hpp>
+#include <tl/types/uuid.hpp>
+#include <tl/types_util.hpp>
+#include <tl/tyinf/type_inference.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <regex>
+#include <set>
+#include <sstream>
+
+#include <dirent.h>
+#include <sys/utsname.h>
+
+namespace TL = TransLucid;
+
+namespace
+{
+  //where the demands of each instant go, by slot
+  class ResultHD : public TL::OutputHD
+  {
+    public:
+
+    ResultHD(TL::DimensionRegistry& dims)
+    : OutputHD(1)
+    , m_slot(dims.getDimensionIndex(U"slot"))
+    {
+    }
+
+    ~ResultHD() throw() {}
+
+    void
+    put(const TL::Context& k, const TL::Constant& c)
+    {
+      const TL::Constant& v = k.lookup(m_slot);
+
+      if (v.index() == TL::TYPE_INDEX_INTMP)
+      {
+        size_t slot = TL::get_constant_pointer<mpz_class>(v).get_ui();
+
+        if (m_results.size() <= slot)
+        {
+          m_results.resize(slot + 1);
+        }
+
+        m_results.at(slot) = c;
+      }
+    }
+
+    TL::Region
+    variance() const
+    {
+      mpz_class lhs = 0;
+
+      return TL::Region
+      {
+        {
+          {m_slot,
+            {
+              TL::Region::Containment::IN,
+              TL::Types::Range::create(TL::Range(&lhs, nullptr))
+            }
+          }
+        }
+      };
+    }
+
+    void
+    commit()
+    {
+    }
+
+    void
+    addAssignment(const TL::Tuple&)
+    {
+    }
+
+    void
+    clear()
+    {
+      m_results.clear();
+    }
+
+    //the number of demands that printed as a value, the header prints
+    //specials as their name
+    size_t
+    printed(size_t demands) const
+    {
+      static const std::set<TL::u32string> specials
+      {
+        U"sperror", U"spaccess", U"typeerror", U"spdim", U"sparith",
+        U"spundef", U"spconst", U"spmultidef", U"sploop"
+      };
+
+      size_t count = 0;
+      for (size_t i = 0; i != demands && i != m_results.size(); ++i)
+      {
+        if (m_results[i].index() == TL::TYPE_INDEX_USTRING &&
+            specials.count(TL::Types::String::get(m_results[i])) == 0)
+        {
+          ++count;
+        }
+      }
+
+      return count;
+    }
+
+    private:
+
+    std::vector<TL::Constant> m_results;
+    TL::dimension_index m_slot;
+  };
+
+  struct Counts
+  {
+    size_t declarations;
+    size_t demands;
+    size_t failed;
+  };
+
+  //runs programs in the tltext format: definitions, then %%, then
+  //expressions, one instant at a time
+  class Evaluator
+  {
+    public:
+
+    Evaluator(bool cached, bool tyinf = false)
+    : m_cached(cached)
+    , m_system(cached, tyinf)
+    , m_results(m_system)
+    {
+      m_system.addOutputHyperdaton(U"demand", &m_results);
+    }
+
+    TL::System&
+    system()
+    {
+      return m_system;
+    }
+
+    Counts
+    run(std::istream& is, const TL::u32string& name)
+    {
+      Counts counts{0, 0, 0};
+
+      is >> std::noskipws;
+
+      TL::Parser::U32Iterator begin(
+        TL::Parser::makeUTF8Iterator(std::istream_iterator<char>(is)));
+      TL::Parser::U32Iterator end(
+        TL::Parser::makeUTF8Iterator(std::istream_iterator<char>()));
+
+      TL::LineTokenizer tokenizer(begin, end);
+
+      while (true)
+      {
+        m_system.disableCache();
+
+        bool valid = true;
+        bool expressions = true;
+        bool first = true;
+        bool done = false;
+
+        while (!done)
+        {
+          auto line = tokenizer.next();
+          switch (line.type)
+          {
+            case TL::LineType::LINE:
+            declare(line, name);
+            ++counts.declarations;
+            break;
+
+            case TL::LineType::DOUBLE_DOLLAR:
+            expressions = false;
+            done = true;
+            break;
+
+            case TL::LineType::EMPTY:
+            valid = !first;
+            expressions = false;
+            done = true;
+            break;
+
+            case TL::LineType::DOUBLE_PERCENT:
+            done = true;
+            break;
+          }
+          first = false;
+        }
+
+        if (!valid)
+        {
+          break;
+        }
+
+        if (m_cached)
+        {
+          m_system.enableCache();
+        }
+
+        size_t slot = 0;
+        while (expressions)
+        {
+          auto line = tokenizer.next();
+          if (line.type == TL::LineType::LINE)
+          {
+            TL::Tree::Expr e = parse(line, name);
+            demand(e, slot);
+            ++slot;
+          }
+          else if (line.type != TL::LineType::DOUBLE_PERCENT)
+          {
+            expressions = false;
+          }
+        }
+
+        m_results.clear();
+        m_system.go();
+
+        counts.demands += slot;
+        counts.failed += slot - m_results.printed(slot);
+      }
+
+      return counts;
+    }
+
+    //adds the definitions of a program without running any instants
+    size_t
+    load(std::istream& is, const TL::u32string& name)
+    {
+      size_t declarations = 0;
+
+      is >> std::noskipws;
+
+      TL::Parser::U32Iterator begin(
+        TL::Parser::makeUTF8Iterator(std::istream_iterator<char>(is)));
+      TL::Parser::U32Iterator end(
+        TL::Parser::makeUTF8Iterator(std::istream_iterator<char>()));
+
+      TL::LineTokenizer tokenizer(begin, end);
+
+      //the expressions are skipped over, up to the next %% or $$
+      bool expressions = false;
+      while (true)
+      {
+        auto line = tokenizer.next();
+
+        if (line.type == TL::LineType::EMPTY)
+        {
+          break;
+        }
+        else if (line.type == TL::LineType::DOUBLE_PERCENT)
+        {
+          expressions = !expressions;
+        }
+        else if (line.type == TL::LineType::DOUBLE_DOLLAR)
+        {
+          expressions = false;
+        }
+        else if (!expressions)
+        {
+          declare(line, name);
+          ++declarations;
+        }
+      }
+
+      return declarations;
+    }
+
+    //parses an expression by itself
+    TL::Tree::Expr
+    parse(const TL::u32string& text)
+    {
+      return parse(TL::LineTokenizer::Line{0, 0, text, TL::LineType::LINE},
+        U"benchmark");
+    }
+
+    private:
+
+    void
+    declare(const TL::LineTokenizer::Line& line, const TL::u32string& name)
+    {
+      auto result = m_system.addDeclaration(
+        TL::Parser::RawInput{name, line.line, line.character, line.text});
+
+      if (m_cached && result.index() == TL::TYPE_INDEX_UUID)
+      {
+        m_system.cacheObject(TL::Types::UUID::get(result));
+      }
+    }
+
+    TL::Tree::Expr
+    parse(const TL::LineTokenizer::Line& line, const TL::u32string& name)
+    {
+      TL::Parser::U32Iterator lineBegin(
+        TL::Parser::makeUTF32Iterator(line.text.begin()));
+      TL::Parser::U32Iterator lineEnd(
+        TL::Parser::makeUTF32Iterator(line.text.end()));
+
+      TL::Parser::StreamPosIterator posbegin(lineBegin, name,
+        line.line, line.character);
+      TL::Parser::StreamPosIterator posend(lineEnd);
+
+      TL::Tree::Expr expr;
+      m_system.parseExpression(posbegin, posend, expr);
+
+      return expr;
+    }
+
+    void
+    demand(const TL::Tree::Expr& e, size_t slot)
+    {
+      namespace Tree = TL::Tree;
+
+      m_system.addAssignment(TL::Parser::Equation
+      (
+        U"demand",
+        Tree::RegionExpr(
+        {
+          Tree::RegionExpr::Entry
+          {
+            Tree::DimensionExpr(U"time"),
+            TL::Region::Containment::IS,
+            mpz_class(m_system.theTime())
+          },
+          Tree::RegionExpr::Entry
+          {
+            Tree::DimensionExpr(U"slot"),
+            TL::Region::Containment::IS,
+            mpz_class(slot)
+          }
+        }),
+        Tree::Expr(),
+        Tree::LambdaAppExpr(Tree::IdentExpr(U"canonical_print"), e)
+      ));
+    }
+
+    bool m_cached;
+    TL::System m_system;
+    ResultHD m_results;
+  };
+
+  struct Options
+  {
+    std::string header;
+    std::string programs;
+    std::string tests;
+    std::string tyinfHeader;
+    size_t iterations;
+  };
+
+  //one run of a workload, only the time spent in the workload itself
+  //counts, not setting up the header
+  struct Sample
+  {
+    double ms;
+    size_t items;
+    size_t failed;
+  };
+
+  typedef Sample (*Workload)(const Options&);
+
+  //the header has to be there for all of them
+  Counts
+  loadHeader(Evaluator& evaluator, const Options& options)
+  {
+    std::ifstream is(options.header.c_str());
+
+    if (!is)
+    {
+      std::cerr << "could not open header " << options.header << std::endl;
+      std::exit(2);
+    }
+
+    return evaluator.run(is, TL::to_u32string(options.header));
+  }
+
+  double
+  since(std::chrono::steady_clock::time_point start)
+  {
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+  }
+
+  Sample
+  runText(const Options& options, const std::string& text, bool cached)
+  {
+    Evaluator evaluator(cached);
+    loadHeader(evaluator, options);
+
+    std::istringstream is(text);
+
+    auto start = std::chrono::steady_clock::now();
+    Counts counts = evaluator.run(is, U"benchmark");
+
+    return Sample{since(start), counts.demands, counts.failed};
+  }
+
+  Sample
+  runFile(const Options& options, const std::string& file)
+  {
+    std::string path = options.programs + "/" + file;
+    std::ifstream is(path.c_str());
+
+    if (!is)
+    {
+      std::cerr << "could not open " << path << std::endl;
+      std::exit(2);
+    }
+
+    std::string text{std::istreambuf_iterator<char>(is),
+      std::istreambuf_iterator<char>()};
+
+    return runText(options, text, false);
+  }
+
+  Sample
+  headerStartup(const Options& options)
+  {
+    auto start = std::chrono::steady_clock::now();
+
+    Evaluator evaluator(false);
+    Counts counts = loadHeader(evaluator, options);
+
+    return Sample{since(start), counts.declarations, 0};
+  }
+
+  const char* fibDefinitions =
+    "var fib [0 : 0] = 0;;\n"
+    "var fib [0 : 1] = 1;;\n"
+    "var fib = fib @ [0 <- #.0 - 1] + fib @ [0 <- #.0 - 2];;\n"
+    "%%\n";
+
+  Sample
+  fib(const Options& options)
+  {
+    return runText(options, std::string(fibDefinitions) +
+      "fib @ [0 <- 10];;\n"
+      "fib @ [0 <- 15];;\n"
+      "fib @ [0 <- 18];;\n"
+      "$$\n",
+      false);
+  }
+
+  Sample
+  fibCached(const Options& options)
+  {
+    return runText(options, std::string(fibDefinitions) +
+      "fib @ [0 <- 10];;\n"
+      "fib @ [0 <- 100];;\n"
+      "fib @ [0 <- 500];;\n"
+      "$$\n",
+      true);
+  }
+
+  Sample
+  matrix(const Options& options)
+  {
+    return runFile(options, "matrix.tl");
+  }
+
+  //the list and stream functions from the header
+  Sample
+  headerFunctions(const Options& options)
+  {
+    return runText(options,
+      "var numbers = 1::2::3::4::5::6::7::8::Nil;;\n"
+      "var total = runningOp.0.plus (#.0 * 7 % 13);;\n"
+      "%%\n"
+      "length.(numbers <> numbers <> numbers);;\n"
+      "head.(tail.(tail.(numbers <> (9::Nil))));;\n"
+      "isNil.(tail.(1::Nil));;\n"
+      "total @ [0 <- 100];;\n"
+      "asa.0 (#.0) (#.0 * #.0 > 2000) ;;\n"
+      "escape_string!\"a string\\tthat has to be escaped\";;\n"
+      "$$\n",
+      false);
+  }
+
+  //assign out [0 : 0..n-1, 1 : 0..n-1] := #.0 * #.0 + #.1 * 3 - 7
+  Sample
+  rangeAssignment(const Options& options)
+  {
+    const size_t n = 200;
+
+    Evaluator evaluator(false);
+    loadHeader(evaluator, options);
+
+    TL::System& s = evaluator.system();
+
+    TL::dimension_index d0 =
+      s.getDimensionIndex(TL::Types::Intmp::create(0));
+    TL::dimension_index d1 =
+      s.getDimensionIndex(TL::Types::Intmp::create(1));
+
+    TL::ArrayHD out;
+    out.initialise({{d0, n}, {d1, n}});
+    s.addOutputHyperdaton(U"out", &out);
+
+    mpz_class zero = 0, last = n - 1;
+
+    auto start = std::chrono::steady_clock::now();
+
+    s.addAssignment(TL::Parser::Equation
+    (
+      U"out",
+      TL::Tree::RegionExpr(
+      {
+        TL::Tree::RegionExpr::Entry
+        {
+          mpz_class(0), TL::Region::Containment::IN,
+          TL::Types::Range::create(TL::Range(&zero, &last))
+        },
+        TL::Tree::RegionExpr::Entry
+        {
+          mpz_class(1), TL::Region::Containment::IN,
+          TL::Types::Range::create(TL::Range(&zero, &last))
+        }
+      }),
+      TL::Tree::Expr(),
+      evaluator.parse(U"#.0 * #.0 + #.1 * 3 - 7")
+    ));
+
+    s.go();
+
+    double ms = since(start);
+
+    size_t failed = 0;
+    for (const TL::Constant& c : out)
+    {
+      if (c.index() != TL::TYPE_INDEX_INTMP)
+      {
+        ++failed;
+      }
+    }
+
+    return Sample{ms, n * n, failed};
+  }
+
+  //every .in file under dir
+  void
+  findPrograms(const std::string& dir, std::set<std::string>& files)
+  {
+    DIR* d = opendir(dir.c_str());
+    if (d == nullptr)
+    {
+      std::cerr << "could not open " << dir << std::endl;
+      std::exit(2);
+    }
+
+    while (dirent* entry = readdir(d))
+    {
+      std::string name = entry->d_name;
+      std::string path = dir + "/" + name;
+
+      if (name == "." || name == "..")
+      {
+        continue;
+      }
+      else if (entry->d_type == DT_DIR)
+      {
+        findPrograms(path, files);
+      }
+      else if (name.size() > 3 && 
+               name.compare(name.size() - 3, 3, ".in") == 0)
+      {
+        files.insert(path);
+      }
+    }
+
+    closedir(d);
+  }
+
+  //compiling what the header didn't need for its first instant
+  Sample
+  compileHeader(const Options& options)
+  {
+    Evaluator evaluator(false);
+    loadHeader(evaluator, options);
+
+    auto start = std::chrono::steady_clock::now();
+    size_t compiled = evaluator.system().compileAll();
+
+    return Sample{since(start), compiled, 0};
+  }
+
+  //compiling the definitions of every tltext test on top of the header
+  Sample
+  compileTests(const Options& options)
+  {
+    Evaluator evaluator(false);
+    loadHeader(evaluator, options);
+
+    //read them in order so that every run compiles the same thing
+    std::set<std::string> files;
+    findPrograms(options.tests, files);
+
+    for (const auto& path : files)
+    {
+      std::ifstream is(path.c_str());
+      evaluator.load(is, TL::to_u32string(path));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    size_t compiled = evaluator.system().compileAll();
+
+    return Sample{since(start), compiled, 0};
+  }
+
+  //inferring the type of every definition in the type inference header
+  Sample
+  inferHeader(const Options& options)
+  {
+    std::ifstream is(options.tyinfHeader.c_str());
+
+    if (!is)
+    {
+      std::cerr << "could not open header " << options.tyinfHeader 
+        << std::endl;
+      std::exit(2);
+    }
+
+    std::string text{std::istreambuf_iterator<char>(is),
+      std::istreambuf_iterator<char>()};
+
+    Evaluator evaluator(false, true);
+    std::istringstream header(text);
+    evaluator.run(header, TL::to_u32string(options.tyinfHeader));
+
+    std::set<TL::u32string> ids;
+    std::regex definition("(^|\\n)(var|fun) ([^ .!\\[=(;]+)");
+
+    for (std::sregex_iterator d(text.begin(), text.end(), definition), end;
+      d != end; ++d)
+    {
+      ids.insert(TL::utf8_to_utf32((*d)[3]));
+    }
+
+    //this one uses a dimension d that doesn't exist
+    ids.erase(U"tournamentOp₂");
+
+    TL::TypeInference::FreshTypeVars fresh;
+    TL::TypeInference::TypeInferrer infer(evaluator.system(), fresh);
+
+    auto start = std::chrono::steady_clock::now();
+    infer.infer_system(ids);
+
+    return Sample{since(start), ids.size(), 0};
+  }
+
+  //instants that are thrown away, each on its own copy of the system
+  Sample
+  forkInstant(const Options& options)
+  {
+    const size_t n = 20;
+
+    Evaluator evaluator(false);
+    loadHeader(evaluator, options);
+
+    size_t failed = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i != n; ++i)
+    {
+      auto result = TL::forkEvaluate(evaluator.system(),
+        [&evaluator, i] (TL::System&) -> TL::u32string
+        {
+          std::istringstream is(std::string(fibDefinitions) +
+            "fib @ [0 <- " + std::to_string(i % 10 + 5) + "];;\n"
+            "$$\n");
+
+          Counts counts = evaluator.run(is, U"what-if");
+
+          return counts.failed == 0 && counts.demands == 1 ? U"ok" : U"";
+        }
+      );
+
+      if (result != U"ok")
+      {
+        ++failed;
+      }
+    }
+
+    return Sample{since(start), n, failed};
+  }
+
+  struct Result
+  {
+    size_t iterations;
+    double latency;
+    double best;
+    double throughput;
+    //blocks that the constant pool handed out, other heap allocations
+    //aren't counted
+    double poolBlocks;
+    double closures;
+    double reused;
+    //best divided by the best of the reference workload
+    double relative;
+  };
+
+  //the workload that the others are timed against
+  const char* const REFERENCE_WORKLOAD = "compile_header";
+
+  //whether the build is optimised, times from an optimised build can't be
+  //compared with an unoptimised one even as ratios
+  std::string
+  buildType()
+  {
+#ifdef __OPTIMIZE__
+    std::string type = "optimised";
+#else
+    std::string type = "unoptimised";
+#endif
+#ifndef NDEBUG
+    type += " asserts";
+#endif
+    return type;
+  }
+
+  std::string
+  hostName()
+  {
+    utsname name;
+    if (uname(&name) != 0)
+    {
+      return "unknown";
+    }
+
+    return std::string(name.nodename) + " " + name.machine;
+  }
+
+  const std::vector<std::pair<std::string, Workload>> workloads
+  {
+    {"header_startup", &headerStartup},
+    {"fib", &fib},
+    {"fib_cached", &fibCached},
+    {"matrix", &matrix},
+    {"header_functions", &headerFunctions},
+    {"range_assignment", &rangeAssignment},
+    {"compile_header", &compileHeader},
+    {"compile_tests", &compileTests},
+    {"infer_header", &inferHeader},
+    {"fork_instant", &forkInstant},
+  };
+
+  bool
+  measure(const std::string& name, Workload w, const Options& options,
+    Result& result)
+  {
+    std::vector<double> times;
+    size_t items = 0;
+    size_t poolBlocks = 0;
+    size_t closures = 0;
+    size_t reused = 0;
+
+    //one run to warm up first
+    w(options);
+
+    for (size_t i = 0; i != options.iterations; ++i)
+    {
+      size_t before = TL::ConstantPool::statistics().allocations;
+      auto closuresBefore = TL::ClosureCache::statistics();
+      Sample sample = w(options);
+      poolBlocks += TL::ConstantPool::statistics().allocations - before;
+      closures += TL::ClosureCache::statistics().created - 
+        closuresBefore.created;
+      reused += TL::ClosureCache::statistics().reused - closuresBefore.reused;
+
+      if (sample.failed != 0)
+      {
+        std::cerr << name << ": " << sample.failed << " of " << sample.items
+          << " results were wrong" << std::endl;
+        return false;
+      }
+
+      times.push_back(sample.ms);
+      items = sample.items;
+    }
+
+    std::sort(times.begin(), times.end());
+
+    result.iterations = options.iterations;
+    result.latency = times[times.size() / 2];
+    result.best = times.front();
+    result.throughput = items / (result.latency / 1000);
+    result.poolBlocks = double(poolBlocks) / options.iterations;
+    result.relative = 1;
+    result.closures = double(closures) / options.iterations;
+    result.reused = double(reused) / options.iterations;
+
+    return true;
+  }
+
+  void
+  save(const std::string& file, const std::map<std::string, Result>& results)
+  {
+    std::ofstream os(file.c_str());
+
+    os << "{" << std::endl;
+    os << "  \"build\": \"" << buildType() << "\"," << std::endl;
+    os << "  \"host\": \"" << hostName() << "\"," << std::endl;
+
+    size_t i = 0;
+    for (const auto& r : results)
+    {
+      os << "  \"" << r.first << "\": {"
+         << "\"iterations\": " << r.second.iterations << ", "
+         << "\"latency_ms\": " << r.second.latency << ", "
+         << "\"best_ms\": " << r.second.best << ", "
+         << "\"throughput\": " << r.second.throughput << ", "
+         << "\"relative\": " << r.second.relative << ", "
+         << "\"pool_blocks\": " << r.second.poolBlocks << ", "
+         << "\"closures\": " << r.second.closures << ", "
+         << "\"closures_reused\": " << r.second.reused << "}";
+
+      ++i;
+      os << (i == results.size() ? "" : ",") << std::endl;
+    }
+
+    os << "}" << std::endl;
+  }
+
+  struct Baseline
+  {
+    std::string build;
+    std::string host;
+    //workload -> field -> value
+    std::map<std::string, std::map<std::string, double>> workloads;
+  };
+
+  //reads back what save wrote
+  Baseline
+  load(const std::string& file)
+  {
+    std::ifstream is(file.c_str());
+
+    if (!is)
+    {
+      std::cerr << "could not open baseline " << file << std::endl;
+      std::exit(2);
+    }
+
+    std::string text{std::istreambuf_iterator<char>(is),
+      std::istreambuf_iterator<char>()};
+
+    Baseline baseline;
+
+    std::regex entry("\"(\\w+)\"\\s*:\\s*\\{([^}]*)\\}");
+    std::regex field("\"(\\w+)\"\\s*:\\s*([-+.eE0-9]+)");
+    std::regex textField("\"(\\w+)\"\\s*:\\s*\"([^\"]*)\"");
+
+    for (std::sregex_iterator e(text.begin(), text.end(), entry), end;
+      e != end; ++e)
+    {
+      std::string fields = (*e)[2];
+      auto& values = baseline.workloads[(*e)[1]];
+
+      for (std::sregex_iterator f(fields.begin(), fields.end(), field);
+        f != end; ++f)
+      {
+        values[(*f)[1]] = std::atof((*f)[2].str().c_str());
+      }
+    }
+
+    for (std::sregex_iterator f(text.begin(), text.end(), textField), end;
+      f != end; ++f)
+    {
+      if ((*f)[1] == "build")
+      {
+        baseline.build = (*f)[2];
+      }
+      else if ((*f)[1] == "host")
+      {
+        baseline.host = (*f)[2];
+      }
+    }
+
+    return baseline;
+  }
+
+  //the best time relative to the reference workload is compared, the
+  //best time is the least noisy and the ratio doesn't depend on the
+  //machine. The pool blocks shouldn't change at all for the same program
+  bool
+  compare(const std::map<std::string, Result>& results,
+    const Baseline& baseline, double tolerance)
+  {
+    if (baseline.build != buildType())
+    {
+      std::cout << "the baseline is from a build that is "
+        << (baseline.build.empty() ? "unknown" : baseline.build)
+        << ", this build is " << buildType() << ", not comparing"
+        << std::endl;
+      return false;
+    }
+
+    if (baseline.host != hostName())
+    {
+      std::cout << "the baseline is from " << baseline.host
+        << ", times are only compared relative to " << REFERENCE_WORKLOAD
+        << std::endl;
+    }
+
+    bool ok = true;
+
+    for (const auto& r : results)
+    {
+      auto iter = baseline.workloads.find(r.first);
+      if (iter == baseline.workloads.end())
+      {
+        std::cout << r.first << ": not in the baseline" << std::endl;
+        continue;
+      }
+
+      auto value = [&] (const char* f) -> double
+      {
+        auto v = iter->second.find(f);
+        return v == iter->second.end() ? 0 : v->second;
+      };
+
+      double relative = value("relative");
+      double poolBlocks = value("pool_blocks");
+
+      bool slow = relative > 0 && 
+        r.second.relative > relative * (1 + tolerance);
+      bool allocates = r.second.poolBlocks > poolBlocks * (1 + tolerance);
+
+      std::cout << r.first << ": relative time " 
+        << (relative > 0 ? r.second.relative / relative : 0)
+        << "x, pool blocks " << r.second.poolBlocks << " vs "
+        << poolBlocks;
+
+      if (slow || allocates)
+      {
+        std::cout << " REGRESSION";
+        ok = false;
+      }
+      std::cout << std::endl;
+    }
+
+    return ok;
+  }
+
+  void
+  usage(const char* name)
+  {
+    std::cerr << "usage: " << name << " [--header file] [--programs dir]"
+      " [--tests dir] [--tyinf-header file] [--iterations n]"
+      " [--save file] [--baseline file] [--tolerance x]" << std::endl;
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  Options options{"src/tltext/header.tl", "src/tl-programs",
+    "src/tltext/tests", "src/tltext/header-tyinf.tl", 5};
+  std::string saveFile;
+  std::string baselineFile;
+  double tolerance = 0.25;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+
+    if (i + 1 == argc)
+    {
+      usage(argv[0]);
+      return 2;
+    }
+
+    std::string value = argv[++i];
+
+    if (arg == "--header")
+    {
+      options.header = value;
+    }
+    else if (arg == "--programs")
+    {
+      options.programs = value;
+    }
+    else if (arg == "--tests")
+    {
+      options.tests = value;
+    }
+    else if (arg == "--tyinf-header")
+    {
+      options.tyinfHeader = value;
+    }
+    else if (arg == "--iterations")
+    {
+      options.iterations = std::max(1, std::atoi(value.c_str()));
+    }
+    else if (arg == "--save")
+    {
+      saveFile = value;
+    }
+    else if (arg == "--baseline")
+    {
+      baselineFile = value;
+    }
+    else if (arg == "--tolerance")
+    {
+      tolerance = std::atof(value.c_str());
+    }
+    else
+    {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  std::map<std::string, Result> results;
+
+  for (const auto& w : workloads)
+  {
+    Result r;
+    if (!measure(w.first, w.second, options, r))
+    {
+      return 1;
+    }
+
+    std::cout << w.first << ": " << r.latency << " ms (best " << r.best
+      << " ms), " << r.throughput << " /s, " << r.poolBlocks
+      << " pool blocks, " << r.closures << " closures made, " << r.reused
+      << " reused" << std::endl;
+
+    results[w.first] = r;
+  }
+
+  double reference = results.at(REFERENCE_WORKLOAD).best;
+  for (auto& r : results)
+  {
+    r.second.relative = reference > 0 ? r.second.best / reference : 0;
+  }
+
+  if (!saveFile.empty())
+  {
+    save(saveFile, results);
+  }
+
+  if (!baselineFile.empty() &&
+      !compare(results, load(baselineFile), tolerance))
+  {
+    return 1;
+  }
+
+  return 0;
+}
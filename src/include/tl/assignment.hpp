@@ -26,9 +26,11 @@ along with TransLucid; see the file COPYING.  If not see
 #define TL_ASSIGNMENT_HPP_INCLUDED
 
 #include <tl/ast.hpp>
+#include <tl/bulk_kernel.hpp>
 #include <tl/workshop.hpp>
 
 #include <memory>
+#include <set>
 
 namespace TransLucid
 {
@@ -38,12 +40,15 @@ namespace TransLucid
 
     struct Definition
     {
-      Tree::Expr booleanExpr;
       Tree::Expr guardExpr;
+      Tree::Expr booleanExpr;
       Tree::Expr bodyExpr;
       std::shared_ptr<WS> guardWS;
       std::shared_ptr<WS> booleanWS;
       std::shared_ptr<WS> bodyWS;
+
+      //the body as a bulk kernel when it is pointwise arithmetic
+      std::shared_ptr<BulkKernel> bodyKernel;
     };
 
     Assignment(u32string name)
@@ -54,8 +59,16 @@ namespace TransLucid
     addDefinition(Definition d)
     {
       m_definitions.push_back(d);
+      m_state.push_back(State());
     }
 
+    /**
+     * Compute the definitions that could have changed since the last
+     * instant. A definition is computed again if it is new, if anything
+     * that it depends on has been changed in the system, or if it depends
+     * on the time, or if an earlier definition that is computed again can
+     * overlap it. Otherwise its previous output is left in the hyperdaton.
+     */
     void
     evaluate
     (
@@ -63,6 +76,29 @@ namespace TransLucid
       Context& k
     );
 
+    /**
+     * Cut the ranges of @a region down to the constant bounds that
+     * @a boolean puts on them. The bounds come from comparisons of #.d
+     * with an integer, such as #.x == 5 or #.y < 10, and from && of those,
+     * when the operators are the integer ones from the header. Anything
+     * else in the boolean is left to be evaluated at each point.
+     * @param s The system that the boolean was fixed up in.
+     * @param boolean The fixed up boolean.
+     * @param region The region to cut down.
+     * @return false if the boolean is false everywhere in the region.
+     */
+    static bool
+    pruneRegion(System& s, const Tree::Expr& boolean, Region& region);
+
+    /**
+     * The number of definitions computed by the last evaluate.
+     */
+    size_t
+    evaluated() const
+    {
+      return m_evaluated;
+    }
+
     const std::vector<Definition>&
     definitions() const
     {
@@ -71,8 +107,36 @@ namespace TransLucid
 
     private:
 
+    //what we know about a definition from the last time it was computed
+    struct State
+    {
+      State()
+      : computed(false), time(false)
+      {}
+
+      bool computed;
+
+      //the definition depends on the time in a way that its guard doesn't fix
+      bool time;
+
+      //every identifier that the definition can reach
+      std::set<u32string> dependencies;
+
+      //the region that the guard gave the last time
+      Constant region;
+    };
+
+    bool
+    needsEvaluating(System& s, const State& state) const;
+
+    void
+    findDependencies(System& s, const Definition& d, State& state,
+      const Constant& region);
+
     u32string m_name;
     std::vector<Definition> m_definitions;
+    std::vector<State> m_state;
+    size_t m_evaluated = 0;
   };
 }
 
@@ -303,11 +303,11 @@ namespace TransLucid
       (
         const u32string& type, 
         const u32string& text, 
-        const Tree::Expr& e
+        Tree::Expr e
       ) 
       : type(type)
       , text(text)
-      , rewritten(e)
+      , rewritten(std::move(e))
       {
       }
 
@@ -328,8 +328,8 @@ namespace TransLucid
        * Construct a parenthesised expression.
        * @param e The inside expression.
        */
-      explicit ParenExpr(const Expr& e)
-      : e(e)
+      explicit ParenExpr(Expr e)
+      : e(std::move(e))
       {
       }
 
@@ -349,8 +349,8 @@ namespace TransLucid
        * @param o The type of unary operation.
        * @param e The expression to operate on.
        */
-      UnaryOpExpr(const UnaryOperator& o, const Expr& e)
-      : op(o), e(e)
+      UnaryOpExpr(const UnaryOperator& o, Expr e)
+      : op(o), e(std::move(e))
       {}
 
       UnaryOperator op; /**< The type of unary operation.*/
@@ -374,10 +374,10 @@ namespace TransLucid
       BinaryOpExpr
       (
         BinaryOperator o,
-        const Expr& l,
-        const Expr& r
+        Expr l,
+        Expr r
       )
-      : op(o), lhs(l), rhs(r)
+      : op(o), lhs(std::move(l)), rhs(std::move(r))
       {}
 
       BinaryOperator op; /**< The binary operation.*/
@@ -423,11 +423,11 @@ namespace TransLucid
       MakeIntenExpr() = default;
 
       MakeIntenExpr(Expr e)
-      : expr(e)
+      : expr(std::move(e))
       {}
 
       MakeIntenExpr(Expr e, std::vector<Expr> binds)
-      : expr(e), binds(binds)
+      : expr(std::move(e)), binds(std::move(binds))
       {}
 
       MakeIntenExpr
@@ -436,7 +436,7 @@ namespace TransLucid
         std::vector<Expr> binds,
         std::vector<dimension_index> scope
       )
-      : expr(e), binds(binds), scope(scope)
+      : expr(std::move(e)), binds(std::move(binds)), scope(std::move(scope))
       {}
 
       Expr expr;
@@ -449,8 +449,8 @@ namespace TransLucid
     {
       EvalIntenExpr() = default;
 
-      EvalIntenExpr(const Tree::Expr& rhs)
-      : expr(rhs)
+      EvalIntenExpr(Tree::Expr rhs)
+      : expr(std::move(rhs))
       {
       }
 
@@ -471,13 +471,13 @@ namespace TransLucid
        * @param name The expression that will return the name.
        * @param args A vector of the arguments.
        */
-      BangAppExpr(const Expr& name, const std::vector<Expr>& args)
-      : name(name), args(args)
+      BangAppExpr(Expr name, std::vector<Expr> args)
+      : name(std::move(name)), args(std::move(args))
       {
       }
 
-      BangAppExpr(const Expr& lhs, const Expr& rhs)
-      : name(lhs)
+      BangAppExpr(Expr lhs, const Expr& rhs)
+      : name(std::move(lhs))
       , args({rhs})
       {
       }
@@ -494,23 +494,23 @@ namespace TransLucid
       BaseAbstractionExpr
       (
         const u32string& param,
-        const Expr& body
+        Expr body
       )
       : params{param}
-      , body(body)
+      , body(std::move(body))
       {
       }
 
       //multiple parameters with binds
       BaseAbstractionExpr
       (
-        const std::vector<Expr>& binds,
+        std::vector<Expr> binds,
         const std::vector<u32string>& params,
-        const Expr& body
+        Expr body
       )
-      : binds(binds),
+      : binds(std::move(binds)),
         params(params),
-        body(body)
+        body(std::move(body))
       {}
 
       std::vector<Expr> binds;
@@ -529,15 +529,15 @@ namespace TransLucid
 
       IfExpr
       (
-        const Expr& c,
-        const Expr& t,
-        const std::vector<std::pair<Expr, Expr>>& eif,
-        const Expr& e
+        Expr c,
+        Expr t,
+        std::vector<std::pair<Expr, Expr>> eif,
+        Expr e
       )
-      : condition(c)
-      , then(t)
-      , else_ifs(eif)
-      , else_(e)
+      : condition(std::move(c))
+      , then(std::move(t))
+      , else_ifs(std::move(eif))
+      , else_(std::move(e))
       {
       }
 
@@ -562,8 +562,8 @@ namespace TransLucid
        * Construct a hash expression.
        * @param e The sub expression.
        */
-      explicit HashExpr(const Expr& e, bool cached = true)
-      : e(e), cached(cached)
+      explicit HashExpr(Expr e, bool cached = true)
+      : e(std::move(e)), cached(cached)
       {}
 
       /**
@@ -602,8 +602,8 @@ namespace TransLucid
        * Construct a TupleExpr.
        * @param p The pairs of expressions.
        */
-      TupleExpr(const TuplePairs& p)
-      : pairs(p)
+      TupleExpr(TuplePairs p)
+      : pairs(std::move(p))
       {}
     };
 
@@ -646,8 +646,8 @@ namespace TransLucid
        * @param lhs The left hand side expression.
        * @param rhs The right hand side expression.
        */
-      AtExpr(const Expr& lhs, const Expr& rhs)
-      : lhs(lhs), rhs(rhs)
+      AtExpr(Expr lhs, Expr rhs)
+      : lhs(std::move(lhs)), rhs(std::move(rhs))
       {}
 
       /**
@@ -699,7 +699,8 @@ namespace TransLucid
         std::vector<Expr> bind,
         RExpr&& rhs
       )
-      : name(name), binds(bind), rhs(std::forward<RExpr>(rhs)), argDim(0)
+      : name(name), binds(std::move(bind)), rhs(std::forward<RExpr>(rhs))
+      , argDim(0)
       {
       }
 
@@ -718,13 +719,13 @@ namespace TransLucid
       : argDim(0)
       {}
 
-      PhiExpr(const u32string& name, const Expr& rhs)
-      : name(name), rhs(rhs), argDim(0)
+      PhiExpr(const u32string& name, Expr rhs)
+      : name(name), rhs(std::move(rhs)), argDim(0)
       {
       }
 
-      PhiExpr(const u32string& name, std::vector<Expr> bind, const Expr& rhs)
-      : name(name), binds(bind), rhs(rhs), argDim(0)
+      PhiExpr(const u32string& name, std::vector<Expr> bind, Expr rhs)
+      : name(name), binds(std::move(bind)), rhs(std::move(rhs)), argDim(0)
       {
       }
 
@@ -749,8 +750,8 @@ namespace TransLucid
        * @param lhs The left-hand-side expression.
        * @param rhs The right-hand-side expression.
        */
-      LambdaAppExpr(const Expr& lhs, const Expr& rhs)
-      : lhs(lhs), rhs(rhs)
+      LambdaAppExpr(Expr lhs, Expr rhs)
+      : lhs(std::move(lhs)), rhs(std::move(rhs))
       {
       }
 
@@ -771,14 +772,14 @@ namespace TransLucid
        * @param lhs The left-hand-side expression.
        * @param rhs The right-hand-side expression.
        */
-      PhiAppExpr(const Expr& lhs, const Expr& rhs)
-      : lhs(lhs), rhs(rhs)
+      PhiAppExpr(Expr lhs, Expr rhs)
+      : lhs(std::move(lhs)), rhs(std::move(rhs))
       {
       }
 
-      PhiAppExpr(const Expr& lhs, const Expr& rhs, 
+      PhiAppExpr(Expr lhs, Expr rhs, 
         const std::vector<dimension_index>& lall)
-      : lhs(lhs), rhs(rhs), Lall(lall)
+      : lhs(std::move(lhs)), rhs(std::move(rhs)), Lall(lall)
       {
       }
 
@@ -29,6 +29,8 @@ along with TransLucid; see the file COPYING.  If not see
 #include <tl/workshop.hpp>
 
 #include <list>
+#include <map>
+#include <set>
 #include <unordered_map>
 
 /**
@@ -217,6 +219,7 @@ namespace TransLucid
     BestfitGroup(DefinitionGrouper* grouper, System& system)
     : m_grouper(grouper)
     , m_system(system)
+    , m_discarded(0)
     , m_parsed(0)
     , m_compiling(false)
     , m_cached(false)
@@ -235,6 +238,7 @@ namespace TransLucid
       m_definitions.push_back(EquationDefinition{id, time, -1});
       m_definitions.back().setRaw(input);
       m_definitions.back().setScope(scope);
+      m_live.insert(m_definitions.size() - 1);
       change(time);
       addUUID(id);
     }
@@ -251,6 +255,7 @@ namespace TransLucid
       m_definitions.push_back(EquationDefinition{id, time, -1});
       m_definitions.back().setParsed(definition);
       m_definitions.back().setScope(scope);
+      m_live.insert(m_definitions.size() - 1);
       change(time);
       addUUID(id);
     }
@@ -274,7 +279,7 @@ namespace TransLucid
       }
       else
       {
-        m_definitions[last].setEnd(time);
+        end(last, time);
       }
 
       change(time);
@@ -302,10 +307,11 @@ namespace TransLucid
         return false;
       }
 
-      m_definitions[last].setEnd(time);
+      end(last, time);
 
       m_definitions.push_back(EquationDefinition{id, time, -1});
       m_definitions.back().setRaw(line);
+      m_live.insert(m_definitions.size() - 1);
 
       change(time);
 
@@ -331,12 +337,44 @@ namespace TransLucid
     Tree::Expr
     getEquation(Context& k);
 
+    /**
+     * Compile the definitions that haven't been compiled yet, so that the
+     * first demand doesn't have to. If something goes wrong, it is left
+     * for the first demand to report.
+     * @return Whether anything was compiled.
+     */
+    bool
+    precompile(Context& k);
+
+    /**
+     * The parsed definitions that haven't been deleted or replaced, in the
+     * order that they were added.
+     */
+    std::vector<Parser::Line>
+    liveDefinitions(Context& k);
+
+    /**
+     * Forget everything that is only valid before @a time, the compiled
+     * definitions and the definitions that ended by then. Nothing before
+     * @a time can be demanded after this, those demands are undefined.
+     */
+    void
+    discardBefore(int time);
+
     void
     setName(const u32string& name)
     {
       m_name = name;
     }
 
+    //the identifier that this group defines, the cache uses it to find
+    //out what it looks at
+    void
+    setIdentifier(const u32string& identifier)
+    {
+      m_identifier = identifier;
+    }
+
     void
     cache()
     {
@@ -384,6 +422,28 @@ namespace TransLucid
       {
         m_changes.push_back(time);
       }
+      else if (!needsCompiling() && !m_evaluators.empty() &&
+        m_evaluators.back().start == time)
+      {
+        //the instant was evaluated before all of its definitions were
+        //added, so compile it again
+        m_evaluators.pop_back();
+      }
+    }
+
+    //definition i is no longer valid from time
+    void
+    end(size_t i, int time)
+    {
+      m_definitions[i].setEnd(time);
+      m_live.erase(i);
+      m_ended.insert({time, i});
+    }
+
+    bool
+    needsCompiling() const
+    {
+      return m_changes.size() > m_discarded + m_evaluators.size();
     }
 
     void
@@ -411,13 +471,25 @@ namespace TransLucid
       Tree::Expr expr;
     };
 
+    //the compiled definition valid at time, or nullptr if there isn't one
+    const CompiledDefinition*
+    findCompiled(int time) const;
+
     DefinitionGrouper* m_grouper;
 
     System& m_system;
 
     std::map<uuid, std::list<size_t>> m_uuids;
+
+    //definitions are only ever added at the current time, so this is
+    //ordered by start time
     std::vector<EquationDefinition> m_definitions;
 
+    //an index of the definitions' lifetimes, the definitions which haven't
+    //ended, and the ones that have ordered by when they end
+    std::set<size_t> m_live;
+    std::multimap<int, size_t> m_ended;
+
     //record when things change, and recompile the whole lot
     //every time a change occurs
     std::vector<int> m_changes;
@@ -425,6 +497,10 @@ namespace TransLucid
     //a list of compiled definitions in order of valid times
     std::vector<CompiledDefinition> m_evaluators;
 
+    //the number of compiled definitions that have been discarded from the
+    //front of m_evaluators
+    size_t m_discarded;
+
     size_t m_parsed;
 
     bool m_compiling;
@@ -432,6 +508,7 @@ namespace TransLucid
     bool m_cached;
 
     u32string m_name;
+    u32string m_identifier;
   };
 
   /**
@@ -456,12 +533,7 @@ namespace TransLucid
      * There are no user dimensions in the guard. System imposed
      * dimensions can still be added.
      **/
-    EquationGuard()
-    : m_guard(nullptr), m_boolean(nullptr), m_compiled(true), 
-      m_system(nullptr)
-    , m_priority(0)
-    {
-    }
+    EquationGuard();
 
     /*
     EquationGuard(const Tuple& t)
@@ -501,14 +573,43 @@ namespace TransLucid
     /**
      * @brief Evaluate the guard.
      *
-     * Returns a tuple of the dimensions and the evaluated AST.
+     * Returns the region that the guard evaluates to, and false if it
+     * can't be used. Demands for dimensions are added to @a demands. When
+     * the whole guard is constant nothing is evaluated and the region is
+     * shared with the guard.
      **/
     template <typename... Delta>
     std::pair<bool, std::shared_ptr<Region>>
-    evaluate(Context& k, Delta&&... delta) const;
+    evaluate(std::vector<dimension_index>& demands, Context& k, 
+      Delta&&... delta) const;
 
     std::pair<bool, std::pair<size_t, std::shared_ptr<Region>>>
-    evaluateCached(Context& k, Delta&, const Thread& w, size_t t) const;
+    evaluateCached(std::vector<dimension_index>& demands, Context& k, 
+      Delta&, const Thread& w, size_t t) const;
+
+    /**
+     * @brief Determines if the guard is applicable in a context.
+     *
+     * The constant part of the guard is checked against @a k directly.
+     * If the guard is applicable its region is put in @a region, which
+     * is only made when some of the guard isn't constant.
+     **/
+    bool
+    applicable(Context& k, std::shared_ptr<Region>& region) const;
+
+    /**
+     * @brief Compiles the guard if it hasn't been compiled yet.
+     *
+     * A guard can be evaluated by several threads at once after this.
+     **/
+    void
+    prepare() const
+    {
+      if (!m_compiled)
+      {
+        compile();
+      }
+    }
 
     /**
      * @brief Adds a system imposed dimension.
@@ -534,14 +635,6 @@ namespace TransLucid
       return m_priority;
     }
 
-    //after a call to evaluate, these are reset to whatever demands evaluate
-    //produced
-    const std::vector<dimension_index>&
-    demands() const
-    {
-      return m_demands;
-    }
-
     private:
 
     void
@@ -575,7 +668,8 @@ namespace TransLucid
 
     mutable int m_priority;
 
-    mutable std::vector<dimension_index> m_demands;
+    //m_dimConstConst as a region, for when the whole guard is constant
+    mutable std::shared_ptr<Region> m_constRegion;
   };
 
 
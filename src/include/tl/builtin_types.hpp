@@ -31,6 +31,17 @@ namespace TransLucid
 {
   void
   init_builtin_types(System& system);
+
+  /**
+   * Append the canonical print of a value of a built in type to @a out,
+   * the same text as the canonical_print definitions in the header.
+   * Only intmp, ustring, uchar, bool and range are printed, tuples and
+   * specials aren't.
+   * @return false if @a c isn't one of those types, and nothing was
+   * appended.
+   */
+  bool
+  canonical_print_to(u32string& out, const Constant& c);
 }
 
 #endif // BUILTIN_TYPES_HPP_INCLUDED
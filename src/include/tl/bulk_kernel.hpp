@@ -0,0 +1,143 @@
+/* Bulk evaluation of pointwise arithmetic over arrays.
+   Copyright (C) 2013 Jarryd Beck
+
+This file is part of TransLucid.
+
+TransLucid is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+TransLucid is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with TransLucid; see the file COPYING.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+/**
+ * @file bulk_kernel.hpp
+ * Bulk kernels. An assignment whose body is pointwise integer arithmetic
+ * over the context can be computed a row at a time straight into the
+ * buffer of an ArrayHD, instead of perturbing the context and running the
+ * evaluator for every cell.
+ */
+
+#ifndef TL_BULK_KERNEL_HPP_INCLUDED
+#define TL_BULK_KERNEL_HPP_INCLUDED
+
+#include <tl/ast_fwd.hpp>
+#include <tl/region.hpp>
+#include <tl/types.hpp>
+
+#include <gmpxx.h>
+
+#include <memory>
+#include <vector>
+
+namespace TransLucid
+{
+  class ArrayHD;
+  class Context;
+  class System;
+
+  class BulkKernel
+  {
+    public:
+
+    BulkKernel(System& system)
+    : m_system(system)
+    {
+    }
+
+    enum class Op
+    {
+      CONSTANT,
+      COORDINATE,
+      PLUS,
+      MINUS,
+      TIMES,
+      NEGATE
+    };
+
+    /**
+     * One step of the kernel. The kernel is a postfix program, CONSTANT
+     * uses @a value, COORDINATE uses @a dim.
+     */
+    struct Instruction
+    {
+      Op op;
+      mpz_class value;
+      dimension_index dim;
+    };
+
+    /**
+     * Recognise a kernel in an expression. The supported shapes are integer
+     * literals, #.d for a constant dimension d, and plus, minus, times and
+     * uminus applied to supported shapes.
+     * @param system The system that the expression was fixed up in.
+     * @param e The fixed up expression.
+     * @return The kernel, or nullptr if the expression isn't pointwise
+     * arithmetic.
+     */
+    static std::shared_ptr<BulkKernel>
+    recognise(System& system, const Tree::Expr& e);
+
+    /**
+     * Compute every cell of @a region into @a out.
+     * The region must enumerate a box of @a out, and every intermediate
+     * value must fit in a machine integer, otherwise nothing is written.
+     * Nothing is written either if a definition of one of the operators,
+     * or of the host function that it calls, could apply to integers and
+     * isn't the integer definition that the header gives.
+     * @return true if the region was computed.
+     */
+    bool
+    evaluate(const Region& region, Context& k, ArrayHD& out) const;
+
+    const std::vector<Instruction>&
+    program() const
+    {
+      return m_program;
+    }
+
+    /**
+     * The number of cells that have been computed in bulk.
+     */
+    size_t
+    cells() const
+    {
+      return m_cells;
+    }
+
+    private:
+
+    System& m_system;
+    std::vector<Instruction> m_program;
+    size_t m_depth;
+    mutable size_t m_cells = 0;
+  };
+
+  /**
+   * Does @a name only mean the host function @a host when it is applied
+   * to integers. That is the case when exactly one definition of @a name
+   * can be chosen for integers, and it does nothing but call @a host with
+   * its arguments, as the header defines the integer operators.
+   * @param system The system that the operator is defined in.
+   * @param name The operator, such as plus or lt.
+   * @param host The host function, such as intmp_plus or intmp_lt.
+   * @param arity The number of arguments of the operator.
+   */
+  bool
+  isIntegerOperator
+  (
+    System& system,
+    const u32string& name,
+    const u32string& host,
+    size_t arity
+  );
+}
+
+#endif
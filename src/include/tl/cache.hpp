@@ -22,8 +22,11 @@ along with TransLucid; see the file COPYING.  If not see
 
 #include <map>
 #include <set>
+#include <unordered_map>
+#include <vector>
 
 #include <tl/context.hpp>
+#include <tl/demand_trace.hpp>
 #include <tl/types.hpp>
 #include <tl/variant.hpp>
 #include <tl/workshop.hpp>
@@ -96,6 +99,8 @@ namespace TransLucid
     CacheLevelNode entry;
   };
   
+  class HDBlock;
+
   class Cache
   {
     public:
@@ -110,6 +115,23 @@ namespace TransLucid
     void
     set(const Context& k, const Delta& delta, const Constant& value);
 
+    /**
+     * Get the value of every point of @a block in @a k, each level of the
+     * cache is walked once for the whole block. A point that isn't there
+     * is a calc, but no calc is left for it.
+     */
+    void
+    getBlock(const Context& k, const Delta& delta, const HDBlock& block,
+      Constant* values);
+
+    /**
+     * Set every point of @a block in @a k, making the entries that aren't
+     * there yet. Each level of the cache is walked once for the block.
+     */
+    void
+    setBlock(const Context& k, const Delta& delta, const HDBlock& block,
+      const Constant* values);
+
     void
     garbageCollect();
 
@@ -155,14 +177,92 @@ namespace TransLucid
     int m_hits;
   };
 
+  /**
+   * The results that one evaluation of a cached expression has finished.
+   * When the expression demands another dimension it is evaluated again,
+   * and anything that was finished without that dimension is found here
+   * instead of being worked out again.
+   *
+   * A result is found again by the values of the dimensions in its delta
+   * only, so the memo relies on every dimension that an evaluation reads
+   * being in its delta. Anything that reads the context without going
+   * through delta mustn't be kept here.
+   */
+  class EvaluationMemo
+  {
+    public:
+    /**
+     * The result of @a ws, if it was finished at time @a t with a delta
+     * that @a d contains and with the same values in @a kappa. Returns
+     * null if there isn't one.
+     */
+    const TimeConstant*
+    find(const WS* ws, const Context& kappa, const Delta& d, size_t t) const;
+
+    /**
+     * Keep @a result for @a ws. Demands are never kept.
+     */
+    void
+    insert(const WS* ws, const Context& kappa, const Delta& d, size_t t,
+      const TimeConstant& result);
+
+    private:
+    struct Entry
+    {
+      size_t time;
+      std::vector<std::pair<dimension_index, Constant>> context;
+      TimeConstant result;
+    };
+
+    std::unordered_map<const WS*, std::vector<Entry>> m_entries;
+  };
+
+  /**
+   * Evaluates @a f for @a ws, or returns the result that it gave before
+   * in the same evaluation. The memo is only used when @a d lists the
+   * dimensions that the result can depend on.
+   */
+  template <typename F>
+  TimeConstant
+  memoise(const WS* ws, Context& kappa, Delta& d, const Thread& w, size_t t,
+    F&& f)
+  {
+    EvaluationMemo* memo = w.memo();
+
+    if (memo == nullptr || d.all())
+    {
+      return f();
+    }
+
+    auto found = memo->find(ws, kappa, d, t);
+    if (found != nullptr)
+    {
+      return *found;
+    }
+
+    auto result = f();
+    memo->insert(ws, kappa, d, t, result);
+
+    return result;
+  }
+
   namespace Workshops
   {
     class CacheWS : public WS
     {
       public:
 
-      CacheWS(WS* expr, u32string name, System& system)
+      /**
+       * Cache @a expr. If it defines @a identifier, the dimensions that the
+       * identifier is known to look at are asked for straight away.
+       */
+      CacheWS(WS* expr, u32string name, System& system,
+        u32string identifier = u32string())
       : m_expr(expr), m_name(std::move(name)), m_system(system)
+      , m_identifier(std::move(identifier))
+      , m_dimsGeneration(NO_GENERATION)
+      , m_traceSerial(0)
+      , m_traceVariable(0)
       {}
 
       Constant
@@ -188,12 +288,30 @@ namespace TransLucid
 
       private:
 
+      static constexpr size_t NO_GENERATION = static_cast<size_t>(-1);
+
+      //the dimensions that m_identifier is known to look at, these are
+      //asked for before evaluating it
+      const std::vector<dimension_index>&
+      staticDimensions();
+
+      //the name of this in the trace that the system is recording
+      uint32_t
+      traceVariable(DemandTrace& trace);
+
       Cache m_cache;
       WS* m_expr;
       u32string m_name;
 
       //we need to hold onto the system to see if we should use the cache
       System& m_system;
+
+      u32string m_identifier;
+      std::vector<dimension_index> m_dims;
+      size_t m_dimsGeneration;
+
+      uint64_t m_traceSerial;
+      uint32_t m_traceVariable;
     };
   }
 }
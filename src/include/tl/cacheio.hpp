@@ -29,14 +29,47 @@ namespace TransLucid
   {
     public:
 
+    CacheIO()
+    : IOHD(1)
+    , m_levelled(false)
+    {
+    }
+
     void
     put(const Context& k, const Constant& c);
 
     Constant
     get(const Context& k) const;
 
+    void
+    putBlock(const Context& k, const HDBlock& block, const Constant* values);
+
+    void
+    getBlock(const Context& k, const HDBlock& block, Constant* values) const;
+
+    //any context can be stored
+    Region
+    variance() const
+    {
+      return Region();
+    }
+
+    void
+    addAssignment(const Tuple&)
+    {
+    }
+
+    void
+    commit()
+    {
+    }
+
     private:
     mutable Cache m_cache;
+
+    //the dimensions of the first put are the ones that every value is
+    //stored and found by, a context is only matched on those
+    bool m_levelled;
   };
 }
 
@@ -25,6 +25,7 @@ along with TransLucid; see the file COPYING.  If not see
 #ifndef TL_CHI_HPP_INCLUDED
 #define TL_CHI_HPP_INCLUDED
 
+#include <tl/rho_path.hpp>
 #include <tl/types.hpp>
 #include <tl/utility.hpp>
 
@@ -40,7 +41,7 @@ namespace TransLucid
   class ChiDim
   {
     public:
-    typedef int16_t type_t;
+    typedef RhoPath::value_type type_t;
 
     ChiDim(int which, const std::vector<type_t>& stack)
     : m_which(which)
@@ -48,15 +49,18 @@ namespace TransLucid
     {
     }
 
+    ChiDim(int which, const RhoPath& stack)
+    : m_which(which)
+    , m_stack(stack)
+    {
+    }
+
     size_t
     hash() const
     {
+      //the path keeps its own hash up to date
       size_t value = m_which;
-
-      for (auto v : m_stack)
-      {
-        hash_combine(v, value);
-      }
+      hash_combine(m_stack.hash(), value);
 
       return value;
     }
@@ -70,7 +74,7 @@ namespace TransLucid
     private:
 
     int m_which;
-    std::vector<type_t> m_stack;
+    RhoPath m_stack;
 
     friend
     std::ostream&
@@ -82,9 +86,9 @@ namespace TransLucid
   operator<<(std::ostream& os, const ChiDim& chi)
   {
     os << chi.m_which << ", ";
-    for (auto v : chi.m_stack)
+    for (size_t i = 0; i != chi.m_stack.size(); ++i)
     {
-      os << static_cast<int>(v) << ":";
+      os << static_cast<int>(chi.m_stack[i]) << ":";
     }
 
     return os;
@@ -0,0 +1,133 @@
+/* Reuse of closures.
+   Copyright (C) 2013 Jarryd Beck
+
+This file is part of TransLucid.
+
+TransLucid is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+TransLucid is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with TransLucid; see the file COPYING.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+/**
+ * @file closure_cache.hpp
+ * The closure cache. A function abstraction is determined entirely by the
+ * abstraction that creates it and the ordinates that it binds, so an
+ * abstraction that is evaluated again with the same bindings can hand out
+ * the function that it made last time.
+ */
+
+#ifndef TL_CLOSURE_CACHE_HPP_INCLUDED
+#define TL_CLOSURE_CACHE_HPP_INCLUDED
+
+#include <tl/types.hpp>
+
+#include <mutex>
+#include <vector>
+
+namespace TransLucid
+{
+  class ClosureCache
+  {
+    public:
+
+    typedef std::vector<std::pair<dimension_index, Constant>> Bindings;
+
+    struct Statistics
+    {
+      size_t created;
+      size_t reused;
+    };
+
+    /**
+     * Find the closure with bindings @a binds, or make it with
+     * @a make.
+     */
+    template <typename Make>
+    Constant
+    get(const Bindings& binds, Make&& make)
+    {
+      size_t h = hash(binds);
+      Slot& slot = m_slots[h % NUM_SLOTS];
+
+      {
+        auto guard = lock();
+        if (slot.used && slot.hash == h && slot.binds == binds)
+        {
+          reused();
+          return slot.closure;
+        }
+      }
+
+      Constant closure = make();
+
+      auto guard = lock();
+      slot.used = true;
+      slot.hash = h;
+      slot.binds = binds;
+      slot.closure = closure;
+      created();
+
+      return closure;
+    }
+
+    /**
+     * The totals over all abstractions so far.
+     */
+    static Statistics
+    statistics();
+
+    private:
+
+    //the closures of one abstraction mostly differ in only a few
+    //ordinates, so only a handful are kept
+    static constexpr size_t NUM_SLOTS = 8;
+
+    struct Slot
+    {
+      Slot()
+      : used(false)
+      , hash(0)
+      {
+      }
+
+      bool used;
+      size_t hash;
+      Bindings binds;
+      Constant closure;
+    };
+
+    static size_t
+    hash(const Bindings& binds);
+
+    //the evaluator only runs on more than one thread while constants are
+    //shared, the rest of the time the cache belongs to one thread and
+    //isn't locked
+    std::unique_lock<std::mutex>
+    lock()
+    {
+      return detail::constants_shared()
+        ? std::unique_lock<std::mutex>(m_mutex)
+        : std::unique_lock<std::mutex>();
+    }
+
+    static void
+    created();
+
+    static void
+    reused();
+
+    Slot m_slots[NUM_SLOTS];
+    std::mutex m_mutex;
+  };
+}
+
+#endif
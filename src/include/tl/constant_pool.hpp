@@ -0,0 +1,78 @@
+/* Pooled allocation of boxed constants.
+   Copyright (C) 2013 Jarryd Beck
+
+This file is part of TransLucid.
+
+TransLucid is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+TransLucid is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with TransLucid; see the file COPYING.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+/**
+ * @file constant_pool.hpp
+ * The constant pool. Boxed constants are created and destroyed constantly
+ * during evaluation, so their memory comes from size classes of fixed
+ * size blocks. Each thread keeps its own free lists, so allocating and
+ * freeing don't need a lock. The memory is kept by the pool for the
+ * lifetime of the program.
+ */
+
+#ifndef TL_CONSTANT_POOL_HPP_INCLUDED
+#define TL_CONSTANT_POOL_HPP_INCLUDED
+
+#include <cstddef>
+
+namespace TransLucid
+{
+  namespace ConstantPool
+  {
+    //every block is aligned to this
+    constexpr size_t ALIGNMENT = 16;
+
+    //blocks up to this size come from the pool, bigger blocks go to
+    //operator new
+    constexpr size_t MAX_POOLED_SIZE = 256;
+
+    struct Statistics
+    {
+      //blocks handed out and given back, including large blocks
+      size_t allocations;
+      size_t deallocations;
+
+      //blocks too big for a size class
+      size_t large;
+
+      //bytes reserved from the system for the size classes
+      size_t reserved;
+    };
+
+    /**
+     * Allocate a block of at least @a size bytes.
+     */
+    void*
+    allocate(size_t size);
+
+    /**
+     * Give back a block. @a size must be what it was allocated with.
+     */
+    void
+    deallocate(void* p, size_t size);
+
+    /**
+     * The totals over all threads so far.
+     */
+    Statistics
+    statistics();
+  }
+}
+
+#endif
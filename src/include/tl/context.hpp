@@ -25,6 +25,7 @@ along with TransLucid; see the file COPYING.  If not see
 #ifndef TL_CONTEXT_HPP_INCLUDED
 #define TL_CONTEXT_HPP_INCLUDED
 
+#include <tl/rho_path.hpp>
 #include <tl/types/special.hpp>
 #include <tl/types.hpp>
 
@@ -140,22 +141,22 @@ namespace TransLucid
     void
     pushRho(uint8_t index)
     {
-      m_rho.push_front(index);
+      m_rho.push(index);
     }
 
     void 
     popRho()
     {
-      m_rho.pop_back();
+      m_rho.pop();
     }
 
-    uint8_t&
-    topRho()
+    void
+    setTopRho(uint8_t index)
     {
-      return m_rho.back();
+      m_rho.setTop(index);
     }
 
-    const std::deque<uint8_t>&
+    const RhoPath&
     getRho()
     {
       return m_rho;
@@ -172,6 +173,7 @@ namespace TransLucid
         {
           d.insert(m);
         }
+        ++m;
       }
     }
 
@@ -198,7 +200,7 @@ namespace TransLucid
 
     std::set<dimension_index> m_setDims;
 
-    std::deque<uint8_t> m_rho;
+    RhoPath m_rho;
   };
 
   class ContextPerturber
@@ -445,28 +447,41 @@ namespace TransLucid
     std::vector<std::pair<dimension_index, Constant>> m_context;
   };
 
+  //keeps track of rho, unless it isn't active because nothing that is
+  //evaluated inside it looks at rho
   class RhoManager
   {
     public:
-    RhoManager(Context& k, uint8_t start = 0)
+    RhoManager(Context& k, uint8_t start = 0, bool active = true)
     : m_kappa(k)
+    , m_active(active)
     {
-      m_kappa.pushRho(start);
+      if (m_active)
+      {
+        m_kappa.pushRho(start);
+      }
     }
 
     ~RhoManager()
     {
-      m_kappa.popRho();
+      if (m_active)
+      {
+        m_kappa.popRho();
+      }
     }
 
     void
     changeTop(int index)
     {
-      m_kappa.topRho() = index;
+      if (m_active)
+      {
+        m_kappa.setTopRho(index);
+      }
     }
 
     private:
     Context& m_kappa;
+    bool m_active;
   };
 
 }
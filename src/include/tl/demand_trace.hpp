@@ -0,0 +1,247 @@
+/* Demand trace recorder.
+   Copyright (C) 2013 Jarryd Beck
+
+This file is part of TransLucid.
+
+TransLucid is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+TransLucid is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with TransLucid; see the file COPYING.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+/**
+ * @file demand_trace.hpp
+ * Records the demands for cached variables. Each demand is a fixed size
+ * record in a ring buffer, so the newest demands are kept when there are
+ * too many. The trace is written to a binary file which
+ * src/tools/tltrace.py summarises.
+ */
+
+#ifndef TL_DEMAND_TRACE_HPP_INCLUDED
+#define TL_DEMAND_TRACE_HPP_INCLUDED
+
+#include <tl/types.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace TransLucid
+{
+  class Context;
+  class Delta;
+
+  class DemandTrace
+  {
+    public:
+
+    enum Outcome : uint8_t
+    {
+      //the value was in the cache
+      OUTCOME_HIT,
+      //the value was computed
+      OUTCOME_CALC,
+      //the value needs dimensions that weren't in the demand
+      OUTCOME_DEMAND,
+      //the value depends on itself
+      OUTCOME_LOOP
+    };
+
+    struct Record
+    {
+      //the order that the demands were made in, starting at 1
+      uint64_t sequence;
+
+      //the demand that made this one, 0 if there wasn't one
+      uint64_t parent;
+
+      //from the start of the demand to its end, including everything
+      //that it demanded
+      uint64_t nanoseconds;
+
+      //the hash of the dimensions that were demanded and their values
+      uint64_t context;
+
+      uint32_t variable;
+      uint8_t outcome;
+    };
+
+    static constexpr uint32_t FILE_VERSION = 1;
+
+    /**
+     * Keep the last @a capacity demands.
+     */
+    DemandTrace(size_t capacity);
+
+    /**
+     * Every trace has a different serial number, the variable numbers
+     * only mean something to the trace with the same serial number.
+     */
+    uint64_t
+    serial() const
+    {
+      return m_serial;
+    }
+
+    /**
+     * The name of a variable in the trace.
+     */
+    uint32_t
+    variable(const u32string& name);
+
+    /**
+     * Start a demand, the result is passed to end.
+     */
+    uint64_t
+    begin();
+
+    /**
+     * Finish the most recent demand that hasn't finished. The context of
+     * the demand is @a kappa restricted to @a delta, which should be the
+     * dimensions that the variable demanded.
+     */
+    void
+    end
+    (
+      uint64_t sequence,
+      uint32_t variable,
+      const Context& kappa,
+      const Delta& delta,
+      Outcome outcome
+    );
+
+    /**
+     * Forget a demand that won't finish.
+     */
+    void
+    abandon(uint64_t sequence);
+
+    /**
+     * The demands that are still kept, oldest first.
+     */
+    std::vector<Record>
+    records() const;
+
+    /**
+     * The number of demands that weren't kept.
+     */
+    uint64_t
+    dropped() const
+    {
+      return m_total > m_ring.size() ? m_total - m_ring.size() : 0;
+    }
+
+    /**
+     * The number of contexts whose text is kept, only the contexts of the
+     * demands that are still kept have text.
+     */
+    size_t
+    contexts() const
+    {
+      return m_contexts.size();
+    }
+
+    /**
+     * Write the trace to @a path.
+     * @return False if the file couldn't be written.
+     */
+    bool
+    write(const std::string& path) const;
+
+    /**
+     * Records the demand that it lives for.
+     */
+    class Scope
+    {
+      public:
+      Scope(DemandTrace* trace)
+      : m_trace(trace)
+      , m_sequence(trace != nullptr ? trace->begin() : 0)
+      {
+      }
+
+      Scope(const Scope&) = delete;
+
+      //a demand that is left by an exception isn't recorded
+      ~Scope()
+      {
+        if (m_trace != nullptr)
+        {
+          m_trace->abandon(m_sequence);
+        }
+      }
+
+      bool
+      active() const
+      {
+        return m_trace != nullptr;
+      }
+
+      void
+      end
+      (
+        uint32_t variable,
+        const Context& kappa,
+        const Delta& delta,
+        Outcome outcome
+      )
+      {
+        if (m_trace != nullptr)
+        {
+          m_trace->end(m_sequence, variable, kappa, delta, outcome);
+          m_trace = nullptr;
+        }
+      }
+
+      private:
+      DemandTrace* m_trace;
+      uint64_t m_sequence;
+    };
+
+    private:
+    typedef std::chrono::steady_clock clock;
+
+    struct Open
+    {
+      uint64_t sequence;
+      uint64_t parent;
+      clock::time_point start;
+    };
+
+    //the demands that haven't finished, innermost last
+    std::vector<Open> m_open;
+
+    uint64_t m_serial;
+
+    std::vector<Record> m_ring;
+    size_t m_capacity;
+    uint64_t m_total;
+    uint64_t m_sequence;
+
+    std::vector<u32string> m_variables;
+    std::unordered_map<u32string, uint32_t> m_variableIds;
+
+    struct ContextText
+    {
+      std::string text;
+      //the number of records in the ring with this context
+      size_t records;
+    };
+
+    //the text of each context, made when a kept record first has it and
+    //dropped when the last record with it leaves the ring
+    std::unordered_map<uint64_t, ContextText> m_contexts;
+  };
+}
+
+#endif
@@ -0,0 +1,218 @@
+/* Static dimensionality analysis.
+   Copyright (C) 2013 Jarryd Beck
+
+This file is part of TransLucid.
+
+TransLucid is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+TransLucid is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with TransLucid; see the file COPYING.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+/**
+ * @file dimensionality.hpp
+ * Static dimensionality analysis. Finds the dimensions of the context that
+ * an identifier can look at, including through the identifiers and the
+ * functions that it uses. The cache uses this to ask for those dimensions
+ * up front instead of finding them one demand at a time. Only dimensions
+ * that are known before evaluation are found, the rest are still left to
+ * the demands.
+ */
+
+#ifndef TL_DIMENSIONALITY_HPP_INCLUDED
+#define TL_DIMENSIONALITY_HPP_INCLUDED
+
+#include <tl/ast.hpp>
+#include <tl/static/function.hpp>
+
+#include <map>
+#include <set>
+
+namespace TransLucid
+{
+  class System;
+
+  namespace Static
+  {
+    class DimensionalityFinder
+    {
+      public:
+      typedef std::set<dimension_index> DimensionSet;
+      typedef Static::Functions::FunctorList<DimensionSet> FunctorList;
+      typedef Static::Functions::FunctorSet<DimensionSet> FunctorSet;
+
+      //0. the dimensions looked at, 1. the direct function values,
+      //2. the indirect function values
+      typedef std::tuple<DimensionSet, FunctorList, FunctorSet> result_type;
+
+      // function types
+      typedef Static::Functions::Up<DimensionSet> Up;
+      typedef Static::Functions::CBV<DimensionSet> CBV;
+      typedef Static::Functions::Base<DimensionSet> Base;
+      typedef Static::Functions::Down<DimensionSet> Down;
+      typedef Static::Functions::ApplyV<DimensionSet> ApplyV;
+      typedef Static::Functions::ApplyB<DimensionSet> ApplyB;
+
+      typedef std::map<u32string, DimensionSet> DimensionalityMap;
+
+      DimensionalityFinder(System* s)
+      : m_system(s)
+      {
+      }
+
+      /**
+       * Find the dimensions of @a x and of every identifier that it uses.
+       * An identifier that can't be analysed has no dimensions.
+       */
+      DimensionalityMap
+      computeDimensionality(const u32string& x);
+
+      result_type
+      operator()(const Tree::nil&)
+      {
+        return result_type();
+      }
+
+      result_type
+      operator()(const bool&);
+
+      result_type
+      operator()(const Special&);
+
+      result_type
+      operator()(const mpz_class&);
+
+      result_type
+      operator()(const char32_t&);
+
+      result_type
+      operator()(const u32string&);
+
+      result_type
+      operator()(const Tree::LiteralExpr&);
+
+      result_type
+      operator()(const Constant&);
+
+      result_type
+      operator()(const Tree::DimensionExpr&);
+
+      result_type
+      operator()(const Tree::IdentExpr&);
+
+      result_type
+      operator()(const Tree::HashSymbol&);
+
+      result_type
+      operator()(const Tree::HostOpExpr&);
+
+      result_type
+      operator()(const Tree::ParenExpr&);
+
+      result_type
+      operator()(const Tree::UnaryOpExpr&);
+
+      result_type
+      operator()(const Tree::BinaryOpExpr&);
+
+      result_type
+      operator()(const Tree::MakeIntenExpr&);
+
+      result_type
+      operator()(const Tree::EvalIntenExpr&);
+
+      result_type
+      operator()(const Tree::IfExpr&);
+
+      result_type
+      operator()(const Tree::HashExpr&);
+
+      result_type
+      operator()(const Tree::RegionExpr&);
+
+      result_type
+      operator()(const Tree::TupleExpr&);
+
+      result_type
+      operator()(const Tree::AtExpr&);
+
+      result_type
+      operator()(const Tree::LambdaExpr&);
+
+      result_type
+      operator()(const Tree::PhiExpr&);
+
+      result_type
+      operator()(const Tree::BaseAbstractionExpr&);
+
+      result_type
+      operator()(const Tree::BangAppExpr&);
+
+      result_type
+      operator()(const Tree::LambdaAppExpr&);
+
+      result_type
+      operator()(const Tree::PhiAppExpr&);
+
+      result_type
+      operator()(const Tree::WhereExpr&);
+
+      result_type
+      operator()(const Tree::ConditionalBestfitExpr&);
+
+      private:
+
+      //the dimension that e always means, if it is one that can be known
+      //before evaluation
+      bool
+      staticDimension(const Tree::Expr& e, dimension_index& dim);
+
+      //the dimensions that an abstraction fixes when it is made, which its
+      //body doesn't get from the context that it is applied in
+      DimensionSet
+      captureDimensions
+      (
+        const std::vector<Tree::Expr>& binds,
+        const std::vector<dimension_index>& scope,
+        result_type& made
+      );
+
+      //adds the dimensions that are looked at and the indirect functions
+      //of a subexpression whose value is only used in this expression
+      void
+      addUsed(result_type& to, const result_type& from);
+
+      //adds the dimensions and all of the functions of a subexpression
+      //whose value can be the value of this expression
+      void
+      addValue(result_type& to, const result_type& from);
+
+      std::map<u32string, result_type> m_idDims;
+      std::set<u32string> m_referenced;
+      System* m_system;
+    };
+
+    namespace Functions
+    {
+      template <>
+      struct PropertyCounter<DimensionalityFinder::DimensionSet>
+      {
+        size_t
+        operator()(const DimensionalityFinder::DimensionSet& s)
+        {
+          return s.size();
+        }
+      };
+    }
+  }
+}
+
+#endif
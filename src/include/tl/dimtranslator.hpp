@@ -23,6 +23,8 @@ along with TransLucid; see the file COPYING.  If not see
 #include <tl/object_registry.hpp>
 #include <tl/types.hpp>
 
+#include <bitset>
+
 namespace TransLucid
 {
   /**
@@ -71,8 +73,15 @@ namespace TransLucid
 
     private:
 
+    //small non-negative integers are the most common dimensions that
+    //aren't named, so they are looked up in an array instead of hashed
+    static constexpr size_t SMALL_INTEGERS = 256;
+
     dimension_index m_nextIndex;
 
+    dimension_index m_small[SMALL_INTEGERS];
+    std::bitset<SMALL_INTEGERS> m_smallKnown;
+
     ObjectRegistry<u32string, decltype(m_nextIndex), 
       Decrement<decltype(m_nextIndex)>> m_named;
     ObjectRegistry<Constant, decltype(m_nextIndex),
@@ -98,6 +98,18 @@ namespace TransLucid
     Tree::Expr
     getEquation(Context& k);
 
+    void
+    discardBefore(int time)
+    {
+      m_bestfit.discardBefore(time);
+    }
+
+    bool
+    precompile(Context& k)
+    {
+      return m_bestfit.precompile(k);
+    }
+
     private:
     u32string m_name;
 
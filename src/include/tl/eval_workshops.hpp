@@ -29,6 +29,7 @@ along with TransLucid; see the file COPYING.  If not see
 //#include <tl/ast.hpp>
 #include <tl/builtin_types.hpp>
 #include <tl/chi.hpp>
+#include <tl/closure_cache.hpp>
 #include <tl/system.hpp>
 #include <tl/types/special.hpp>
 #include <tl/workshop.hpp>
@@ -52,6 +53,30 @@ namespace TransLucid
 
   namespace Workshops
   {
+    /**
+     * @brief Remembers the last dimension that was computed.
+     * A dimension that is computed usually evaluates to the same thing
+     * each time, so the last value and its index are kept to save a
+     * trip to the dimension translator. Like the translator, it isn't
+     * locked.
+     */
+    class DimensionCache
+    {
+      public:
+      DimensionCache()
+      : m_index(0), m_valid(false)
+      {
+      }
+
+      dimension_index
+      operator()(System& system, const Constant& value);
+
+      private:
+      Constant m_value;
+      dimension_index m_index;
+      bool m_valid;
+    };
+
     /**
      * @brief The outermost hyperdaton which starts an evaluation.
      * Sets up the right context so that evaluation works.
@@ -153,10 +178,33 @@ namespace TransLucid
       u32string m_symbol;
     };
 
+    /**
+     * A workshop that keeps track of where it is in rho. The workshop
+     * builder turns this off when nothing that it evaluates can reach
+     * something that looks at rho, even through another definition.
+     */
+    class RhoWS : public WS
+    {
+      public:
+      RhoWS()
+      : m_rho(true)
+      {
+      }
+
+      void
+      setRho(bool rho)
+      {
+        m_rho = rho;
+      }
+
+      protected:
+      bool m_rho;
+    };
+
     /**
      * A bang operation workshop. Evaluates a host function.
      */
-    class BangOpWS : public WS
+    class BangOpWS : public RhoWS
     {
       public:
       /**
@@ -208,6 +256,10 @@ namespace TransLucid
       operator()(Context& kappa, Delta& d, const Thread& w, size_t t);
 
       private:
+      //the cached evaluation, the result is kept for the demands
+      TimeConstant
+      apply(Context& kappa, Delta& d, const Thread& w, size_t t);
+
       System& m_system;
       WS* m_name;
       std::vector<WS*> m_args;
@@ -254,7 +306,7 @@ namespace TransLucid
       std::vector<dimension_index> m_scope;
     };
 
-    class EvalIntenWS : public WS
+    class EvalIntenWS : public RhoWS
     {
       public:
 
@@ -284,7 +336,7 @@ namespace TransLucid
     /**
      * An if expression workshop.
      */
-    class IfWS : public WS
+    class IfWS : public RhoWS
     {
       public:
 
@@ -372,6 +424,7 @@ namespace TransLucid
       System& m_system;
       WS* m_e;
       bool m_cached;
+      DimensionCache m_dim;
     };
 
     class HostOpWS : public WS
@@ -443,7 +496,7 @@ namespace TransLucid
     /**
      * A tuple creation workshop.
      */
-    class TupleWS : public WS
+    class TupleWS : public RhoWS
     {
       public:
 
@@ -454,7 +507,7 @@ namespace TransLucid
        */
       TupleWS(System& system,
                  const std::list<std::pair<WS*, WS*>>& elements)
-      : m_system(system), m_elements(elements)
+      : m_system(system), m_elements(elements), m_dims(elements.size())
       {}
 
       ~TupleWS()
@@ -484,6 +537,7 @@ namespace TransLucid
       private:
       System& m_system;
       std::list<std::pair<WS*, WS*>> m_elements;
+      std::vector<DimensionCache> m_dims;
 
       public:
       /**
@@ -517,7 +571,7 @@ namespace TransLucid
     /**
      * An at expression workshop. Evaluates an at expression.
      */
-    class AtWS : public WS
+    class AtWS : public RhoWS
     {
       public:
 
@@ -619,6 +673,7 @@ namespace TransLucid
       std::vector<dimension_index> m_scope;
       std::vector<WS*> m_binds;
       WS* m_rhs;
+      ClosureCache m_closures;
     };
 
     /**
@@ -694,13 +749,14 @@ namespace TransLucid
       WS* m_rhs;
       std::vector<WS*> m_binds;
       std::vector<dimension_index> m_scope;
+      ClosureCache m_closures;
     };
 
     /*
      * A call-by-value application workshop.
      * Applies an argument to a call-by-value function.
      */
-    class LambdaApplicationWS : public WS
+    class LambdaApplicationWS : public RhoWS
     {
       public:
       /**
@@ -738,6 +794,10 @@ namespace TransLucid
       operator()(Context& kappa, Delta& d, const Thread& w, size_t t);
 
       private:
+      //the cached evaluation, the result is kept for the demands
+      TimeConstant
+      apply(Context& kappa, Delta& d, const Thread& w, size_t t);
+
       WS* m_lhs;
       WS* m_rhs;
     };
@@ -790,7 +850,7 @@ namespace TransLucid
      * Evaluates an at expression when the rhs is a tuple expression. This
      * allows us to make an optimisation by not building tuples all the time.
      */
-    class AtTupleWS : public WS
+    class AtTupleWS : public RhoWS
     {
       public:
       template <typename T>
@@ -803,6 +863,7 @@ namespace TransLucid
       : m_e2(e2)
       , m_tuple(pairs.begin(), pairs.end())
       , m_system(system)
+      , m_dims(m_tuple.size())
       {
       }
 
@@ -828,6 +889,7 @@ namespace TransLucid
       WS* m_e2;
       std::vector<std::pair<WS*, WS*>> m_tuple;
       System& m_system;
+      std::vector<DimensionCache> m_dims;
     };
   }
 }
@@ -92,6 +92,24 @@ namespace TransLucid
       return m_bestfit.getEquation(k);
     }
 
+    std::vector<Parser::Line>
+    liveDefinitions(Context& k)
+    {
+      return m_bestfit.liveDefinitions(k);
+    }
+
+    void
+    discardBefore(int time)
+    {
+      m_bestfit.discardBefore(time);
+    }
+
+    bool
+    precompile(Context& k)
+    {
+      return m_bestfit.precompile(k);
+    }
+
     private:
     u32string m_name;
     System& m_system;
@@ -294,7 +294,7 @@ namespace TransLucid
     {
       Tree::ConditionalBestfitExpr cond;
 
-      for (auto eqn : e.declarations)
+      for (const auto& eqn : e.declarations)
       {
         cond.declarations.push_back
         (
@@ -29,9 +29,112 @@ along with TransLucid; see the file COPYING.  If not see
 #include <tl/types.hpp>
 
 #include <type_traits>
+#include <vector>
+
+#include <gmpxx.h>
 
 namespace TransLucid
 {
+  /**
+   * A rectangular block of points. Each bound is a run of consecutive
+   * integers in one dimension. The values of a block are stored
+   * contiguously with the last bound varying fastest.
+   */
+  class HDBlock
+  {
+    public:
+
+    struct Bound
+    {
+      dimension_index dim;
+      mpz_class lower;
+      size_t size;
+    };
+
+    void
+    add(dimension_index dim, const mpz_class& lower, size_t size)
+    {
+      m_bounds.push_back(Bound{dim, lower, size});
+    }
+
+    const std::vector<Bound>&
+    bounds() const
+    {
+      return m_bounds;
+    }
+
+    //the number of points, a block with no bounds is one point
+    size_t
+    size() const
+    {
+      size_t n = 1;
+      for (const auto& b : m_bounds)
+      {
+        n *= b.size;
+      }
+
+      return n;
+    }
+
+    /**
+     * The points from @a start to @a start + @a count along the first
+     * bound.
+     */
+    HDBlock
+    slice(size_t start, size_t count) const
+    {
+      HDBlock result(*this);
+      result.m_bounds.front().lower += start;
+      result.m_bounds.front().size = count;
+
+      return result;
+    }
+
+    /**
+     * Perturb @a k by each point in turn, and call @a f with the position
+     * of the point and @a k.
+     */
+    template <typename F>
+    void
+    each(Context& k, F f) const
+    {
+      size_t n = size();
+
+      std::vector<mpz_class> current;
+      for (const auto& b : m_bounds)
+      {
+        current.push_back(b.lower);
+      }
+
+      for (size_t i = 0; i != n; ++i)
+      {
+        {
+          ContextPerturber p(k);
+          for (size_t j = 0; j != m_bounds.size(); ++j)
+          {
+            p.perturb(m_bounds[j].dim, Types::Intmp::create(current[j]));
+          }
+
+          f(i, k);
+        }
+
+        size_t j = m_bounds.size();
+        while (j != 0)
+        {
+          --j;
+          if (++current[j] != m_bounds[j].lower + m_bounds[j].size)
+          {
+            break;
+          }
+          current[j] = m_bounds[j].lower;
+        }
+      }
+    }
+
+    private:
+    std::vector<Bound> m_bounds;
+  };
+
   class HD 
   {
     public:
@@ -71,6 +174,21 @@ namespace TransLucid
 
     virtual Constant
     get(const Context& k) const = 0;
+
+    /**
+     * Get every point of @a block into @a values, the dimensions that
+     * aren't in the block come from @a k.
+     */
+    virtual void
+    getBlock(const Context& k, const HDBlock& block, Constant* values) const
+    {
+      Context point(k);
+      block.each(point, [this, values] (size_t i, Context& c)
+        {
+          values[i] = get(c);
+        }
+      );
+    }
   };
 
   class OutputHD : public virtual HD
@@ -87,6 +205,21 @@ namespace TransLucid
     virtual void
     put(const Context& k, const Constant& c) = 0;
 
+    /**
+     * Put @a values at every point of @a block, the dimensions that
+     * aren't in the block come from @a k.
+     */
+    virtual void
+    putBlock(const Context& k, const HDBlock& block, const Constant* values)
+    {
+      Context point(k);
+      block.each(point, [this, values] (size_t i, Context& c)
+        {
+          put(c, values[i]);
+        }
+      );
+    }
+
     virtual void
     addAssignment(const Tuple& region) = 0;
 
@@ -17,6 +17,9 @@ You should have received a copy of the GNU General Public License
 along with TransLucid; see the file COPYING.  If not see
 <http://www.gnu.org/licenses/>.  */
 
+#ifndef TL_RUNTIME_ARRAYHD_HPP_INCLUDED
+#define TL_RUNTIME_ARRAYHD_HPP_INCLUDED
+
 #include <vector>
 #include <utility>
 
@@ -65,6 +68,12 @@ namespace TransLucid
     void
     put(const Context&, const Constant&);
 
+    void
+    getBlock(const Context& k, const HDBlock& block, Constant* values) const;
+
+    void
+    putBlock(const Context& k, const HDBlock& block, const Constant* values);
+
     void
     commit();
 
@@ -78,6 +87,13 @@ namespace TransLucid
     }
 
     private:
+
+    //the index of the first point of the block and how far each bound of
+    //the block moves through the array, false if the block doesn't fit
+    bool
+    blockLayout(const Context& k, const HDBlock& block, size_t& first,
+      std::vector<size_t>& strides) const;
+
     size_t m_size;
     Constant* m_data;
     std::vector<std::pair<dimension_index, size_t>> m_bounds;
@@ -92,5 +108,13 @@ namespace TransLucid
       return m_bounds;
     }
 
+    const decltype(m_multipliers)&
+    multipliers() const
+    {
+      return m_multipliers;
+    }
+
   };
 }
+
+#endif
@@ -0,0 +1,192 @@
+/* Shared memory hyperdaton.
+   Copyright (C) 2013 Jarryd Beck
+
+This file is part of TransLucid.
+
+TransLucid is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+TransLucid is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with TransLucid; see the file COPYING.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+/**
+ * @file sharedhd.hpp
+ * An array hyperdaton in a POSIX shared memory segment, so that other
+ * processes on the same machine can read and write it in place.
+ *
+ * The segment starts with a SharedArrayHD::Header, which is followed by
+ * two buffers of values, each one the product of the bounds long, with
+ * the last bound varying fastest. One buffer has the values of the last
+ * instant that was committed, the other is written by the instant in
+ * progress. A commit swaps them by incrementing Header::commits, so the
+ * committed buffer is commits % 2.
+ *
+ * A reader loads commits with acquire ordering, reads the committed
+ * buffer, issues an acquire fence, and loads commits again. If it changed
+ * then the buffer was being overwritten and has to be read again. Every
+ * reader outside of TransLucid has to do the same check, without the fence
+ * it can see torn values with an unchanged count on weakly ordered
+ * processors.
+ */
+
+#ifndef TL_SHAREDHD_HPP_INCLUDED
+#define TL_SHAREDHD_HPP_INCLUDED
+
+#include <tl/hyperdaton.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace TransLucid
+{
+  class SharedArrayHD : public IOHD
+  {
+    public:
+
+    enum ElementType : uint32_t
+    {
+      ELEMENT_INT64,
+      ELEMENT_FLOAT64
+    };
+
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t MAX_RANK = 8;
+    static constexpr size_t NAME_SIZE = 32;
+
+    struct Header
+    {
+      //"TLSHMHD" and a zero
+      char magic[8];
+      uint32_t version;
+      uint32_t type;
+      uint32_t rank;
+      uint32_t reserved;
+
+      //the number of instants that have been committed
+      std::atomic<uint64_t> commits;
+
+      //the size of each bound and the name of its dimension
+      uint64_t bounds[MAX_RANK];
+      char names[MAX_RANK][NAME_SIZE];
+    };
+
+    struct Bound
+    {
+      dimension_index dim;
+      std::string name;
+      size_t size;
+    };
+
+    /**
+     * Create the segment @a segment, replacing one with the same name.
+     */
+    SharedArrayHD
+    (
+      const std::string& segment,
+      const std::vector<Bound>& bounds,
+      ElementType type
+    );
+
+    /**
+     * Open the segment @a segment that was made by another process.
+     * @a dims are the dimensions of this process that its bounds vary in.
+     */
+    SharedArrayHD
+    (
+      const std::string& segment,
+      const std::vector<dimension_index>& dims
+    );
+
+    ~SharedArrayHD();
+
+    SharedArrayHD(const SharedArrayHD&) = delete;
+
+    SharedArrayHD&
+    operator=(const SharedArrayHD&) = delete;
+
+    /**
+     * Remove the name of a segment, the processes that have it open can
+     * still use it.
+     */
+    static void
+    unlink(const std::string& segment);
+
+    /**
+     * The value at @a k in the last instant that was committed.
+     */
+    Constant
+    get(const Context& k) const;
+
+    /**
+     * Write @a c into the instant in progress. A value that isn't a number
+     * of the element type leaves the point as it was.
+     */
+    void
+    put(const Context& k, const Constant& c);
+
+    /**
+     * Make the instant in progress the one that readers see.
+     */
+    void
+    commit();
+
+    Region
+    variance() const;
+
+    void
+    addAssignment(const Tuple&)
+    {
+    }
+
+    const Header&
+    header() const
+    {
+      return *m_header;
+    }
+
+    //the number of values in each buffer
+    size_t
+    size() const
+    {
+      return m_size;
+    }
+
+    private:
+
+    void
+    map(int fd, bool create);
+
+    void
+    setBounds(const std::vector<std::pair<dimension_index, size_t>>& bounds);
+
+    //the index of k in a buffer, false if it is outside of the bounds
+    bool
+    index(const Context& k, size_t& i) const;
+
+    //the start of buffer n
+    char*
+    buffer(uint64_t n) const;
+
+    std::string m_segment;
+
+    Header* m_header;
+    size_t m_mapped;
+
+    size_t m_size;
+    std::vector<std::pair<dimension_index, size_t>> m_bounds;
+    std::vector<size_t> m_multipliers;
+    Region m_variance;
+  };
+}
+
+#endif
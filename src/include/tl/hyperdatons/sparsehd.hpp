@@ -0,0 +1,121 @@
+/* Sparse array hyperdaton.
+   Copyright (C) 2013 Jarryd Beck
+
+This file is part of TransLucid.
+
+TransLucid is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+TransLucid is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with TransLucid; see the file COPYING.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+/**
+ * @file sparsehd.hpp
+ * An array hyperdaton that only stores the points that are put, for
+ * bounds that are far too big to allocate, but which only a few points
+ * are ever assigned to. An assignment to it evaluates its boolean at
+ * every point of its region that is within the bounds and within the
+ * constant bounds in the boolean, see Assignment::pruneRegion.
+ */
+
+#ifndef TL_SPARSEHD_HPP_INCLUDED
+#define TL_SPARSEHD_HPP_INCLUDED
+
+#include <tl/hyperdaton.hpp>
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace TransLucid
+{
+  class SparseArrayHD : public IOHD
+  {
+    public:
+
+    //the index of a point, with the last bound varying fastest, and its
+    //value
+    typedef std::unordered_map<size_t, Constant> Points;
+
+    SparseArrayHD()
+    : IOHD(1)
+    {}
+
+    /**
+     * Set the bounds, the same as ArrayHD::initialise, and forget every
+     * point. Throws if the product of the bounds doesn't fit in a size_t.
+     */
+    void
+    initialise(const std::vector<std::pair<dimension_index, size_t>>& bounds);
+
+    /**
+     * The value at @a k, undef if nothing was put there.
+     */
+    Constant
+    get(const Context& k) const;
+
+    /**
+     * Store @a c at @a k, a point outside of the bounds is ignored.
+     */
+    void
+    put(const Context& k, const Constant& c);
+
+    void
+    commit();
+
+    Region
+    variance() const;
+
+    void
+    addAssignment(const Tuple&)
+    {
+      //ignore this
+    }
+
+    //the number of points that have been put
+    size_t
+    size() const
+    {
+      return m_points.size();
+    }
+
+    Points::const_iterator
+    begin() const
+    {
+      return m_points.begin();
+    }
+
+    Points::const_iterator
+    end() const
+    {
+      return m_points.end();
+    }
+
+    const std::vector<std::pair<dimension_index, size_t>>&
+    bounds() const
+    {
+      return m_bounds;
+    }
+
+    private:
+
+    //the index of k, false if it is outside of the bounds
+    bool
+    index(const Context& k, size_t& i) const;
+
+    Points m_points;
+    std::vector<std::pair<dimension_index, size_t>> m_bounds;
+    std::vector<size_t> m_multipliers;
+    Region m_variance;
+  };
+}
+
+#endif
@@ -0,0 +1,96 @@
+/* Finds what an expression depends on from one instant to the next.
+   Copyright (C) 2013 Jarryd Beck
+
+This file is part of TransLucid.
+
+TransLucid is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+TransLucid is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with TransLucid; see the file COPYING.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+/**
+ * @file instant_dependencies.hpp
+ * Instant dependencies. Between two instants the only things that can
+ * change the value of an expression are the identifiers that it refers to
+ * and the time dimension, so an assignment whose dependencies haven't
+ * changed doesn't need to be computed again.
+ */
+
+#ifndef TL_INSTANT_DEPENDENCIES_HPP_INCLUDED
+#define TL_INSTANT_DEPENDENCIES_HPP_INCLUDED
+
+#include <tl/ast.hpp>
+#include <tl/generic_walker.hpp>
+
+#include <set>
+
+namespace TransLucid
+{
+  //finds the identifiers that a transformed expression refers to, and
+  //whether it can look at the time dimension
+  class InstantDependencies : private GenericTreeVisitor<InstantDependencies>
+  {
+    public:
+
+    using GenericTreeVisitor::operator();
+
+    typedef void result_type;
+
+    struct Result
+    {
+      std::set<u32string> identifiers;
+
+      //true if the expression might depend on the time
+      bool time;
+    };
+
+    Result
+    find(const Tree::Expr& e);
+
+    /**
+     * Find the dependencies of a guard. The dimensions that a region
+     * constrains aren't read, so for a region only the values count.
+     */
+    Result
+    findGuard(const Tree::Expr& e);
+
+    result_type
+    operator()(const Constant& c);
+
+    result_type
+    operator()(const Tree::DimensionExpr& e);
+
+    result_type
+    operator()(const Tree::IdentExpr& e);
+
+    result_type
+    operator()(const Tree::HashSymbol& e);
+
+    result_type
+    operator()(const Tree::LiteralExpr& e);
+
+    result_type
+    operator()(const Tree::BinaryOpExpr& e);
+
+    result_type
+    operator()(const Tree::PhiExpr& e);
+
+    result_type
+    operator()(const Tree::WhereExpr& e);
+
+    private:
+
+    Result m_result;
+  };
+}
+
+#endif
@@ -98,7 +98,7 @@ namespace Juice
     recursive_wrapper(const recursive_wrapper& rhs)
     : m_t(new T(rhs.get())) { }
 
-    recursive_wrapper(recursive_wrapper&& rhs)
+    recursive_wrapper(recursive_wrapper&& rhs) noexcept
     : m_t(rhs.m_t)
     {
       rhs.m_t = nullptr;
@@ -112,7 +112,7 @@ namespace Juice
     }
 
     recursive_wrapper&
-    operator=(recursive_wrapper&& rhs)
+    operator=(recursive_wrapper&& rhs) noexcept
     {
       delete m_t;
       m_t = rhs.m_t;
@@ -515,7 +515,9 @@ namespace Juice
       indicate_which(rhs.which());
     }
 
-    Variant(Variant&& rhs)
+    //noexcept so that containers of variants move them when they grow
+    //instead of copying them
+    Variant(Variant&& rhs) noexcept
     {
       rhs.apply_visitor_internal(move_constructor(*this));
       indicate_which(rhs.which());
@@ -531,7 +533,7 @@ namespace Juice
       return *this;
     }
 
-    Variant& operator=(Variant&& rhs)
+    Variant& operator=(Variant&& rhs) noexcept
     {
       if (this != &rhs)
       {
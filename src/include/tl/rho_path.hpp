@@ -0,0 +1,217 @@
+/* The rho path.
+   Copyright (C) 2013 Jarryd Beck
+
+This file is part of TransLucid.
+
+TransLucid is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+TransLucid is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with TransLucid; see the file COPYING.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+/**
+ * @file rho_path.hpp
+ * The rho path, which is where the evaluation is in the expression. It
+ * gives a where clause different dimensions each time that it is reached.
+ */
+
+#ifndef TL_RHO_PATH_HPP_INCLUDED
+#define TL_RHO_PATH_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace TransLucid
+{
+  /**
+   * A path of small integers. The first entries are stored inline and the
+   * rest spill into a vector, so pushing and popping don't allocate for
+   * the depths that are usually seen. The hash of every prefix is kept as
+   * the path changes, so hashing a path is constant time.
+   */
+  class RhoPath
+  {
+    public:
+    typedef int16_t value_type;
+
+    RhoPath()
+    : m_size(0)
+    {
+    }
+
+    //only the entries that are in use are copied
+    RhoPath(const RhoPath& other)
+    : m_size(other.m_size)
+    , m_spill(other.m_spill)
+    {
+      copyInline(other);
+    }
+
+    RhoPath&
+    operator=(const RhoPath& other)
+    {
+      m_size = other.m_size;
+      m_spill = other.m_spill;
+      copyInline(other);
+
+      return *this;
+    }
+
+    /**
+     * A path with @a values, the first one is the outermost.
+     */
+    explicit RhoPath(const std::vector<value_type>& values)
+    : m_size(0)
+    {
+      for (auto v : values)
+      {
+        push(v);
+      }
+    }
+
+    void
+    push(value_type v)
+    {
+      Entry e{v, combine(prefixHash(m_size), v)};
+
+      if (m_size < INLINE_SIZE)
+      {
+        m_inline[m_size] = e;
+      }
+      else
+      {
+        m_spill.push_back(e);
+      }
+
+      ++m_size;
+    }
+
+    void
+    pop()
+    {
+      --m_size;
+
+      if (m_size >= INLINE_SIZE)
+      {
+        m_spill.pop_back();
+      }
+    }
+
+    value_type
+    top() const
+    {
+      return entry(m_size - 1).value;
+    }
+
+    //change the innermost entry
+    void
+    setTop(value_type v)
+    {
+      entry(m_size - 1) = Entry{v, combine(prefixHash(m_size - 1), v)};
+    }
+
+    size_t
+    size() const
+    {
+      return m_size;
+    }
+
+    value_type
+    operator[](size_t i) const
+    {
+      return entry(i).value;
+    }
+
+    size_t
+    hash() const
+    {
+      return prefixHash(m_size);
+    }
+
+    bool
+    operator==(const RhoPath& rhs) const
+    {
+      if (m_size != rhs.m_size || hash() != rhs.hash())
+      {
+        return false;
+      }
+
+      for (size_t i = 0; i != m_size; ++i)
+      {
+        if (entry(i).value != rhs.entry(i).value)
+        {
+          return false;
+        }
+      }
+
+      return true;
+    }
+
+    bool
+    operator!=(const RhoPath& rhs) const
+    {
+      return !(*this == rhs);
+    }
+
+    private:
+    struct Entry
+    {
+      value_type value;
+
+      //the hash of the path up to and including this entry
+      size_t hash;
+    };
+
+    static constexpr size_t INLINE_SIZE = 16;
+
+    static size_t
+    combine(size_t seed, value_type v)
+    {
+      seed ^= size_t(v) + 0x9e3779b9 + (seed<<6) + (seed>>2);
+      return seed;
+    }
+
+    void
+    copyInline(const RhoPath& other)
+    {
+      for (size_t i = 0; i != m_size && i != INLINE_SIZE; ++i)
+      {
+        m_inline[i] = other.m_inline[i];
+      }
+    }
+
+    //the hash of the first n entries
+    size_t
+    prefixHash(size_t n) const
+    {
+      return n == 0 ? 0 : entry(n - 1).hash;
+    }
+
+    Entry&
+    entry(size_t i)
+    {
+      return i < INLINE_SIZE ? m_inline[i] : m_spill[i - INLINE_SIZE];
+    }
+
+    const Entry&
+    entry(size_t i) const
+    {
+      return i < INLINE_SIZE ? m_inline[i] : m_spill[i - INLINE_SIZE];
+    }
+
+    size_t m_size;
+    Entry m_inline[INLINE_SIZE];
+    std::vector<Entry> m_spill;
+  };
+}
+
+#endif
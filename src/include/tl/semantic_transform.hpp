@@ -100,6 +100,10 @@ namespace TransLucid
     ScopePtr
     makeScope() const;
 
+    //transforms MakeIntenExpr(e)
+    Tree::Expr
+    transformIntension(const Tree::Expr& e);
+
     //open a new scope, possibly shadowing another
     u32string
     pushScope(const u32string& id);
@@ -29,11 +29,13 @@ along with TransLucid; see the file COPYING.  If not see
 #include <tl/cache.hpp>
 #include <tl/chi.hpp>
 #include <tl/datadef.hpp>
+#include <tl/demand_trace.hpp>
 #include <tl/dimtranslator.hpp>
 #include <tl/types.hpp>
 #include <tl/equation.hpp>
 #include <tl/function.hpp>
 #include <tl/hyperdaton.hpp>
+#include <tl/instant_dependencies.hpp>
 #include <tl/opdef.hpp>
 #include <tl/parser_api.hpp>
 #include <tl/parser_iterator.hpp>
@@ -42,6 +44,7 @@ along with TransLucid; see the file COPYING.  If not see
 #include <tl/system_object.hpp>
 #include <tl/trie.hpp>
 
+#include <mutex>
 #include <unordered_set>
 #include <unordered_map>
 
@@ -264,6 +267,26 @@ namespace TransLucid
     void
     go();
 
+    /**
+     * Forget the definitions of variables and functions that are only
+     * valid before @a time, and what was compiled from them. Use this when
+     * nothing will demand those times again, for example to keep a long
+     * interactive session small.
+     */
+    void
+    discardHistory(size_t time);
+
+    /**
+     * After each instant, discard the history before the last @a instants
+     * instants. Zero, the default, keeps everything, because an expression
+     * can ask for any time.
+     */
+    void
+    keepHistory(size_t instants)
+    {
+      m_history = instants;
+    }
+
     void
     addEnvVars();
 
@@ -297,6 +320,46 @@ namespace TransLucid
     bool
     cacheEnabled() const;
 
+    //compute pointwise arithmetic assignments in bulk
+    void
+    enableBulkKernels(bool enable = true)
+    {
+      m_bulkKernels = enable;
+    }
+
+    //compile everything that has changed at the start of each instant,
+    //instead of when it is first demanded
+    void
+    enableEagerCompile(bool enable = true)
+    {
+      m_eagerCompile = enable;
+    }
+
+    /**
+     * Record the demands for cached variables, keeping the last
+     * @a capacity of them.
+     */
+    void
+    enableDemandTrace(size_t capacity)
+    {
+      m_demandTrace.reset(new DemandTrace(capacity));
+    }
+
+    //the demands that are being recorded, or nullptr if they aren't
+    DemandTrace*
+    demandTrace()
+    {
+      return m_demandTrace.get();
+    }
+
+    /**
+     * Compile every variable and function that has definitions which
+     * haven't been compiled yet.
+     * @return The number of variables and functions compiled.
+     */
+    size_t
+    compileAll();
+
     Tree::Expr
     fixupTreeAndAdd(const Tree::Expr& e, ScopePtr scope = ScopePtr());
 
@@ -378,6 +441,16 @@ namespace TransLucid
     void
     setDefaultContext();
 
+    void
+    markChanged(const u32string& name);
+
+    //marks the identifier that the declaration id belongs to
+    void
+    markDeclarationChanged(const uuid& id);
+
+    void
+    markAllChanged();
+
     template <typename... Renames>
     Tree::Expr
     toWSTreePlusExtras(const Tree::Expr& e, TreeToWSTree& tows,
@@ -386,6 +459,30 @@ namespace TransLucid
     //bool m_cached;
     bool m_cacheEnabled;
     bool m_simplified;
+    bool m_bulkKernels;
+    bool m_eagerCompile;
+
+    //the number of instants of definitions to keep, 0 keeps all of them
+    size_t m_history;
+
+    std::unique_ptr<DemandTrace> m_demandTrace;
+
+    //what has changed in this instant, so that go() only recomputes the
+    //assignments that depend on it
+    bool m_allChanged;
+    std::unordered_set<u32string> m_changedIdentifiers;
+
+    //the identifier that each declaration defines
+    UUIDStringMap m_declarationNames;
+    std::unordered_map<u32string, InstantDependencies::Result>
+      m_identifierDependencies;
+
+    //the dimensions that each identifier can look at, these include what
+    //the identifiers that they use look at, so a change anywhere throws
+    //them all away
+    std::unordered_map<u32string, std::vector<dimension_index>>
+      m_identifierDimensions;
+    size_t m_dimensionalityGeneration;
 
     ObjectMap m_objects;
     IdentifierMap m_identifiers;
@@ -458,6 +555,10 @@ namespace TransLucid
 
     Parser::Parser* m_parser;
 
+    //held while the parser evaluates in the system, so that declarations
+    //can be parsed by more than one thread
+    std::recursive_mutex m_parseLock;
+
     ChiMap m_chiMap;
 
     static GettextInit m_gettext;
@@ -504,6 +605,41 @@ namespace TransLucid
     Constant
     addDeclaration(const Parser::RawInput& input);
 
+    /**
+     * Adds a declaration that parseDeclarations has already parsed.
+     * @param input The text of the declaration.
+     * @param parsed The parsed declaration, or null if it wasn't parsed,
+     * in which case @a input is added like any other.
+     */
+    Constant
+    addDeclaration
+    (
+      const Parser::RawInput& input,
+      const std::shared_ptr<Parser::Line>& parsed
+    );
+
+    /**
+     * Can the declaration be parsed ahead of the ones before it. Only var
+     * and fun declarations can be, everything else could change how the
+     * declarations after it are parsed.
+     */
+    bool
+    independentDeclaration(const Parser::RawInput& input);
+
+    /**
+     * Parse independent declarations concurrently. Nothing is added to
+     * the system, the results are added in order with addDeclaration.
+     * @param inputs Declarations for which independentDeclaration is true.
+     * @param threads The most threads to parse with.
+     * @return The parsed declarations, null for any that didn't parse.
+     */
+    std::vector<std::shared_ptr<Parser::Line>>
+    parseDeclarations
+    (
+      const std::vector<Parser::RawInput>& inputs,
+      size_t threads
+    );
+
     Constant
     addOpDeclRaw
     (
@@ -558,6 +694,13 @@ namespace TransLucid
       Parser::LexerIterator& iter
     );
 
+    Constant
+    addAssignmentRaw
+    (
+      const Parser::RawInput& input, 
+      Parser::LexerIterator& iter
+    );
+
     Constant
     delDecl
     (
@@ -601,15 +744,18 @@ namespace TransLucid
       IdentifierLookup
       (
         IdentifierMap& identifiers,
-        decltype(m_cachedVars)& cached
+        decltype(m_cachedVars)& cached,
+        std::recursive_mutex& lock
       )
       : m_identifiers(&identifiers),
-        m_cached(&cached)
+        m_cached(&cached),
+        m_lock(&lock)
       {
       }
 
       IdentifierLookup()
       : m_identifiers(nullptr)
+      , m_lock(nullptr)
       {}
       
       operator bool() const
@@ -620,19 +766,75 @@ namespace TransLucid
       WS*
       lookup(const u32string& name) const;
 
+      /**
+       * Lock the system for an evaluation. Anything that looks up and
+       * evaluates identifiers while parsing must hold this.
+       */
+      std::unique_lock<std::recursive_mutex>
+      lockEvaluation() const
+      {
+        if (m_lock == nullptr)
+        {
+          return std::unique_lock<std::recursive_mutex>();
+        }
+
+        return std::unique_lock<std::recursive_mutex>(*m_lock);
+      }
+
       private:
       IdentifierMap* m_identifiers;
       decltype(m_cachedVars)* m_cached;
+      std::recursive_mutex* m_lock;
     };
 
     IdentifierLookup lookupIdentifiers()
     {
-      return IdentifierLookup(m_identifiers, m_cachedVars);
+      return IdentifierLookup(m_identifiers, m_cachedVars, m_parseLock);
     }
 
     Tree::Expr
     getIdentifierTree(const u32string& x);
 
+    /**
+     * The current declarations of the function @a x, empty if there is
+     * no function called @a x.
+     */
+    std::vector<Parser::FnDecl>
+    getFunctionDefinitions(const u32string& x);
+
+    /**
+     * Has the definition of x changed since the last instant.
+     */
+    bool
+    identifierChanged(const u32string& x) const
+    {
+      return m_allChanged ||
+        m_changedIdentifiers.find(x) != m_changedIdentifiers.end();
+    }
+
+    /**
+     * The identifiers that the definition of x refers to directly, and
+     * whether it looks at the time.
+     */
+    const InstantDependencies::Result&
+    getIdentifierDependencies(const u32string& x);
+
+    /**
+     * The dimensions that x can look at, as far as can be found without
+     * evaluating it. These are only a hint, x can still demand others.
+     */
+    const std::vector<dimension_index>&
+    getIdentifierDimensions(const u32string& x);
+
+    /**
+     * Changes every time that the identifier dimensions might change.
+     */
+    size_t
+    dimensionalityGeneration() const
+    {
+      return m_dimensionalityGeneration;
+    }
+
     //template <size_t N>
     //auto
     //lookupFunction(const u32string& name)
@@ -0,0 +1,113 @@
+/* Evaluation on a copy-on-write copy of a system.
+   Copyright (C) 2013 Jarryd Beck
+
+This file is part of TransLucid.
+
+TransLucid is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+TransLucid is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with TransLucid; see the file COPYING.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+/**
+ * @file system_fork.hpp
+ * What-if evaluation. The workshops of a system all refer back to it, so
+ * a system can't be copied in place. Instead the copy is a forked child
+ * process: it starts out sharing everything that the system has built,
+ * the compiled definitions, the registries, the caches and the contents
+ * of the hyperdatons, and a page is only copied when one side changes
+ * it. Whatever the copy does is thrown away with it.
+ */
+
+#ifndef TL_SYSTEM_FORK_HPP_INCLUDED
+#define TL_SYSTEM_FORK_HPP_INCLUDED
+
+#include <tl/exception.hpp>
+
+#include <functional>
+#include <string>
+
+#include <sys/types.h>
+
+namespace TransLucid
+{
+  class System;
+
+  class SystemForkError : public Exception
+  {
+    public:
+    SystemForkError(const std::string& m)
+    : message(m)
+    {
+    }
+
+    ~SystemForkError() throw()
+    {
+    }
+
+    const char*
+    what() const throw()
+    {
+      return message.c_str();
+    }
+
+    private:
+    std::string message;
+  };
+
+  /**
+   * Fork a child process that runs @a child and exits with the code that
+   * it returns, without cleaning up anything that the parent owns. Output
+   * that is still buffered is flushed first so that it isn't written
+   * twice.
+   * @return The pid of the child.
+   * @throw SystemForkError If the process couldn't be forked.
+   */
+  pid_t
+  forkChild(const std::function<int()>& child);
+
+  /**
+   * Wait for the child @a pid to finish, or for any child if it is -1. A
+   * wait interrupted by a signal is started again, unless @a stop is given
+   * and returns true.
+   * @param status Set to the wait status of the child.
+   * @param block If false, return straight away when nothing has finished.
+   * @return The pid of the child that finished, 0 if @a block is false and
+   * nothing has finished, or -1 if there is nothing to wait for or it was
+   * stopped.
+   */
+  pid_t
+  waitChild
+  (
+    pid_t pid,
+    int& status,
+    bool block = true,
+    const std::function<bool()>& stop = std::function<bool()>()
+  );
+
+  /**
+   * Describe how a child finished from its wait status, empty if it exited
+   * normally with zero.
+   */
+  std::string
+  describeExit(int status);
+
+  /**
+   * Run @a f on a copy of @a system, and return what it returns. No other
+   * thread can be using the system while the copy is made.
+   * @throw SystemForkError If the copy couldn't be made, or @a f didn't
+   * return.
+   */
+  u32string
+  forkEvaluate(System& system, const std::function<u32string(System&)>& f);
+}
+
+#endif
@@ -20,7 +20,9 @@ along with TransLucid; see the file COPYING.  If not see
 #ifndef TL_TYINF_CONSTRAINT_GRAPH_HPP_INCLUDED
 #define TL_TYINF_CONSTRAINT_GRAPH_HPP_INCLUDED
 
+#include <deque>
 #include <map>
+#include <memory>
 #include <queue>
 #include <vector>
 
@@ -63,16 +65,15 @@ namespace TransLucid
     //1. a list of <= type variables
     //2. the set of constraints in C\uparrow(alpha)
     //3. the set of constraints in C\downarrow(alpha)
+    //the nodes are numbered densely in the order that they are added, and
+    //the variables are kept in a sorted vector that maps them to their
+    //numbers. Type schemes are copied far more often than their graphs
+    //are changed, so copies share their contents until one of them
+    //changes.
     class ConstraintGraph
     {
       public:
 
-      ConstraintGraph() = default;
-      ConstraintGraph(const ConstraintGraph&);
-
-      ConstraintGraph&
-      operator=(const ConstraintGraph& rhs);
-
       //Makes a union with another constraint graph.
       //The type variables must be disjoint.
       //The current one becomes the result.
@@ -96,40 +97,13 @@ namespace TransLucid
       lower(TypeVariable b) const;
 
       void
-      erase_var(TypeVariable a)
-      {
-        m_graph.erase(a);
-      }
-
-      std::vector<TypeVariable>
-      predecessor(TypeVariable a) const
-      {
-        auto iter = m_graph.find(a);
-
-        if (iter != m_graph.end())
-        {
-          return iter->second.less;
-        }
-        else
-        {
-          return {};
-        }
-      }
+      erase_var(TypeVariable a);
 
-      std::vector<TypeVariable>
-      successor(TypeVariable a) const
-      {
-        auto iter = m_graph.find(a);
+      const std::vector<TypeVariable>&
+      predecessor(TypeVariable a) const;
 
-        if (iter != m_graph.end())
-        {
-          return iter->second.greater;
-        }
-        else
-        {
-          return {};
-        }
-      }
+      const std::vector<TypeVariable>&
+      successor(TypeVariable a) const;
 
       //is a < b in this graph?
       bool
@@ -163,7 +137,7 @@ namespace TransLucid
         const std::vector<TypeVariable>& succ
       )
       {
-        m_graph[v] = ConstraintNode
+        get_make_entry(v).second = ConstraintNode
           {
             pred, succ, lower, upper
           };
@@ -173,8 +147,15 @@ namespace TransLucid
       void
       rewrite_bounds(Lower rl, Upper ru)
       {
-        for (auto& c : m_graph)
+        if (!m_data)
         {
+          return;
+        }
+
+        Data& d = modify();
+        for (const auto& i : d.index)
+        {
+          auto& c = d.nodes[i.second];
           c.second.lower = rl(c.second.lower);
           c.second.upper = ru(c.second.upper);
         }
@@ -187,34 +168,41 @@ namespace TransLucid
       {
         ConstraintGraph result;
 
+        if (!C.m_data)
+        {
+          return result;
+        }
+
+        Data& data = result.modify();
+
         std::map<ConditionalNode*, ConditionalNode*> noderewrites;
 
         //go through the domain and rename everything first, then add
         //things later, this makes it deterministic
-        for (const auto& v : C.m_graph)
-        {
-          auto r = rewrite.rename_var(v.first);
-          result.m_graph[r] = ConstraintNode();
-        }
+        C.for_each_entry([&] (const Entry& v)
+          {
+            result.get_make_entry(rewrite.rename_var(v.first));
+          }
+        );
 
         //rewrite the conditional constraints
-        for (auto ccn : C.m_conditionals)
+        for (auto ccn : C.m_data->conditionals)
         {
           std::unique_ptr<ConditionalNode> p(new ConditionalNode(
             ccn->s, 
             rewrite.rename_var(ccn->lhs),
             rewrite.rename_var(ccn->rhs),
-            &result
+            &data
           ));
 
-          result.m_conditionals.insert(p.get());
+          data.conditionals.insert(p.get());
           
           noderewrites[ccn] = p.get();
 
           p.release();
         }
 
-        for (const auto& v : C.m_graph)
+        C.for_each_entry([&] (const Entry& v)
         {
           ConstraintNode node;
 
@@ -240,8 +228,8 @@ namespace TransLucid
             node.conditions.insert(CondNodeP(rewritten));
           }
 
-          result.m_graph[r] = node;
-        }
+          result.get_make_entry(r).second = std::move(node);
+        });
 
         return result;
       }
@@ -264,33 +252,33 @@ namespace TransLucid
       void
       for_each_lower_if(F f, Cond c) const
       {
-        for (const auto& v : m_graph)
+        for_each_entry([&] (const Entry& v)
         {
           if (c(v))
           {
             f(v.second.lower);
           }
-        }
+        });
       }
 
       template <typename F, typename Cond>
       void
       for_each_upper_if(F f, Cond c) const
       {
-        for (const auto& v : m_graph)
+        for_each_entry([&] (const Entry& v)
         {
           if (c(v))
           {
             f(v.second.upper);
           }
-        }
+        });
       }
 
       template <typename F, typename Cond>
       void
       for_each_condition_if(F f, Cond c) const
       {
-        for (const auto& v : m_graph)
+        for_each_entry([&] (const Entry& v)
         {
           if (c(v))
           {
@@ -306,7 +294,7 @@ namespace TransLucid
 
             f(result);
           }
-        }
+        });
       }
 
       std::vector<TypeVariable>
@@ -314,9 +302,13 @@ namespace TransLucid
       {
         std::vector<TypeVariable> d;
 
-        for (const auto& v : m_graph)
+        if (m_data)
         {
-          d.push_back(v.first);
+          d.reserve(m_data->index.size());
+          for (const auto& i : m_data->index)
+          {
+            d.push_back(i.first);
+          }
         }
 
         return d;
@@ -341,6 +333,8 @@ namespace TransLucid
       private:
 
       typedef std::queue<Constraint> ConstraintQueue;
+
+      struct Data;
       
       struct ConditionalNode
       {
@@ -349,7 +343,7 @@ namespace TransLucid
           Type s, 
           TypeVariable lhs, 
           TypeVariable rhs,
-          ConstraintGraph* owner
+          Data* owner
         )
         : s(s)
         , lhs(lhs)
@@ -363,7 +357,7 @@ namespace TransLucid
         TypeVariable rhs;
 
         int counter = 0;
-        ConstraintGraph *m_owner;
+        Data *m_owner;
       };
 
       friend void intrusive_ptr_add_ref(ConditionalNode*);
@@ -420,8 +414,60 @@ namespace TransLucid
         std::set<CondNodeP> conditions;
       };
 
+      typedef std::pair<TypeVariable, ConstraintNode> Entry;
+
+      struct Data
+      {
+        Data() = default;
+        Data(const Data&) = delete;
+
+        //this has to go before the nodes, which remove themselves from it
+        std::set<ConditionalNode*> conditionals;
+
+        //a node doesn't move once it is added, so entries can be held on
+        //to while the graph grows
+        std::deque<Entry> nodes;
+
+        //the variables in order, and the number of each one's node
+        std::vector<std::pair<TypeVariable, size_t>> index;
+      };
+
+      //the contents, which can be shared with other graphs, or null for
+      //an empty graph
+      std::shared_ptr<Data> m_data;
+
+      //the contents to change, copied first if they are shared
+      Data&
+      modify();
+
+      //copies the nodes of from that aren't in to
+      static void
+      copy_contents(const Data& from, Data& to);
+
+      const Entry*
+      find(TypeVariable a) const;
+
+      Entry&
+      get_make_entry(TypeVariable a);
+
+      //visits the entries in the order of their variables
+      template <typename F>
       void
-      copy_contents(const ConstraintGraph& other);
+      for_each_entry(F f) const
+      {
+        if (m_data)
+        {
+          for (const auto& i : m_data->index)
+          {
+            f(m_data->nodes[i.second]);
+          }
+        }
+      }
+
+      //the variable after a in the graph, as iterating through a map 
+      //would find it, so that the graph can change in between
+      bool
+      next_var(TypeVariable a, TypeVariable& next) const;
 
       void
       add_constraint(TypeVariable a, TypeVariable b, ConstraintQueue&);
@@ -438,26 +484,20 @@ namespace TransLucid
       void
       add_less_closed(TypeVariable a, TypeVariable b);
 
-      std::set<ConditionalNode*> m_conditionals;
-      std::map<TypeVariable, ConstraintNode> m_graph;
-
-      decltype(m_graph)::iterator
-      get_make_entry(TypeVariable a);
-
       void
-      new_lower_closed(decltype(m_graph)::iterator var, Type bound)
+      new_lower_closed(Entry& var, Type bound)
       {
-        var->second.lower = bound;
+        var.second.lower = bound;
         check_conditionals(var);
       }
 
       void
-      check_conditionals(decltype(m_graph)::iterator var);
+      check_conditionals(Entry& var);
 
       void
       check_single_conditional
       (
-        decltype(m_graph)::iterator var,
+        Entry& var,
         const CondNodeP& cc
       );
 
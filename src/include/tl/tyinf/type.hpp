@@ -20,6 +20,7 @@ along with TransLucid; see the file COPYING.  If not see
 #ifndef TL_TYINF_TYPE_HPP_INCLUDED
 #define TL_TYINF_TYPE_HPP_INCLUDED
 
+#include <atomic>
 #include <vector>
 
 #include <tl/types.hpp>
@@ -142,11 +143,6 @@ namespace TransLucid
       static
       TypeAtomicUnion
       intersection(const TypeAtomicUnion& a, const TypeAtomicUnion& b);
-
-      private:
-
-      std::map<type_index, std::vector<decltype(constants)::iterator>> 
-        atomic_map;
     };
 
     typedef std::set<TypeVariable> VarSet;
@@ -222,6 +218,8 @@ namespace TransLucid
       TypeVariable record;
     };
 
+    //the recursion groups of a system can be inferred by several threads,
+    //which all draw from the same variables
     class FreshTypeVars
     {
       public:
@@ -239,7 +237,7 @@ namespace TransLucid
       size_t
       fresh()
       {
-        return m_var++;
+        return m_var.fetch_add(1, std::memory_order_relaxed);
       }
 
       size_t
@@ -249,7 +247,7 @@ namespace TransLucid
       }
 
       private:
-      size_t m_var;
+      std::atomic<size_t> m_var;
     };
 
     //constructs and normalises
@@ -26,6 +26,8 @@ along with TransLucid; see the file COPYING.  If not see
 #include <tl/tyinf/type_context.hpp>
 #include <tl/tyinf/type_variable.hpp>
 
+#include <mutex>
+
 namespace TransLucid
 {
   class TypeRegistry;
@@ -42,12 +44,7 @@ namespace TransLucid
       public:
       typedef TypeScheme result_type;
 
-      TypeInferrer(System& system, FreshTypeVars& freshVars)
-      : m_freshVars(freshVars)
-      , m_system(system)
-      , indecl(false)
-      {
-      }
+      TypeInferrer(System& system, FreshTypeVars& freshVars);
 
       TypeVariable
       fresh()
@@ -55,9 +52,31 @@ namespace TransLucid
         return m_freshVars.fresh();
       }
 
+      /**
+       * Infer the types of @a ids and everything that they use. The
+       * identifiers that already have a type are left alone.
+       */
       void
       infer_system(const std::set<u32string>& ids);
 
+      /**
+       * Forget the types of the identifiers whose definitions have changed
+       * in this instant, and of everything that uses them, so that the
+       * next infer_system only infers those again.
+       */
+      void
+      invalidate_changed();
+
+      /**
+       * Let infer_system use up to @a n threads. Recursion groups that
+       * don't depend on each other are inferred at the same time.
+       */
+      void
+      setThreads(size_t n)
+      {
+        m_threads = n;
+      }
+
       result_type
       infer(const Tree::Expr& e);
 
@@ -169,8 +188,34 @@ namespace TransLucid
 
       private:
 
+      typedef std::vector<std::pair<u32string, TypeScheme>> GroupTypes;
+
+      //a worker that infers one recursion group for @a parent, it looks up
+      //the groups that have finished in the parent's environment
+      TypeInferrer(TypeInferrer* parent);
+
+      //the groups in an order that they can be inferred in, and for each
+      //group, the groups that it uses
       std::vector<std::vector<u32string>>
-      generate_recurse_groups(const std::set<u32string>& ids);
+      generate_recurse_groups(const std::set<u32string>& ids,
+        std::vector<std::vector<size_t>>& depends);
+
+      GroupTypes
+      infer_group(const std::vector<u32string>& group);
+
+      void
+      infer_parallel
+      (
+        const std::vector<std::vector<u32string>>& groups,
+        const std::vector<std::vector<size_t>>& depends
+      );
+
+      const TypeScheme*
+      find_scheme(const u32string& x);
+
+      //the system is shared by all of the workers
+      std::unique_lock<std::mutex>
+      lock_system();
 
       TypeScheme
       simplify(TypeScheme t);
@@ -193,6 +238,19 @@ namespace TransLucid
       bool indecl;
 
       std::map<u32string, TypeScheme> m_environment;
+
+      //the identifiers that each inferred identifier uses directly
+      std::map<u32string, std::set<u32string>> m_uses;
+
+      TypeInferrer* m_parent;
+      size_t m_threads;
+
+      //looked up before there are any workers, so that they don't go to
+      //the type registry
+      TypeAtomic m_bool;
+
+      //guards the environment and the system while there are workers
+      std::mutex m_mutex;
     };
 
     TypeAtomic
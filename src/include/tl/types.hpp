@@ -20,6 +20,7 @@ along with TransLucid; see the file COPYING.  If not see
 #ifndef TYPES_HPP_INCLUDED
 #define TYPES_HPP_INCLUDED
 
+#include <atomic>
 #include <map>
 #include <memory>
 #include <cstdint>
@@ -27,6 +28,7 @@ along with TransLucid; see the file COPYING.  If not see
 #include <set>
 #include <string>
 
+#include <tl/constant_pool.hpp>
 #include <tl/types_fwd.hpp>
 #include <tl/types_basic.hpp>
 
@@ -73,12 +75,17 @@ namespace TransLucid
     size_t (*hash)(const Constant&);
     void (*destroy)(void*);
     bool (*less)(const Constant&, const Constant&);
+
+    //only runs the destructor, for values that share a pooled block with
+    //their ConstantPointerValue, nullptr if the type can't be pooled
+    void (*destruct)(void*);
   };
 
   struct ConstantPointerValue
   {
-    ConstantPointerValue(TypeFunctions* f, void* d)
+    ConstantPointerValue(TypeFunctions* f, void* d, uint32_t size = 0)
     : refCount(1)
+    , size(size)
     , functions(f)
     , data(d)
     {
@@ -92,11 +99,59 @@ namespace TransLucid
       data = nullptr;
     }
 
-    int refCount;
+    //only changed with read-modify-write instructions while there is a
+    //SharedConstants, otherwise it is read and written plainly
+    std::atomic<int> refCount;
+
+    //the size of the pooled block that holds this and the data, or zero
+    //if they were both allocated with new
+    uint32_t size;
+
     TypeFunctions* functions;
     void* data;
   };
 
+  namespace detail
+  {
+    //the number of SharedConstants that exist
+    extern std::atomic<int> constant_sharers;
+
+    inline bool
+    constants_shared()
+    {
+      return constant_sharers.load(std::memory_order_relaxed) != 0;
+    }
+  }
+
+  /**
+   * While one of these exists, constants can be copied and destroyed by
+   * more than one thread at once. Without one, reference counts are
+   * changed without atomic read-modify-write instructions, so a constant
+   * can only be handed to another thread where the two threads
+   * synchronise, such as when a thread starts or is joined.
+   *
+   * Make one before starting threads that use constants and destroy it
+   * after they have been joined.
+   */
+  class SharedConstants
+  {
+    public:
+    SharedConstants()
+    {
+      detail::constant_sharers.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    ~SharedConstants()
+    {
+      detail::constant_sharers.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    SharedConstants(const SharedConstants&) = delete;
+
+    SharedConstants&
+    operator=(const SharedConstants&) = delete;
+  };
+
   enum TypeField
   {
     TYPE_FIELD_ERROR, //not a value, don't read any field
@@ -283,15 +338,33 @@ namespace TransLucid
     void
     removeReference()
     {
+      auto& count = data.ptr->refCount;
+      int current = count.load(std::memory_order_relaxed);
+
       //it might have already been released
-      if (data.ptr->refCount != 0)
+      if (current != 0)
       {
-        --data.ptr->refCount;
+        if (detail::constants_shared())
+        {
+          current = count.fetch_sub(1, std::memory_order_acq_rel);
+        }
+        else
+        {
+          count.store(current - 1, std::memory_order_relaxed);
+        }
 
-        if (data.ptr->refCount == 0)
+        if (current == 1)
         {
-          (*data.ptr->functions->destroy)(data.ptr->data);
-          delete data.ptr;
+          if (data.ptr->size == 0)
+          {
+            (*data.ptr->functions->destroy)(data.ptr->data);
+            delete data.ptr;
+          }
+          else
+          {
+            (*data.ptr->functions->destruct)(data.ptr->data);
+            ConstantPool::deallocate(data.ptr, data.ptr->size);
+          }
           data.ptr = nullptr;
         }
       }
@@ -305,7 +378,17 @@ namespace TransLucid
     void 
     increaseReference()
     {
-      ++data.ptr->refCount;
+      auto& count = data.ptr->refCount;
+
+      if (detail::constants_shared())
+      {
+        count.fetch_add(1, std::memory_order_relaxed);
+      }
+      else
+      {
+        count.store(count.load(std::memory_order_relaxed) + 1,
+          std::memory_order_relaxed);
+      }
     }
 
     void
@@ -354,6 +437,14 @@ namespace TransLucid
       return m_delta.erase(d);
     }
 
+    //true if every dimension is contained, then only the dimensions that
+    //have been changed are listed
+    bool
+    all() const
+    {
+      return m_all;
+    }
+
     bool
     contains(dimension_index d) const
     {
@@ -20,6 +20,7 @@ along with TransLucid; see the file COPYING.  If not see
 #ifndef TYPES_FUNCTION_HPP_INCLUDED
 #define TYPES_FUNCTION_HPP_INCLUDED
 
+#include <tl/closure_cache.hpp>
 #include <tl/context.hpp>
 #include <tl/fixed_indexes.hpp>
 #include <tl/system.hpp>
@@ -31,6 +32,19 @@ along with TransLucid; see the file COPYING.  If not see
 
 namespace TransLucid
 {
+  /**
+   * Find the ordinates that an abstraction binds. These are the evaluated
+   * dimensions in @a binds, then the dimensions in @a scope, then rho.
+   */
+  ClosureCache::Bindings
+  bindAbstraction
+  (
+    System* system,
+    const std::vector<WS*>& binds,
+    const std::vector<dimension_index>& scope,
+    Context& k
+  );
+
   class BaseFunctionType
   {
     public:
@@ -126,6 +140,7 @@ namespace TransLucid
       Context& k
     )
     : m_dims(dims)
+    , m_binds(bindAbstraction(system, binds, scope, k))
     , m_expr(expr)
     {
       if (m_expr == nullptr)
@@ -133,32 +148,22 @@ namespace TransLucid
         std::cerr << "base function built with nullptr body" << std::endl;
       }
 
-      RhoManager rho(k);
-      uint8_t index = 1;
-      for (auto ws : binds)
-      {
-        rho.changeTop(index);
-        auto c = (*ws)(k);
-        auto d = system->getDimensionIndex(c); 
-
-        m_binds.push_back(std::make_pair(d, k.lookup(d)));
-
-        ++index;
-      }
-
-      //std::cerr << "binding in function:" << std::endl;
-      for (auto d : scope)
-      {
-        //std::cerr << d << " ";
-        m_binds.push_back(std::make_pair(d, k.lookup(d)));
-      }
-      //std::cerr << std::endl;
-
-      //hold on to rho
-      m_binds.push_back(std::make_pair(DIM_RHO, k.lookup(DIM_RHO)));
       m_binds.push_back(std::make_pair(DIM_TIME, k.lookup(DIM_TIME)));
     }
 
+    //the bindings have already been found
+    BaseFunctionAbstraction
+    (
+      const std::vector<dimension_index>& dims,
+      const ClosureCache::Bindings& binds,
+      WS* expr
+    )
+    : m_dims(dims)
+    , m_binds(binds)
+    , m_expr(expr)
+    {
+    }
+
     BaseFunctionAbstraction
     (
       const std::vector<dimension_index>& dims,
@@ -453,30 +458,25 @@ namespace TransLucid
       Context& k
     )
     : m_system(system), m_name(name), m_dim(argDim), m_expr(expr)
+    , m_binds(bindAbstraction(system, binds, scope, k))
     {
-      RhoManager rho(k);
-      uint8_t index = 1;
-      for (auto ws : binds)
-      {
-        rho.changeTop(index);
-        auto c = (*ws)(k);
-        auto d = system->getDimensionIndex(c); 
-
-        m_binds.push_back(std::make_pair(d, k.lookup(d)));
-
-        ++index;
-      }
-
-      //std::cerr << "binding in function:" << std::endl;
-      for (auto d : scope)
-      {
-        //std::cerr << d << " ";
-        m_binds.push_back(std::make_pair(d, k.lookup(d)));
-      }
-      //std::cerr << std::endl;
+    }
 
-      //hold on to rho
-      m_binds.push_back(std::make_pair(DIM_RHO, k.lookup(DIM_RHO)));
+    //the bindings have already been found
+    ValueFunctionType
+    (
+      System* system,
+      const u32string& name, 
+      dimension_index argDim, 
+      WS* expr,
+      const ClosureCache::Bindings& binds
+    )
+    : m_system(system)
+    , m_name(name)
+    , m_dim(argDim)
+    , m_expr(expr)
+    , m_binds(binds)
+    {
     }
 
     ValueFunctionType
@@ -550,7 +550,8 @@ namespace TransLucid
     WS* expr,
     const std::vector<WS*>& binds,
     const std::vector<dimension_index>& scope,
-    Context& kappa
+    Context& kappa,
+    ClosureCache& closures
   );
 
   //check for scope dimensions
@@ -579,7 +580,8 @@ namespace TransLucid
     Context& kappa,
     Delta& delta,
     const Thread& w, 
-    size_t t
+    size_t t,
+    ClosureCache& closures
   );
 
   namespace Types
@@ -22,6 +22,9 @@ along with TransLucid; see the file COPYING.  If not see
 
 #include <tl/types.hpp>
 
+#include <new>
+#include <type_traits>
+
 namespace TransLucid
 {
   template <typename T>
@@ -31,15 +34,86 @@ namespace TransLucid
     delete reinterpret_cast<T*>(p);
   }
 
+  template <typename T>
+  void
+  destruct_ptr(void* p)
+  {
+    reinterpret_cast<T*>(p)->~T();
+  }
+
+  /**
+   * Construct a boxed constant in place. The ConstantPointerValue and the
+   * value are put in one block from the constant pool, so funs->destruct
+   * must be destruct_ptr<T>.
+   */
+  template <typename T, typename... Args>
+  Constant
+  emplace_constant_pointer(TypeFunctions* funs, type_index index,
+    Args&&... args)
+  {
+    static_assert(alignof(T) <= ConstantPool::ALIGNMENT,
+      "constant is over aligned for the pool");
+
+    constexpr size_t offset = (sizeof(ConstantPointerValue) + alignof(T) - 1)
+      / alignof(T) * alignof(T);
+    constexpr size_t size = offset + sizeof(T);
+
+    char* block = static_cast<char*>(ConstantPool::allocate(size));
+
+    T* value;
+    try
+    {
+      value = new (block + offset) T(std::forward<Args>(args)...);
+    }
+    catch (...)
+    {
+      ConstantPool::deallocate(block, size);
+      throw;
+    }
+
+    return Constant(new (block) ConstantPointerValue(funs, value, size),
+      index);
+  }
+
+  namespace detail
+  {
+    //polymorphic values copy themselves with clone, so they can't be put
+    //in the pool
+    template <typename T, bool Pooled = !std::is_polymorphic<T>::value>
+    struct make_constant_pointer
+    {
+      Constant
+      operator()(const T& v, TypeFunctions* funs, type_index index)
+      {
+        if (funs->destruct != nullptr)
+        {
+          return emplace_constant_pointer<T>(funs, index, v);
+        }
+
+        return make_constant_pointer<T, false>()(v, funs, index);
+      }
+    };
+
+    template <typename T>
+    struct make_constant_pointer<T, false>
+    {
+      Constant
+      operator()(const T& v, TypeFunctions* funs, type_index index)
+      {
+        std::unique_ptr<T> value(clone<T>()(v));
+        ConstantPointerValue* p = 
+          new ConstantPointerValue(funs, value.get());
+        value.release();
+        return Constant(p, index);
+      }
+    };
+  }
+
   template <typename T>
   Constant
   make_constant_pointer(const T& v, TypeFunctions* funs, type_index index)
   {
-    std::unique_ptr<T> value(detail::clone<T>()(v));
-    ConstantPointerValue* p = 
-      new ConstantPointerValue(funs, value.get());
-    value.release();
-    return Constant(p, index);
+    return detail::make_constant_pointer<T>()(v, funs, index);
   }
 
   template <typename T>
@@ -26,8 +26,33 @@ along with TransLucid; see the file COPYING.  If not see
 
 namespace TransLucid
 {
+  class EvaluationMemo;
+
+  //the state of one evaluation of a cached expression, which is shared by
+  //everything that it evaluates
   class Thread
   {
+    public:
+    Thread()
+    : m_memo(nullptr)
+    {
+    }
+
+    explicit Thread(EvaluationMemo& memo)
+    : m_memo(&memo)
+    {
+    }
+
+    //the results that have already been finished, or null if they aren't
+    //being kept
+    EvaluationMemo*
+    memo() const
+    {
+      return m_memo;
+    }
+
+    private:
+    EvaluationMemo* m_memo;
   };
 
   class WS
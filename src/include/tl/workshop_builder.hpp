@@ -32,6 +32,11 @@ namespace TransLucid
 
   class System;
 
+  namespace Workshops
+  {
+    class RhoWS;
+  }
+
   class WorkshopBuilder
   {
     public:
@@ -76,6 +81,17 @@ namespace TransLucid
     WS* operator()(const Tree::ConditionalBestfitExpr& e);
 
     private:
+    //builds an expression that is used as a dimension
+    WS* build_dimension(const Tree::Expr& e);
+
+    //starts building a workshop that keeps track of rho, returns whether
+    //what was built before it looks at rho
+    bool begin_rho();
+
+    //finishes building ws, it only keeps track of rho if something that
+    //was built for it looks at rho
+    WS* end_rho(bool outer, Workshops::RhoWS* ws);
+
     //the system to compile with
     System* m_system;
 
@@ -87,6 +103,11 @@ namespace TransLucid
 
     //the where L_{out}s
     std::vector<dimension_index> m_whereOut;
+
+    //something that has been built looks at rho. Where clauses and the
+    //abstractions do, and so does anything that can run code from
+    //somewhere else: identifiers, applications and evaluating an intension
+    bool m_rhoUsed;
   };
 
 } //namespace TransLucid
@@ -24,17 +24,47 @@ along with TransLucid; see the file COPYING.  If not see
 
 #include <tl/assignment.hpp>
 #include <tl/fixed_indexes.hpp>
+#include <tl/hyperdatons/arrayhd.hpp>
+#include <tl/instant_dependencies.hpp>
 #include <tl/system.hpp>
 #include <tl/types/region.hpp>
 #include <tl/types/tuple.hpp>
 #include <tl/utility.hpp>
 
+#include <algorithm>
+#include <map>
+
 namespace TransLucid
 {
 
 namespace {
-  //for every context in ctxts that is valid in k,
-  //output the result of computation compute to out
+  //the most values that are computed before they are put, so that a big
+  //region doesn't need all of its values at once
+  const size_t BLOCK_VALUES = 4096;
+
+  //the range that the hyperdaton varies in for dim, null if it doesn't
+  //have one
+  const Range*
+  varianceRange(const Region& variance, dimension_index dim)
+  {
+    for (const auto& v : variance)
+    {
+      if (v.first == dim)
+      {
+        if (v.second.first == Region::Containment::IN &&
+            v.second.second.index() == TYPE_INDEX_RANGE)
+        {
+          return &Types::Range::get(v.second.second);
+        }
+        return nullptr;
+      }
+    }
+
+    return nullptr;
+  }
+
+  //for every context in ctxts that is valid in k, and where boolean is
+  //true, output the result of computation compute to out
   //at the moment we only know how to enumerate ranges, this could
   //become richer as we work out the type system better
   void
@@ -43,88 +73,655 @@ namespace {
     const Region& ctxts, 
     Context& k,
     WS& compute,
+    WS* boolean,
     OutputHD* out
   )
   {
-    //Tuple variance = out->variance();
-    Region variance;
+    //points outside of the hyperdaton would be thrown away, so the
+    //ranges are cut down to it before anything is evaluated
+    Region variance = out->variance();
 
-    //all the ranges in order
-    std::vector<Range> limits;
-
-    //the current value of each range dimension
-    std::vector<std::pair<dimension_index, mpz_class>> current;
+    //the ranges make a block, the rest are fixed
+    HDBlock block;
 
     //the context to evaluate in
     Context evalContext(k);
 
-    //determine which dimensions are ranges
     for (const auto& v : ctxts)
     {
+      const Range* limit = varianceRange(variance, v.first);
+
       if (v.second.second.index() == TYPE_INDEX_RANGE && 
           v.second.first == Region::Containment::IN)
       {
         const Range& r = Types::Range::get(v.second.second);
 
-        if (r.lower() == nullptr || r.upper() == nullptr)
+        const mpz_class* lower = r.lower();
+        const mpz_class* upper = r.upper();
+
+        if (limit != nullptr)
+        {
+          if (limit->lower() != nullptr && 
+              (lower == nullptr || *lower < *limit->lower()))
+          {
+            lower = limit->lower();
+          }
+
+          if (limit->upper() != nullptr && 
+              (upper == nullptr || *limit->upper() < *upper))
+          {
+            upper = limit->upper();
+          }
+        }
+
+        if (lower == nullptr || upper == nullptr)
         {
           //std::cerr << "Error: infinite bounds in demand, dimension " <<
           //  v.first << std::endl;
           throw "Infinite bounds in demand";
         }
 
-        limits.push_back(r);
-        current.push_back(std::make_pair(v.first, *r.lower()));
+        if (*upper < *lower)
+        {
+          return;
+        }
+
+        //a dimension that k already has is only demanded at its value in k
+        if (k.has_entry(v.first))
+        {
+          const Constant& current = k.lookup(v.first);
+
+          if (current.index() != TYPE_INDEX_INTMP ||
+              Types::Intmp::get(current) < *lower ||
+              *upper < Types::Intmp::get(current))
+          {
+            return;
+          }
+
+          block.add(v.first, Types::Intmp::get(current), 1);
+        }
+        else
+        {
+          mpz_class size = *upper - *lower + 1;
+          block.add(v.first, *lower, size.get_ui());
+        }
       }
       else
       {
+        if (k.has_entry(v.first) && k.lookup(v.first) != v.second.second)
+        {
+          return;
+        }
+
+        //a fixed point outside of the hyperdaton rules out everything
+        if (limit != nullptr && v.second.first == Region::Containment::IS &&
+            v.second.second.index() == TYPE_INDEX_INTMP &&
+            !limit->within(Types::Intmp::get(v.second.second)))
+        {
+          return;
+        }
+
         //if not a range then store it permanantly
         evalContext.perturb(v.first, v.second.second);
       }
     }
 
+    auto evaluateBlock = [&] (const HDBlock& b)
+    {
+      std::vector<Constant> values(b.size());
+
+      b.each(evalContext, [&compute, &values] (size_t i, Context& c)
+        {
+          values[i] = compute(c);
+        }
+      );
+
+      out->putBlock(evalContext, b, values.data());
+    };
+
+    //only the points where the boolean holds are computed and put, which
+    //is what a sparse hyperdaton wants. The region has already been cut
+    //down to the constant bounds in the boolean, the boolean is evaluated
+    //at every point that is left
+    auto evaluateSelected = [&] (const HDBlock& b)
+    {
+      b.each(evalContext, [&compute, boolean, out] (size_t, Context& c)
+        {
+          Constant holds = (*boolean)(c);
+          if (holds.index() == TYPE_INDEX_BOOL && get_constant<bool>(holds))
+          {
+            out->put(c, compute(c));
+          }
+        }
+      );
+    };
+
+    if (boolean != nullptr)
+    {
+      evaluateSelected(block);
+      return;
+    }
+
     //by doing it this way, even if there is no range, we still evaluate
     //everything once
-    while (true)
+    if (block.bounds().empty())
     {
-      ContextPerturber p(evalContext);
-      for (const auto& v : current)
+      evaluateBlock(block);
+      return;
+    }
+
+    //split the block along its first bound
+    size_t rows = block.bounds().front().size;
+    size_t rowSize = rows == 0 ? 0 : block.size() / rows;
+    size_t step = std::max(size_t(1), BLOCK_VALUES / std::max(rowSize, 
+      size_t(1)));
+
+    for (size_t row = 0; row < rows; row += step)
+    {
+      evaluateBlock(block.slice(row, std::min(step, rows - row)));
+    }
+  }
+
+  //names that the evaluator looks up by itself, so they never appear in
+  //the tree
+  const u32string implicitIdentifiers[] =
+  {
+    U"bestselect__",
+    U"constant_bang",
+    U"construct_literal",
+    U"special_combine"
+  };
+
+  //is the time fixed by every context in the region
+  bool
+  fixesTime(const Constant& ctxts)
+  {
+    if (ctxts.index() != TYPE_INDEX_REGION)
+    {
+      return false;
+    }
+
+    const Region& region = Types::Region::get(ctxts);
+
+    for (const auto& v : region)
+    {
+      if (v.first == DIM_TIME)
       {
-        p.perturb(v.first, Types::Intmp::create(v.second));
+        return v.second.first == Region::Containment::IS;
       }
+    }
+
+    return false;
+  }
+
+  //the bounds that a boolean puts on a dimension
+  struct Bounds
+  {
+    Bounds()
+    : hasLower(false), hasUpper(false)
+    {}
+
+    bool hasLower;
+    bool hasUpper;
+    mpz_class lower;
+    mpz_class upper;
 
-      //is the demand valid for the hyperdaton, and is the demand valid for
-      //the current context
-      if (regionApplicable(variance, evalContext) && k <= evalContext)
+    void
+    atLeast(const mpz_class& v)
+    {
+      if (!hasLower || lower < v)
       {
-        out->put(evalContext, compute(evalContext));
+        lower = v;
+        hasLower = true;
       }
-      
-      //then we increment the counters at the end
-      auto limitIter = limits.begin();
-      auto currentIter = current.begin();
-      while (currentIter != current.end())
+    }
+
+    void
+    atMost(const mpz_class& v)
+    {
+      if (!hasUpper || v < upper)
       {
-        ++currentIter->second;
-        if (!limitIter->within(currentIter->second))
-        {
-          currentIter->second = *limitIter->lower();
-          ++currentIter;
-          ++limitIter;
-        }
-        else
-        {
-          break;
-        }
+        upper = v;
+        hasUpper = true;
+      }
+    }
+  };
+
+  typedef std::map<dimension_index, Bounds> BoundsMap;
+
+  const Tree::Expr&
+  stripParens(const Tree::Expr& e)
+  {
+    auto p = get<Tree::ParenExpr>(&e);
+    return p == nullptr ? e : stripParens(p->e);
+  }
+
+  //is e #.d for a constant dimension d
+  bool
+  constantHash(System& s, const Tree::Expr& e, dimension_index& dim)
+  {
+    auto h = get<Tree::HashExpr>(&stripParens(e));
+    if (h == nullptr)
+    {
+      return false;
+    }
+
+    if (auto d = get<Tree::DimensionExpr>(&h->e))
+    {
+      dim = d->text.empty() ? d->dim : s.getDimensionIndex(d->text);
+      return true;
+    }
+    else if (auto v = get<mpz_class>(&h->e))
+    {
+      dim = s.getDimensionIndex(Types::Intmp::create(*v));
+      return true;
+    }
+
+    return false;
+  }
+
+  bool
+  integerLiteral(const Tree::Expr& e, mpz_class& value)
+  {
+    const Tree::Expr& x = stripParens(e);
+
+    if (auto v = get<mpz_class>(&x))
+    {
+      value = *v;
+      return true;
+    }
+    else if (auto c = get<Constant>(&x))
+    {
+      if (c->index() == TYPE_INDEX_INTMP)
+      {
+        value = Types::Intmp::get(*c);
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  enum class Comparison
+  {
+    EQ,
+    LT,
+    LTE,
+    GT,
+    GTE
+  };
+
+  struct ComparisonOperator
+  {
+    Comparison cmp;
+    u32string name;
+    u32string host;
+  };
+
+  const ComparisonOperator comparisons[] =
+  {
+    {Comparison::EQ, U"eq", U"intmp_eq"},
+    {Comparison::LT, U"lt", U"intmp_lt"},
+    {Comparison::LTE, U"lte", U"intmp_lte"},
+    {Comparison::GT, U"gt", U"intmp_gt"},
+    {Comparison::GTE, U"gte", U"intmp_gte"}
+  };
+
+  //is bool_and defined as the header defines it, as
+  //fun bool_and a b = if a then b else false fi
+  bool
+  isConjunction(System& s)
+  {
+    auto decls = s.getFunctionDefinitions(U"bool_and");
+
+    if (decls.size() != 1)
+    {
+      return false;
+    }
+
+    const auto& decl = decls.front();
+
+    if (decl.args.size() != 2 || get<Tree::nil>(&decl.guard) == nullptr ||
+        get<Tree::nil>(&decl.boolean) == nullptr)
+    {
+      return false;
+    }
+
+    auto test = get<Tree::IfExpr>(&stripParens(decl.expr));
+    if (test == nullptr || !test->else_ifs.empty())
+    {
+      return false;
+    }
+
+    auto condition = get<Tree::IdentExpr>(&stripParens(test->condition));
+    auto then = get<Tree::IdentExpr>(&stripParens(test->then));
+    auto else_ = get<bool>(&stripParens(test->else_));
+
+    return condition != nullptr && condition->text == decl.args[0].second &&
+      then != nullptr && then->text == decl.args[1].second &&
+      else_ != nullptr && !*else_;
+  }
+
+  //the bounds that hold wherever the boolean is true, found in
+  //comparisons of #.d with an integer, and && of those. Anything else
+  //doesn't bound anything
+  void
+  findBounds(System& s, const Tree::Expr& boolean, BoundsMap& bounds)
+  {
+    //binary operators are (f.x).y
+    auto app = get<Tree::LambdaAppExpr>(&stripParens(boolean));
+    if (app == nullptr)
+    {
+      return;
+    }
+
+    auto inner = get<Tree::LambdaAppExpr>(&stripParens(app->lhs));
+    if (inner == nullptr)
+    {
+      return;
+    }
+
+    auto fn = get<Tree::IdentExpr>(&stripParens(inner->lhs));
+    if (fn == nullptr)
+    {
+      return;
+    }
+
+    //&& passes its arguments as intensions
+    if (fn->text == U"bool_and")
+    {
+      auto lhs = get<Tree::MakeIntenExpr>(&stripParens(inner->rhs));
+      auto rhs = get<Tree::MakeIntenExpr>(&stripParens(app->rhs));
+
+      if (lhs != nullptr && rhs != nullptr && isConjunction(s))
+      {
+        findBounds(s, lhs->expr, bounds);
+        findBounds(s, rhs->expr, bounds);
+      }
+      return;
+    }
+
+    auto op = std::find_if(std::begin(comparisons), std::end(comparisons),
+      [&] (const ComparisonOperator& c) { return c.name == fn->text; });
+
+    if (op == std::end(comparisons))
+    {
+      return;
+    }
+
+    dimension_index dim;
+    mpz_class value;
+    Comparison cmp = op->cmp;
+
+    if (!constantHash(s, inner->rhs, dim) || 
+        !integerLiteral(app->rhs, value))
+    {
+      if (!integerLiteral(inner->rhs, value) || 
+          !constantHash(s, app->rhs, dim))
+      {
+        return;
+      }
+
+      //c < #.d is #.d > c
+      switch (cmp)
+      {
+        case Comparison::LT: cmp = Comparison::GT; break;
+        case Comparison::LTE: cmp = Comparison::GTE; break;
+        case Comparison::GT: cmp = Comparison::LT; break;
+        case Comparison::GTE: cmp = Comparison::LTE; break;
+        case Comparison::EQ: break;
       }
-      
-      if (currentIter == current.end())
+    }
+
+    //the coordinates are integers, so this only holds if the operator
+    //means integer comparison
+    if (!isIntegerOperator(s, op->name, op->host, 2))
+    {
+      return;
+    }
+
+    Bounds& b = bounds[dim];
+    switch (cmp)
+    {
+      case Comparison::EQ:
+      b.atLeast(value);
+      b.atMost(value);
+      break;
+
+      case Comparison::LT:
+      b.atMost(value - 1);
+      break;
+
+      case Comparison::LTE:
+      b.atMost(value);
+      break;
+
+      case Comparison::GT:
+      b.atLeast(value + 1);
+      break;
+
+      case Comparison::GTE:
+      b.atLeast(value);
+      break;
+    }
+  }
+
+  //can two regions share a context, it is only known that they can't
+  //when both fix a dimension to values that are apart
+  bool
+  mayOverlap(const Constant& a, const Constant& b)
+  {
+    if (a.index() != TYPE_INDEX_REGION || b.index() != TYPE_INDEX_REGION)
+    {
+      return true;
+    }
+
+    const Region& ra = Types::Region::get(a);
+    const Region& rb = Types::Region::get(b);
+
+    auto range = [] (const Region::Entries::value_type& v) -> const Range*
+    {
+      if (v.second.first == Region::Containment::IN &&
+          v.second.second.index() == TYPE_INDEX_RANGE)
+      {
+        return &Types::Range::get(v.second.second);
+      }
+      return nullptr;
+    };
+
+    auto point = [] (const Region::Entries::value_type& v) -> const mpz_class*
+    {
+      if (v.second.first == Region::Containment::IS &&
+          v.second.second.index() == TYPE_INDEX_INTMP)
+      {
+        return &Types::Intmp::get(v.second.second);
+      }
+      return nullptr;
+    };
+
+    auto ib = rb.begin();
+    for (const auto& va : ra)
+    {
+      while (ib != rb.end() && ib->first < va.first)
+      {
+        ++ib;
+      }
+
+      if (ib == rb.end())
       {
         break;
       }
+
+      if (ib->first != va.first)
+      {
+        continue;
+      }
+
+      const auto& vb = *ib;
+
+      if (va.second.first == Region::Containment::IS &&
+          vb.second.first == Region::Containment::IS &&
+          va.second.second != vb.second.second)
+      {
+        return false;
+      }
+
+      const Range* rangeA = range(va);
+      const Range* rangeB = range(vb);
+      const mpz_class* pointA = point(va);
+      const mpz_class* pointB = point(vb);
+
+      if ((rangeA != nullptr && rangeB != nullptr && 
+           !rangeA->overlaps(*rangeB)) ||
+          (rangeA != nullptr && pointB != nullptr && 
+           !rangeA->within(*pointB)) ||
+          (pointA != nullptr && rangeB != nullptr && 
+           !rangeB->within(*pointA)))
+      {
+        return false;
+      }
     }
+
+    return true;
   }
+}
+
+bool
+Assignment::pruneRegion(System& s, const Tree::Expr& boolean, Region& region)
+{
+  BoundsMap bounds;
+  findBounds(s, boolean, bounds);
+
+  for (auto& v : region)
+  {
+    auto iter = bounds.find(v.first);
+    if (iter == bounds.end())
+    {
+      continue;
+    }
+
+    const Bounds& b = iter->second;
+
+    if (b.hasLower && b.hasUpper && b.upper < b.lower)
+    {
+      return false;
+    }
+
+    const Constant& value = v.second.second;
+
+    if (v.second.first == Region::Containment::IN &&
+        value.index() == TYPE_INDEX_RANGE)
+    {
+      const Range& r = Types::Range::get(value);
+
+      const mpz_class* lower = r.lower();
+      const mpz_class* upper = r.upper();
 
+      if (b.hasLower && (lower == nullptr || *lower < b.lower))
+      {
+        lower = &b.lower;
+      }
+
+      if (b.hasUpper && (upper == nullptr || b.upper < *upper))
+      {
+        upper = &b.upper;
+      }
+
+      if (lower != nullptr && upper != nullptr && *upper < *lower)
+      {
+        return false;
+      }
+
+      v.second.second = Types::Range::create(Range(lower, upper));
+    }
+    else if (v.second.first == Region::Containment::IS &&
+             value.index() == TYPE_INDEX_INTMP)
+    {
+      const mpz_class& point = Types::Intmp::get(value);
+
+      if ((b.hasLower && point < b.lower) || (b.hasUpper && b.upper < point))
+      {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+bool
+Assignment::needsEvaluating(System& s, const State& state) const
+{
+  if (!state.computed || state.time)
+  {
+    return true;
+  }
+
+  for (const auto& x : state.dependencies)
+  {
+    if (s.identifierChanged(x))
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void
+Assignment::findDependencies
+(
+  System& s,
+  const Definition& d,
+  State& state,
+  const Constant& region
+)
+{
+  InstantDependencies finder;
+
+  auto guard = finder.findGuard(d.guardExpr);
+  auto body = finder.find(d.bodyExpr);
+  auto boolean = finder.find(d.booleanExpr);
+
+  body.identifiers.insert(boolean.identifiers.begin(),
+    boolean.identifiers.end());
+  body.identifiers.insert(std::begin(implicitIdentifiers),
+    std::end(implicitIdentifiers));
+
+  //follow the identifiers to everything that they can reach, keeping
+  //track of whether the guard or the body can see the time
+  auto closure = [&s] (InstantDependencies::Result& r)
+  {
+    std::vector<u32string> todo(r.identifiers.begin(), r.identifiers.end());
+
+    while (!todo.empty())
+    {
+      auto x = todo.back();
+      todo.pop_back();
+
+      const auto& deps = s.getIdentifierDependencies(x);
+      r.time = r.time || deps.time;
+
+      for (const auto& y : deps.identifiers)
+      {
+        if (r.identifiers.insert(y).second)
+        {
+          todo.push_back(y);
+        }
+      }
+    }
+  };
+
+  closure(guard);
+  closure(body);
+
+  //if the guard pins the time then the body is always evaluated at the
+  //same time
+  state.time = guard.time ||
+    ((body.time || boolean.time) && !fixesTime(region));
+
+  state.dependencies = std::move(guard.identifiers);
+  state.dependencies.insert(body.identifiers.begin(), body.identifiers.end());
 }
 
 void
@@ -147,11 +744,39 @@ Assignment::evaluate
 
   //theContext.perturb(DIM_TIME, Types::Intmp::create(m_time));
 
+  m_evaluated = 0;
+
+  //the regions written so far in this instant. A later definition wins
+  //where it overlaps an earlier one, so it has to be written again after
+  //the earlier one even if nothing that it uses has changed
+  std::vector<Constant> written;
+
+  auto overwritten = [&written] (const Constant& region) -> bool
+  {
+    for (const auto& w : written)
+    {
+      if (mayOverlap(w, region))
+      {
+        return true;
+      }
+    }
+    return false;
+  };
+
   //this needs to be way better
   //for a start: only look at demands for the current time
   //auto equations = ident.second->equations();
-  for (auto& assign : m_definitions)
+  for (size_t i = 0; i != m_definitions.size(); ++i)
   {
+    auto& assign = m_definitions[i];
+    auto& state = m_state[i];
+
+    //the previous output is still correct
+    if (!needsEvaluating(s, state) && !overwritten(state.region))
+    {
+      continue;
+    }
+
     //const Tuple& constraint = m_outputHDDecls.find(ident.first)->second;
     const auto& guard = assign.guardWS;
 
@@ -159,12 +784,36 @@ Assignment::evaluate
     {
       auto ctxts = (*guard)(theContext);
 
+      findDependencies(s, assign, state, ctxts);
+      state.computed = false;
+      state.region = ctxts;
+      written.push_back(ctxts);
+      ++m_evaluated;
+
       if (ctxts.index() == TYPE_INDEX_REGION)
       {
-        //the demand could have ranges, so we need to enumerate them
-        enumerateContextSet(Types::Region::get(ctxts), theContext, 
-          *assign.bodyWS, hd);
+        Region region = Types::Region::get(ctxts);
+
+        WS* boolean = get<Tree::nil>(&assign.booleanExpr) == nullptr
+          ? assign.booleanWS.get() : nullptr;
+
+        //the boolean can be false everywhere in the region
+        bool empty = boolean != nullptr &&
+          !pruneRegion(s, assign.booleanExpr, region);
+
+        //try to do the whole region at once first
+        ArrayHD* array = dynamic_cast<ArrayHD*>(hd);
+        if (!empty &&
+            !(assign.bodyKernel && array != nullptr && boolean == nullptr &&
+              assign.bodyKernel->evaluate(region, theContext, *array)))
+        {
+          //the demand could have ranges, so we need to enumerate them
+          enumerateContextSet(region, theContext, *assign.bodyWS, boolean,
+            hd);
+        }
       }
+
+      state.computed = true;
     }
   }
 }
@@ -31,6 +31,8 @@ along with TransLucid; see the file COPYING.  If not see
 
 #include "tl/parser.hpp"
 
+#include <algorithm>
+
 //#define TL_PRINT_TREE
 
 /**
@@ -38,7 +40,6 @@ along with TransLucid; see the file COPYING.  If not see
  * The implementation of bestfitting.
  */
 
-static constexpr size_t LINEAR_SEARCH_MAX_SIZE = 7;
 
 namespace TransLucid
 {
@@ -292,6 +293,15 @@ namespace
   };
 
   static TypeComparators typeCompare;
+
+  //the region of an equation with no guard, nothing ever changes it so
+  //it can be shared
+  const std::shared_ptr<Region>&
+  emptyRegion()
+  {
+    static const std::shared_ptr<Region> empty = std::make_shared<Region>();
+    return empty;
+  }
 }
 
 //TODO finish this
@@ -376,30 +386,146 @@ BestfitGroup::getEquation(Context& k)
     return Tree::Expr();
   }
 
-  //first check the last definition
+  auto compiled = findCompiled(time);
+
+  if (compiled == nullptr)
+  {
+    return Tree::Expr();
+  }
+
+  return compiled->expr;
+}
+
+const BestfitGroup::CompiledDefinition*
+BestfitGroup::findCompiled(int time) const
+{
+  if (m_evaluators.empty())
+  {
+    return nullptr;
+  }
+
+  //first check the last definition, which is nearly always the one
   auto& last = m_evaluators.back();
-  if (time >= last.start && (last.end == -1 || time <= last.end))
+  if (time >= last.start)
   {
-    return last.expr;
+    return last.end == -1 || time <= last.end ? &last : nullptr;
   }
 
-  //make sure that it's not bigger than the last and smaller than the first
-  if (time > last.start || time < m_evaluators.front().start)
+  //the compiled definitions cover consecutive intervals of time, so the
+  //one we want is the last one to start at or before time
+  auto iter = std::upper_bound(m_evaluators.begin(), m_evaluators.end(),
+    time,
+    [] (int t, const CompiledDefinition& d) { return t < d.start; });
+
+  if (iter == m_evaluators.begin())
   {
-    return Tree::Expr();
+    return nullptr;
   }
 
-  //otherwise do a linear search backwards if small, binary search if big
-  for (auto i = m_evaluators.rbegin(); i != m_evaluators.rend(); ++i)
+  --iter;
+  return time <= iter->end ? &*iter : nullptr;
+}
+
+std::vector<Parser::Line>
+BestfitGroup::liveDefinitions(Context& k)
+{
+  parse(k);
+
+  std::vector<Parser::Line> lines;
+  for (size_t i : m_live)
   {
-    if (time >= i->start && time <= i->end)
+    lines.push_back(*m_definitions[i].parsed());
+  }
+
+  return lines;
+}
+
+void
+BestfitGroup::discardBefore(int time)
+{
+  //the last compiled definition never ends, so it is always kept
+  auto keep = std::find_if(m_evaluators.begin(), m_evaluators.end(),
+    [time] (const CompiledDefinition& d)
     {
-      return i->expr;
+      return d.end == -1 || d.end >= time;
+    });
+
+  m_discarded += keep - m_evaluators.begin();
+  m_evaluators.erase(m_evaluators.begin(), keep);
+
+  //a definition that ends at or before time can't be valid again, so its
+  //text and tree are dropped too
+  auto last = m_ended.upper_bound(time);
+  if (last == m_ended.begin())
+  {
+    return;
+  }
+
+  std::vector<bool> gone(m_definitions.size(), false);
+  for (auto iter = m_ended.begin(); iter != last; ++iter)
+  {
+    gone[iter->second] = true;
+  }
+  m_ended.erase(m_ended.begin(), last);
+
+  //move the rest down, and renumber everything that indexes them
+  std::vector<size_t> index(m_definitions.size());
+  size_t kept = 0;
+  size_t parsed = 0;
+  for (size_t i = 0; i != m_definitions.size(); ++i)
+  {
+    if (gone[i])
+    {
+      continue;
+    }
+
+    index[i] = kept;
+    if (i != kept)
+    {
+      m_definitions[kept] = std::move(m_definitions[i]);
+    }
+
+    if (i < m_parsed)
+    {
+      ++parsed;
     }
+    ++kept;
   }
-  //if we got here then something broke
 
-  return Tree::Expr();
+  m_definitions.erase(m_definitions.begin() + kept, m_definitions.end());
+  m_parsed = parsed;
+
+  std::set<size_t> live;
+  for (size_t i : m_live)
+  {
+    live.insert(index[i]);
+  }
+  m_live.swap(live);
+
+  for (auto& ended : m_ended)
+  {
+    ended.second = index[ended.second];
+  }
+
+  auto iter = m_uuids.begin();
+  while (iter != m_uuids.end())
+  {
+    auto& defs = iter->second;
+    defs.remove_if([&gone] (size_t i) { return gone[i]; });
+
+    if (defs.empty())
+    {
+      iter = m_uuids.erase(iter);
+    }
+    else
+    {
+      for (auto& i : defs)
+      {
+        i = index[i];
+      }
+      ++iter;
+    }
+  }
 }
 
 void
@@ -410,9 +536,9 @@ BestfitGroup::compile(Context& k)
   parse(k);
 
   //add in the extra definitions for that which has changed
-  if (m_changes.size() > m_evaluators.size())
+  if (needsCompiling())
   {
-    size_t change = m_evaluators.size();
+    size_t change = m_discarded + m_evaluators.size();
 
     while (change != m_changes.size())
     {
@@ -421,10 +547,10 @@ BestfitGroup::compile(Context& k)
       //there is no end
       int end = -1;
 
-      if (change != 0)
+      if (!m_evaluators.empty())
       {
         //the previous should end one before the current time
-        m_evaluators[change-1].end = m_changes[change] - 1;
+        m_evaluators.back().end = m_changes[change] - 1;
       }
 
       //compile one group of definitions
@@ -434,8 +560,8 @@ BestfitGroup::compile(Context& k)
       auto compiled = compileExpression(expression, 
         m_definitions.front().getScope());
 
-      m_evaluators.push_back(CompiledDefinition{start, end, compiled.second, 
-        compiled.first});
+      m_evaluators.push_back(CompiledDefinition{start, end, 
+        std::move(compiled.second), std::move(compiled.first)});
 
       ++change;
     }
@@ -464,14 +590,14 @@ BestfitGroup::compileExpression(const Tree::Expr& expr, ScopePtr scope)
   if (m_cached)
   {
     ws = std::make_shared<Workshops::CacheWS>(
-      compile.build_workshops(fixed), m_name, m_system);
+      compile.build_workshops(fixed), m_name, m_system, m_identifier);
   }
   else
   {
     ws = std::shared_ptr<WS>(compile.build_workshops(fixed));
   }
 
-  return std::make_pair(fixed, ws);
+  return std::make_pair(std::move(fixed), std::move(ws));
 }
 
 Tree::Expr
@@ -480,19 +606,56 @@ BestfitGroup::compileInstant(int time)
   //look for everything that is valid at time and compile it into one
   //expression
 
-  std::list<EquationDefinition> valid;
-  for (auto i = m_definitions.begin(); i != m_definitions.end(); 
-    ++i)
+  //only the definitions before this one have started by time
+  auto started = std::upper_bound(m_definitions.begin(), m_definitions.end(),
+    time,
+    [] (int t, const EquationDefinition& d) { return t < d.start(); })
+    - m_definitions.begin();
+
+  //a definition is valid until the time that it ends, so it is either
+  //still live or it ends after time
+  std::vector<size_t> indexes(m_live.begin(), m_live.lower_bound(started));
+
+  for (auto i = m_ended.upper_bound(time); i != m_ended.end(); ++i)
   {
-    if (i->start() <= time && (i->end() == -1 || i->end() < time))
+    if (i->second < static_cast<size_t>(started))
     {
-      valid.push_back(*i);
+      indexes.push_back(i->second);
     }
   }
 
+  std::sort(indexes.begin(), indexes.end());
+
+  std::list<EquationDefinition> valid;
+  for (auto i : indexes)
+  {
+    valid.push_back(m_definitions[i]);
+  }
+
   return m_grouper->group(valid);
 }
 
+bool
+BestfitGroup::precompile(Context& k)
+{
+  if (m_compiling || !needsCompiling())
+  {
+    return false;
+  }
+
+  try
+  {
+    compile(k);
+  }
+  catch (...)
+  {
+    m_compiling = false;
+    return false;
+  }
+
+  return true;
+}
+
 void
 BestfitGroup::preEvalCheck(Context& k)
 {
@@ -502,7 +665,7 @@ BestfitGroup::preEvalCheck(Context& k)
   }
 
   //if (m_parsed != m_definitions.size())
-  if (m_changes.size() > m_evaluators.size())
+  if (needsCompiling())
   {
     try
     {
@@ -543,7 +706,7 @@ BestfitGroup::operator()(Context& kappa, Delta& d, const Thread& w, size_t t)
   }
 
   //if (m_parsed != m_definitions.size())
-  if (m_changes.size() > m_evaluators.size())
+  if (needsCompiling())
   {
     try
     {
@@ -572,70 +735,29 @@ BestfitGroup::evaluate(Context& k, Args&&... args)
     time = Types::Intmp::get(dimtime).get_si();
   }
 
-  //first check the last definition
-  auto& last = m_evaluators.back();
-  if (time >= last.start && (last.end == -1 || time <= last.end))
-  {
-    return (*last.evaluator)(k, args...);
-  }
+  auto compiled = findCompiled(time);
 
-  //make sure that it's not bigger than the last and smaller than the first
-  if (time > last.start || time < m_evaluators.front().start)
+  if (compiled == nullptr)
   {
     return detail::cached_return(Types::Special::create(SP_UNDEF), args...);
   }
 
-  //otherwise do a linear search backwards if small, binary search if big
-  if (m_evaluators.size() <= LINEAR_SEARCH_MAX_SIZE)
-  {
-    for (auto i = m_evaluators.rbegin(); i != m_evaluators.rend(); ++i)
-    {
-      if (time >= i->start && time <= i->end)
-      {
-        return (*i->evaluator)(k, args...);
-      }
-    }
-    //if we got here then something broke
-    return detail::cached_return(Types::Special::create(SP_UNDEF), args...);
-  }
-  else
-  {
-    //binary search the rest
-    auto begin = m_evaluators.begin();
-    auto end = m_evaluators.end();
-    --end;
-    auto current = begin + (end - begin) / 2;
-
-    //this is guaranteed to find a match now
-    while (!(time >= current->start && time <= current->end))
-    {
-      if (time < current->start)
-      {
-        end = current;
-      }
-      else
-      {
-        begin = current + 1;
-      }
-      current = begin + (end - begin) / 2;
-    }
-
-    //current is the match
-    return (*current->evaluator)(k, args...);
-  }
+  return (*compiled->evaluator)(k, args...);
 }
 
 template <typename... Delta>
 std::pair<bool, std::shared_ptr<Region>>
-EquationGuard::evaluate(Context& k, Delta&&... delta) const
+EquationGuard::evaluate(std::vector<dimension_index>& demands, Context& k, 
+  Delta&&... delta) const
 {
-  if (!m_compiled)
+  prepare();
+
+  if (m_onlyConst)
   {
-    compile();
+    return std::make_pair(true, m_constRegion);
   }
 
   bool nonspecial = true;
-  m_demands.clear();
   Region::Entries t = m_dimConstConst;
 
   if (m_guard)
@@ -650,7 +772,7 @@ EquationGuard::evaluate(Context& k, Delta&&... delta) const
       if (ord.index() == TYPE_INDEX_DEMAND)
       {
         const auto& dims = Types::Demand::get(ord).dims();
-        std::copy(dims.begin(), dims.end(), std::back_inserter(m_demands));
+        std::copy(dims.begin(), dims.end(), std::back_inserter(demands));
       }
       else
       {
@@ -666,7 +788,7 @@ EquationGuard::evaluate(Context& k, Delta&&... delta) const
       if (dim.index() == TYPE_INDEX_DEMAND)
       {
         const auto& dims = Types::Demand::get(dim).dims();
-        std::copy(dims.begin(), dims.end(), std::back_inserter(m_demands));
+        std::copy(dims.begin(), dims.end(), std::back_inserter(demands));
       }
       else if (dim.index() == TYPE_INDEX_SPECIAL)
       {
@@ -699,14 +821,14 @@ EquationGuard::evaluate(Context& k, Delta&&... delta) const
       if (ord.index() == TYPE_INDEX_DEMAND)
       {
         const auto& dims = Types::Demand::get(ord).dims();
-        std::copy(dims.begin(), dims.end(), std::back_inserter(m_demands));
+        std::copy(dims.begin(), dims.end(), std::back_inserter(demands));
         isdemand = true;
       }
 
       if (dim.index() == TYPE_INDEX_DEMAND)
       {
         const auto& dims = Types::Demand::get(dim).dims();
-        std::copy(dims.begin(), dims.end(), std::back_inserter(m_demands));
+        std::copy(dims.begin(), dims.end(), std::back_inserter(demands));
         isdemand = true;
       }
 
@@ -729,16 +851,17 @@ EquationGuard::evaluate(Context& k, Delta&&... delta) const
 }
 
 std::pair<bool, std::pair<size_t, std::shared_ptr<Region>>>
-EquationGuard::evaluateCached(Context& k, Delta& d, const Thread& w, size_t t) 
-  const
+EquationGuard::evaluateCached(std::vector<dimension_index>& demands, 
+  Context& k, Delta& d, const Thread& w, size_t t) const
 {
-  if (!m_compiled)
+  prepare();
+
+  if (m_onlyConst)
   {
-    compile();
+    return std::make_pair(true, std::make_pair(t, m_constRegion));
   }
 
   bool nonspecial = true;
-  m_demands.clear();
   Region::Entries e = m_dimConstConst;
   size_t maxTime = t;
 
@@ -756,7 +879,7 @@ EquationGuard::evaluateCached(Context& k, Delta& d, const Thread& w, size_t t)
       if (ord.second.index() == TYPE_INDEX_DEMAND)
       {
         const auto& dims = Types::Demand::get(ord.second).dims();
-        std::copy(dims.begin(), dims.end(), std::back_inserter(m_demands));
+        std::copy(dims.begin(), dims.end(), std::back_inserter(demands));
       }
       else
       {
@@ -773,7 +896,7 @@ EquationGuard::evaluateCached(Context& k, Delta& d, const Thread& w, size_t t)
       if (dim.second.index() == TYPE_INDEX_DEMAND)
       {
         const auto& dims = Types::Demand::get(dim.second).dims();
-        std::copy(dims.begin(), dims.end(), std::back_inserter(m_demands));
+        std::copy(dims.begin(), dims.end(), std::back_inserter(demands));
       }
       else if (dim.second.index() == TYPE_INDEX_SPECIAL)
       {
@@ -806,14 +929,14 @@ EquationGuard::evaluateCached(Context& k, Delta& d, const Thread& w, size_t t)
       if (ord.second.index() == TYPE_INDEX_DEMAND)
       {
         const auto& dims = Types::Demand::get(ord.second).dims();
-        std::copy(dims.begin(), dims.end(), std::back_inserter(m_demands));
+        std::copy(dims.begin(), dims.end(), std::back_inserter(demands));
         isdemand = true;
       }
 
       if (dim.second.index() == TYPE_INDEX_DEMAND)
       {
         const auto& dims = Types::Demand::get(dim.second).dims();
-        std::copy(dims.begin(), dims.end(), std::back_inserter(m_demands));
+        std::copy(dims.begin(), dims.end(), std::back_inserter(demands));
         isdemand = true;
       }
 
@@ -836,6 +959,39 @@ EquationGuard::evaluateCached(Context& k, Delta& d, const Thread& w, size_t t)
     std::make_pair(maxTime, std::make_shared<Region>(e)));
 }
 
+bool
+EquationGuard::applicable(Context& k, std::shared_ptr<Region>& region) const
+{
+  prepare();
+
+  for (const auto& entry : m_dimConstConst)
+  {
+    if (!valueInside(k.lookup(entry.first), entry.second.first, 
+          entry.second.second))
+    {
+      return false;
+    }
+  }
+
+  if (m_onlyConst)
+  {
+    region = m_constRegion;
+    return true;
+  }
+
+  //the demands don't matter without a delta
+  std::vector<dimension_index> demands;
+  auto result = evaluate(demands, k);
+
+  if (result.first && regionApplicable(*result.second, k))
+  {
+    region = std::move(result.second);
+    return true;
+  }
+
+  return false;
+}
+
 //how to bestfit with a cache
 //  until we find a priority that has valid equations and there are no demands
 //  for dimensions, do:
@@ -1011,20 +1167,17 @@ ConditionalBestfitWS::operator()(Context& k)
       if (eqn_i->validContext())
       {
         const EquationGuard& guard = eqn_i->validContext();
-        auto result = guard.evaluate(k);
+        std::shared_ptr<Region> region;
 
-        if (result.first && regionApplicable(*result.second, k)
-          && booleanTrue(guard, k)
-        )
+        if (guard.applicable(k, region) && booleanTrue(guard, k))
         {
           applicable.push_back
-            (ApplicableTuple(result.second, eqn_i));
+            (ApplicableTuple(std::move(region), eqn_i));
         }
       }
       else
       {
-        applicable.push_back
-          (ApplicableTuple(std::make_shared<Region>(), eqn_i));
+        applicable.push_back(ApplicableTuple(emptyRegion(), eqn_i));
       }
     }
   }
@@ -1065,19 +1218,22 @@ ConditionalBestfitWS::operator()(Context& kappa, Context& delta)
       if (eqn_i->validContext())
       {
         const EquationGuard& guard = eqn_i->validContext();
-        auto result = guard.evaluate(kappa, delta);
+        size_t demanded = demands.size();
+        auto result = guard.evaluate(demands, kappa, delta);
 
         if (result.first)
         {
-          std::copy(guard.demands().begin(), guard.demands().end(),
-            std::back_inserter(demands));
-
           potential.push_back(ApplicableTuple(result.second, eqn_i));
         }
+        else
+        {
+          //the demands of a guard that can't be used don't count
+          demands.resize(demanded);
+        }
       }
       else
       {
-        potential.push_back(ApplicableTuple(std::make_shared<Region>(), eqn_i));
+        potential.push_back(ApplicableTuple(emptyRegion(), eqn_i));
       }
     }
 
@@ -1166,21 +1322,23 @@ ConditionalBestfitWS::operator()
       if (eqn_i->validContext())
       {
         const EquationGuard& guard = eqn_i->validContext();
-        auto result = guard.evaluateCached(kappa, d, w, t);
+        size_t demanded = demands.size();
+        auto result = guard.evaluateCached(demands, kappa, d, w, t);
 
         if (result.first)
         {
-          std::copy(guard.demands().begin(), guard.demands().end(),
-            std::back_inserter(demands));
-
           potential.push_back(ApplicableTuple(result.second.second, eqn_i));
 
           maxTime = std::max(maxTime, result.second.first);
         }
+        else
+        {
+          demands.resize(demanded);
+        }
       }
       else
       {
-        potential.push_back(ApplicableTuple(std::make_shared<Region>(), eqn_i));
+        potential.push_back(ApplicableTuple(emptyRegion(), eqn_i));
       }
     }
 
@@ -1233,6 +1391,14 @@ ConditionalBestfitWS::operator()
   return bestfit(applicable, kappa, d, w, maxTime);
 }
 
+EquationGuard::EquationGuard()
+: m_guard(nullptr), m_boolean(nullptr), m_compiled(true), m_onlyConst(true)
+, m_system(nullptr)
+, m_priority(0)
+, m_constRegion(emptyRegion())
+{
+}
+
 EquationGuard::EquationGuard(WS* g, WS* b)
 : m_guard(g), m_boolean(b), m_compiled(false), m_onlyConst(false),
   m_system(nullptr), m_priority(0)
@@ -1250,6 +1416,7 @@ EquationGuard::EquationGuard(const EquationGuard& other)
 , m_onlyConst(other.m_onlyConst)
 , m_system(other.m_system)
 , m_priority(other.m_priority)
+, m_constRegion(other.m_constRegion)
 {
 }
 
@@ -1259,6 +1426,8 @@ EquationGuard::compile() const
   //everything goes into nonconst right now
   if (m_guard == nullptr)
   {
+    m_onlyConst = true;
+    m_constRegion = emptyRegion();
     m_compiled = true;
     return;
   }
@@ -1352,6 +1521,7 @@ EquationGuard::compile() const
       }
     }
 
+    m_constRegion = std::make_shared<Region>(m_dimConstConst);
     m_compiled = true;
   }
   else
@@ -1364,12 +1534,12 @@ EquationGuard::compile() const
 ConditionalBestfitWS::ConditionalBestfitWS(Equations e)
 : m_equations(e)
 {
-  Context emptyk;
   for (auto uiter = m_equations.begin(); uiter != m_equations.end(); ++uiter)
   {
     auto& eqn = *uiter;
-    //force the equation to be compiled and get the priority
-    eqn.validContext().evaluate(emptyk);
+    //force the equation to be compiled and get the priority, after this
+    //the guards are only read
+    eqn.validContext().prepare();
 
     int time = eqn.provenance();
     
@@ -343,6 +343,103 @@ namespace TransLucid
       {TYPE_INDEX_UCHAR, TYPE_INDEX_USTRING}
     };
 
+    //the characters that the header escapes by name
+    bool
+    escape_named(u32string& out, char32_t c)
+    {
+      switch (c)
+      {
+        case U'\n':
+        out += U"\\n";
+        return true;
+
+        case U'\t':
+        out += U"\\t";
+        return true;
+
+        case U'\r':
+        out += U"\\r";
+        return true;
+
+        case U'\\':
+        out += U"\\\\";
+        return true;
+
+        case U'"':
+        out += U"\\\"";
+        return true;
+
+        case U'\'':
+        out += U"\\'";
+        return true;
+      }
+
+      return false;
+    }
+
+    //the same as escape_character in the header
+    void
+    escape_character(u32string& out, char32_t c)
+    {
+      if (escape_named(out, c))
+      {
+        return;
+      }
+
+      if (u_isprint(c))
+      {
+        out += c;
+        return;
+      }
+
+      int digits = c <= 0xFFFF ? 4 : 8;
+      out += digits == 4 ? U"\\u" : U"\\U";
+
+      while (digits != 0)
+      {
+        --digits;
+        int current = (c >> (digits * 4)) & 0xF;
+        out += static_cast<char32_t>
+          (current <= 9 ? current + '0' : current + 'A' - 10);
+      }
+    }
+
+    void
+    print_intmp_to(u32string& out, const mpz_class& z)
+    {
+      thread_local std::string digits;
+      digits.resize(mpz_sizeinbase(z.get_mpz_t(), 10) + 2);
+      mpz_get_str(&digits[0], 10, z.get_mpz_t());
+
+      for (const char* d = digits.c_str(); *d != 0; ++d)
+      {
+        //negative numbers are written with ~
+        out += *d == '-' ? U'~' : static_cast<char32_t>(*d);
+      }
+    }
+
+    //the canonical print of the built in types for the header, specials
+    //and tuples aren't printed by the host
+    Constant
+    canonical_print_value(const Constant& c)
+    {
+      //reused so that printing doesn't allocate once it has grown
+      thread_local u32string buffer;
+      buffer.clear();
+
+      if (!canonical_print_to(buffer, c))
+      {
+        return Types::Special::create(SP_TYPEERROR);
+      }
+
+      return Types::String::create(buffer);
+    }
+
+    //it takes any of the types that canonical_print_to prints, which
+    //can't be written as one type, so it is left untyped
+    BuiltinBaseFunction<1> canonical_print_builtin{&canonical_print_value,
+      {}};
+
     BuiltinBaseFunction<1> get_type_index{
       [] (const Constant& c) -> Constant
       {
@@ -421,6 +518,7 @@ namespace TransLucid
       {U"print_error", &print_error},
       {U"print_uuid", &print_uuid},
       {U"print_floatmp", &print_floatmp},
+      {U"canonical_print_base", &canonical_print_builtin},
 
       {U"make_union", &construct_union},
       {U"type_index", &get_type_index}
@@ -438,6 +536,45 @@ namespace TransLucid
   {
     return Types::String::create(U"internal compiler error");
   }
+
+  bool
+  canonical_print_to(u32string& out, const Constant& c)
+  {
+    switch (c.index())
+    {
+      case TYPE_INDEX_INTMP:
+      print_intmp_to(out, get_constant_pointer<mpz_class>(c));
+      break;
+
+      case TYPE_INDEX_USTRING:
+      out += U'"';
+      for (char32_t ch : get_constant_pointer<u32string>(c))
+      {
+        escape_character(out, ch);
+      }
+      out += U'"';
+      break;
+
+      case TYPE_INDEX_UCHAR:
+      out += U'\'';
+      escape_character(out, get_constant<char32_t>(c));
+      out += U'\'';
+      break;
+
+      case TYPE_INDEX_BOOL:
+      out += get_constant<bool>(c) ? U"true" : U"false";
+      break;
+
+      case TYPE_INDEX_RANGE:
+      out += U"range";
+      break;
+
+      default:
+      return false;
+    }
+
+    return true;
+  }
 }
 
 namespace std
@@ -467,7 +604,8 @@ namespace TransLucid
         &Types::String::equality,
         &Types::String::hash,
         &delete_ptr<u32string>,
-        &Types::String::less
+        &Types::String::less,
+        &destruct_ptr<u32string>
       };
 
     TypeFunctions base_function_type_functions =
@@ -475,7 +613,8 @@ namespace TransLucid
         &Types::BaseFunction::equality,
         &Types::BaseFunction::hash,
         &delete_ptr<BaseFunctionType>,
-        &less_false
+        &less_false,
+        nullptr
       };
 
     TypeFunctions value_function_type_functions =
@@ -483,7 +622,8 @@ namespace TransLucid
         &Types::ValueFunction::equality,
         &Types::ValueFunction::hash,
         &delete_ptr<ValueFunctionType>,
-        &Types::ValueFunction::less
+        &Types::ValueFunction::less,
+        nullptr
       };
 
     TypeFunctions range_type_functions =
@@ -491,7 +631,8 @@ namespace TransLucid
         &Types::Range::equality,
         &Types::Range::hash,
         &delete_ptr<Range>,
-        &Types::Range::less
+        &Types::Range::less,
+        &destruct_ptr<Range>
       };
 
     TypeFunctions region_type_functions =
@@ -499,7 +640,8 @@ namespace TransLucid
         &Types::Region::equality,
         &Types::Region::hash,
         &delete_ptr<Region>,
-        &Types::Region::less
+        &Types::Region::less,
+        &destruct_ptr<Region>
       };
 
     TypeFunctions tuple_type_functions =
@@ -507,7 +649,8 @@ namespace TransLucid
         &Types::Tuple::equality,
         &Types::Tuple::hash,
         &delete_ptr<Tuple>,
-        &Types::Tuple::less
+        &Types::Tuple::less,
+        &destruct_ptr<Tuple>
       };
 
     TypeFunctions intmp_type_functions = 
@@ -515,7 +658,8 @@ namespace TransLucid
         &Types::Intmp::equality,
         &Types::Intmp::hash,
         &delete_ptr<mpz_class>,
-        &Types::Intmp::less
+        &Types::Intmp::less,
+        &destruct_ptr<mpz_class>
       };
 
     TypeFunctions floatmp_type_functions = 
@@ -523,14 +667,17 @@ namespace TransLucid
         &Types::Floatmp::equality,
         &Types::Floatmp::hash,
         &delete_ptr<mpf_class>,
-        &Types::Floatmp::less
+        &Types::Floatmp::less,
+        &destruct_ptr<mpf_class>
       };
 
     TypeFunctions hyperdaton_type_functions =
       {
         &Types::Hyperdatons::equality,
         &Types::Hyperdatons::hash,
-        &delete_ptr<HD>
+        &delete_ptr<HD>,
+        nullptr,
+        nullptr
       };
 
     TypeFunctions workshop_type_functions =
@@ -538,7 +685,8 @@ namespace TransLucid
         &Types::Intension::equality,
         &Types::Intension::hash,
         &delete_ptr<IntensionType>,
-        &Types::Intension::less
+        &Types::Intension::less,
+        &destruct_ptr<IntensionType>
       };
 
     TypeFunctions demand_type_functions =
@@ -546,7 +694,8 @@ namespace TransLucid
         &Types::Demand::equality,
         &Types::Demand::hash,
         &delete_ptr<DemandType>,
-        &Types::Demand::less
+        &Types::Demand::less,
+        &destruct_ptr<DemandType>
       };
 
     //copied and pasted from types.hpp, this should match the strings below
@@ -1527,14 +1676,9 @@ namespace TransLucid
         Context& k
       )
       {
-        ConstantPointerValue* p =
-          new ConstantPointerValue(
-            &workshop_type_functions,
-            new IntensionType(system, const_cast<WS*>(ws), 
-              std::move(binds), 
-              std::move(scope), k));
-
-        return Constant(p, TYPE_INDEX_INTENSION);
+        return emplace_constant_pointer<IntensionType>(
+          &workshop_type_functions, TYPE_INDEX_INTENSION,
+          system, const_cast<WS*>(ws), std::move(binds), std::move(scope), k);
       }
 
       const IntensionType&
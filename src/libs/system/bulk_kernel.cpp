@@ -0,0 +1,787 @@
+/* Bulk evaluation of pointwise arithmetic over arrays.
+   Copyright (C) 2013 Jarryd Beck
+
+This file is part of TransLucid.
+
+TransLucid is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+TransLucid is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with TransLucid; see the file COPYING.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+/**
+ * @file bulk_kernel.cpp
+ * Recognising and running bulk kernels.
+ */
+
+#include <tl/ast.hpp>
+#include <tl/bulk_kernel.hpp>
+#include <tl/context.hpp>
+#include <tl/hyperdatons/arrayhd.hpp>
+#include <tl/range.hpp>
+#include <tl/system.hpp>
+#include <tl/types/intmp.hpp>
+#include <tl/types/range.hpp>
+#include <tl/types_util.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <set>
+
+namespace TransLucid
+{
+
+namespace
+{
+  typedef std::vector<BulkKernel::Instruction> Program;
+
+  //postfix translation of the tree, returns false if part of the tree
+  //is not something that we can do in bulk
+  bool
+  translate(System& system, const Tree::Expr& e, Program& program)
+  {
+    if (auto v = get<mpz_class>(&e))
+    {
+      program.push_back(
+        BulkKernel::Instruction{BulkKernel::Op::CONSTANT, *v, 0});
+      return true;
+    }
+    else if (auto c = get<Constant>(&e))
+    {
+      if (c->index() != TYPE_INDEX_INTMP)
+      {
+        return false;
+      }
+
+      program.push_back(BulkKernel::Instruction
+        {BulkKernel::Op::CONSTANT, Types::Intmp::get(*c), 0});
+      return true;
+    }
+    else if (auto h = get<Tree::HashExpr>(&e))
+    {
+      //only a constant dimension, anything else has to look at the
+      //context to work out which dimension it is
+      dimension_index dim;
+      if (auto d = get<Tree::DimensionExpr>(&h->e))
+      {
+        dim = d->text.empty() ? d->dim : system.getDimensionIndex(d->text);
+      }
+      else if (auto v = get<mpz_class>(&h->e))
+      {
+        dim = system.getDimensionIndex(Types::Intmp::create(*v));
+      }
+      else
+      {
+        return false;
+      }
+
+      program.push_back(
+        BulkKernel::Instruction{BulkKernel::Op::COORDINATE, 0, dim});
+      return true;
+    }
+    else if (auto app = get<Tree::LambdaAppExpr>(&e))
+    {
+      //unary operators are f.x, binary operators are (f.x).y
+      if (auto fn = get<Tree::IdentExpr>(&app->lhs))
+      {
+        if (fn->text != U"uminus" || !translate(system, app->rhs, program))
+        {
+          return false;
+        }
+
+        program.push_back(
+          BulkKernel::Instruction{BulkKernel::Op::NEGATE, 0, 0});
+        return true;
+      }
+
+      auto inner = get<Tree::LambdaAppExpr>(&app->lhs);
+      if (inner == nullptr)
+      {
+        return false;
+      }
+
+      auto fn = get<Tree::IdentExpr>(&inner->lhs);
+      if (fn == nullptr)
+      {
+        return false;
+      }
+
+      BulkKernel::Op op;
+      if (fn->text == U"plus")
+      {
+        op = BulkKernel::Op::PLUS;
+      }
+      else if (fn->text == U"minus")
+      {
+        op = BulkKernel::Op::MINUS;
+      }
+      else if (fn->text == U"times")
+      {
+        op = BulkKernel::Op::TIMES;
+      }
+      else
+      {
+        return false;
+      }
+
+      if (!translate(system, inner->rhs, program) ||
+          !translate(system, app->rhs, program))
+      {
+        return false;
+      }
+
+      program.push_back(BulkKernel::Instruction{op, 0, 0});
+      return true;
+    }
+    else if (auto p = get<Tree::ParenExpr>(&e))
+    {
+      return translate(system, p->e, program);
+    }
+
+    return false;
+  }
+
+  //the operators that a kernel uses, and the host function that each
+  //one has to be defined as for integers
+  struct Builtin
+  {
+    BulkKernel::Op op;
+    u32string name;
+    u32string host;
+  };
+
+  const Builtin builtins[] =
+  {
+    {BulkKernel::Op::PLUS, U"plus", U"intmp_plus"},
+    {BulkKernel::Op::MINUS, U"minus", U"intmp_minus"},
+    {BulkKernel::Op::TIMES, U"times", U"intmp_times"},
+    {BulkKernel::Op::NEGATE, U"uminus", U"intmp_uminus"}
+  };
+
+  const Tree::Expr&
+  stripParens(const Tree::Expr& e)
+  {
+    auto p = get<Tree::ParenExpr>(&e);
+    return p == nullptr ? e : stripParens(p->e);
+  }
+
+  //the host function that an identifier is currently defined as, following
+  //variables that are only another name for one, or null if it is anything
+  //else
+  const BaseFunctionType*
+  resolveHost(System& system, u32string name)
+  {
+    std::set<u32string> seen;
+
+    while (seen.insert(name).second)
+    {
+      Tree::Expr tree = system.getIdentifierTree(name);
+      const Tree::Expr* e = &stripParens(tree);
+
+      //a variable with one unguarded definition
+      if (auto bestfit = get<Tree::ConditionalBestfitExpr>(e))
+      {
+        if (bestfit->declarations.size() != 1 ||
+            get<Tree::nil>(&std::get<1>(bestfit->declarations.front())) 
+              == nullptr ||
+            get<Tree::nil>(&std::get<2>(bestfit->declarations.front())) 
+              == nullptr)
+        {
+          return nullptr;
+        }
+
+        e = &stripParens(std::get<3>(bestfit->declarations.front()));
+      }
+
+      if (auto host = get<Tree::HostOpExpr>(e))
+      {
+        return system.lookupBaseFunction(host->name);
+      }
+
+      auto ident = get<Tree::IdentExpr>(e);
+      if (ident == nullptr)
+      {
+        return nullptr;
+      }
+
+      name = ident->text;
+    }
+
+    return nullptr;
+  }
+
+  //the host function that the system registers for a builtin name. The
+  //first definition of a host function is the one made when the system
+  //starts, and System::addHostFunction calls it name_0
+  const BaseFunctionType*
+  registeredHost(System& system, const u32string& name)
+  {
+    return system.lookupBaseFunction(name + U"_0");
+  }
+
+  //is this the definition of the operator for integers, which is
+  //either unguarded or guarded by imp intmp on every argument, and does
+  //nothing but call the host function with the arguments in order. The
+  //function that it calls is resolved and compared with the host
+  //function, so how it is written doesn't matter
+  bool
+  isIntegerDefinition(System& system, const Parser::FnDecl& decl, 
+    const u32string& hostName)
+  {
+    std::set<u32string> args;
+    for (const auto& a : decl.args)
+    {
+      args.insert(a.second);
+    }
+
+    if (get<Tree::nil>(&decl.guard) == nullptr)
+    {
+      auto region = get<Tree::RegionExpr>(&decl.guard);
+      if (region == nullptr || region->entries.size() != args.size())
+      {
+        return false;
+      }
+
+      std::set<u32string> guarded;
+      for (const auto& entry : region->entries)
+      {
+        auto arg = get<Tree::IdentExpr>(&stripParens(std::get<0>(entry)));
+        auto type = get<Tree::IdentExpr>(&stripParens(std::get<2>(entry)));
+
+        if (arg == nullptr || type == nullptr ||
+            std::get<1>(entry) != Region::Containment::IMP ||
+            type->text != U"intmp")
+        {
+          return false;
+        }
+
+        guarded.insert(arg->text);
+      }
+
+      if (guarded != args)
+      {
+        return false;
+      }
+    }
+
+    if (get<Tree::nil>(&decl.boolean) == nullptr)
+    {
+      return false;
+    }
+
+    auto call = get<Tree::BangAppExpr>(&stripParens(decl.expr));
+    if (call == nullptr || call->args.size() != decl.args.size())
+    {
+      return false;
+    }
+
+    for (size_t i = 0; i != call->args.size(); ++i)
+    {
+      auto arg = get<Tree::IdentExpr>(&stripParens(call->args[i]));
+      if (arg == nullptr || arg->text != decl.args[i].second)
+      {
+        return false;
+      }
+    }
+
+    auto fn = get<Tree::IdentExpr>(&stripParens(call->name));
+    if (fn == nullptr)
+    {
+      return false;
+    }
+
+    const BaseFunctionType* host = registeredHost(system, hostName);
+    return host != nullptr && resolveHost(system, fn->text) == host;
+  }
+
+  //the builtin types that never hold an integer
+  const u32string otherTypes[] =
+  {
+    U"floatmp", U"float", U"bool", U"ustring", U"uchar"
+  };
+
+  //the values that an argument can be fixed to that aren't integers
+  const u32string otherValues[] =
+  {
+    U"infty", U"neginfty"
+  };
+
+  //does the guard require an argument to be a type that an integer
+  //never is, then the definition can't be chosen for integers
+  bool
+  excludesIntegers(const Parser::FnDecl& decl)
+  {
+    auto region = get<Tree::RegionExpr>(&decl.guard);
+    if (region == nullptr)
+    {
+      return false;
+    }
+
+    for (const auto& entry : region->entries)
+    {
+      auto arg = get<Tree::IdentExpr>(&std::get<0>(entry));
+      auto type = get<Tree::IdentExpr>(&std::get<2>(entry));
+
+      if (type == nullptr)
+      {
+        continue;
+      }
+
+      bool other = std::get<1>(entry) == Region::Containment::IS
+        ? std::find(std::begin(otherValues), std::end(otherValues),
+            type->text) != std::end(otherValues)
+        : std::find(std::begin(otherTypes), std::end(otherTypes),
+            type->text) != std::end(otherTypes);
+
+      if (arg != nullptr && other &&
+          std::any_of(decl.args.begin(), decl.args.end(),
+            [&] (const std::pair<Parser::FnDecl::ArgType, u32string>& a)
+            {
+              return a.second == arg->text;
+            }))
+      {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  bool
+  fitsMachine(const mpz_class& v)
+  {
+    return v >= std::numeric_limits<int64_t>::min() &&
+      v <= std::numeric_limits<int64_t>::max();
+  }
+
+  //the value of a dimension for the whole region, or the bounds of it when
+  //it is enumerated by the region
+  struct Coordinate
+  {
+    mpz_class lower;
+    mpz_class upper;
+  };
+
+  //the values of every coordinate are within the given bounds, so if all
+  //of the possible intermediate values fit in a machine integer then
+  //we can safely compute without overflow
+  bool
+  boundsFit
+  (
+    const Program& program,
+    const std::map<dimension_index, Coordinate>& coords
+  )
+  {
+    std::vector<std::pair<mpz_class, mpz_class>> stack;
+
+    for (const auto& inst : program)
+    {
+      switch (inst.op)
+      {
+        case BulkKernel::Op::CONSTANT:
+        stack.push_back(std::make_pair(inst.value, inst.value));
+        break;
+
+        case BulkKernel::Op::COORDINATE:
+        {
+          const auto& c = coords.find(inst.dim)->second;
+          stack.push_back(std::make_pair(c.lower, c.upper));
+        }
+        break;
+
+        case BulkKernel::Op::NEGATE:
+        {
+          auto& top = stack.back();
+          mpz_class lower = -top.second;
+          top.second = -top.first;
+          top.first = lower;
+        }
+        break;
+
+        default:
+        {
+          auto rhs = stack.back();
+          stack.pop_back();
+          auto& lhs = stack.back();
+
+          if (inst.op == BulkKernel::Op::PLUS)
+          {
+            lhs.first += rhs.first;
+            lhs.second += rhs.second;
+          }
+          else if (inst.op == BulkKernel::Op::MINUS)
+          {
+            mpz_class lower = lhs.first - rhs.second;
+            lhs.second = lhs.second - rhs.first;
+            lhs.first = lower;
+          }
+          else
+          {
+            mpz_class products[] = {
+              lhs.first * rhs.first, lhs.first * rhs.second,
+              lhs.second * rhs.first, lhs.second * rhs.second
+            };
+
+            lhs.first = *std::min_element(products, products + 4);
+            lhs.second = *std::max_element(products, products + 4);
+          }
+        }
+        break;
+      }
+
+      if (!fitsMachine(stack.back().first) ||
+          !fitsMachine(stack.back().second))
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+}
+
+bool
+isIntegerOperator
+(
+  System& system,
+  const u32string& name,
+  const u32string& host,
+  size_t arity
+)
+{
+  if (!system.getFunctionDefinitions(host).empty())
+  {
+    return false;
+  }
+
+  size_t integer = 0;
+  for (const auto& decl : system.getFunctionDefinitions(name))
+  {
+    if (decl.args.size() != arity)
+    {
+      return false;
+    }
+
+    if (isIntegerDefinition(system, decl, host))
+    {
+      ++integer;
+    }
+    else if (!excludesIntegers(decl))
+    {
+      return false;
+    }
+  }
+
+  return integer == 1;
+}
+
+std::shared_ptr<BulkKernel>
+BulkKernel::recognise(System& system, const Tree::Expr& e)
+{
+  Program program;
+
+  if (!translate(system, e, program))
+  {
+    return std::shared_ptr<BulkKernel>();
+  }
+
+  //a kernel without any coordinates is a constant, which isn't worth the
+  //trouble
+  bool coordinates = std::any_of(program.begin(), program.end(),
+    [] (const Instruction& i) { return i.op == Op::COORDINATE; });
+
+  if (!coordinates)
+  {
+    return std::shared_ptr<BulkKernel>();
+  }
+
+  auto kernel = std::make_shared<BulkKernel>(system);
+  kernel->m_program = std::move(program);
+
+  //work out how deep the stack gets
+  size_t depth = 0;
+  kernel->m_depth = 0;
+  for (const auto& i : kernel->m_program)
+  {
+    if (i.op == Op::CONSTANT || i.op == Op::COORDINATE)
+    {
+      ++depth;
+      kernel->m_depth = std::max(kernel->m_depth, depth);
+    }
+    else if (i.op != Op::NEGATE)
+    {
+      --depth;
+    }
+  }
+
+  return kernel;
+}
+
+bool
+BulkKernel::evaluate
+(
+  const Region& region,
+  Context& k,
+  ArrayHD& out
+) const
+{
+  const auto& bounds = out.bounds();
+
+  if (bounds.empty())
+  {
+    return false;
+  }
+
+  std::map<dimension_index, Coordinate> coords;
+
+  //the context outside of the region
+  Context evalContext(k);
+
+  //every dimension of the array has to be a finite range inside the array,
+  //and there can't be any other ranges. A dimension that the context
+  //already has is only demanded at that value, which a box can't express
+  for (const auto& entry : region)
+  {
+    if (k.has_entry(entry.first))
+    {
+      return false;
+    }
+
+    bool inArray = std::find_if(bounds.begin(), bounds.end(),
+      [&] (const std::pair<dimension_index, size_t>& b)
+      {
+        return b.first == entry.first;
+      }) != bounds.end();
+
+    const Constant& value = entry.second.second;
+
+    if (value.index() == TYPE_INDEX_RANGE &&
+        entry.second.first == Region::Containment::IN)
+    {
+      const Range& r = Types::Range::get(value);
+
+      if (!inArray || r.lower() == nullptr || r.upper() == nullptr)
+      {
+        return false;
+      }
+
+      coords[entry.first] = Coordinate{*r.lower(), *r.upper()};
+    }
+    else if (inArray)
+    {
+      return false;
+    }
+    else
+    {
+      evalContext.perturb(entry.first, value);
+    }
+  }
+
+  for (const auto& b : bounds)
+  {
+    auto iter = coords.find(b.first);
+    if (iter == coords.end() || iter->second.lower < 0 ||
+        iter->second.upper >= b.second ||
+        iter->second.lower > iter->second.upper)
+    {
+      return false;
+    }
+  }
+
+  //any other coordinate comes from the context and is the same for the
+  //whole region
+  for (const auto& inst : m_program)
+  {
+    if (inst.op == Op::COORDINATE && coords.find(inst.dim) == coords.end())
+    {
+      const Constant& c = evalContext.lookup(inst.dim);
+
+      if (c.index() != TYPE_INDEX_INTMP)
+      {
+        return false;
+      }
+
+      const mpz_class& v = Types::Intmp::get(c);
+      coords[inst.dim] = Coordinate{v, v};
+    }
+  }
+
+  if (!boundsFit(m_program, coords))
+  {
+    return false;
+  }
+
+  //every operator in the kernel has to mean integer arithmetic, checked
+  //on every evaluation because the definitions can change between instants
+  for (const auto& builtin : builtins)
+  {
+    bool used = std::any_of(m_program.begin(), m_program.end(),
+      [&] (const Instruction& i) { return i.op == builtin.op; });
+
+    if (used && !isIntegerOperator(m_system, builtin.name, builtin.host,
+          builtin.op == Op::NEGATE ? 1 : 2))
+    {
+      return false;
+    }
+  }
+
+  //the innermost dimension of the array is contiguous, so we compute a
+  //row at a time along it
+  dimension_index rowDim = bounds.back().first;
+  int64_t rowStart = coords[rowDim].lower.get_si();
+  size_t rowLength = coords[rowDim].upper.get_si() - rowStart + 1;
+
+  std::vector<std::vector<int64_t>> stack(m_depth,
+    std::vector<int64_t>(rowLength));
+
+  //the current value of the outer dimensions
+  std::vector<int64_t> current;
+  for (auto iter = bounds.begin(); iter + 1 != bounds.end(); ++iter)
+  {
+    current.push_back(coords[iter->first].lower.get_si());
+  }
+
+  Constant* data = out.begin();
+  const auto& multipliers = out.multipliers();
+
+  while (true)
+  {
+    size_t offset = rowStart;
+    for (size_t i = 0; i != current.size(); ++i)
+    {
+      offset += current[i] * multipliers[i];
+    }
+
+    size_t top = 0;
+    for (const auto& inst : m_program)
+    {
+      switch (inst.op)
+      {
+        case Op::CONSTANT:
+        std::fill(stack[top].begin(), stack[top].end(), inst.value.get_si());
+        ++top;
+        break;
+
+        case Op::COORDINATE:
+        {
+          auto& row = stack[top];
+          if (inst.dim == rowDim)
+          {
+            for (size_t j = 0; j != rowLength; ++j)
+            {
+              row[j] = rowStart + j;
+            }
+          }
+          else
+          {
+            auto iter = std::find_if(bounds.begin(), bounds.end(),
+              [&] (const std::pair<dimension_index, size_t>& b)
+              {
+                return b.first == inst.dim;
+              });
+
+            int64_t value = iter == bounds.end()
+              ? coords[inst.dim].lower.get_si()
+              : current[iter - bounds.begin()];
+            std::fill(row.begin(), row.end(), value);
+          }
+          ++top;
+        }
+        break;
+
+        case Op::NEGATE:
+        {
+          int64_t* a = stack[top - 1].data();
+          for (size_t j = 0; j != rowLength; ++j)
+          {
+            a[j] = -a[j];
+          }
+        }
+        break;
+
+        //the arithmetic loops are kept simple so that the compiler can
+        //vectorise them
+        case Op::PLUS:
+        {
+          int64_t* a = stack[top - 2].data();
+          const int64_t* b = stack[top - 1].data();
+          for (size_t j = 0; j != rowLength; ++j)
+          {
+            a[j] += b[j];
+          }
+          --top;
+        }
+        break;
+
+        case Op::MINUS:
+        {
+          int64_t* a = stack[top - 2].data();
+          const int64_t* b = stack[top - 1].data();
+          for (size_t j = 0; j != rowLength; ++j)
+          {
+            a[j] -= b[j];
+          }
+          --top;
+        }
+        break;
+
+        case Op::TIMES:
+        {
+          int64_t* a = stack[top - 2].data();
+          const int64_t* b = stack[top - 1].data();
+          for (size_t j = 0; j != rowLength; ++j)
+          {
+            a[j] *= b[j];
+          }
+          --top;
+        }
+        break;
+      }
+    }
+
+    m_cells += rowLength;
+
+    const auto& result = stack[0];
+    for (size_t j = 0; j != rowLength; ++j)
+    {
+      data[offset + j] = Types::Intmp::create(mpz_class(
+        static_cast<long>(result[j])));
+    }
+
+    //increment the outer dimensions, the last one fastest
+    bool carry = true;
+    size_t i = current.size();
+    while (carry && i != 0)
+    {
+      --i;
+      if (current[i] == coords[bounds[i].first].upper)
+      {
+        current[i] = coords[bounds[i].first].lower.get_si();
+      }
+      else
+      {
+        ++current[i];
+        carry = false;
+      }
+    }
+
+    if (carry)
+    {
+      break;
+    }
+  }
+
+  return true;
+}
+
+}
@@ -18,6 +18,7 @@ along with TransLucid; see the file COPYING.  If not see
 <http://www.gnu.org/licenses/>.  */
 
 #include <tl/cache.hpp>
+#include <tl/hyperdaton.hpp>
 #include <tl/system.hpp>
 #include <tl/types/calc.hpp>
 #include <tl/types/demand.hpp>
@@ -26,6 +27,7 @@ along with TransLucid; see the file COPYING.  If not see
 
 #include <tl/output.hpp>
 
+#include <algorithm>
 #include <iostream>
 
 //define this to debug the cache
@@ -36,6 +38,10 @@ namespace TransLucid
 
 namespace
 {
+  //a function that is applied in lots of different contexts during one
+  //evaluation stops being kept after this many
+  constexpr size_t MAX_MEMO_ENTRIES = 16;
+
   //Constant
   //lookup_entry_map
   //(
@@ -489,6 +495,173 @@ set_visit_top_entry
   }
 }
 
+//walks the cache for every point of a block at once, a level that looks
+//at one of the block's dimensions goes through each of its values, and
+//the points of the block that a level doesn't look at share its entry
+class BlockWalk
+{
+  public:
+
+  BlockWalk(const Context& k, const Delta& delta, const HDBlock& block,
+    Cache& cache, bool create)
+  : m_k(k)
+  , m_delta(delta)
+  , m_bounds(block.bounds())
+  , m_strides(m_bounds.size())
+  , m_walked(m_bounds.size(), false)
+  , m_cache(cache)
+  , m_create(create)
+  {
+    //the last bound varies fastest
+    size_t stride = 1;
+    for (size_t b = m_bounds.size(); b != 0; --b)
+    {
+      m_strides[b - 1] = stride;
+      stride *= m_bounds[b - 1].size;
+    }
+  }
+
+  //found is called with the entry of each point that has one, and missing
+  //with the demand or calc that a get would have given for the rest
+  template <typename Found, typename Missing>
+  void
+  level(CacheLevel& l, size_t offset, Found& found, Missing& missing)
+  {
+    std::vector<dimension_index> demands;
+    for (auto d : l.dims)
+    {
+      if (!m_delta.contains(d))
+      {
+        demands.push_back(d);
+      }
+    }
+
+    if (!m_create && !demands.empty())
+    {
+      Constant demand = Types::Demand::create(demands);
+      points(offset, 0, [&] (size_t i) { missing(demand, i); });
+      return;
+    }
+
+    node(l.entry, l.dims.begin(), l.dims.end(), offset, found, missing);
+  }
+
+  private:
+
+  template <typename Found, typename Missing>
+  void
+  node
+  (
+    CacheLevelNode& n,
+    std::vector<dimension_index>::const_iterator iter,
+    std::vector<dimension_index>::const_iterator end,
+    size_t offset,
+    Found& found,
+    Missing& missing
+  )
+  {
+    if (auto e = get<CacheEntry>(&n.entry))
+    {
+      m_cache.updateRetirementAge(e->age);
+      e->age = 0;
+
+      if (auto l = get<CacheLevel>(&e->entry))
+      {
+        level(*l, offset, found, missing);
+      }
+      else
+      {
+        points(offset, 0, [&] (size_t i) { found(*e, i); });
+      }
+
+      return;
+    }
+
+    auto& map = get<CacheEntryMap>(n.entry).entry;
+    auto next = iter;
+    ++next;
+
+    values(*iter, offset, [&] (const Constant& v, size_t at)
+      {
+        auto child = map.find(v);
+
+        if (child == map.end())
+        {
+          if (!m_create)
+          {
+            m_cache.miss();
+            Constant calc = Types::Calc::create();
+            points(at, 0, [&] (size_t i) { missing(calc, i); });
+            return;
+          }
+
+          child = map.insert(std::make_pair(v, next == end 
+            ? CacheLevelNode(CacheEntry(Types::Calc::create()))
+            : CacheLevelNode(CacheEntryMap()))).first;
+        }
+
+        node(child->second, next, end, at, found, missing);
+      }
+    );
+  }
+
+  //the values of dim, every value of its bound if the block has one
+  template <typename F>
+  void
+  values(dimension_index dim, size_t offset, F f)
+  {
+    for (size_t b = 0; b != m_bounds.size(); ++b)
+    {
+      if (!m_walked[b] && m_bounds[b].dim == dim)
+      {
+        m_walked[b] = true;
+
+        mpz_class v = m_bounds[b].lower;
+        for (size_t i = 0; i != m_bounds[b].size; ++i, ++v)
+        {
+          f(Types::Intmp::create(v), offset + i * m_strides[b]);
+        }
+
+        m_walked[b] = false;
+        return;
+      }
+    }
+
+    f(m_k.lookup(dim), offset);
+  }
+
+  //every point that varies only in the bounds that haven't been walked,
+  //in the order of the block
+  template <typename F>
+  void
+  points(size_t offset, size_t b, F f)
+  {
+    if (b == m_bounds.size())
+    {
+      f(offset);
+    }
+    else if (m_walked[b])
+    {
+      points(offset, b + 1, f);
+    }
+    else
+    {
+      for (size_t i = 0; i != m_bounds[b].size; ++i)
+      {
+        points(offset + i * m_strides[b], b + 1, f);
+      }
+    }
+  }
+
+  const Context& m_k;
+  const Delta& m_delta;
+  const std::vector<HDBlock::Bound>& m_bounds;
+  std::vector<size_t> m_strides;
+  std::vector<bool> m_walked;
+  Cache& m_cache;
+  bool m_create;
+};
+
 }
 
 Cache::Cache()
@@ -541,6 +714,68 @@ Cache::set(const Context& k, const Delta& delta, const Constant& value)
   );
 }
 
+void
+Cache::getBlock
+(
+  const Context& k,
+  const Delta& delta,
+  const HDBlock& block,
+  Constant* values
+)
+{
+  if (!m_entry)
+  {
+    m_entry = new CacheLevel;
+    std::fill_n(values, block.size(), Types::Calc::create());
+    return;
+  }
+
+  //as get_cache_entry_visitor does for one point
+  auto found = [this, values] (CacheEntry& e, size_t i)
+    {
+      hit();
+
+      const Constant& c = TransLucid::get<Constant>(e.entry);
+      values[i] = c.index() == TYPE_INDEX_CALC 
+        ? Types::Special::create(SP_LOOP) : c;
+    };
+
+  auto missing = [values] (const Constant& r, size_t i)
+    {
+      values[i] = r;
+    };
+
+  BlockWalk(k, delta, block, *this, false).level(*m_entry, 0, found, 
+    missing);
+}
+
+void
+Cache::setBlock
+(
+  const Context& k,
+  const Delta& delta,
+  const HDBlock& block,
+  const Constant* values
+)
+{
+  if (!m_entry)
+  {
+    m_entry = new CacheLevel;
+  }
+
+  //points that share an entry are set in order, so the last one is kept
+  //as it would be by setting them one at a time
+  auto found = [values] (CacheEntry& e, size_t i)
+    {
+      set_cache_value(e, values[i]);
+    };
+
+  auto missing = [] (const Constant&, size_t) {};
+
+  BlockWalk(k, delta, block, *this, true).level(*m_entry, 0, found, 
+    missing);
+}
+
 void
 Cache::garbageCollect()
 {
@@ -566,6 +801,80 @@ CacheLevel::CacheLevel()
 {
 }
 
+const TimeConstant*
+EvaluationMemo::find
+(
+  const WS* ws,
+  const Context& kappa,
+  const Delta& d,
+  size_t t
+) const
+{
+  auto iter = m_entries.find(ws);
+
+  if (iter == m_entries.end())
+  {
+    return nullptr;
+  }
+
+  for (const auto& entry : iter->second)
+  {
+    if (entry.time != t)
+    {
+      continue;
+    }
+
+    bool same = std::all_of(entry.context.begin(), entry.context.end(),
+      [&] (const std::pair<dimension_index, Constant>& v)
+      {
+        return d.contains(v.first) && kappa.lookup(v.first) == v.second;
+      });
+
+    if (same)
+    {
+      return &entry.result;
+    }
+  }
+
+  return nullptr;
+}
+
+void
+EvaluationMemo::insert
+(
+  const WS* ws,
+  const Context& kappa,
+  const Delta& d,
+  size_t t,
+  const TimeConstant& result
+)
+{
+  auto index = result.second.index();
+
+  //a loop only means that something else is being computed right now
+  if (index == TYPE_INDEX_DEMAND || (index == TYPE_INDEX_SPECIAL &&
+      get_constant<Special>(result.second) == SP_LOOP))
+  {
+    return;
+  }
+
+  auto& entries = m_entries[ws];
+
+  if (entries.size() == MAX_MEMO_ENTRIES)
+  {
+    return;
+  }
+
+  Entry entry{t, {}, result};
+
+  for (auto dim : d)
+  {
+    entry.context.push_back(std::make_pair(dim, kappa.lookup(dim)));
+  }
+
+  entries.push_back(std::move(entry));
+}
+
 namespace Workshops
 {
 
@@ -579,14 +888,24 @@ CacheWS::operator()(Context& kappa)
   //although maybe it can just call cached code with all the dimensions
   if (m_system.cacheEnabled())
   {
-    //we need to start a new thread and a new time
-    Thread w;
+    //we need to start a new thread and a new time, the memo is kept for
+    //every try below, each one only adds dimensions
+    EvaluationMemo memo;
+    Thread w(memo);
     Delta delta;
+    ContextPerturber p{kappa};
+
+    //everything is available here, so start with what we know is needed
+    for (auto d : staticDimensions())
+    {
+      p.perturb(d, kappa.lookup(d));
+      delta.insert(d);
+    }
+
     auto c = operator()(kappa, delta, w, 0);
 
     if (c.second.index() == TYPE_INDEX_DEMAND)
     {
-      ContextPerturber p{kappa};
       //or not, we need to fill in the undefined dimensions and try again
       while (c.second.index() == TYPE_INDEX_DEMAND)
       {
@@ -695,20 +1014,56 @@ CacheWS::operator()(Context& kappa, Delta& delta, const Thread& w, size_t t)
   Delta subdelta;
   Context subcontext;
   ContextPerturber p(subcontext);
+  bool seeded = false;
+
+  DemandTrace* trace = m_system.demandTrace();
+  DemandTrace::Scope traced(trace);
+  DemandTrace::Outcome outcome = DemandTrace::OUTCOME_HIT;
+
+  //what was finished before a demand is still good after it, the caller's
+  //memo is used if it has one so that it lasts over its tries as well
+  EvaluationMemo memo;
+  Thread inner = w.memo() != nullptr ? w : Thread(memo);
 
   while (true)
   {
     Constant d = m_cache.get(kappa, subdelta);
 
-    if (d.index() == TYPE_INDEX_CALC)
+    std::vector<dimension_index> seed;
+    if (d.index() == TYPE_INDEX_CALC && !seeded)
+    {
+      //the first time that something has to be computed, the dimensions
+      //that we know it will demand are treated as though it already has,
+      //which saves evaluating it again for each one
+      seeded = true;
+
+      //only the dimensions that delta actually lists, the same as the
+      //demands below, a delta that contains everything lists nothing
+      const auto& dims = staticDimensions();
+      std::set_intersection(dims.begin(), dims.end(),
+        delta.begin(), delta.end(),
+        std::back_inserter(seed));
+
+      seed.erase(std::remove_if(seed.begin(), seed.end(),
+        [&subdelta] (dimension_index dim) { return subdelta.contains(dim); }),
+        seed.end());
+    }
+
+    if (!seed.empty())
+    {
+      d = Types::Demand::create(seed);
+      m_cache.set(kappa, subdelta, d);
+    }
+    else if (d.index() == TYPE_INDEX_CALC)
     {
       #ifdef TL_DEBUG_CACHE
       std::cerr << "cache node: " << m_name << ": calc" << std::endl;
       #endif
 
-      auto result = (*m_expr)(kappa, subdelta, w, t);
+      auto result = (*m_expr)(kappa, subdelta, inner, t);
       m_cache.set(kappa, subdelta, result.second);
       d = result.second;
+      outcome = DemandTrace::OUTCOME_CALC;
     }
     #ifdef TL_DEBUG_CACHE
     std::cerr << "cache node: " << m_name << ": result: " <<
@@ -730,6 +1085,11 @@ CacheWS::operator()(Context& kappa, Delta& delta, const Thread& w, size_t t)
 
       if (diff.size() != 0)
       {
+        if (traced.active())
+        {
+          traced.end(traceVariable(*trace), kappa, subdelta,
+            DemandTrace::OUTCOME_DEMAND);
+        }
         return TimeConstant(t, Types::Demand::create(diff));
       }
 
@@ -771,9 +1131,54 @@ CacheWS::operator()(Context& kappa, Delta& delta, const Thread& w, size_t t)
   }
   #endif
 
+  if (traced.active())
+  {
+    if (v.index() == TYPE_INDEX_SPECIAL && 
+        get_constant<Special>(v) == SP_LOOP)
+    {
+      outcome = DemandTrace::OUTCOME_LOOP;
+    }
+
+    //the context is what the variable demanded, not what the caller
+    //had, so that the same work under different callers is one context
+    traced.end(traceVariable(*trace), kappa, subdelta, outcome);
+  }
+
   return std::make_pair(t, v);
 }
 
+uint32_t
+CacheWS::traceVariable(DemandTrace& trace)
+{
+  //a new trace numbers the names again
+  if (m_traceSerial != trace.serial())
+  {
+    m_traceSerial = trace.serial();
+    m_traceVariable = trace.variable(m_name);
+  }
+
+  return m_traceVariable;
+}
+
+const std::vector<dimension_index>&
+CacheWS::staticDimensions()
+{
+  if (m_identifier.empty())
+  {
+    return m_dims;
+  }
+
+  if (m_dimsGeneration != m_system.dimensionalityGeneration())
+  {
+    m_dims = m_system.getIdentifierDimensions(m_identifier);
+
+    //finding them can compile definitions, which changes the generation
+    m_dimsGeneration = m_system.dimensionalityGeneration();
+  }
+
+  return m_dims;
+}
+
 }
 
 }
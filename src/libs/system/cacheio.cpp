@@ -19,32 +19,119 @@ along with TransLucid; see the file COPYING.  If not see
 
 #include <tl/cacheio.hpp>
 #include <tl/fixed_indexes.hpp>
+#include <tl/types/demand.hpp>
+
+#include <algorithm>
 
 namespace TransLucid
 {
 
+namespace
+{
+  //a value that hasn't been put is undefined, asking for it leaves a
+  //placeholder that is a loop the next time
+  Constant
+  cached_value(Constant r)
+  {
+    if (r.index() == TYPE_INDEX_DEMAND || r.index() == TYPE_INDEX_CALC ||
+        (r.index() == TYPE_INDEX_SPECIAL && 
+         get_constant<Special>(r) == SP_LOOP))
+    {
+      return Types::Special::create(SP_UNDEF);
+    }
+
+    return r;
+  }
+
+  //the cache can't set a value that it hasn't got a place for, so the
+  //first put gives it one level with the dimensions of that put, and
+  //every value is found by those dimensions after that
+  void
+  level(Cache& cache, bool& levelled, const Context& k, const Delta& d)
+  {
+    if (!levelled)
+    {
+      cache.get(k, d);
+      cache.set(k, d, Types::Demand::create(
+        std::vector<dimension_index>(d.begin(), d.end())));
+      levelled = true;
+    }
+  }
+
+  //every point of the block has the same dimensions
+  Delta
+  block_delta(const Context& k, const HDBlock& block)
+  {
+    Delta d;
+    k.fillDelta(d);
+
+    for (const auto& b : block.bounds())
+    {
+      d.insert(b.dim);
+    }
+
+    return d;
+  }
+}
+
 void
 CacheIO::put(const Context& k, const Constant& c)
 {
   Delta d;
   k.fillDelta(d);
 
+  level(m_cache, m_levelled, k, d);
+
+  m_cache.get(k, d);
   m_cache.set(k, d, c);
 }
 
 Constant
 CacheIO::get(const Context& k) const
 {
+  if (!m_levelled)
+  {
+    return Types::Special::create(SP_UNDEF);
+  }
+
   Delta d;
   k.fillDelta(d);
-  auto r = m_cache.get(k, d);
 
-  if (r.index() == TYPE_INDEX_DEMAND || r.index() == TYPE_INDEX_CALC)
+  return cached_value(m_cache.get(k, d));
+}
+
+void
+CacheIO::putBlock
+(
+  const Context& k,
+  const HDBlock& block,
+  const Constant* values
+)
+{
+  Delta d = block_delta(k, block);
+
+  level(m_cache, m_levelled, k, d);
+  m_cache.setBlock(k, d, block, values);
+}
+
+void
+CacheIO::getBlock
+(
+  const Context& k,
+  const HDBlock& block,
+  Constant* values
+) const
+{
+  if (!m_levelled)
   {
-    return Types::Special::create(SP_UNDEF);
+    std::fill_n(values, block.size(), Types::Special::create(SP_UNDEF));
+    return;
   }
 
-  return r;
+  Delta d = block_delta(k, block);
+
+  m_cache.getBlock(k, d, block, values);
+  std::transform(values, values + block.size(), values, cached_value);
 }
 
 }
@@ -0,0 +1,71 @@
+/* Reuse of closures.
+   Copyright (C) 2013 Jarryd Beck
+
+This file is part of TransLucid.
+
+TransLucid is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+TransLucid is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with TransLucid; see the file COPYING.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <tl/closure_cache.hpp>
+
+#include <atomic>
+
+namespace TransLucid
+{
+
+namespace
+{
+  std::atomic<size_t> closuresCreated(0);
+  std::atomic<size_t> closuresReused(0);
+}
+
+constexpr size_t ClosureCache::NUM_SLOTS;
+
+size_t
+ClosureCache::hash(const Bindings& binds)
+{
+  size_t h = 0;
+
+  for (const auto& b : binds)
+  {
+    h = h * 31 + b.first;
+    h = h * 31 + b.second.hash();
+  }
+
+  return h;
+}
+
+void
+ClosureCache::created()
+{
+  closuresCreated.fetch_add(1, std::memory_order_relaxed);
+}
+
+void
+ClosureCache::reused()
+{
+  closuresReused.fetch_add(1, std::memory_order_relaxed);
+}
+
+ClosureCache::Statistics
+ClosureCache::statistics()
+{
+  return Statistics
+  {
+    closuresCreated.load(std::memory_order_relaxed),
+    closuresReused.load(std::memory_order_relaxed)
+  };
+}
+
+}
@@ -0,0 +1,320 @@
+/* Pooled allocation of boxed constants.
+   Copyright (C) 2013 Jarryd Beck
+
+This file is part of TransLucid.
+
+TransLucid is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+TransLucid is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with TransLucid; see the file COPYING.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <tl/constant_pool.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <set>
+
+namespace TransLucid
+{
+
+namespace ConstantPool
+{
+
+namespace
+{
+  constexpr size_t NUM_CLASSES = MAX_POOLED_SIZE / ALIGNMENT;
+
+  //each thread carves its blocks out of slabs this big
+  constexpr size_t SLAB_SIZE = 64 * 1024;
+
+  struct FreeBlock
+  {
+    FreeBlock* next;
+  };
+
+  inline size_t
+  sizeClass(size_t size)
+  {
+    return (size + ALIGNMENT - 1) / ALIGNMENT - 1;
+  }
+
+  inline size_t
+  classSize(size_t c)
+  {
+    return (c + 1) * ALIGNMENT;
+  }
+
+  //only the owning thread writes to these, so they don't need a locked
+  //increment, but other threads can read them for the statistics
+  struct Counter
+  {
+    Counter()
+    : value(0)
+    {
+    }
+
+    void
+    increment()
+    {
+      value.store(value.load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+    }
+
+    size_t
+    get() const
+    {
+      return value.load(std::memory_order_relaxed);
+    }
+
+    std::atomic<size_t> value;
+  };
+
+  struct ThreadCache
+  {
+    ThreadCache()
+    : free{}
+    , slabPos(nullptr)
+    , slabEnd(nullptr)
+    {
+    }
+
+    FreeBlock* free[NUM_CLASSES];
+
+    //the rest of the current slab
+    char* slabPos;
+    char* slabEnd;
+
+    Counter allocations;
+    Counter deallocations;
+  };
+
+  //where the blocks of threads that have finished go, and the totals for
+  //everything that isn't in a thread cache
+  struct Depot
+  {
+    Depot()
+    : free{}
+    , statistics{0, 0, 0, 0}
+    {
+    }
+
+    std::mutex mutex;
+    FreeBlock* free[NUM_CLASSES];
+    std::set<ThreadCache*> caches;
+    Statistics statistics;
+  };
+
+  //never destroyed, because constants can outlive everything else
+  Depot&
+  depot()
+  {
+    static Depot* d = new Depot;
+    return *d;
+  }
+
+  void
+  push(FreeBlock*& list, void* p)
+  {
+    FreeBlock* b = static_cast<FreeBlock*>(p);
+    b->next = list;
+    list = b;
+  }
+
+  void*
+  pop(FreeBlock*& list)
+  {
+    FreeBlock* b = list;
+    list = b->next;
+    return b;
+  }
+
+  void
+  retire(ThreadCache* cache)
+  {
+    Depot& d = depot();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    for (size_t c = 0; c != NUM_CLASSES; ++c)
+    {
+      while (cache->free[c] != nullptr)
+      {
+        push(d.free[c], pop(cache->free[c]));
+      }
+    }
+
+    d.statistics.allocations += cache->allocations.get();
+    d.statistics.deallocations += cache->deallocations.get();
+    d.caches.erase(cache);
+  }
+
+  //the cache is only created when a thread first uses the pool, and once
+  //the thread has finished with it everything goes straight to the depot
+  thread_local ThreadCache* t_cache = nullptr;
+  thread_local bool t_finished = false;
+
+  struct CacheOwner
+  {
+    ~CacheOwner()
+    {
+      if (t_cache != nullptr)
+      {
+        retire(t_cache);
+        delete t_cache;
+        t_cache = nullptr;
+      }
+      t_finished = true;
+    }
+  };
+
+  thread_local CacheOwner t_owner;
+
+  ThreadCache*
+  threadCache()
+  {
+    if (t_cache == nullptr && !t_finished)
+    {
+      //make sure that the owner will clean up
+      (void)&t_owner;
+
+      t_cache = new ThreadCache;
+
+      Depot& d = depot();
+      std::lock_guard<std::mutex> lock(d.mutex);
+      d.caches.insert(t_cache);
+    }
+
+    return t_cache;
+  }
+
+  //get more blocks for size class c when the thread has run out
+  void*
+  refill(ThreadCache* cache, size_t c)
+  {
+    size_t size = classSize(c);
+
+    if (cache->slabPos + size > cache->slabEnd)
+    {
+      Depot& d = depot();
+      std::lock_guard<std::mutex> lock(d.mutex);
+
+      //take everything that finished threads left behind
+      if (d.free[c] != nullptr)
+      {
+        cache->free[c] = d.free[c];
+        d.free[c] = nullptr;
+        return pop(cache->free[c]);
+      }
+
+      cache->slabPos = static_cast<char*>(::operator new(SLAB_SIZE));
+      cache->slabEnd = cache->slabPos + SLAB_SIZE;
+      d.statistics.reserved += SLAB_SIZE;
+    }
+
+    void* p = cache->slabPos;
+    cache->slabPos += size;
+    return p;
+  }
+}
+
+void*
+allocate(size_t size)
+{
+  if (size > MAX_POOLED_SIZE)
+  {
+    Depot& d = depot();
+    void* p = ::operator new(size);
+
+    std::lock_guard<std::mutex> lock(d.mutex);
+    ++d.statistics.large;
+    ++d.statistics.allocations;
+    return p;
+  }
+
+  size_t c = sizeClass(size);
+  ThreadCache* cache = threadCache();
+
+  if (cache == nullptr)
+  {
+    //the thread is exiting, so use the depot
+    Depot& d = depot();
+    std::lock_guard<std::mutex> lock(d.mutex);
+    ++d.statistics.allocations;
+
+    if (d.free[c] != nullptr)
+    {
+      return pop(d.free[c]);
+    }
+
+    d.statistics.reserved += classSize(c);
+    return ::operator new(classSize(c));
+  }
+
+  cache->allocations.increment();
+
+  if (cache->free[c] != nullptr)
+  {
+    return pop(cache->free[c]);
+  }
+
+  return refill(cache, c);
+}
+
+void
+deallocate(void* p, size_t size)
+{
+  if (size > MAX_POOLED_SIZE)
+  {
+    ::operator delete(p);
+
+    Depot& d = depot();
+    std::lock_guard<std::mutex> lock(d.mutex);
+    ++d.statistics.deallocations;
+    return;
+  }
+
+  size_t c = sizeClass(size);
+  ThreadCache* cache = threadCache();
+
+  if (cache == nullptr)
+  {
+    Depot& d = depot();
+    std::lock_guard<std::mutex> lock(d.mutex);
+    ++d.statistics.deallocations;
+    push(d.free[c], p);
+    return;
+  }
+
+  cache->deallocations.increment();
+  push(cache->free[c], p);
+}
+
+Statistics
+statistics()
+{
+  Depot& d = depot();
+  std::lock_guard<std::mutex> lock(d.mutex);
+
+  Statistics s = d.statistics;
+
+  for (auto cache : d.caches)
+  {
+    s.allocations += cache->allocations.get();
+    s.deallocations += cache->deallocations.get();
+  }
+
+  return s;
+}
+
+}
+
+}
@@ -0,0 +1,259 @@
+/* Demand trace recorder.
+   Copyright (C) 2013 Jarryd Beck
+
+This file is part of TransLucid.
+
+TransLucid is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+TransLucid is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with TransLucid; see the file COPYING.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <tl/charset.hpp>
+#include <tl/context.hpp>
+#include <tl/demand_trace.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+
+namespace TransLucid
+{
+
+namespace
+{
+  const char FILE_MAGIC[8] = {'T', 'L', 'T', 'R', 'A', 'C', 'E', 0};
+
+  std::atomic<uint64_t> nextSerial(1);
+
+  //everything in the file is little endian
+  template <typename T>
+  void
+  write_number(std::ostream& os, T value)
+  {
+    for (size_t i = 0; i != sizeof(T); ++i)
+    {
+      os.put(static_cast<char>((value >> (i * 8)) & 0xFF));
+    }
+  }
+
+  void
+  write_string(std::ostream& os, const std::string& s)
+  {
+    write_number<uint32_t>(os, s.size());
+    os.write(s.data(), s.size());
+  }
+
+  uint64_t
+  combine(uint64_t seed, uint64_t v)
+  {
+    return seed ^ (v + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+  }
+}
+
+DemandTrace::DemandTrace(size_t capacity)
+: m_serial(nextSerial++)
+, m_capacity(std::max(capacity, size_t(1)))
+, m_total(0)
+, m_sequence(0)
+{
+}
+
+uint32_t
+DemandTrace::variable(const u32string& name)
+{
+  auto iter = m_variableIds.find(name);
+
+  if (iter != m_variableIds.end())
+  {
+    return iter->second;
+  }
+
+  uint32_t id = m_variables.size();
+  m_variables.push_back(name);
+  m_variableIds.insert({name, id});
+
+  return id;
+}
+
+uint64_t
+DemandTrace::begin()
+{
+  uint64_t parent = m_open.empty() ? 0 : m_open.back().sequence;
+
+  m_open.push_back(Open{++m_sequence, parent, clock::now()});
+
+  return m_sequence;
+}
+
+void
+DemandTrace::end
+(
+  uint64_t sequence,
+  uint32_t variable,
+  const Context& kappa,
+  const Delta& delta,
+  Outcome outcome
+)
+{
+  auto now = clock::now();
+
+  //anything inside this that didn't finish is forgotten
+  while (!m_open.empty() && m_open.back().sequence != sequence)
+  {
+    m_open.pop_back();
+  }
+
+  if (m_open.empty())
+  {
+    return;
+  }
+
+  Open open = m_open.back();
+  m_open.pop_back();
+
+  //only the dimensions that were asked for say where the demand was
+  uint64_t context = 0;
+  for (auto d : delta)
+  {
+    context = combine(context, d);
+    context = combine(context, kappa.lookup(d).hash());
+  }
+
+  auto text = m_contexts.find(context);
+  if (text == m_contexts.end())
+  {
+    std::ostringstream os;
+    os << "[";
+    bool first = true;
+    for (auto d : delta)
+    {
+      if (!first)
+      {
+        os << ", ";
+      }
+      first = false;
+      os << "#" << d << " <- " << print_constant(kappa.lookup(d));
+    }
+    os << "]";
+
+    text = m_contexts.insert({context, ContextText{os.str(), 0}}).first;
+  }
+  ++text->second.records;
+
+  Record record
+  {
+    sequence,
+    open.parent,
+    static_cast<uint64_t>(std::chrono::duration_cast
+      <std::chrono::nanoseconds>(now - open.start).count()),
+    context,
+    variable,
+    outcome
+  };
+
+  if (m_ring.size() < m_capacity)
+  {
+    m_ring.push_back(record);
+  }
+  else
+  {
+    Record& oldest = m_ring[m_total % m_capacity];
+
+    auto old = m_contexts.find(oldest.context);
+    if (--old->second.records == 0)
+    {
+      m_contexts.erase(old);
+    }
+
+    oldest = record;
+  }
+
+  ++m_total;
+}
+
+void
+DemandTrace::abandon(uint64_t sequence)
+{
+  while (!m_open.empty())
+  {
+    bool found = m_open.back().sequence == sequence;
+    m_open.pop_back();
+
+    if (found)
+    {
+      break;
+    }
+  }
+}
+
+std::vector<DemandTrace::Record>
+DemandTrace::records() const
+{
+  if (m_ring.size() < m_capacity)
+  {
+    return m_ring;
+  }
+
+  //the oldest is the next one to be overwritten
+  size_t oldest = m_total % m_capacity;
+
+  std::vector<Record> result(m_ring.begin() + oldest, m_ring.end());
+  result.insert(result.end(), m_ring.begin(), m_ring.begin() + oldest);
+
+  return result;
+}
+
+bool
+DemandTrace::write(const std::string& path) const
+{
+  std::ofstream os(path, std::ios::binary);
+
+  if (!os)
+  {
+    return false;
+  }
+
+  os.write(FILE_MAGIC, sizeof(FILE_MAGIC));
+  write_number<uint32_t>(os, FILE_VERSION);
+  write_number<uint64_t>(os, m_total);
+  write_number<uint64_t>(os, dropped());
+
+  write_number<uint32_t>(os, m_variables.size());
+  for (const auto& name : m_variables)
+  {
+    write_string(os, utf32_to_utf8(name));
+  }
+
+  write_number<uint32_t>(os, m_contexts.size());
+  for (const auto& context : m_contexts)
+  {
+    write_number<uint64_t>(os, context.first);
+    write_string(os, context.second.text);
+  }
+
+  auto kept = records();
+  write_number<uint64_t>(os, kept.size());
+  for (const auto& r : kept)
+  {
+    write_number<uint64_t>(os, r.sequence);
+    write_number<uint64_t>(os, r.parent);
+    write_number<uint64_t>(os, r.nanoseconds);
+    write_number<uint64_t>(os, r.context);
+    write_number<uint32_t>(os, r.variable);
+    write_number<uint8_t>(os, r.outcome);
+  }
+
+  return bool(os);
+}
+
+}
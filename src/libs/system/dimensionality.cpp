@@ -0,0 +1,640 @@
+/* Static dimensionality analysis.
+   Copyright (C) 2013 Jarryd Beck
+
+This file is part of TransLucid.
+
+TransLucid is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+TransLucid is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with TransLucid; see the file COPYING.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <algorithm>
+
+#include <tl/dimensionality.hpp>
+#include <tl/static/function_printer.hpp>
+#include <tl/system.hpp>
+#include <tl/types/dimension.hpp>
+#include <tl/types/intmp.hpp>
+#include <tl/types/string.hpp>
+
+namespace TransLucid
+{
+
+namespace Static
+{
+
+namespace
+{
+  //recursive functions can keep making bigger function values, so stop
+  //looking after this many rounds, what has been found so far is still
+  //useful
+  constexpr size_t MAX_ROUNDS = 16;
+
+  void
+  removeDimensions
+  (
+    DimensionalityFinder::DimensionSet& dims,
+    const DimensionalityFinder::DimensionSet& remove
+  )
+  {
+    for (auto d : remove)
+    {
+      dims.erase(d);
+    }
+  }
+}
+
+DimensionalityFinder::DimensionalityMap
+DimensionalityFinder::computeDimensionality(const u32string& x)
+{
+  m_idDims.clear();
+  m_referenced = {x};
+
+  std::set<u32string> seen;
+  size_t objects = 0;
+
+  for (size_t round = 0; round != MAX_ROUNDS; ++round)
+  {
+    seen = m_referenced;
+
+    std::map<u32string, result_type> current;
+    size_t currentObjects = 0;
+
+    for (const auto& id : seen)
+    {
+      auto& result = current[id];
+
+      try
+      {
+        auto expr = m_system->getIdentifierTree(id);
+        result = apply_visitor(*this, expr);
+      }
+      catch (...)
+      {
+        //this is only used to save work, so anything that can't be
+        //analysed is left to the demands, which also report any errors
+        result = result_type();
+      }
+
+      currentObjects += std::get<0>(result).size() +
+        Static::Functions::count_objects(std::get<1>(result));
+
+      for (const auto& f : std::get<2>(result))
+      {
+        currentObjects += Static::Functions::count_objects(f);
+      }
+    }
+
+    m_idDims = std::move(current);
+
+    if (seen.size() == m_referenced.size() && objects == currentObjects)
+    {
+      break;
+    }
+
+    objects = currentObjects;
+  }
+
+  DimensionalityMap dims;
+
+  for (const auto& id : m_idDims)
+  {
+    dims.insert(std::make_pair(id.first, std::get<0>(id.second)));
+  }
+
+  return dims;
+}
+
+bool
+DimensionalityFinder::staticDimension
+(
+  const Tree::Expr& e,
+  dimension_index& dim
+)
+{
+  if (auto d = get<Tree::DimensionExpr>(&e))
+  {
+    dim = d->text.empty() ? d->dim : m_system->getDimensionIndex(d->text);
+    return true;
+  }
+  else if (auto i = get<mpz_class>(&e))
+  {
+    dim = m_system->getDimensionIndex(Types::Intmp::create(*i));
+    return true;
+  }
+  else if (auto s = get<u32string>(&e))
+  {
+    dim = m_system->getDimensionIndex(Types::String::create(*s));
+    return true;
+  }
+  else if (auto c = get<Constant>(&e))
+  {
+    //any other constant means the dimension that it names
+    dim = c->index() == TYPE_INDEX_DIMENSION
+      ? get_constant<dimension_index>(*c)
+      : m_system->getDimensionIndex(*c);
+    return true;
+  }
+  else if (auto p = get<Tree::ParenExpr>(&e))
+  {
+    return staticDimension(p->e, dim);
+  }
+
+  return false;
+}
+
+void
+DimensionalityFinder::addUsed(result_type& to, const result_type& from)
+{
+  std::get<0>(to).insert(std::get<0>(from).begin(), std::get<0>(from).end());
+
+  std::copy_if(std::get<1>(from).begin(), std::get<1>(from).end(),
+    std::inserter(std::get<2>(to), std::get<2>(to).end()),
+    Static::Functions::is_app());
+
+  std::get<2>(to).insert(std::get<2>(from).begin(), std::get<2>(from).end());
+}
+
+void
+DimensionalityFinder::addValue(result_type& to, const result_type& from)
+{
+  std::get<0>(to).insert(std::get<0>(from).begin(), std::get<0>(from).end());
+  std::get<1>(to).insert(std::get<1>(to).end(),
+    std::get<1>(from).begin(), std::get<1>(from).end());
+  std::get<2>(to).insert(std::get<2>(from).begin(), std::get<2>(from).end());
+}
+
+DimensionalityFinder::DimensionSet
+DimensionalityFinder::captureDimensions
+(
+  const std::vector<Tree::Expr>& binds,
+  const std::vector<dimension_index>& scope,
+  result_type& made
+)
+{
+  DimensionSet captured(scope.begin(), scope.end());
+
+  for (const auto& bind : binds)
+  {
+    dimension_index dim;
+    if (staticDimension(bind, dim))
+    {
+      captured.insert(dim);
+    }
+    else
+    {
+      addUsed(made, apply_visitor(*this, bind));
+    }
+  }
+
+  //their values are looked up when the abstraction is made
+  std::get<0>(made).insert(captured.begin(), captured.end());
+
+  return captured;
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const bool& e)
+{
+  return result_type();
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const Constant& c)
+{
+  return result_type();
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const Special& e)
+{
+  return result_type();
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const mpz_class& e)
+{
+  return result_type();
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const char32_t& e)
+{
+  return result_type();
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const u32string& e)
+{
+  return result_type();
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const Tree::LiteralExpr& e)
+{
+  return result_type();
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const Tree::DimensionExpr& e)
+{
+  dimension_index dim;
+  staticDimension(e, dim);
+
+  return std::make_tuple(DimensionSet(),
+    FunctorList{Static::Functions::Param{dim}}, FunctorSet{});
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const Tree::IdentExpr& e)
+{
+  m_referenced.insert(e.text);
+
+  auto iter = m_idDims.find(e.text);
+
+  if (iter == m_idDims.end())
+  {
+    return result_type();
+  }
+  else
+  {
+    return iter->second;
+  }
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const Tree::HashSymbol& e)
+{
+  //the whole context can't be listed, so this is left to the demands
+  return result_type();
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const Tree::HostOpExpr& e)
+{
+  return result_type();
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const Tree::ParenExpr& e)
+{
+  return apply_visitor(*this, e.e);
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const Tree::UnaryOpExpr& e)
+{
+  throw U"error: unary op expression seen in DimensionalityFinder";
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const Tree::BinaryOpExpr& e)
+{
+  throw U"error: binary op expression seen in DimensionalityFinder";
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const Tree::MakeIntenExpr& e)
+{
+  result_type result;
+
+  auto captured = captureDimensions(e.binds, e.scope, result);
+
+  auto body = apply_visitor(*this, e.expr);
+  removeDimensions(std::get<0>(body), captured);
+
+  std::get<1>(result).push_back(
+    Up{std::get<0>(body), std::get<1>(body), std::get<2>(body)});
+
+  return result;
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const Tree::EvalIntenExpr& e)
+{
+  DimensionSet resultX;
+  FunctorList resultF;
+  FunctorSet fundeps;
+
+  auto deps = apply_visitor(*this, e.expr);
+
+  FunctorList ups;
+
+  for (const auto& f : std::get<1>(deps))
+  {
+    auto fup = get<Up>(&f);
+
+    if (fup == nullptr)
+    {
+      resultF.push_back(Down{f});
+    }
+    else
+    {
+      ups.push_back(f);
+    }
+  }
+
+  auto eval = Static::Functions::evals_down(ups);
+
+  fundeps = std::get<2>(deps);
+  fundeps.insert(std::get<2>(eval).begin(), std::get<2>(eval).end());
+
+  resultF.insert(resultF.end(), std::get<1>(eval).begin(),
+    std::get<1>(eval).end());
+
+  resultX = std::get<0>(deps);
+  resultX.insert(std::get<0>(eval).begin(), std::get<0>(eval).end());
+
+  return result_type(resultX, resultF, fundeps);
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const Tree::IfExpr& e)
+{
+  result_type result;
+
+  addUsed(result, apply_visitor(*this, e.condition));
+  addValue(result, apply_visitor(*this, e.then));
+
+  for (const auto& branch : e.else_ifs)
+  {
+    addUsed(result, apply_visitor(*this, branch.first));
+    addValue(result, apply_visitor(*this, branch.second));
+  }
+
+  addValue(result, apply_visitor(*this, e.else_));
+
+  return result;
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const Tree::HashExpr& e)
+{
+  dimension_index dim;
+
+  if (staticDimension(e.e, dim))
+  {
+    return std::make_tuple(DimensionSet{dim},
+      FunctorList{Static::Functions::Param{dim}}, FunctorSet{});
+  }
+
+  //the dimension is only known when it is evaluated
+  auto result = apply_visitor(*this, e.e);
+
+  return std::make_tuple(
+    std::get<0>(result),
+    FunctorList{Static::Functions::Topfun()},
+    std::get<2>(result)
+  );
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const Tree::RegionExpr& e)
+{
+  result_type result;
+
+  for (const auto& entry : e.entries)
+  {
+    //a region looks at every dimension that it constrains
+    dimension_index dim;
+    if (staticDimension(std::get<0>(entry), dim))
+    {
+      std::get<0>(result).insert(dim);
+    }
+    else
+    {
+      addUsed(result, apply_visitor(*this, std::get<0>(entry)));
+    }
+
+    addUsed(result, apply_visitor(*this, std::get<2>(entry)));
+  }
+
+  return result;
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const Tree::TupleExpr& e)
+{
+  result_type result;
+
+  for (const auto& entry : e.pairs)
+  {
+    addUsed(result, apply_visitor(*this, entry.first));
+    addUsed(result, apply_visitor(*this, entry.second));
+  }
+
+  return result;
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const Tree::AtExpr& e)
+{
+  result_type result;
+
+  auto lhs = apply_visitor(*this, e.lhs);
+
+  //the left hand side doesn't need the dimensions that are changed
+  if (auto tuple = get<Tree::TupleExpr>(&e.rhs))
+  {
+    for (const auto& entry : tuple->pairs)
+    {
+      dimension_index dim;
+      if (staticDimension(entry.first, dim))
+      {
+        std::get<0>(lhs).erase(dim);
+      }
+    }
+  }
+
+  addValue(result, lhs);
+  addUsed(result, apply_visitor(*this, e.rhs));
+
+  return result;
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const Tree::LambdaExpr& e)
+{
+  result_type result;
+
+  auto captured = captureDimensions(e.binds, e.scope, result);
+  captured.insert(e.argDim);
+
+  auto body = apply_visitor(*this, e.rhs);
+  removeDimensions(std::get<0>(body), captured);
+
+  std::get<1>(result).push_back(CBV
+    {e.argDim, std::get<0>(body), std::get<1>(body), std::get<2>(body)});
+
+  return result;
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const Tree::PhiExpr& e)
+{
+  throw U"cbn function in dimensionality finder";
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const Tree::BaseAbstractionExpr& e)
+{
+  result_type result;
+
+  auto captured = captureDimensions(e.binds, e.scope, result);
+  captured.insert(e.dims.begin(), e.dims.end());
+
+  auto body = apply_visitor(*this, e.body);
+  removeDimensions(std::get<0>(body), captured);
+
+  std::get<1>(result).push_back(Base{e.dims,
+    std::get<0>(body), std::get<1>(body), std::get<2>(body)});
+
+  return result;
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const Tree::BangAppExpr& e)
+{
+  DimensionSet X;
+  FunctorList F;
+  FunctorSet Fcal;
+
+  FunctorList bases;
+
+  FunctorList F_0;
+  std::vector<FunctorList> F_j;
+  F_j.reserve(e.args.size());
+
+  auto result = apply_visitor(*this, e.name);
+
+  X = std::get<0>(result);
+  F_0 = std::get<1>(result);
+  Fcal = std::get<2>(result);
+
+  for (const auto& expr : e.args)
+  {
+    result = apply_visitor(*this, expr);
+    X.insert(std::get<0>(result).begin(), std::get<0>(result).end());
+    F_j.push_back(std::get<1>(result));
+    Fcal.insert(std::get<2>(result).begin(), std::get<2>(result).end());
+  }
+
+  for (const auto& f : F_0)
+  {
+    auto base = get<Base>(&f);
+
+    if (base == nullptr)
+    {
+      F.push_back(ApplyB{f, F_j});
+    }
+    else
+    {
+      bases.push_back(*base);
+    }
+  }
+
+  //the body of the function looks at the context it is applied in
+  result = Static::Functions::evals_applyb(bases, F_j);
+
+  X.insert(std::get<0>(result).begin(), std::get<0>(result).end());
+  F.insert(F.end(), std::get<1>(result).begin(), std::get<1>(result).end());
+  Fcal.insert(std::get<2>(result).begin(), std::get<2>(result).end());
+
+  return std::make_tuple(X, F, Fcal);
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const Tree::LambdaAppExpr& e)
+{
+  DimensionSet X;
+  FunctorList F;
+  FunctorSet Fcal;
+  FunctorList cbvs;
+
+  auto lhs = apply_visitor(*this, e.lhs);
+  auto rhs = apply_visitor(*this, e.rhs);
+
+  for (const auto& f : std::get<1>(lhs))
+  {
+    auto cbv = get<CBV>(&f);
+
+    if (cbv == nullptr)
+    {
+      F.push_back(ApplyV{f, std::get<1>(rhs)});
+    }
+    else
+    {
+      cbvs.push_back(*cbv);
+    }
+  }
+
+  auto eval_result = evals_applyv(cbvs, std::get<1>(rhs));
+
+  X = std::get<0>(lhs);
+  X.insert(std::get<0>(rhs).begin(), std::get<0>(rhs).end());
+  X.insert(std::get<0>(eval_result).begin(), std::get<0>(eval_result).end());
+
+  F.insert(F.end(), std::get<1>(eval_result).begin(),
+    std::get<1>(eval_result).end());
+
+  Fcal = std::get<2>(lhs);
+  Fcal.insert(std::get<2>(rhs).begin(), std::get<2>(rhs).end());
+  Fcal.insert(std::get<2>(eval_result).begin(),
+    std::get<2>(eval_result).end());
+
+  return std::make_tuple(X, F, Fcal);
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const Tree::PhiAppExpr& e)
+{
+  throw U"cbn application in dimensionality finder";
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const Tree::WhereExpr& e)
+{
+  //this is just a wheredim now
+  result_type result;
+
+  //the local dimensions are set by the wheredim itself
+  auto body = apply_visitor(*this, e.e);
+  removeDimensions(std::get<0>(body),
+    DimensionSet(e.dimAllocation.begin(), e.dimAllocation.end()));
+
+  addValue(result, body);
+
+  for (const auto& dim : e.dims)
+  {
+    addUsed(result, apply_visitor(*this, dim.second));
+  }
+
+  return result;
+}
+
+DimensionalityFinder::result_type
+DimensionalityFinder::operator()(const Tree::ConditionalBestfitExpr& e)
+{
+  result_type result;
+
+  for (const auto& decl : e.declarations)
+  {
+    addUsed(result, apply_visitor(*this, std::get<1>(decl)));
+    addUsed(result, apply_visitor(*this, std::get<2>(decl)));
+    addValue(result, apply_visitor(*this, std::get<3>(decl)));
+  }
+
+  return result;
+}
+
+} //namespace Static
+} //namespace TransLucid
@@ -19,6 +19,8 @@ along with TransLucid; see the file COPYING.  If not see
 
 #include <vector>
 
+#include <gmpxx.h>
+
 #include <tl/dimtranslator.hpp>
 #include <tl/fixed_indexes.hpp>
 #include <tl/types/intmp.hpp>
@@ -70,10 +72,24 @@ DimensionTranslator::lookup(const Constant& value)
   {
     return get_constant<dimension_index>(value);
   }
-  else
+  else if (value.index() == TYPE_INDEX_INTMP)
   {
-    return m_constants(value);
+    const mpz_class& i = Types::Intmp::get(value);
+    if (i.fits_uint_p() && i.get_ui() < SMALL_INTEGERS)
+    {
+      size_t n = i.get_ui();
+      if (!m_smallKnown[n])
+      {
+        //the registry still hands out the index, so that reverse lookups
+        //and the fixed indexes for 0, 1 and 2 stay the same
+        m_small[n] = m_constants(value);
+        m_smallKnown[n] = true;
+      }
+      return m_small[n];
+    }
   }
+
+  return m_constants(value);
 }
 
 const u32string*
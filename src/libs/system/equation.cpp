@@ -67,6 +67,7 @@ VariableWS::VariableWS(const u32string& name, System& system)
 : m_name(name), m_bestfit(this, system)
 {
   m_bestfit.setName(U"variable: " + m_name);
+  m_bestfit.setIdentifier(m_name);
 }
 
 void
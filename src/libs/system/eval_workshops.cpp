@@ -25,6 +25,7 @@ along with TransLucid; see the file COPYING.  If not see
 #include <gmpxx.h>
 
 #include <tl/builtin_types.hpp>
+#include <tl/cache.hpp>
 #include <tl/chi.hpp>
 #include <tl/context.hpp>
 #include <tl/constws.hpp>
@@ -119,6 +120,24 @@ namespace
 
 }
 
+dimension_index
+DimensionCache::operator()(System& system, const Constant& value)
+{
+  if (value.index() == TYPE_INDEX_DIMENSION)
+  {
+    return get_constant<dimension_index>(value);
+  }
+
+  if (!m_valid || m_value != value)
+  {
+    m_index = system.getDimensionIndex(value);
+    m_value = value;
+    m_valid = true;
+  }
+
+  return m_index;
+}
+
 DimensionWS::DimensionWS(System& system, dimension_index dim)
 : m_value(Types::Dimension::create(dim))
 {
@@ -415,7 +434,7 @@ BangOpWS::operator()(Context& k)
   //lookup function in the system and call it
 
   //evaluate fn expr
-  RhoManager rho(k);
+  RhoManager rho(k, 0, m_rho);
   Constant name = (*m_name)(k);
 
   if (name.index() == TYPE_INDEX_BASE_FUNCTION)
@@ -526,6 +545,15 @@ BangOpWS::operator()(Context& k)
 
 TimeConstant
 BangOpWS::operator()(Context& kappa, Delta& d, const Thread& w, size_t t)
+{
+  //if the expression that this is in demands a dimension later on, this
+  //doesn't have to be applied again
+  return memoise(this, kappa, d, w, t,
+    [&] () { return apply(kappa, d, w, t); });
+}
+
+TimeConstant
+BangOpWS::apply(Context& kappa, Delta& d, const Thread& w, size_t t)
 {
   //lookup function in the system and call it
 
@@ -764,7 +792,7 @@ MakeIntenWS::operator()(Context& kappa, Delta& d, const Thread& w, size_t t)
 Constant
 EvalIntenWS::operator()(Context& k)
 {
-  RhoManager rho(k);
+  RhoManager rho(k, 0, m_rho);
   Constant rhs = (*m_rhs)(k);
 
   if (rhs.index() != TYPE_INDEX_INTENSION)
@@ -808,7 +836,7 @@ EvalIntenWS::operator()(Context& kappa, Delta& d, const Thread& w, size_t t)
 Constant
 IfWS::operator()(Context& k)
 {
-  RhoManager rho(k);
+  RhoManager rho(k, 0, m_rho);
   Constant condv = (*m_condition)(k);
 
   if (condv.index() == TYPE_INDEX_SPECIAL)
@@ -999,7 +1027,7 @@ Constant
 HashWS::operator()(Context& k)
 {
   Constant r = (*m_e)(k);
-  return lookup_context(m_system, r, k);
+  return Constant(k.lookup(m_dim(m_system, r)));
 }
 
 Constant
@@ -1012,13 +1040,19 @@ HashWS::operator()(Context& kappa, Context& delta)
     return r;
   }
 
-  if (m_cached)
+  dimension_index dim = m_dim(m_system, r);
+
+  if (!m_cached)
   {
-    return lookup_context_cached(m_system, r, delta);
+    return Constant(kappa.lookup(dim));
+  }
+  else if (delta.has_entry(dim))
+  {
+    return Constant(delta.lookup(dim));
   }
   else
   {
-    return lookup_context(m_system, r, kappa);
+    return Types::Demand::create({dim});
   }
 }
 
@@ -1032,7 +1066,7 @@ HashWS::operator()(Context& kappa, Delta& d, const Thread& w, size_t t)
     return r;
   }
 
-  auto dim = m_system.getDimensionIndex(r.second);
+  auto dim = m_dim(m_system, r.second);
   if (!d.contains(dim))
   {
     return std::make_pair(r.first, Types::Demand::create({dim}));
@@ -1206,10 +1240,12 @@ Constant
 TupleWS::operator()(Context& k)
 {
   uint8_t index = 0;
-  RhoManager rho(k);
+  RhoManager rho(k, 0, m_rho);
   tuple_t kp;
+  auto dim = m_dims.begin();
   for(auto& pair : m_elements)
   {
+    DimensionCache& leftDim = *dim++;
     rho.changeTop(index * 2);
     //const Pair& p = v.first.value<Pair>();
     Constant left = (*pair.first)(k);
@@ -1230,7 +1266,7 @@ TupleWS::operator()(Context& k)
     }
     else
     {
-      kp[m_system.getDimensionIndex(left)] = right;
+      kp[leftDim(m_system, left)] = right;
     }
 
     ++index;
@@ -1243,8 +1279,10 @@ TupleWS::operator()(Context& kappa, Context& delta)
 {
   std::vector<dimension_index> demands;
   tuple_t kp;
+  auto dim = m_dims.begin();
   for(auto& pair : m_elements)
   {
+    DimensionCache& leftDim = *dim++;
     bool hasdemands = false;
     //const Pair& p = v.first.value<Pair>();
     Constant left = (*pair.first)(kappa, delta);
@@ -1284,7 +1322,7 @@ TupleWS::operator()(Context& kappa, Context& delta)
       }
       else
       {
-        kp[m_system.getDimensionIndex(left)] = right;
+        kp[leftDim(m_system, left)] = right;
       }
     }
   }
@@ -1306,8 +1344,10 @@ TupleWS::operator()(Context& kappa, Delta& d, const Thread& w, size_t t)
   tuple_t kp;
   size_t maxTime = 0;
 
+  auto dim = m_dims.begin();
   for(auto& pair : m_elements)
   {
+    DimensionCache& leftDim = *dim++;
     bool hasdemands = false;
     //const Pair& p = v.first.value<Pair>();
     auto left = (*pair.first)(kappa, d, w, t);
@@ -1350,7 +1390,7 @@ TupleWS::operator()(Context& kappa, Delta& d, const Thread& w, size_t t)
       }
       else
       {
-        kp[m_system.getDimensionIndex(left.second)] = right.second;
+        kp[leftDim(m_system, left.second)] = right.second;
       }
     }
   }
@@ -1369,7 +1409,7 @@ Constant
 AtWS::operator()(Context& k)
 {
   //tuple_t kNew = k.tuple();
-  RhoManager rho(k, 1);
+  RhoManager rho(k, 1, m_rho);
   Constant val1 = (*e1)(k);
   if (val1.index() != TYPE_INDEX_TUPLE)
   {
@@ -1499,17 +1539,14 @@ HostOpWS::operator()(Context& kappa, Delta& d, const Thread& w, size_t t)
 Constant
 BaseAbstractionWS::operator()(Context& k)
 {
-  return Types::BaseFunction::create
-  (
-    BaseFunctionAbstraction
-    (
-      m_system,
-      m_dims,
-      m_scope,
-      m_binds,
-      m_rhs,
-      k
-    )
+  auto binds = bindAbstraction(m_system, m_binds, m_scope, k);
+  binds.push_back(std::make_pair(DIM_TIME, k.lookup(DIM_TIME)));
+
+  return m_closures.get(binds, [&] ()
+    {
+      return Types::BaseFunction::create(
+        BaseFunctionAbstraction(m_dims, binds, m_rhs));
+    }
   );
 }
 
@@ -1569,15 +1606,26 @@ BaseAbstractionWS::operator()
     return std::make_pair(maxTime, Types::Demand::create(demands));
   }
 
-  return std::make_pair(maxTime, Types::BaseFunction::create(
-    BaseFunctionAbstraction
-    (
-      m_dims,
-      m_scope,
-      binds,
-      m_rhs,
-      kappa
-    )));
+  ClosureCache::Bindings bound;
+  bound.reserve(binds.size() + m_scope.size() + 1);
+
+  for (auto b : binds)
+  {
+    bound.push_back(std::make_pair(b, kappa.lookup(b)));
+  }
+
+  for (auto s : m_scope)
+  {
+    bound.push_back(std::make_pair(s, kappa.lookup(s)));
+  }
+  bound.push_back(std::make_pair(DIM_TIME, kappa.lookup(DIM_TIME)));
+
+  return std::make_pair(maxTime, m_closures.get(bound, [&] ()
+    {
+      return Types::BaseFunction::create(
+        BaseFunctionAbstraction(m_dims, bound, m_rhs));
+    }
+  ));
 }
 
 Constant
@@ -1591,7 +1639,8 @@ LambdaAbstractionWS::operator()(Context& k)
       m_rhs,
       m_binds,
       m_scope,
-      k
+      k,
+      m_closures
     );
 
   #if 0
@@ -1655,7 +1704,8 @@ LambdaAbstractionWS::operator()
       m_binds,
       m_scope,
       kappa,
-      d, w, t
+      d, w, t,
+      m_closures
     );
 }
 
@@ -1665,7 +1715,7 @@ LambdaApplicationWS::operator()(Context& k)
   //evaluate the lhs, evaluate the rhs
   //and pass the value to the function to evaluate
 
-  RhoManager rho(k);
+  RhoManager rho(k, 0, m_rho);
   rho.changeTop(1);
   Constant lhs = (*m_lhs)(k);
   //first make sure that it is a function
@@ -1714,6 +1764,14 @@ LambdaApplicationWS::operator()(Context& kappa, Context& delta)
 TimeConstant
 LambdaApplicationWS::operator()
 (Context& kappa, Delta& d, const Thread& w, size_t t)
+{
+  return memoise(this, kappa, d, w, t,
+    [&] () { return apply(kappa, d, w, t); });
+}
+
+TimeConstant
+LambdaApplicationWS::apply
+(Context& kappa, Delta& d, const Thread& w, size_t t)
 {
   auto lhs = (*m_lhs)(kappa, d, w, t);
   auto rhs = (*m_rhs)(kappa, d, w, t);
@@ -1779,8 +1837,7 @@ WhereWS::operator()(Context& k)
     for (const auto& v : m_dims)
     {
       //the CHI dimension
-      ChiDim chi(index, 
-        std::vector<ChiDim::type_t>(k.getRho().begin(), k.getRho().end()));
+      ChiDim chi(index, k.getRho());
       dimension_index d = m_system.getChiDim(chi);
 
       //std::cerr << "chi dimension: " << chi << " has index " << d << std::endl;
@@ -1875,7 +1932,7 @@ AtTupleWS::operator()(Context& k)
   //do some magic to initialise the vector with iterators that do the
   //evaluation all at once so that we only need one allocation
 
-  RhoManager rho(k);
+  RhoManager rho(k, 0, m_rho);
   int index = 1;
 
   bool access = false;
@@ -1885,8 +1942,10 @@ AtTupleWS::operator()(Context& k)
   std::vector<std::pair<dimension_index, Constant>> tuple;
   std::vector<Constant> specials;
 
+  auto dim = m_dims.begin();
   for (const auto& entry : m_tuple)
   {
+    DimensionCache& lhsDim = *dim++;
     rho.changeTop(index*2);
     Constant lhs = (*entry.first)(k);
     rho.changeTop(index*2 + 1);
@@ -1916,7 +1975,7 @@ AtTupleWS::operator()(Context& k)
       else
       {
         tuple.push_back(
-          std::make_pair(this->m_system.getDimensionIndex(lhs), rhs));
+          std::make_pair(lhsDim(m_system, lhs), rhs));
       }
     }
 
@@ -1955,8 +2014,10 @@ AtTupleWS::operator()(Context& kappa, Context& delta)
   std::set<dimension_index> demands;
   std::vector<Constant> specials;
 
+  auto dim = m_dims.begin();
   for (const auto& entry : m_tuple)
   {
+    DimensionCache& lhsDim = *dim++;
     Constant lhs = (*entry.first)(kappa, delta);
     Constant rhs = (*entry.second)(kappa, delta);
 
@@ -1998,7 +2059,7 @@ AtTupleWS::operator()(Context& kappa, Context& delta)
       else
       {
         tuple.push_back(
-          std::make_pair(this->m_system.getDimensionIndex(lhs), rhs));
+          std::make_pair(lhsDim(m_system, lhs), rhs));
       }
     }
   }
@@ -2050,8 +2111,10 @@ AtTupleWS::operator()(Context& kappa, Delta& d, const Thread& w, size_t t)
   std::vector<Constant> specials;
   size_t maxTime = 0;
 
+  auto dim = m_dims.begin();
   for (const auto& entry : m_tuple)
   {
+    DimensionCache& lhsDim = *dim++;
     auto lhs = (*entry.first)(kappa, d, w, t);
     auto rhs = (*entry.second)(kappa, d, w, t);
 
@@ -2098,8 +2161,7 @@ AtTupleWS::operator()(Context& kappa, Delta& d, const Thread& w, size_t t)
       else
       {
         tuple.push_back(
-          std::make_pair(this->m_system.getDimensionIndex(lhs.second), 
-            rhs.second));
+          std::make_pair(lhsDim(m_system, lhs.second), rhs.second));
       }
     }
   }
@@ -17,6 +17,7 @@ You should have received a copy of the GNU General Public License
 along with TransLucid; see the file COPYING.  If not see
 <http://www.gnu.org/licenses/>.  */
 
+#include <tl/fixed_indexes.hpp>
 #include <tl/hyperdatons/arrayhd.hpp>
 #include <tl/types_util.hpp>
 
@@ -29,6 +30,41 @@ along with TransLucid; see the file COPYING.  If not see
 namespace TransLucid
 {
 
+namespace
+{
+  //call f with the position in the block and the index in the array of
+  //every point of the block
+  template <typename F>
+  void
+  walk_block(const HDBlock& block, size_t first,
+    const std::vector<size_t>& strides, F f)
+  {
+    const auto& bounds = block.bounds();
+    size_t n = block.size();
+
+    std::vector<size_t> counters(bounds.size(), 0);
+    size_t index = first;
+
+    for (size_t i = 0; i != n; ++i)
+    {
+      f(i, index);
+
+      size_t j = bounds.size();
+      while (j != 0)
+      {
+        --j;
+        index += strides[j];
+        if (++counters[j] != bounds[j].size)
+        {
+          break;
+        }
+        index -= strides[j] * bounds[j].size;
+        counters[j] = 0;
+      }
+    }
+  }
+}
+
 void
 ArrayHD::initialise(
   const std::vector<std::pair<dimension_index, size_t>>& bounds)
@@ -47,6 +83,7 @@ ArrayHD::initialise(
 
   delete [] m_data;
   m_data = new Constant[size];
+  m_size = size;
 
   m_bounds = bounds;
 
@@ -67,6 +104,7 @@ ArrayHD::initialise(
   m_variance = variance;
 
   //set up the multipliers for indexing the array
+  m_multipliers.clear();
   m_multipliers.insert(m_multipliers.end(), m_bounds.size(), 0);
   size_t prev = 1;
   auto muliter = m_multipliers.rbegin(); 
@@ -124,6 +162,110 @@ ArrayHD::put(const Context& k, const Constant& c)
   m_data[index] = c;
 }
 
+bool
+ArrayHD::blockLayout
+(
+  const Context& k,
+  const HDBlock& block,
+  size_t& first,
+  std::vector<size_t>& strides
+) const
+{
+  const auto& bounds = block.bounds();
+
+  //the array doesn't vary in a dimension that isn't one of its bounds
+  strides.assign(bounds.size(), 0);
+  first = 0;
+
+  for (size_t i = 0; i != m_bounds.size(); ++i)
+  {
+    auto dim = m_bounds[i].first;
+    size_t size = m_bounds[i].second;
+
+    auto b = std::find_if(bounds.begin(), bounds.end(),
+      [dim] (const HDBlock::Bound& bound) { return bound.dim == dim; });
+
+    if (b != bounds.end())
+    {
+      if (b->lower < 0 || b->lower + b->size > size)
+      {
+        return false;
+      }
+
+      first += b->lower.get_ui() * m_multipliers[i];
+      strides[b - bounds.begin()] = m_multipliers[i];
+    }
+    else
+    {
+      const Constant& value = k.lookup(dim);
+      if (value.index() != TYPE_INDEX_INTMP)
+      {
+        return false;
+      }
+
+      const mpz_class& v = get_constant_pointer<mpz_class>(value);
+      if (v < 0 || v >= size)
+      {
+        return false;
+      }
+
+      first += v.get_ui() * m_multipliers[i];
+    }
+  }
+
+  return true;
+}
+
+void
+ArrayHD::getBlock
+(
+  const Context& k,
+  const HDBlock& block,
+  Constant* values
+) const
+{
+  size_t first;
+  std::vector<size_t> strides;
+
+  if (!blockLayout(k, block, first, strides))
+  {
+    InputHD::getBlock(k, block, values);
+    return;
+  }
+
+  walk_block(block, first, strides, 
+    [this, values] (size_t i, size_t index)
+    {
+      values[i] = m_data[index];
+    }
+  );
+}
+
+void
+ArrayHD::putBlock
+(
+  const Context& k,
+  const HDBlock& block,
+  const Constant* values
+)
+{
+  size_t first;
+  std::vector<size_t> strides;
+
+  if (!blockLayout(k, block, first, strides))
+  {
+    OutputHD::putBlock(k, block, values);
+    return;
+  }
+
+  walk_block(block, first, strides, 
+    [this, values] (size_t i, size_t index)
+    {
+      m_data[index] = values[i];
+    }
+  );
+}
+
 void
 ArrayHD::commit()
 {
@@ -0,0 +1,392 @@
+/* Shared memory hyperdaton.
+   Copyright (C) 2013 Jarryd Beck
+
+This file is part of TransLucid.
+
+TransLucid is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+TransLucid is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with TransLucid; see the file COPYING.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <tl/fixed_indexes.hpp>
+#include <tl/hyperdatons/sharedhd.hpp>
+#include <tl/types/floatmp.hpp>
+#include <tl/types/intmp.hpp>
+#include <tl/types/range.hpp>
+#include <tl/types/special.hpp>
+#include <tl/types_util.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <gmpxx.h>
+
+namespace TransLucid
+{
+
+namespace
+{
+  const char MAGIC[8] = {'T', 'L', 'S', 'H', 'M', 'H', 'D', 0};
+
+  //every element is eight bytes
+  constexpr size_t ELEMENT_SIZE = 8;
+
+  //the buffers start on a cache line
+  constexpr size_t HEADER_SIZE =
+    (sizeof(SharedArrayHD::Header) + 63) / 64 * 64;
+
+  static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+    "the commit count is shared between processes");
+
+  std::system_error
+  os_error(const std::string& what, const std::string& segment)
+  {
+    return std::system_error(errno, std::generic_category(),
+      what + " " + segment);
+  }
+
+  //closes the descriptor when the segment has been mapped, or failed to be
+  struct FileCloser
+  {
+    ~FileCloser()
+    {
+      close(fd);
+    }
+
+    int fd;
+  };
+}
+
+SharedArrayHD::SharedArrayHD
+(
+  const std::string& segment,
+  const std::vector<Bound>& bounds,
+  ElementType type
+)
+: IOHD(1)
+, m_segment(segment)
+, m_header(nullptr)
+, m_mapped(0)
+{
+  if (bounds.size() > MAX_RANK)
+  {
+    throw std::runtime_error("too many bounds for shared memory " + segment);
+  }
+
+  std::vector<std::pair<dimension_index, size_t>> dims;
+  for (const auto& b : bounds)
+  {
+    dims.push_back(std::make_pair(b.dim, b.size));
+  }
+  setBounds(dims);
+
+  int fd = shm_open(segment.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0600);
+  if (fd == -1)
+  {
+    throw os_error("shm_open", segment);
+  }
+  FileCloser closer{fd};
+
+  m_mapped = HEADER_SIZE + 2 * m_size * ELEMENT_SIZE;
+  if (ftruncate(fd, m_mapped) == -1)
+  {
+    throw os_error("ftruncate", segment);
+  }
+
+  map(fd, true);
+
+  //a new segment is all zeros
+  Header& h = *m_header;
+  std::copy(MAGIC, MAGIC + sizeof(MAGIC), h.magic);
+  h.version = VERSION;
+  h.type = type;
+  h.rank = bounds.size();
+
+  for (size_t i = 0; i != bounds.size(); ++i)
+  {
+    h.bounds[i] = bounds[i].size;
+    strncpy(h.names[i], bounds[i].name.c_str(), NAME_SIZE - 1);
+  }
+
+  new (&h.commits) std::atomic<uint64_t>(0);
+}
+
+SharedArrayHD::SharedArrayHD
+(
+  const std::string& segment,
+  const std::vector<dimension_index>& dims
+)
+: IOHD(1)
+, m_segment(segment)
+, m_header(nullptr)
+, m_mapped(0)
+{
+  int fd = shm_open(segment.c_str(), O_RDWR, 0);
+  if (fd == -1)
+  {
+    throw os_error("shm_open", segment);
+  }
+  FileCloser closer{fd};
+
+  struct stat st;
+  if (fstat(fd, &st) == -1)
+  {
+    throw os_error("fstat", segment);
+  }
+
+  if (size_t(st.st_size) < HEADER_SIZE)
+  {
+    throw std::runtime_error("not a shared array " + segment);
+  }
+
+  m_mapped = st.st_size;
+  map(fd, false);
+
+  const Header& h = *m_header;
+  if (!std::equal(MAGIC, MAGIC + sizeof(MAGIC), h.magic) ||
+      h.version != VERSION || h.rank != dims.size() ||
+      (h.type != ELEMENT_INT64 && h.type != ELEMENT_FLOAT64))
+  {
+    munmap(m_header, m_mapped);
+    throw std::runtime_error("shared array " + segment +
+      " doesn't have the expected layout");
+  }
+
+  std::vector<std::pair<dimension_index, size_t>> bounds;
+  for (size_t i = 0; i != dims.size(); ++i)
+  {
+    bounds.push_back(std::make_pair(dims[i], h.bounds[i]));
+  }
+  setBounds(bounds);
+
+  if (m_mapped < HEADER_SIZE + 2 * m_size * ELEMENT_SIZE)
+  {
+    munmap(m_header, m_mapped);
+    throw std::runtime_error("shared array " + segment + " is too short");
+  }
+}
+
+SharedArrayHD::~SharedArrayHD()
+{
+  munmap(m_header, m_mapped);
+}
+
+void
+SharedArrayHD::unlink(const std::string& segment)
+{
+  shm_unlink(segment.c_str());
+}
+
+void
+SharedArrayHD::map(int fd, bool create)
+{
+  void* p = mmap(nullptr, m_mapped, PROT_READ | PROT_WRITE, MAP_SHARED,
+    fd, 0);
+
+  if (p == MAP_FAILED)
+  {
+    if (create)
+    {
+      shm_unlink(m_segment.c_str());
+    }
+    throw os_error("mmap", m_segment);
+  }
+
+  m_header = static_cast<Header*>(p);
+}
+
+void
+SharedArrayHD::setBounds
+(
+  const std::vector<std::pair<dimension_index, size_t>>& bounds
+)
+{
+  m_bounds = bounds;
+  m_size = 1;
+
+  Region::Entries variance;
+  mpz_class a = 0;
+  for (const auto& bound : m_bounds)
+  {
+    m_size *= bound.second;
+
+    mpz_class b = bound.second - 1;
+    variance.insert(std::make_pair(bound.first,
+      std::make_pair(
+        Region::Containment::IN, Types::Range::create(Range(&a, &b))
+      )));
+  }
+
+  m_variance = variance;
+
+  //the last bound varies fastest
+  m_multipliers.assign(m_bounds.size(), 0);
+  size_t prev = 1;
+  for (size_t i = m_bounds.size(); i != 0; --i)
+  {
+    m_multipliers[i - 1] = prev;
+    prev *= m_bounds[i - 1].second;
+  }
+}
+
+bool
+SharedArrayHD::index(const Context& k, size_t& i) const
+{
+  i = 0;
+  for (size_t j = 0; j != m_bounds.size(); ++j)
+  {
+    const Constant& v = k.lookup(m_bounds[j].first);
+
+    if (v.index() != TYPE_INDEX_INTMP)
+    {
+      return false;
+    }
+
+    const mpz_class& n = get_constant_pointer<mpz_class>(v);
+    if (n < 0 || n >= m_bounds[j].second)
+    {
+      return false;
+    }
+
+    i += n.get_ui() * m_multipliers[j];
+  }
+
+  return true;
+}
+
+char*
+SharedArrayHD::buffer(uint64_t n) const
+{
+  return reinterpret_cast<char*>(m_header) + HEADER_SIZE +
+    (n % 2) * m_size * ELEMENT_SIZE;
+}
+
+Constant
+SharedArrayHD::get(const Context& k) const
+{
+  size_t i;
+  if (!index(k, i))
+  {
+    return Types::Special::create(SP_UNDEF);
+  }
+
+  //a commit copies the new instant over the buffer being read, so read it
+  //again if there was a commit in between
+  char bytes[ELEMENT_SIZE];
+  uint64_t commits = m_header->commits.load(std::memory_order_acquire);
+  while (true)
+  {
+    memcpy(bytes, buffer(commits) + i * ELEMENT_SIZE, ELEMENT_SIZE);
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    uint64_t again = m_header->commits.load(std::memory_order_relaxed);
+    if (again == commits)
+    {
+      break;
+    }
+    commits = again;
+  }
+
+  if (m_header->type == ELEMENT_INT64)
+  {
+    int64_t v;
+    memcpy(&v, bytes, sizeof(v));
+    return Types::Intmp::create(mpz_class(static_cast<long>(v)));
+  }
+  else
+  {
+    double v;
+    memcpy(&v, bytes, sizeof(v));
+    return Types::Floatmp::create(mpf_class(v));
+  }
+}
+
+void
+SharedArrayHD::put(const Context& k, const Constant& c)
+{
+  size_t i;
+  if (!index(k, i))
+  {
+    return;
+  }
+
+  //only this process commits, so the instant in progress is the buffer
+  //after the committed one
+  char* p = buffer(m_header->commits.load(std::memory_order_relaxed) + 1)
+    + i * ELEMENT_SIZE;
+
+  if (m_header->type == ELEMENT_INT64)
+  {
+    if (c.index() != TYPE_INDEX_INTMP)
+    {
+      return;
+    }
+
+    const mpz_class& n = get_constant_pointer<mpz_class>(c);
+    if (!n.fits_slong_p())
+    {
+      return;
+    }
+
+    int64_t v = n.get_si();
+    memcpy(p, &v, sizeof(v));
+  }
+  else
+  {
+    double v;
+    if (c.index() == TYPE_INDEX_INTMP)
+    {
+      v = get_constant_pointer<mpz_class>(c).get_d();
+    }
+    else if (c.index() == TYPE_INDEX_FLOATMP)
+    {
+      v = Types::Floatmp::get(c).get_d();
+    }
+    else
+    {
+      return;
+    }
+
+    memcpy(p, &v, sizeof(v));
+  }
+}
+
+void
+SharedArrayHD::commit()
+{
+  uint64_t commits =
+    m_header->commits.fetch_add(1, std::memory_order_release) + 1;
+
+  //a reader that loaded the old count may still be reading the buffer that
+  //is about to be overwritten, so the increment has to be visible before
+  //any of the writes, which a release fence ensures
+  std::atomic_thread_fence(std::memory_order_release);
+
+  //the next instant starts from this one
+  memcpy(buffer(commits + 1), buffer(commits), m_size * ELEMENT_SIZE);
+}
+
+Region
+SharedArrayHD::variance() const
+{
+  return m_variance;
+}
+
+}
@@ -0,0 +1,141 @@
+/* Sparse array hyperdaton.
+   Copyright (C) 2013 Jarryd Beck
+
+This file is part of TransLucid.
+
+TransLucid is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+TransLucid is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with TransLucid; see the file COPYING.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <tl/fixed_indexes.hpp>
+#include <tl/hyperdatons/sparsehd.hpp>
+#include <tl/types/range.hpp>
+#include <tl/types/special.hpp>
+#include <tl/types_util.hpp>
+
+#include <limits>
+
+#include <gmpxx.h>
+
+namespace TransLucid
+{
+
+void
+SparseArrayHD::initialise
+(
+  const std::vector<std::pair<dimension_index, size_t>>& bounds
+)
+{
+  //the index of every point has to fit
+  mpz_class size = 1;
+  for (const auto& bound : bounds)
+  {
+    size *= bound.second;
+  }
+
+  if (size > std::numeric_limits<size_t>::max())
+  {
+    throw "sparse hyperdaton bounds are too large";
+  }
+
+  m_points.clear();
+  m_bounds = bounds;
+
+  Region::Entries variance;
+  mpz_class a = 0;
+  for (const auto& bound : m_bounds)
+  {
+    mpz_class b = bound.second - 1;
+    variance.insert(std::make_pair(bound.first,
+      std::make_pair(
+        Region::Containment::IN, Types::Range::create(Range(&a, &b))
+      )));
+  }
+
+  m_variance = variance;
+
+  //the last bound varies fastest
+  m_multipliers.assign(m_bounds.size(), 0);
+  size_t prev = 1;
+  for (size_t i = m_bounds.size(); i != 0; --i)
+  {
+    m_multipliers[i - 1] = prev;
+    prev *= m_bounds[i - 1].second;
+  }
+}
+
+bool
+SparseArrayHD::index(const Context& k, size_t& i) const
+{
+  i = 0;
+  for (size_t j = 0; j != m_bounds.size(); ++j)
+  {
+    const Constant& v = k.lookup(m_bounds[j].first);
+
+    if (v.index() != TYPE_INDEX_INTMP)
+    {
+      return false;
+    }
+
+    const mpz_class& n = get_constant_pointer<mpz_class>(v);
+    if (n < 0 || n >= m_bounds[j].second)
+    {
+      return false;
+    }
+
+    i += n.get_ui() * m_multipliers[j];
+  }
+
+  return true;
+}
+
+Constant
+SparseArrayHD::get(const Context& k) const
+{
+  size_t i;
+  if (!index(k, i))
+  {
+    return Types::Special::create(SP_UNDEF);
+  }
+
+  auto iter = m_points.find(i);
+  if (iter == m_points.end())
+  {
+    return Types::Special::create(SP_UNDEF);
+  }
+
+  return iter->second;
+}
+
+void
+SparseArrayHD::put(const Context& k, const Constant& c)
+{
+  size_t i;
+  if (index(k, i))
+  {
+    m_points[i] = c;
+  }
+}
+
+void
+SparseArrayHD::commit()
+{
+}
+
+Region
+SparseArrayHD::variance() const
+{
+  return m_variance;
+}
+
+}
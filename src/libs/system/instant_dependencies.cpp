@@ -0,0 +1,141 @@
+/* Finds what an expression depends on from one instant to the next.
+   Copyright (C) 2013 Jarryd Beck
+
+This file is part of TransLucid.
+
+TransLucid is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+TransLucid is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with TransLucid; see the file COPYING.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <tl/fixed_indexes.hpp>
+#include <tl/instant_dependencies.hpp>
+#include <tl/types/dimension.hpp>
+
+namespace TransLucid
+{
+
+InstantDependencies::Result
+InstantDependencies::find(const Tree::Expr& e)
+{
+  m_result = Result{{}, false};
+
+  apply_visitor(*this, e);
+
+  return m_result;
+}
+
+InstantDependencies::Result
+InstantDependencies::findGuard(const Tree::Expr& e)
+{
+  m_result = Result{{}, false};
+
+  auto region = get<Tree::RegionExpr>(&e);
+
+  if (region == nullptr)
+  {
+    apply_visitor(*this, e);
+  }
+  else
+  {
+    for (const auto& entry : region->entries)
+    {
+      //a dimension on the left is only a name, but anything else has to
+      //be evaluated to find out which dimension it is
+      if (get<Tree::DimensionExpr>(&std::get<0>(entry)) == nullptr)
+      {
+        apply_visitor(*this, std::get<0>(entry));
+      }
+      apply_visitor(*this, std::get<2>(entry));
+    }
+  }
+
+  return m_result;
+}
+
+void
+InstantDependencies::operator()(const Constant& c)
+{
+  if (c.index() == TYPE_INDEX_DIMENSION &&
+      get_constant<dimension_index>(c) == DIM_TIME)
+  {
+    m_result.time = true;
+  }
+}
+
+void
+InstantDependencies::operator()(const Tree::DimensionExpr& e)
+{
+  if (e.text.empty() ? e.dim == DIM_TIME : e.text == U"time")
+  {
+    m_result.time = true;
+  }
+}
+
+void
+InstantDependencies::operator()(const Tree::IdentExpr& e)
+{
+  m_result.identifiers.insert(e.text);
+}
+
+void
+InstantDependencies::operator()(const Tree::HashSymbol& e)
+{
+  //the whole context includes the time
+  m_result.time = true;
+}
+
+void
+InstantDependencies::operator()(const Tree::LiteralExpr& e)
+{
+  m_result.identifiers.insert(U"construct_literal");
+  apply_visitor(*this, e.rewritten);
+}
+
+void
+InstantDependencies::operator()(const Tree::BinaryOpExpr& e)
+{
+  m_result.identifiers.insert(e.op.op);
+  apply_visitor(*this, e.lhs);
+  apply_visitor(*this, e.rhs);
+}
+
+void
+InstantDependencies::operator()(const Tree::PhiExpr& e)
+{
+  for (const auto& b : e.binds)
+  {
+    apply_visitor(*this, b);
+  }
+
+  apply_visitor(*this, e.rhs);
+}
+
+void
+InstantDependencies::operator()(const Tree::WhereExpr& e)
+{
+  apply_visitor(*this, e.e);
+
+  for (const auto& d : e.dims)
+  {
+    apply_visitor(*this, d.second);
+  }
+
+  for (const auto& v : e.vars)
+  {
+    apply_visitor(*this, std::get<1>(v));
+    apply_visitor(*this, std::get<2>(v));
+    apply_visitor(*this, std::get<3>(v));
+  }
+}
+
+}
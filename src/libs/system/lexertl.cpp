@@ -59,7 +59,8 @@ namespace
       U"hd",
       U"constructor",
       U"data",
-      U"dim"
+      U"dim",
+      U"assign"
     };
 
     return decls.find(name) != decls.end();
@@ -403,6 +404,8 @@ namespace
 
       std::u32string text = u32string(begin, end);
 
+      auto lock = idents.lockEvaluation();
+
       //need OPTYPE @ [symbol <- u32string(first, last)]
       WS* ws = idents.lookup(U"operator");
 
@@ -232,8 +232,13 @@ add_decl_parser(Decls&& decls, DeclName&& d, Obj&& obj, Fn&& f)
 }
 
 Parser::Parser(System& system)
+: Parser(system, system.getDefaultContext())
+{
+}
+
+Parser::Parser(System& system, Context& k)
 : m_system(system)
-, m_idents(system.lookupIdentifiers()), m_context(system.getDefaultContext())
+, m_idents(system.lookupIdentifiers()), m_context(k)
 {
   //start with top level declarations
   m_which_decl.push(&m_top_decls);
@@ -321,6 +326,7 @@ find_unary_operator
 {
   //lookup ATL_SYMBOL
 
+  auto lock = idents.lockEvaluation();
   ContextPerturber p(k, {{symbolDim, Types::String::create(symbol)}});
 
   WS* atlWS = idents.lookup(U"ATL_SYMBOL");
@@ -355,6 +361,7 @@ find_binary_operator
 
   //std::cerr << "looking up symbol " << symbol << std::endl;
 
+  auto lock = idents.lockEvaluation();
   ContextPerturber p(k, {{symbolDim, Types::String::create(symbol)}});
   WS* atlWS = idents.lookup(U"ATL_SYMBOL");
   Constant atl = (*atlWS)(k);
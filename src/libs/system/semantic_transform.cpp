@@ -65,47 +65,44 @@ SemanticTransform::operator()(const Tree::ParenExpr& e)
   return apply_visitor(*this, e.e);
 }
 
+//the operators are rewritten and transformed in the same pass, the
+//operands are transformed where they are instead of being copied into the
+//rewritten application and then walked again
+
 Tree::Expr 
 SemanticTransform::operator()(const Tree::UnaryOpExpr& e)
 {
-  //(FN1 ! (#arg0)) @ [fnname <- e.op.op, arg0 <- T(e.e)]
-
-  Tree::Expr result = Tree::LambdaAppExpr
-  (
-    Tree::IdentExpr(e.op.op),
-    e.e
-  );
-
-  return apply_visitor(*this, result);
+  //(e.op.op) . (e.e)
+  Tree::Expr op = (*this)(Tree::IdentExpr(e.op.op));
+  return Tree::LambdaAppExpr(std::move(op), apply_visitor(*this, e.e));
 }
 
 Tree::Expr 
 SemanticTransform::operator()(const Tree::BinaryOpExpr& e)
 {
   //(e.op.op) . (e.lhs) . (e.rhs)
-  //(FN2 ! (#arg0, #arg1))
-  //  @ [fnname <- e.op.op, arg0 <- T(e.lhs), arg1 <- T(e.rhs)]
+  //or for call by name
+  //(e.op.op) (e.lhs) (e.rhs)
+  Tree::Expr op = (*this)(Tree::IdentExpr(e.op.op));
+  Tree::Expr lhs;
+  Tree::Expr rhs;
 
-  Tree::Expr result;
-    
   if (e.op.cbn)
   {
-    result = Tree::PhiAppExpr
-    (
-      Tree::PhiAppExpr(Tree::IdentExpr(e.op.op), e.lhs),
-      e.rhs
-    );
+    lhs = transformIntension(e.lhs);
+    rhs = transformIntension(e.rhs);
   }
   else
   {
-    result = Tree::LambdaAppExpr
-    (
-      Tree::LambdaAppExpr(Tree::IdentExpr(e.op.op), e.lhs),
-      e.rhs
-    );
+    lhs = apply_visitor(*this, e.lhs);
+    rhs = apply_visitor(*this, e.rhs);
   }
 
-  return apply_visitor(*this, result);
+  return Tree::LambdaAppExpr
+  (
+    Tree::LambdaAppExpr(std::move(op), std::move(lhs)),
+    std::move(rhs)
+  );
 }
 
 Tree::Expr 
@@ -122,12 +119,12 @@ SemanticTransform::operator()(const Tree::BangAppExpr& e)
     Tree::Expr name = apply_visitor(*this, e.name);
     std::vector<Tree::Expr> args;
 
-    for (auto expr : e.args)
+    for (const auto& expr : e.args)
     {
       args.push_back(apply_visitor(*this, expr));
     }
 
-    return Tree::BangAppExpr(name, args);
+    return Tree::BangAppExpr(std::move(name), std::move(args));
   }
 }
 
@@ -321,14 +318,25 @@ SemanticTransform::operator()(const Tree::MakeIntenExpr& e)
   Tree::MakeIntenExpr inten;
   inten.expr = apply_visitor(*this, e.expr);
 
-  for (const auto b : e.binds)
+  for (const auto& b : e.binds)
   {
     inten.binds.push_back(apply_visitor(*this, b));
   }
 
   inten.scope.insert(inten.scope.end(), m_scope.begin(), m_scope.end());
 
-  return inten;
+  return std::move(inten);
+}
+
+Tree::Expr
+SemanticTransform::transformIntension(const Tree::Expr& e)
+{
+  //the same as transforming MakeIntenExpr(e) without building it
+  Tree::MakeIntenExpr inten;
+  inten.expr = apply_visitor(*this, e);
+  inten.scope.insert(inten.scope.end(), m_scope.begin(), m_scope.end());
+
+  return std::move(inten);
 }
 
 //these could be local to the one function that uses them, but at the moment,
@@ -499,12 +507,11 @@ SemanticTransform::operator()(const Tree::PhiExpr& e)
 Tree::Expr
 SemanticTransform::operator()(const Tree::PhiAppExpr& e)
 {
-  Tree::Expr result = Tree::LambdaAppExpr
-  (
-    e.lhs, Tree::MakeIntenExpr(e.rhs)
-  );
+  //e.lhs . (MakeIntenExpr e.rhs)
+  Tree::Expr lhs = apply_visitor(*this, e.lhs);
+  Tree::Expr rhs = transformIntension(e.rhs);
 
-  return apply_visitor(*this, result);
+  return Tree::LambdaAppExpr(std::move(lhs), std::move(rhs));
 }
 
 ScopePtr
@@ -22,8 +22,10 @@ along with TransLucid; see the file COPYING.  If not see
 #endif
 
 #include <algorithm>
+#include <atomic>
 #include <initializer_list>
 #include <sstream>
+#include <thread>
 #include <unordered_map>
 
 #include <signal.h>
@@ -35,6 +37,7 @@ along with TransLucid; see the file COPYING.  If not see
 #include <tl/cache.hpp>
 #include <tl/constws.hpp>
 #include <tl/context.hpp>
+#include <tl/dimensionality.hpp>
 #include <tl/eval_workshops.hpp>
 #include <tl/opdef.hpp>
 #include <tl/output.hpp>
@@ -276,6 +279,8 @@ System::addVariableDeclInternal
   var->addEquation(u, std::forward<Input>(decl), m_time, scope);
 
   m_identifiers.insert({name, var});
+  m_declarationNames.insert({u, name});
+  markChanged(name);
 
   return Types::UUID::create(u);
 }
@@ -309,6 +314,8 @@ System::addFunDeclInternal
   fun->addEquation(u, decl, m_time, scope);
 
   m_identifiers.insert({name, fun});
+  m_declarationNames.insert({u, name});
+  markChanged(name);
 
   return Types::UUID::create(u);
 }
@@ -332,6 +339,10 @@ System::addOpDeclInternal
   }
 
   m_operators->addEquation(u, decl, m_time);
+  m_declarationNames.insert({u, U"operator"});
+
+  //an operator changes how everything after it is parsed
+  markAllChanged();
 
   m_objects.insert(
   {
@@ -366,6 +377,8 @@ System::addConstructorInternal
   consIter->second->addEquation(u, std::forward<Input>(decl), m_time);
 
   m_identifiers.insert({name, consIter->second});
+  m_declarationNames.insert({u, name});
+  markChanged(name);
 
   return Types::UUID::create(u);
 }
@@ -384,6 +397,11 @@ System::System(bool cached, bool simplify)
 : 
   m_cacheEnabled(cached),
   m_simplified(simplify),
+  m_bulkKernels(true),
+  m_eagerCompile(false),
+  m_history(0),
+  m_allChanged(true),
+  m_dimensionalityGeneration(0),
   m_nextTypeIndex(-1),
   m_typeRegistry(m_nextTypeIndex,
   std::vector<std::pair<u32string, type_index>>{
@@ -459,11 +477,21 @@ void
 System::go()
 {
   setDefaultContext();
+
+  if (m_eagerCompile)
+  {
+    compileAll();
+  }
+
   for (auto& assign : m_assignments)
   {
     assign.second->evaluate(*this, m_defaultk);
   }
 
+  //the next instant only needs to look at what changes from here
+  m_allChanged = false;
+  m_changedIdentifiers.clear();
+
   //collect some garbage
   for (auto& cached : m_cachedVars)
   {
@@ -484,6 +512,71 @@ System::go()
 
   ++m_time;
   setDefaultContext();
+
+  if (m_history != 0 && m_time > m_history)
+  {
+    discardHistory(m_time - m_history);
+  }
+}
+
+size_t
+System::compileAll()
+{
+  //compiling parses with the current operators, adds to the system and
+  //allocates dimensions, none of which can be done concurrently, so each
+  //one is compiled in turn
+  size_t compiled = 0;
+  size_t pass = 0;
+
+  do
+  {
+    //compiling can add more variables, so work from a copy, and go around
+    //again for anything that was added
+    std::vector<std::shared_ptr<VariableWS>> vars;
+    std::vector<std::shared_ptr<FunctionWS>> funs;
+
+    for (auto& var : m_variables)
+    {
+      vars.push_back(var.second);
+    }
+
+    for (auto& fun : m_functions)
+    {
+      funs.push_back(fun.second);
+    }
+
+    pass = std::count_if(vars.begin(), vars.end(),
+      [this] (const std::shared_ptr<VariableWS>& v)
+      {
+        return v->precompile(m_defaultk);
+      }
+    );
+
+    pass += std::count_if(funs.begin(), funs.end(),
+      [this] (const std::shared_ptr<FunctionWS>& f)
+      {
+        return f->precompile(m_defaultk);
+      }
+    );
+
+    compiled += pass;
+  } while (pass != 0);
+
+  return compiled;
+}
+
+void
+System::discardHistory(size_t time)
+{
+  for (auto& var : m_variables)
+  {
+    var.second->discardBefore(time);
+  }
+
+  for (auto& fun : m_functions)
+  {
+    fun.second->discardBefore(time);
+  }
 }
 
 void
@@ -601,31 +694,43 @@ System::addAssignment(const Parser::Equation& eqn)
 
   WorkshopBuilder compile(this);
 
+  std::shared_ptr<BulkKernel> kernel;
+  if (m_bulkKernels)
+  {
+    kernel = BulkKernel::recognise(*this, expr);
+  }
+
   if (cached())
   {
+    //each definition has its own name so that a demand trace doesn't
+    //mix them up
+    u32string suffix = U": " + std::get<0>(eqn) + U"." +
+      to_u32string(std::to_string(assign->second->definitions().size()));
+
     auto guardws = std::make_shared<Workshops::CacheWS>
       (
         compile.build_workshops(guard),
-        U"assignment_guard",
+        U"assignment_guard" + suffix,
         *this
       );
     auto booleanws = std::make_shared<Workshops::CacheWS>
       (
         compile.build_workshops(boolean),
-        U"assignment_boolean",
+        U"assignment_boolean" + suffix,
         *this
       );
     auto exprws = std::make_shared<Workshops::CacheWS>
       (
         compile.build_workshops(expr),
-        U"assignment_expr",
+        U"assignment_expr" + suffix,
         *this
       );
 
     assign->second->addDefinition(Assignment::Definition
       {
         guard, boolean, expr,
-        guardws, booleanws, exprws
+        guardws, booleanws, exprws,
+        kernel
       });
   }
   else
@@ -637,7 +742,8 @@ System::addAssignment(const Parser::Equation& eqn)
     assign->second->addDefinition(Assignment::Definition
       {
         guard, boolean, expr,
-        guardws, booleanws, exprws
+        guardws, booleanws, exprws,
+        kernel
       });
   }
 
@@ -859,6 +965,9 @@ System::addEnvVar(const u32string& name, const Constant& value)
 {
   m_envvars.insert({getDimensionIndex(name), value});
 
+  //this changes the default context
+  markAllChanged();
+
   addDimension(name);
 }
 
@@ -1014,7 +1123,7 @@ System::cacheVar(const u32string& name)
   {
     std::unique_ptr<Workshops::CacheWS> cachews
     {
-      new Workshops::CacheWS(thevar->second, name, *this)
+      new Workshops::CacheWS(thevar->second, name, *this, name)
     };
     m_cachedVars.insert({name, cachews.get()});
     cachews.release();
@@ -1092,7 +1201,7 @@ System::fixupTreeAndAdd(const Tree::Expr& e, ScopePtr scope)
   auto result = fixupTree(*this, e, scope);
   addTransformedEquations(result.second);
 
-  return result.first;
+  return std::move(result.first);
 }
 
 BaseFunctionType*
@@ -1172,10 +1281,145 @@ System::addDeclaration(const Parser::RawInput& input)
   {
     return replDecl(input, lexit);
   }
+  else if (token == U"assign")
+  {
+    return addAssignmentRaw(input, lexit);
+  }
 
   return Constant();
 }
 
+Constant
+System::addDeclaration
+(
+  const Parser::RawInput& input,
+  const std::shared_ptr<Parser::Line>& parsed
+)
+{
+  if (parsed)
+  {
+    auto var = get<Parser::Variable>(parsed.get());
+    if (var != nullptr)
+    {
+      return addVariableDeclInternal(std::get<0>(var->eqn), *var);
+    }
+
+    auto fun = get<Parser::FnDecl>(parsed.get());
+    if (fun != nullptr)
+    {
+      return addFunDeclInternal(fun->name, *fun);
+    }
+  }
+
+  return addDeclaration(input);
+}
+
+bool
+System::independentDeclaration(const Parser::RawInput& input)
+{
+  Parser::U32Iterator inputBegin(
+    Parser::makeUTF32Iterator(input.text.begin())
+  );
+  Parser::U32Iterator inputEnd(
+    Parser::makeUTF32Iterator(input.text.end())
+  );
+
+  Parser::StreamPosIterator posbegin(inputBegin, input.source,
+    input.line, input.character);
+  Parser::StreamPosIterator posend(inputEnd);
+
+  try
+  {
+    Parser::LexerIterator lexit(posbegin, posend, m_defaultk, 
+      lookupIdentifiers());
+
+    auto start = *lexit;
+
+    if (start.getType() != Parser::TOKEN_DECLID)
+    {
+      return false;
+    }
+    
+    u32string token = get<u32string>(start.getValue());
+
+    return token == U"var" || token == U"fun";
+  }
+  catch (Parser::ParseError&)
+  {
+    //adding it will report the error
+    return false;
+  }
+}
+
+std::vector<std::shared_ptr<Parser::Line>>
+System::parseDeclarations
+(
+  const std::vector<Parser::RawInput>& inputs,
+  size_t threads
+)
+{
+  std::vector<std::shared_ptr<Parser::Line>> results(inputs.size());
+
+  threads = std::max(size_t(1), std::min(threads, inputs.size()));
+
+  //each thread parses in its own copy of the context, the evaluations
+  //that the lexer and the parser do are serialised by m_parseLock
+  std::vector<Context> contexts(threads, m_defaultk);
+  std::atomic<size_t> next(0);
+
+  auto work = [this, &inputs, &results, &next] (Context& k)
+  {
+    Parser::Parser p(*this, k);
+
+    for (size_t i = next++; i < inputs.size(); i = next++)
+    {
+      const Parser::RawInput& text = inputs[i];
+
+      Parser::U32Iterator ubegin(Parser::makeUTF32Iterator(text.text.begin()));
+      Parser::U32Iterator uend(Parser::makeUTF32Iterator(text.text.end()));
+
+      Parser::StreamPosIterator posbegin(ubegin, text.source, 
+        text.line, text.character);
+      Parser::StreamPosIterator posend(uend);
+
+      try
+      {
+        Parser::LexerIterator lexbegin(posbegin, posend, k, 
+          lookupIdentifiers());
+        Parser::LexerIterator lexend = lexbegin.makeEnd();
+
+        Parser::Line result;
+        if (p.parse_decl(lexbegin, lexend, result))
+        {
+          results[i] = std::make_shared<Parser::Line>(std::move(result));
+        }
+      }
+      catch (...)
+      {
+        //leave it unparsed, it is added from the text and the error
+        //comes out wherever it would have
+      }
+    }
+  };
+
+  //this thread is one of the workers
+  SharedConstants shared;
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i != threads; ++i)
+  {
+    workers.push_back(std::thread(work, std::ref(contexts[i])));
+  }
+
+  work(contexts[0]);
+
+  for (auto& t : workers)
+  {
+    t.join();
+  }
+
+  return results;
+}
+
 Constant
 System::addVariableDeclRaw
 (
@@ -1298,6 +1542,30 @@ System::addConstructorRaw
   return addConstructorInternal(name, input);
 }
 
+Constant
+System::addAssignmentRaw
+(
+  const Parser::RawInput& input, 
+  Parser::LexerIterator& iter
+)
+{
+  //an assignment is evaluated at the end of every instant, so there is
+  //nothing to gain by waiting to parse it
+  Parser::Line result;
+  if (!m_parser->parse_decl(iter, iter.makeEnd(), result))
+  {
+    return Types::Special::create(SP_ERROR);
+  }
+
+  auto assign = get<Parser::Assignment>(&result);
+  if (assign == nullptr)
+  {
+    return Types::Special::create(SP_ERROR);
+  }
+
+  return addAssignment(assign->eqn);
+}
+
 Constant
 System::addDimDeclRaw
 (
@@ -1360,6 +1628,8 @@ System::delDecl
     return Types::Special::create(SP_UNDEF);
   }
 
+  markDeclarationChanged(id);
+
   return Types::Boolean::create(object->second->del(id, m_time));
 }
 
@@ -1401,6 +1671,8 @@ System::replDecl
     return Types::Special::create(SP_UNDEF);
   }
 
+  markDeclarationChanged(id);
+
   return Types::Boolean::create(object->second->repl(id, m_time, input));
 }
 
@@ -1424,4 +1696,97 @@ System::getIdentifierTree(const u32string& x)
   return Tree::Expr();
 }
 
+std::vector<Parser::FnDecl>
+System::getFunctionDefinitions(const u32string& x)
+{
+  std::vector<Parser::FnDecl> decls;
+
+  auto funiter = m_functions.find(x);
+  if (funiter != m_functions.end())
+  {
+    for (const auto& line : funiter->second->liveDefinitions(m_defaultk))
+    {
+      if (auto fn = get<Parser::FnDecl>(&line))
+      {
+        decls.push_back(*fn);
+      }
+    }
+  }
+
+  return decls;
+}
+
+const InstantDependencies::Result&
+System::getIdentifierDependencies(const u32string& x)
+{
+  auto iter = m_identifierDependencies.find(x);
+
+  if (iter == m_identifierDependencies.end())
+  {
+    InstantDependencies finder;
+    iter = m_identifierDependencies.insert
+      ({x, finder.find(getIdentifierTree(x))}).first;
+  }
+
+  return iter->second;
+}
+
+const std::vector<dimension_index>&
+System::getIdentifierDimensions(const u32string& x)
+{
+  auto iter = m_identifierDimensions.find(x);
+
+  if (iter == m_identifierDimensions.end())
+  {
+    Static::DimensionalityFinder finder(this);
+    auto dims = finder.computeDimensionality(x);
+
+    //everything that x uses has been done too
+    for (const auto& d : dims)
+    {
+      m_identifierDimensions.insert({d.first,
+        std::vector<dimension_index>(d.second.begin(), d.second.end())});
+    }
+
+    iter = m_identifierDimensions.find(x);
+  }
+
+  return iter->second;
+}
+
+void
+System::markChanged(const u32string& name)
+{
+  m_changedIdentifiers.insert(name);
+  m_identifierDependencies.erase(name);
+  m_identifierDimensions.clear();
+  ++m_dimensionalityGeneration;
+}
+
+void
+System::markDeclarationChanged(const uuid& id)
+{
+  auto iter = m_declarationNames.find(id);
+
+  if (iter != m_declarationNames.end() && iter->second != U"operator")
+  {
+    markChanged(iter->second);
+  }
+  else
+  {
+    //we don't know what the object was, or it was an operator, so
+    //everything could have changed
+    markAllChanged();
+  }
+}
+
+void
+System::markAllChanged()
+{
+  m_allChanged = true;
+  m_identifierDependencies.clear();
+  m_identifierDimensions.clear();
+  ++m_dimensionalityGeneration;
+}
+
 } //namespace TransLucid
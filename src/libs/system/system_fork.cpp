@@ -0,0 +1,223 @@
+/* Evaluation on a copy-on-write copy of a system.
+   Copyright (C) 2013 Jarryd Beck
+
+This file is part of TransLucid.
+
+TransLucid is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+TransLucid is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with TransLucid; see the file COPYING.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include <tl/system.hpp>
+#include <tl/system_fork.hpp>
+#include <tl/charset.hpp>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace TransLucid
+{
+
+namespace
+{
+  bool
+  writeAll(int fd, const std::string& s)
+  {
+    const char* p = s.data();
+    const char* end = p + s.size();
+
+    while (p != end)
+    {
+      ssize_t n = write(fd, p, end - p);
+      if (n == -1)
+      {
+        if (errno == EINTR)
+        {
+          continue;
+        }
+        return false;
+      }
+      p += n;
+    }
+
+    return true;
+  }
+
+  std::string
+  readAll(int fd)
+  {
+    std::string result;
+    char buffer[4096];
+
+    while (true)
+    {
+      ssize_t n = read(fd, buffer, sizeof(buffer));
+      if (n == -1 && errno == EINTR)
+      {
+        continue;
+      }
+
+      if (n <= 0)
+      {
+        return result;
+      }
+
+      result.append(buffer, n);
+    }
+  }
+}
+
+pid_t
+forkChild(const std::function<int()>& child)
+{
+  //anything still buffered would be written by both
+  std::cout.flush();
+  std::cerr.flush();
+  fflush(nullptr);
+
+  pid_t pid = fork();
+
+  if (pid == -1)
+  {
+    throw SystemForkError(std::string("could not fork: ") + strerror(errno));
+  }
+
+  if (pid == 0)
+  {
+    //everything else belongs to the parent, so nothing is cleaned up
+    _exit(child());
+  }
+
+  return pid;
+}
+
+pid_t
+waitChild
+(
+  pid_t pid,
+  int& status,
+  bool block,
+  const std::function<bool()>& stop
+)
+{
+  while (true)
+  {
+    pid_t finished = waitpid(pid, &status, block ? 0 : WNOHANG);
+
+    if (finished == -1 && errno == EINTR && !(stop && stop()))
+    {
+      continue;
+    }
+
+    return finished;
+  }
+}
+
+std::string
+describeExit(int status)
+{
+  if (WIFEXITED(status))
+  {
+    return WEXITSTATUS(status) == 0 ? std::string() 
+      : "exited with " + std::to_string(WEXITSTATUS(status));
+  }
+  else if (WIFSIGNALED(status))
+  {
+    return std::string("was killed by ") + strsignal(WTERMSIG(status));
+  }
+  else
+  {
+    return "stopped";
+  }
+}
+
+u32string
+forkEvaluate(System& system, const std::function<u32string(System&)>& f)
+{
+  int fds[2];
+
+  if (pipe(fds) == -1)
+  {
+    throw SystemForkError(std::string("could not make a pipe: ") + 
+      strerror(errno));
+  }
+
+  pid_t pid;
+  try
+  {
+    pid = forkChild([&] () -> int
+      {
+        close(fds[0]);
+
+        //the first byte says whether it worked, then the result or the
+        //error
+        std::string message;
+        int code = 0;
+
+        try
+        {
+          message = "1" + utf32_to_utf8(f(system));
+        }
+        catch (std::exception& e)
+        {
+          message = std::string("0") + e.what();
+          code = 1;
+        }
+        catch (...)
+        {
+          message = "0unknown exception";
+          code = 1;
+        }
+
+        writeAll(fds[1], message);
+        close(fds[1]);
+
+        return code;
+      }
+    );
+  }
+  catch (...)
+  {
+    close(fds[0]);
+    close(fds[1]);
+    throw;
+  }
+
+  close(fds[1]);
+  std::string message = readAll(fds[0]);
+  close(fds[0]);
+
+  int status = 0;
+  waitChild(pid, status);
+
+  if (message.empty() || !WIFEXITED(status))
+  {
+    std::string how = describeExit(status);
+    throw SystemForkError("the copy of the system didn't finish" +
+      (how.empty() ? how : ", it " + how));
+  }
+
+  if (message[0] != '1')
+  {
+    throw SystemForkError("the copy of the system failed: " + 
+      message.substr(1));
+  }
+
+  return utf8_to_utf32(message.substr(1));
+}
+
+}
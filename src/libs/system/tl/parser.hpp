@@ -36,6 +36,9 @@ namespace TransLucid
     {
       public:
       Parser(System& system);
+
+      //parse in the context k instead of the system's context
+      Parser(System& system, Context& k);
       
       bool
       parse_expr(LexerIterator& begin, const LexerIterator& end,
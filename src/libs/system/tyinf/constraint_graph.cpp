@@ -24,6 +24,7 @@ along with TransLucid; see the file COPYING.  If not see
 #include <tl/system.hpp>
 #include <tl/utility.hpp>
 
+#include <atomic>
 #include <iostream>
 
 namespace TransLucid
@@ -121,34 +122,74 @@ intrusive_ptr_release(ConstraintGraph::ConditionalNode* p)
 {
   if (--p->counter == 0)
   {
-    p->m_owner->m_conditionals.erase(p);
+    p->m_owner->conditionals.erase(p);
     delete p;
   }
 }
 
+namespace
+{
+  struct IndexLess
+  {
+    template <typename T>
+    bool
+    operator()(const T& a, TypeVariable b) const
+    {
+      return a.first < b;
+    }
+
+    template <typename T>
+    bool
+    operator()(TypeVariable a, const T& b) const
+    {
+      return a < b.first;
+    }
+
+    template <typename T>
+    bool
+    operator()(const T& a, const T& b) const
+    {
+      return a.first < b.first;
+    }
+  };
+
+  const std::vector<TypeVariable> no_vars;
+}
+
 void
-ConstraintGraph::copy_contents(const ConstraintGraph& other)
+ConstraintGraph::copy_contents(const Data& from, Data& to)
 {
   //copy the conditional nodes and update their owners
   std::map<ConditionalNode*, ConditionalNode*> rewrites;
 
-  for (const auto& c : other.m_conditionals)
+  for (const auto& c : from.conditionals)
   {
     std::unique_ptr<ConditionalNode> p(new ConditionalNode(
       c->s,
       c->lhs,
       c->rhs,
-      this)
+      &to)
     );
 
     rewrites[c] = p.get();
-    m_conditionals.insert(p.get());
+    to.conditionals.insert(p.get());
 
     p.release();
   }
 
-  for (const auto& v : other.m_graph)
+  //the variables that weren't already there, these are merged into the
+  //index at the end
+  std::vector<std::pair<TypeVariable, size_t>> added;
+
+  for (const auto& i : from.index)
   {
+    if (std::binary_search(to.index.begin(), to.index.end(), i.first,
+        IndexLess()))
+    {
+      continue;
+    }
+
+    const auto& v = from.nodes[i.second];
     decltype(v.second.conditions) cond;
 
     for (const auto& c : v.second.conditions)
@@ -159,7 +200,7 @@ ConstraintGraph::copy_contents(const ConstraintGraph& other)
       cond.insert(r);
     }
 
-    m_graph.insert(std::make_pair(v.first, ConstraintNode
+    to.nodes.push_back(std::make_pair(v.first, ConstraintNode
       {
         v.second.less, 
         v.second.greater,
@@ -168,27 +209,107 @@ ConstraintGraph::copy_contents(const ConstraintGraph& other)
         cond
       }
      ));
+    added.push_back(std::make_pair(v.first, to.nodes.size() - 1));
   }
+
+  size_t middle = to.index.size();
+  to.index.insert(to.index.end(), added.begin(), added.end());
+  std::inplace_merge(to.index.begin(), to.index.begin() + middle,
+    to.index.end(), IndexLess());
 }
 
-ConstraintGraph::ConstraintGraph(const ConstraintGraph& rhs)
+ConstraintGraph::Data&
+ConstraintGraph::modify()
 {
-  copy_contents(rhs);
+  if (!m_data)
+  {
+    m_data = std::make_shared<Data>();
+  }
+  else if (m_data.use_count() != 1)
+  {
+    auto copy = std::make_shared<Data>();
+    copy_contents(*m_data, *copy);
+    m_data = copy;
+  }
+  else
+  {
+    //another thread could have just let go of its copy
+    std::atomic_thread_fence(std::memory_order_acquire);
+  }
+
+  return *m_data;
+}
+
+const ConstraintGraph::Entry*
+ConstraintGraph::find(TypeVariable a) const
+{
+  if (!m_data)
+  {
+    return nullptr;
+  }
+
+  const auto& index = m_data->index;
+  auto iter = std::lower_bound(index.begin(), index.end(), a, IndexLess());
+
+  if (iter == index.end() || iter->first != a)
+  {
+    return nullptr;
+  }
+
+  return &m_data->nodes[iter->second];
+}
+
+bool
+ConstraintGraph::next_var(TypeVariable a, TypeVariable& next) const
+{
+  if (!m_data)
+  {
+    return false;
+  }
+
+  const auto& index = m_data->index;
+  auto iter = std::upper_bound(index.begin(), index.end(), a, IndexLess());
+
+  if (iter == index.end())
+  {
+    return false;
+  }
+
+  next = iter->first;
+  return true;
 }
 
-ConstraintGraph&
-ConstraintGraph::operator=(const ConstraintGraph& rhs)
+void
+ConstraintGraph::erase_var(TypeVariable a)
 {
-  if (this == &rhs)
+  if (find(a) == nullptr)
   {
-    return *this;
+    return;
   }
 
-  m_graph.clear();
-  assert(m_conditionals.empty());
-  copy_contents(rhs);
+  Data& d = modify();
+  auto iter = std::lower_bound(d.index.begin(), d.index.end(), a, 
+    IndexLess());
+
+  //the node stays where it is, but it can let go of everything
+  d.nodes[iter->second].second = ConstraintNode();
+  d.index.erase(iter);
+}
+
+const std::vector<TypeVariable>&
+ConstraintGraph::predecessor(TypeVariable a) const
+{
+  auto entry = find(a);
+
+  return entry != nullptr ? entry->second.less : no_vars;
+}
+
+const std::vector<TypeVariable>&
+ConstraintGraph::successor(TypeVariable a) const
+{
+  auto entry = find(a);
 
-  return *this;
+  return entry != nullptr ? entry->second.greater : no_vars;
 }
 
 void
@@ -202,95 +323,95 @@ ConstraintGraph::add_constraint(TypeVariable a, TypeVariable b,
 
   // find a' and b' | a' < a and b < b'
 
-  auto a_data = get_make_entry(a);
-  auto b_data = get_make_entry(b);
+  auto& a_data = get_make_entry(a);
+  auto& b_data = get_make_entry(b);
 
   std::vector<Constraint> toadd;
-  subc(Constraint{a_data->second.lower, b_data->second.upper}, toadd);
+  subc(Constraint{a_data.second.lower, b_data.second.upper}, toadd);
 
   push_range(toadd.begin(), toadd.end(), q);
 
-  auto a_less = a_data->second.less;
-  auto b_greater = b_data->second.greater; 
+  auto a_less = a_data.second.less;
+  auto b_greater = b_data.second.greater; 
 
   add_less_closed(a, b);
 
   //add the constraints to the upper and lower bounds of a and b
-  a_data->second.upper = construct_glb(a_data->second.upper, 
-    b_data->second.upper);
-  new_lower_closed(b_data, construct_lub(b_data->second.lower,
-    a_data->second.lower));
+  a_data.second.upper = construct_glb(a_data.second.upper, 
+    b_data.second.upper);
+  new_lower_closed(b_data, construct_lub(b_data.second.lower,
+    a_data.second.lower));
 
   //for each bp in the greater of b, its lower is (lower bp) lub (lower a)
-  for (const auto bp : b_data->second.greater)
+  for (const auto bp : b_data.second.greater)
   {
-    auto bp_data = m_graph.find(bp);
+    auto& bp_data = get_make_entry(bp);
 
-    new_lower_closed(bp_data, construct_lub(bp_data->second.lower, 
-      a_data->second.lower));
+    new_lower_closed(bp_data, construct_lub(bp_data.second.lower, 
+      a_data.second.lower));
   }
 
   //for each ap in the less of a, its upper is (upper ap) glb (upper b)
-  for (const auto ap : a_data->second.less)
+  for (const auto ap : a_data.second.less)
   {
-    auto ap_data = m_graph.find(ap);
+    auto& ap_data = get_make_entry(ap);
 
-    ap_data->second.upper = construct_glb(ap_data->second.upper,
-      b_data->second.upper);
+    ap_data.second.upper = construct_glb(ap_data.second.upper,
+      b_data.second.upper);
   }
 }
 
 void
 ConstraintGraph::add_constraint(TypeVariable a, Type t, ConstraintQueue& q)
 {
-  auto iter = get_make_entry(a);
+  auto& iter = get_make_entry(a);
 
-  if (type_term_contains_neg(iter->second.upper, t))
+  if (type_term_contains_neg(iter.second.upper, t))
   {
     return ;
   }
 
   std::vector<Constraint> toadd;
-  subc(Constraint{iter->second.lower, t}, toadd);
+  subc(Constraint{iter.second.lower, t}, toadd);
 
   push_range(toadd.begin(), toadd.end(), q);
 
   //put itself in the constraints
-  iter->second.upper = construct_glb(iter->second.upper, t);
+  iter.second.upper = construct_glb(iter.second.upper, t);
 
   //for each ap less than a, its upper is (upper ap) glb t
-  for (const auto ap : iter->second.less)
+  for (const auto ap : iter.second.less)
   {
-    auto ap_data = m_graph.find(ap);
+    auto& ap_data = get_make_entry(ap);
 
-    ap_data->second.upper = construct_glb(ap_data->second.upper, t);
+    ap_data.second.upper = construct_glb(ap_data.second.upper, t);
   }
 }
 
 void
 ConstraintGraph::add_constraint(Type t, TypeVariable b, ConstraintQueue& q)
 {
-  auto iter = get_make_entry(b);
+  auto& iter = get_make_entry(b);
 
-  if (type_term_contains_pos(iter->second.lower, t))
+  if (type_term_contains_pos(iter.second.lower, t))
   {
     return ;
   }
 
   std::vector<Constraint> toadd;
-  subc(Constraint{t, iter->second.upper}, toadd);
+  subc(Constraint{t, iter.second.upper}, toadd);
 
   push_range(toadd.begin(), toadd.end(), q);
 
   //put itself in the constraints
-  iter->second.lower = construct_lub(iter->second.lower, t);
+  iter.second.lower = construct_lub(iter.second.lower, t);
 
   //for each bp greater than b, its lower is (lower bp) lub t
-  for (const auto bp : iter->second.greater)
+  for (const auto bp : iter.second.greater)
   {
-    auto bp_data = m_graph.find(bp);
+    auto& bp_data = get_make_entry(bp);
 
-    new_lower_closed(bp_data, construct_lub(bp_data->second.lower, t));
+    new_lower_closed(bp_data, construct_lub(bp_data.second.lower, t));
   }
 }
 
@@ -333,13 +454,13 @@ ConstraintGraph::add_to_closure(const Constraint& constraint)
 void
 ConstraintGraph::add_conditional(const CondConstraint& cc)
 {
-  auto data = get_make_entry(cc.a);
+  auto& data = get_make_entry(cc.a);
 
   std::unique_ptr<ConditionalNode> p(
-    new ConditionalNode(cc.s, cc.lhs, cc.rhs, this));
+    new ConditionalNode(cc.s, cc.lhs, cc.rhs, m_data.get()));
 
-  m_conditionals.insert(p.get());
-  data->second.conditions.insert(p.get());
+  m_data->conditionals.insert(p.get());
+  data.second.conditions.insert(p.get());
 
   auto node = p.release();
 
@@ -347,18 +468,18 @@ ConstraintGraph::add_conditional(const CondConstraint& cc)
   check_single_conditional(data, node);
 
   //propagate to less thans
-  for (const auto less : data->second.less)
+  for (const auto less : data.second.less)
   {
-    auto ldata = get_make_entry(less);
-    ldata->second.conditions.insert(node);
+    auto& ldata = get_make_entry(less);
+    ldata.second.conditions.insert(node);
   }
 
 }
 
 void
-ConstraintGraph::check_conditionals(decltype(m_graph)::iterator var)
+ConstraintGraph::check_conditionals(Entry& var)
 {
-  for (const auto& cc : var->second.conditions)
+  for (const auto& cc : var.second.conditions)
   {
     check_single_conditional(var, cc);
   }
@@ -367,12 +488,12 @@ ConstraintGraph::check_conditionals(decltype(m_graph)::iterator var)
 void
 ConstraintGraph::check_single_conditional
 (
-  decltype(m_graph)::iterator var,
+  Entry& var,
   const CondNodeP& cc
 )
 {
   HeadCompare head;
-  if (apply_visitor_binary(head, cc->s, var->second.lower))
+  if (apply_visitor_binary(head, cc->s, var.second.lower))
   {
     add_to_closure(Constraint{cc->lhs, cc->rhs});
   }
@@ -387,14 +508,14 @@ ConstraintGraph::less(TypeVariable a, TypeVariable b) const
     return true;
   }
 
-  auto iter = m_graph.find(a);
+  auto entry = find(a);
 
-  if (iter == m_graph.end())
+  if (entry == nullptr)
   {
     return false;
   }
 
-  const auto& lessthan = iter->second.greater;
+  const auto& lessthan = entry->second.greater;
   
   return std::binary_search(lessthan.begin(), lessthan.end(), b);
 }
@@ -408,30 +529,30 @@ ConstraintGraph::add_less(TypeVariable a, TypeVariable b)
   }
 
   //add b to the greater of a, and a to the less of b
-  auto a_data = get_make_entry(a);
-  auto b_data = get_make_entry(b);
+  auto& a_data = get_make_entry(a);
+  auto& b_data = get_make_entry(b);
 
-  insert_sorted(a_data->second.greater, b);
-  insert_sorted(b_data->second.less, a);
+  insert_sorted(a_data.second.greater, b);
+  insert_sorted(b_data.second.less, a);
 
   //add any constraints in b to a
-  for (const auto& p : b_data->second.conditions)
+  for (const auto& p : b_data.second.conditions)
   {
-    a_data->second.conditions.insert(p);
+    a_data.second.conditions.insert(p);
   }
 
-  a_data->second.conditions.insert
+  a_data.second.conditions.insert
   (
-    b_data->second.conditions.begin(),
-    b_data->second.conditions.end()
+    b_data.second.conditions.begin(),
+    b_data.second.conditions.end()
   );
 }
 
 void
 ConstraintGraph::add_less_closed(TypeVariable a, TypeVariable b)
 {
-  auto a_data = get_make_entry(a);
-  auto b_data = get_make_entry(b);
+  auto& a_data = get_make_entry(a);
+  auto& b_data = get_make_entry(b);
 
   if (less(a, b))
   {
@@ -439,9 +560,9 @@ ConstraintGraph::add_less_closed(TypeVariable a, TypeVariable b)
   }
 
   //include a < a and b < b
-  auto a_less = a_data->second.less;
+  auto a_less = a_data.second.less;
   a_less.push_back(a);
-  auto b_greater = b_data->second.greater; 
+  auto b_greater = b_data.second.greater; 
   b_greater.push_back(b);
 
   //we go through every pair of a less and b greater
@@ -454,17 +575,22 @@ ConstraintGraph::add_less_closed(TypeVariable a, TypeVariable b)
   }
 }
 
-decltype(ConstraintGraph::m_graph)::iterator
+ConstraintGraph::Entry&
 ConstraintGraph::get_make_entry(TypeVariable a)
 {
-  auto iter = m_graph.find(a);
+  Data& d = modify();
+  auto iter = std::lower_bound(d.index.begin(), d.index.end(), a, 
+    IndexLess());
 
-  if (iter == m_graph.end())
+  if (iter != d.index.end() && iter->first == a)
   {
-    iter = m_graph.insert(std::make_pair(a, ConstraintNode())).first;
+    return d.nodes[iter->second];
   }
 
-  return iter;
+  d.nodes.push_back(std::make_pair(a, ConstraintNode()));
+  d.index.insert(iter, std::make_pair(a, d.nodes.size() - 1));
+
+  return d.nodes.back();
 }
 
 void
@@ -587,7 +713,19 @@ subc(const Constraint& c, std::vector<Constraint>& result)
 void
 ConstraintGraph::make_union(const ConstraintGraph& other)
 {
-  copy_contents(other);
+  if (!other.m_data)
+  {
+    return;
+  }
+
+  //an empty graph can just share the other one
+  if (!m_data || (m_data->index.empty() && m_data->conditionals.empty()))
+  {
+    m_data = other.m_data;
+    return;
+  }
+
+  copy_contents(*other.m_data, modify());
 }
 
 template <typename Printer>
@@ -595,7 +733,7 @@ u32string
 ConstraintGraph::print_internal(Printer&& p) const
 {
   u32string result;
-  for (const auto& var : m_graph)
+  for_each_entry([&] (const Entry& var)
   {
     //lower bound
     result += p(var.second.lower);
@@ -630,7 +768,7 @@ ConstraintGraph::print_internal(Printer&& p) const
     }
 
     result += U"\n";
-  }
+  });
 
   return result;
 }
@@ -687,47 +825,47 @@ ConstraintGraph::print_display(TypePrinter& printer) const
 Type
 ConstraintGraph::upper(TypeVariable a) const
 {
-  auto iter = m_graph.find(a);
+  auto entry = find(a);
 
-  if (iter == m_graph.end())
+  if (entry == nullptr)
   {
     return TypeTop();
   }
   else
   {
-    return iter->second.upper;
+    return entry->second.upper;
   }
 }
 
 Type
 ConstraintGraph::lower(TypeVariable b) const
 {
-  auto iter = m_graph.find(b);
+  auto entry = find(b);
 
-  if (iter == m_graph.end())
+  if (entry == nullptr)
   {
     return TypeBot();
   }
   else
   {
-    return iter->second.lower;
+    return entry->second.lower;
   }
 }
 
 void
 ConstraintGraph::setUpper(TypeVariable a, Type t)
 {
-  auto iter = get_make_entry(a);
+  auto& iter = get_make_entry(a);
 
-  iter->second.upper = t;
+  iter.second.upper = t;
 }
 
 void
 ConstraintGraph::setLower(TypeVariable a, Type t)
 {
-  auto iter = get_make_entry(a);
+  auto& iter = get_make_entry(a);
 
-  iter->second.lower = t;
+  iter.second.lower = t;
 }
 
 void
@@ -737,9 +875,9 @@ ConstraintGraph::setPredecessor
   const std::vector<TypeVariable>& pred
 )
 {
-  auto iter = get_make_entry(a);
+  auto& iter = get_make_entry(a);
 
-  iter->second.less = pred;
+  iter.second.less = pred;
 }
 
 void
@@ -749,9 +887,9 @@ ConstraintGraph::setSuccessor
   const std::vector<TypeVariable>& succ
 )
 {
-  auto iter = get_make_entry(a);
+  auto& iter = get_make_entry(a);
 
-  iter->second.greater = succ;
+  iter.second.greater = succ;
 }
 
 
@@ -760,20 +898,31 @@ ConstraintGraph::setSuccessor
 void
 ConstraintGraph::rewrite_less(TypeVariable gamma, const VarSet& S)
 {
-  for (const auto& v : m_graph)
+  //adding to the graph can add variables, so go through it by looking
+  //for the next variable each time
+  TypeVariable v = 0;
+  bool more = m_data && !m_data->index.empty();
+  if (more)
+  {
+    v = m_data->index.front().first;
+  }
+
+  while (more)
   {
     bool found = false;
     auto iter = S.begin();
     while (!found && iter != S.end())
     {
       //don't add variables that are less than themselves
-      if (less(*iter, v.first) && *iter != v.first)
+      if (less(*iter, v) && *iter != v)
       {
         found = true;
-        add_less_closed(gamma, v.first);
+        add_less_closed(gamma, v);
       }
       ++iter;
     }
+
+    more = next_var(v, v);
   }
 }
 
@@ -781,20 +930,29 @@ ConstraintGraph::rewrite_less(TypeVariable gamma, const VarSet& S)
 void
 ConstraintGraph::rewrite_greater(TypeVariable lambda, const VarSet& S)
 {
-  for (const auto& v : m_graph)
+  TypeVariable v = 0;
+  bool more = m_data && !m_data->index.empty();
+  if (more)
+  {
+    v = m_data->index.front().first;
+  }
+
+  while (more)
   {
     bool found = false;
     auto iter = S.begin();
     while (!found && iter != S.end())
     {
       //don't add variables that are less than themselves
-      if (less(v.first, *iter) && *iter != v.first)
+      if (less(v, *iter) && *iter != v)
       {
         found = true;
-        add_less_closed(v.first, lambda);
+        add_less_closed(v, lambda);
       }
       ++iter;
     }
+
+    more = next_var(v, v);
   }
 }
 
@@ -825,10 +983,19 @@ ConstraintGraph::collect(const VarSet& neg, const VarSet& pos)
 {
   VarSet toRemove;
 
+  if (!m_data)
+  {
+    return;
+  }
+
+  Data& d = modify();
+
   //only keep lower bounds if the variable is positive
   //only keep upper bounds if the variable is negative
-  for (auto& v : m_graph)
+  for (const auto& i : d.index)
   {
+    auto& v = d.nodes[i.second];
+
     //only keep < if it is neg < pos
     if (pos.find(v.first) != pos.end())
     {
@@ -874,10 +1041,22 @@ ConstraintGraph::collect(const VarSet& neg, const VarSet& pos)
     }
   }
 
-  for (auto v : toRemove)
-  {
-    m_graph.erase(v);
-  }
+  //the nodes that go stay where they are, but they can let go of
+  //everything
+  auto end = std::remove_if(d.index.begin(), d.index.end(),
+    [&] (const std::pair<TypeVariable, size_t>& i)
+    {
+      if (toRemove.find(i.first) == toRemove.end())
+      {
+        return false;
+      }
+
+      d.nodes[i.second].second = ConstraintNode();
+      return true;
+    }
+  );
+
+  d.index.erase(end, d.index.end());
 
 }
 
@@ -1131,12 +1131,7 @@ TypeAtomicUnion::add(const Type& t)
     const Constant& c = get<Constant>(t);
     if (atomics.find(c.index()) == atomics.end())
     {
-      auto result = constants.insert(c);
-
-      if (result.second)
-      {
-        atomic_map[c.index()].push_back(result.first);
-      }
+      constants.insert(c);
     }
   }
 }
@@ -1190,15 +1185,17 @@ TypeAtomicUnion::add_atomic(type_index index)
 
   //keep normalised, i.e., remove any constants that are covered by an
   //atomic
-  auto iter = atomic_map.find(index);
-  if (iter != atomic_map.end())
+  auto iter = constants.begin();
+  while (iter != constants.end())
   {
-    for (const auto& v : iter->second)
+    if (iter->index() == index)
     {
-      constants.erase(v);
+      iter = constants.erase(iter);
+    }
+    else
+    {
+      ++iter;
     }
-
-    atomic_map.erase(iter);
   }
 }
 
@@ -40,7 +40,12 @@ along with TransLucid; see the file COPYING.  If not see
 
 #include <tl/system.hpp>
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <stack>
+#include <thread>
 
 //#define TYINF_PRINT_ALL
 
@@ -148,6 +153,26 @@ TypeInferrer::simplify(TypeScheme t)
   return S;
 }
 
+TypeInferrer::TypeInferrer(System& system, FreshTypeVars& freshVars)
+: m_freshVars(freshVars)
+, m_system(system)
+, indecl(false)
+, m_parent(nullptr)
+, m_threads(1)
+, m_bool(makeAtomic(system, U"bool"))
+{
+}
+
+TypeInferrer::TypeInferrer(TypeInferrer* parent)
+: m_freshVars(parent->m_freshVars)
+, m_system(parent->m_system)
+, indecl(parent->indecl)
+, m_parent(parent)
+, m_threads(1)
+, m_bool(parent->m_bool)
+{
+}
+
 void
 TypeInferrer::infer_system(const std::set<u32string>& ids)
 {
@@ -161,94 +186,179 @@ TypeInferrer::infer_system(const std::set<u32string>& ids)
   std::cout << std::endl;
   #endif
 
-  auto recursion_groups = generate_recurse_groups(ids);
+  std::vector<std::vector<size_t>> depends;
+  auto recursion_groups = generate_recurse_groups(ids, depends);
 
-  const u32string* currentId = nullptr;
+  if (m_threads > 1 && recursion_groups.size() > 1)
+  {
+    infer_parallel(recursion_groups, depends);
+  }
+  else
+  {
+    for (const auto& group : recursion_groups)
+    {
+      for (auto& xs : infer_group(group))
+      {
+        m_environment[xs.first] = std::move(xs.second);
+      }
+    }
+  }
+}
 
-  try
+void
+TypeInferrer::invalidate_changed()
+{
+  //who uses each identifier
+  std::map<u32string, std::vector<u32string>> users;
+
+  for (const auto& x : m_uses)
   {
+    for (const auto& y : x.second)
+    {
+      users[y].push_back(x.first);
+    }
+  }
 
-    for (const auto& group : recursion_groups)
+  //an identifier that wasn't defined before can be now, so this looks
+  //at everything that is used as well as everything that was inferred
+  std::vector<u32string> stale;
+  for (const auto& x : m_uses)
+  {
+    if (m_system.identifierChanged(x.first))
     {
-      //build up C and A as we go
-      TypeContext A;
-      ConstraintGraph C;
-      std::map<u32string, Type> types;
+      stale.push_back(x.first);
+    }
+  }
 
-      for (const auto& x : group)
-      {
-        //we can cheat sometimes and provide appropriate types when we
-        //know that they can't be inferred properly
+  for (const auto& y : users)
+  {
+    if (m_uses.find(y.first) == m_uses.end() &&
+        m_system.identifierChanged(y.first))
+    {
+      stale.push_back(y.first);
+    }
+  }
 
-        decltype(types.begin()) typeInserted;
+  //a recursion group uses itself, so this gets the whole group as well as
+  //its dependents
+  std::set<u32string> removed;
+  while (!stale.empty())
+  {
+    auto x = stale.back();
+    stale.pop_back();
 
-        auto iter = m_environment.find(x);
-        if (iter != m_environment.end())
-        {
-          auto S = rename_scheme(iter->second, m_freshVars);
-          //Rename rename(m_freshVars);
-          //auto S = rename.rename(iter->second);
+    if (!removed.insert(x).second)
+    {
+      continue;
+    }
 
-          A.join(std::get<0>(S));
-          C.make_union(std::get<2>(S));
-          typeInserted = types.insert(std::make_pair(x, std::get<1>(S))).first;
-        }
-        else
-        {
-          currentId = &x;
-          auto e = m_system.getIdentifierTree(x);
+    m_environment.erase(x);
+    m_uses.erase(x);
 
-          //std::cout << "inferring : " << x << std::endl;
+    auto iter = users.find(x);
+    if (iter != users.end())
+    {
+      stale.insert(stale.end(), iter->second.begin(), iter->second.end());
+    }
+  }
+}
 
-          auto t = apply_visitor(*this, e);
+TypeInferrer::GroupTypes
+TypeInferrer::infer_group(const std::vector<u32string>& group)
+{
+  const u32string* currentId = nullptr;
 
-          A.join(std::get<0>(t));
-          C.make_union(std::get<2>(t));
+  GroupTypes result;
 
-          typeInserted = types.insert(std::make_pair(x, std::get<1>(t))).first;
-        }
+  try
+  {
+    //build up C and A as we go
+    TypeContext A;
+    ConstraintGraph C;
+    std::map<u32string, Type> types;
+
+    for (const auto& x : group)
+    {
+      //we can cheat sometimes and provide appropriate types when we
+      //know that they can't be inferred properly
+
+      decltype(types.begin()) typeInserted;
 
-        #ifdef TYINF_PRINT_ALL
-        std::cout << x << " : " << 
-          print_type(typeInserted->second, m_system) 
-          << std::endl;
-        #endif
+      auto known = find_scheme(x);
+      if (known != nullptr)
+      {
+        auto S = rename_scheme(*known, m_freshVars);
+        //Rename rename(m_freshVars);
+        //auto S = rename.rename(*known);
+
+        A.join(std::get<0>(S));
+        C.make_union(std::get<2>(S));
+        typeInserted = types.insert(std::make_pair(x, std::get<1>(S))).first;
       }
-        
-      if (types.size() > 1)
+      else
       {
-        for (const auto& xt : types)
+        currentId = &x;
+        Tree::Expr e;
+
         {
-          currentId = &xt.first;
-          //each x is allocated an alpha and a gamma type variable
-          auto alpha = fresh();
-          auto gamma = fresh();
-
-          //then we link up the type from the context to the return types
-          C.add_to_closure(Constraint{xt.second, alpha});
-          C.add_to_closure(Constraint{alpha, gamma});
-          C.add_to_closure(Constraint{gamma, A.lookup(xt.first)});
+          auto lock = lock_system();
+          e = m_system.getIdentifierTree(x);
         }
+
+        //std::cout << "inferring : " << x << std::endl;
+
+        auto t = apply_visitor(*this, e);
+
+        A.join(std::get<0>(t));
+        C.make_union(std::get<2>(t));
+
+        typeInserted = types.insert(std::make_pair(x, std::get<1>(t))).first;
       }
 
-      //remove each var from the context
+      #ifdef TYINF_PRINT_ALL
+      std::cout << x << " : " << 
+        print_type(typeInserted->second, m_system) 
+        << std::endl;
+      #endif
+    }
+      
+    if (types.size() > 1)
+    {
       for (const auto& xt : types)
       {
-        A.remove(xt.first);
+        currentId = &xt.first;
+        //each x is allocated an alpha and a gamma type variable
+        auto alpha = fresh();
+        auto gamma = fresh();
+
+        //then we link up the type from the context to the return types
+        C.add_to_closure(Constraint{xt.second, alpha});
+        C.add_to_closure(Constraint{alpha, gamma});
+        C.add_to_closure(Constraint{gamma, A.lookup(xt.first)});
       }
+    }
 
-      for (const auto& xt : types)
-      {
-        auto S =  simplify(std::make_tuple(A, xt.second, C));
+    //remove each var from the context
+    for (const auto& xt : types)
+    {
+      A.remove(xt.first);
+    }
+
+    for (const auto& xt : types)
+    {
+      auto S =  simplify(std::make_tuple(A, xt.second, C));
 
-        #ifdef TYINF_PRINT_ALL
-        std::cout << std::get<2>(S).print(m_system) << "\n";
-        std::cout << "\nContext: ";
-        std::cout << std::get<0>(S).print_context(m_system) << std::endl;
-        #endif
+      #ifdef TYINF_PRINT_ALL
+      std::cout << std::get<2>(S).print(m_system) << "\n";
+      std::cout << "\nContext: ";
+      std::cout << std::get<0>(S).print_context(m_system) << std::endl;
+      #endif
 
-        m_environment[xt.first] = S;
-      }
+      //the variables are numbered from one in each scheme, so that it
+      //doesn't matter which thread inferred it or what else was inferred
+      //at the same time. Everything that uses a scheme renames it first
+      FreshTypeVars numbering;
+      result.push_back(std::make_pair(xt.first, rename_scheme(S, numbering)));
     }
   } 
   catch (...)
@@ -256,10 +366,163 @@ TypeInferrer::infer_system(const std::set<u32string>& ids)
     std::cerr << "Error checking type of " << *currentId << std::endl;
     throw;
   }
+
+  return result;
+}
+
+void
+TypeInferrer::infer_parallel
+(
+  const std::vector<std::vector<u32string>>& groups,
+  const std::vector<std::vector<size_t>>& depends
+)
+{
+  //how many groups each group is still waiting for, and which groups are
+  //waiting for it
+  std::vector<size_t> waiting(groups.size());
+  std::vector<std::vector<size_t>> dependents(groups.size());
+  std::deque<size_t> ready;
+
+  for (size_t g = 0; g != groups.size(); ++g)
+  {
+    waiting[g] = depends[g].size();
+
+    for (auto d : depends[g])
+    {
+      dependents[d].push_back(g);
+    }
+
+    if (waiting[g] == 0)
+    {
+      ready.push_back(g);
+    }
+  }
+
+  size_t finished = 0;
+  std::exception_ptr error;
+  std::condition_variable changed;
+
+  auto work = [&] ()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (true)
+    {
+      changed.wait(lock, [&] () 
+        {
+          return !ready.empty() || finished == groups.size() || error;
+        }
+      );
+
+      if (error || ready.empty())
+      {
+        return;
+      }
+
+      size_t g = ready.front();
+      ready.pop_front();
+
+      lock.unlock();
+
+      GroupTypes types;
+      try
+      {
+        TypeInferrer worker(this);
+        types = worker.infer_group(groups[g]);
+      }
+      catch (...)
+      {
+        lock.lock();
+        if (!error)
+        {
+          error = std::current_exception();
+        }
+        changed.notify_all();
+        return;
+      }
+
+      lock.lock();
+
+      for (auto& xs : types)
+      {
+        m_environment[xs.first] = std::move(xs.second);
+      }
+
+      ++finished;
+      for (auto d : dependents[g])
+      {
+        if (--waiting[d] == 0)
+        {
+          ready.push_back(d);
+        }
+      }
+
+      changed.notify_all();
+    }
+  };
+
+  //this thread is one of the workers
+  SharedConstants shared;
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < std::min(m_threads, groups.size()); ++i)
+  {
+    threads.push_back(std::thread(work));
+  }
+
+  work();
+
+  for (auto& t : threads)
+  {
+    t.join();
+  }
+
+  if (error)
+  {
+    std::rethrow_exception(error);
+  }
+}
+
+const TypeScheme*
+TypeInferrer::find_scheme(const u32string& x)
+{
+  if (m_parent != nullptr)
+  {
+    //the other workers add to the parent while this one is running, but
+    //a scheme doesn't change once its group has been added
+    std::lock_guard<std::mutex> lock(m_parent->m_mutex);
+    return m_parent->find_scheme(x);
+  }
+
+  auto iter = m_environment.find(x);
+  if (iter == m_environment.end())
+  {
+    return nullptr;
+  }
+  else
+  {
+    return &iter->second;
+  }
+}
+
+std::unique_lock<std::mutex>
+TypeInferrer::lock_system()
+{
+  if (m_parent != nullptr)
+  {
+    return m_parent->lock_system();
+  }
+  else
+  {
+    return std::unique_lock<std::mutex>(m_mutex);
+  }
 }
 
 std::vector<std::vector<u32string>>
-TypeInferrer::generate_recurse_groups(const std::set<u32string>& ids)
+TypeInferrer::generate_recurse_groups
+(
+  const std::set<u32string>& ids,
+  std::vector<std::vector<size_t>>& depends
+)
 {
   FreeVariables free;
 
@@ -269,6 +532,17 @@ TypeInferrer::generate_recurse_groups(const std::set<u32string>& ids)
   std::vector<u32string> newVars;
   std::vector<u32string> currentRound(ids.begin(), ids.end());
 
+  //the identifiers that already have a type don't need to be looked at
+  auto unknown = [this] (const u32string& v)
+    {
+      return m_environment.find(v) == m_environment.end();
+    };
+
+  currentRound.erase(
+    std::remove_if(currentRound.begin(), currentRound.end(), 
+      [&unknown] (const u32string& v) { return !unknown(v); }),
+    currentRound.end());
+
   while (!currentRound.empty())
   {
     for (const auto& v : currentRound)
@@ -276,9 +550,16 @@ TypeInferrer::generate_recurse_groups(const std::set<u32string>& ids)
       auto result = freeVariables.insert(
         std::make_pair(v, free.findFree(m_system.getIdentifierTree(v))));
 
+      if (!result.second)
+      {
+        continue;
+      }
+
+      m_uses[v] = result.first->second;
+
       for (const auto& f : result.first->second)
       {
-        if (freeVariables.find(f) == freeVariables.end())
+        if (freeVariables.find(f) == freeVariables.end() && unknown(f))
         {
           newVars.push_back(f);
         }
@@ -313,7 +594,7 @@ TypeInferrer::generate_recurse_groups(const std::set<u32string>& ids)
     };
 
   //vertex list for dependency graph
-  std::vector<std::vector<size_t>> depGraph(ids.size());
+  std::vector<std::vector<size_t>> depGraph;
 
   for (const auto& var : freeVariables)
   {
@@ -327,6 +608,11 @@ TypeInferrer::generate_recurse_groups(const std::set<u32string>& ids)
 
     for (const auto& f : var.second)
     {
+      if (!unknown(f))
+      {
+        continue;
+      }
+
       size_t fi = updateIndex(f);
 
       depGraph[index].push_back(fi);
@@ -336,6 +622,7 @@ TypeInferrer::generate_recurse_groups(const std::set<u32string>& ids)
   auto connected = generate_strongly_connected(depGraph);
 
   std::vector<std::vector<u32string>> groups;
+  std::vector<size_t> groupOf(depGraph.size());
 
   for (const auto& component : connected)
   {
@@ -343,10 +630,33 @@ TypeInferrer::generate_recurse_groups(const std::set<u32string>& ids)
     for (const auto& v : component)
     {
       oneGroup.push_back(indexToString[v]);
+      groupOf[v] = groups.size();
     }
     groups.push_back(oneGroup);
   }
 
+  //the components come out after everything that they use, so the groups
+  //can be inferred in order, but they also need the edges between them to
+  //be inferred in parallel
+  depends.assign(groups.size(), std::vector<size_t>());
+
+  for (size_t v = 0; v != depGraph.size(); ++v)
+  {
+    for (auto f : depGraph[v])
+    {
+      if (groupOf[f] != groupOf[v])
+      {
+        depends[groupOf[v]].push_back(groupOf[f]);
+      }
+    }
+  }
+
+  for (auto& d : depends)
+  {
+    std::sort(d.begin(), d.end());
+    d.erase(std::unique(d.begin(), d.end()), d.end());
+  }
+
   return groups;
 }
 
@@ -392,6 +702,7 @@ TypeInferrer::process_region_guard
           if (c.index() == TYPE_INDEX_TYPE)
           {
             auto baseType = get_constant<type_index>(c);
+            auto lock = lock_system();
             currentType = TypeAtomic{m_system.getTypeName(baseType), baseType};
             result.push_back(std::make_pair(d, currentType));
 
@@ -504,11 +815,16 @@ TypeInferrer::result_type
 TypeInferrer::operator()(const Tree::LiteralExpr& e)
 {
   //evaluate the literal, and that is its type
-  WorkshopBuilder compile(&m_system);
+  Constant result;
 
-  std::shared_ptr<WS> ws(compile.build_workshops(e.rewritten));
+  {
+    auto lock = lock_system();
+    WorkshopBuilder compile(&m_system);
+
+    std::shared_ptr<WS> ws(compile.build_workshops(e.rewritten));
 
-  Constant result = (*ws)(m_system.getDefaultContext());
+    result = (*ws)(m_system.getDefaultContext());
+  }
 
   ConstraintGraph C;
   auto t = fresh();
@@ -527,16 +843,22 @@ TypeInferrer::operator()(const Tree::DimensionExpr& e)
   }
   else
   {
-    return make_constant(
-      Types::Dimension::create(m_system.getDimensionIndex(e.text)));
+    dimension_index d;
+
+    {
+      auto lock = lock_system();
+      d = m_system.getDimensionIndex(e.text);
+    }
+
+    return make_constant(Types::Dimension::create(d));
   }
 }
 
 TypeInferrer::result_type
 TypeInferrer::operator()(const Tree::IdentExpr& e)
 {
-  auto iter = m_environment.find(e.text);
-  if (iter == m_environment.end())
+  auto known = find_scheme(e.text);
+  if (known == nullptr)
   {
     auto alpha = fresh();
     auto gamma = fresh();
@@ -553,7 +875,7 @@ TypeInferrer::operator()(const Tree::IdentExpr& e)
   else
   {
     //rename the type scheme and return
-    return rename_scheme(iter->second, m_freshVars);
+    return rename_scheme(*known, m_freshVars);
   }
 }
 
@@ -566,18 +888,24 @@ TypeInferrer::operator()(const Tree::HashSymbol& e)
 TypeInferrer::result_type
 TypeInferrer::operator()(const Tree::HostOpExpr& e)
 {
-  auto f = m_system.lookupBaseFunction(e.name);
+  std::vector<type_index> type;
 
-  if (f == nullptr)
-  {
-    auto t = fresh();
-    return std::make_tuple(TypeContext(), t, ConstraintGraph());
-  }
-  else
   {
-    auto t = make_host_op_type(f->type(), m_freshVars);
-    return t;
+    auto lock = lock_system();
+    auto f = m_system.lookupBaseFunction(e.name);
+
+    if (f == nullptr)
+    {
+      lock.unlock();
+      auto t = fresh();
+      return std::make_tuple(TypeContext(), t, ConstraintGraph());
+    }
+
+    type = f->type();
   }
+
+  auto t = make_host_op_type(type, m_freshVars);
+  return t;
 }
 
 TypeInferrer::result_type
@@ -654,7 +982,7 @@ TypeInferrer::operator()(const Tree::IfExpr& e)
   C.make_union(std::get<2>(then_type));
 
   //make a boolean less than type var
-  C.add_to_closure(Constraint{beta, makeAtomic(m_system, U"bool")});
+  C.add_to_closure(Constraint{beta, m_bool});
 
   //the condition is less than bool
   C.add_to_closure(Constraint{std::get<1>(cond_type), beta});
@@ -869,7 +1197,10 @@ TypeInferrer::operator()(const Tree::TupleExpr& e)
     if (C.predecessor(dimType).size() == 0 && C.successor(dimType).size() == 0
         && variant_is_type<Constant>(lower))
     {
+      auto lock = lock_system();
       auto d = m_system.getDimensionIndex(get<Constant>(lower));
+      lock.unlock();
+
       result.types[d] = std::get<1>(t_2);
     }
   }
@@ -1189,7 +1520,7 @@ TypeInferrer::operator()(const Tree::ConditionalBestfitExpr& e)
       C.make_union(std::get<2>(t_1));
 
       C.add_to_closure(Constraint{std::get<1>(t_1), 
-        makeAtomic(m_system, U"bool")
+        m_bool
       });
     }
 
@@ -37,6 +37,11 @@ along with TransLucid; see the file COPYING.  If not see
 namespace TransLucid
 {
 
+namespace detail
+{
+  std::atomic<int> constant_sharers(0);
+}
+
 namespace 
 {
 
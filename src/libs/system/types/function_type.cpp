@@ -84,6 +84,42 @@ bool function_less
 
 }
 
+ClosureCache::Bindings
+bindAbstraction
+(
+  System* system,
+  const std::vector<WS*>& binds,
+  const std::vector<dimension_index>& scope,
+  Context& k
+)
+{
+  ClosureCache::Bindings bound;
+  bound.reserve(binds.size() + scope.size() + 2);
+
+  RhoManager rho(k);
+  uint8_t index = 1;
+  for (auto ws : binds)
+  {
+    rho.changeTop(index);
+    auto c = (*ws)(k);
+    auto d = system->getDimensionIndex(c); 
+
+    bound.push_back(std::make_pair(d, k.lookup(d)));
+
+    ++index;
+  }
+
+  for (auto d : scope)
+  {
+    bound.push_back(std::make_pair(d, k.lookup(d)));
+  }
+
+  //hold on to rho
+  bound.push_back(std::make_pair(DIM_RHO, k.lookup(DIM_RHO)));
+
+  return bound;
+}
+
 Constant
 createValueFunction
 (
@@ -93,11 +129,17 @@ createValueFunction
   WS* expr,
   const std::vector<WS*>& binds,
   const std::vector<dimension_index>& scope,
-  Context& kappa
+  Context& kappa,
+  ClosureCache& closures
 )
 {
-  return Types::ValueFunction::create(
-    ValueFunctionType(system, name, argDim, expr, binds, scope, kappa)
+  auto bound = bindAbstraction(system, binds, scope, kappa);
+
+  return closures.get(bound, [&] ()
+    {
+      return Types::ValueFunction::create(
+        ValueFunctionType(system, name, argDim, expr, bound));
+    }
   );
 }
 
@@ -139,7 +181,8 @@ createValueFunctionCachedNew
   Context& kappa,
   Delta& delta,
   const Thread& w, 
-  size_t t
+  size_t t,
+  ClosureCache& closures
 )
 {
   //return Types::ValueFunction::create(
@@ -192,8 +235,24 @@ createValueFunctionCachedNew
     return std::make_pair(maxTime, Types::Demand::create(demands));
   }
 
-  return std::make_pair(maxTime, Types::ValueFunction::create(
-    ValueFunctionType(system, name, argDim, expr, binds, scope, kappa)
+  ClosureCache::Bindings bound;
+  bound.reserve(binds.size() + scope.size());
+
+  for (auto d : binds)
+  {
+    bound.push_back(std::make_pair(d, kappa.lookup(d)));
+  }
+
+  for (auto d : scope)
+  {
+    bound.push_back(std::make_pair(d, kappa.lookup(d)));
+  }
+
+  return std::make_pair(maxTime, closures.get(bound, [&] ()
+    {
+      return Types::ValueFunction::create(
+        ValueFunctionType(system, name, argDim, expr, bound));
+    }
   ));
 }
 
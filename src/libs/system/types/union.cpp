@@ -34,7 +34,8 @@ namespace
       &Types::Union::equality,
       &Types::Union::hash,
       &delete_ptr<UnionType>,
-      &Types::Union::less
+      &Types::Union::less,
+      &destruct_ptr<UnionType>
     };
 }
 
@@ -737,7 +737,7 @@ fixupTree(System& s, const Tree::Expr& e, ScopePtr scope)
 
   return 
   {
-    e4, 
+    std::move(e4), 
     {
       transform.newVars()
     }
@@ -18,6 +18,7 @@ along with TransLucid; see the file COPYING.  If not see
 <http://www.gnu.org/licenses/>.  */
 
 #include <random>
+#include <iterator>
 
 #include <tl/fixed_indexes.hpp>
 #include <tl/types/special.hpp>
@@ -36,6 +37,12 @@ namespace TransLucid
     class RandomIterator
     {
       public:
+      typedef std::input_iterator_tag iterator_category;
+      typedef unsigned int value_type;
+      typedef std::ptrdiff_t difference_type;
+      typedef unsigned int* pointer;
+      typedef unsigned int reference;
+
       RandomIterator(std::random_device* rand)
       : m_rand(rand), m_count(0)
       {}
@@ -80,7 +87,9 @@ namespace TransLucid
       {
         &Types::UUID::equality,
         &Types::UUID::hash,
-        &delete_ptr<uuid>
+        &delete_ptr<uuid>,
+        nullptr,
+        &destruct_ptr<uuid>
       };
 
     template <typename Generator>
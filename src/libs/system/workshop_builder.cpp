@@ -30,6 +30,8 @@ along with TransLucid; see the file COPYING.  If not see
 #include <tl/workshop_builder.hpp>
 #include <tl/fixed_indexes.hpp>
 #include <tl/rename.hpp>
+#include <tl/types/intmp.hpp>
+#include <tl/types/string.hpp>
 #include <tl/utility.hpp>
 
 namespace TransLucid
@@ -37,6 +39,7 @@ namespace TransLucid
 
 WorkshopBuilder::WorkshopBuilder(System* system)
 : m_system(system)
+, m_rhoUsed(false)
 {
 }
 
@@ -50,6 +53,24 @@ WorkshopBuilder::build_workshops(const Tree::Expr& e)
   return apply_visitor(*this, e);
 }
 
+bool
+WorkshopBuilder::begin_rho()
+{
+  bool outer = m_rhoUsed;
+  m_rhoUsed = false;
+
+  return outer;
+}
+
+WS*
+WorkshopBuilder::end_rho(bool outer, Workshops::RhoWS* ws)
+{
+  ws->setRho(m_rhoUsed);
+  m_rhoUsed = m_rhoUsed || outer;
+
+  return ws;
+}
+
 WS*
 WorkshopBuilder::operator()(const Tree::nil& n)
 {
@@ -126,6 +147,10 @@ WorkshopBuilder::operator()(const Tree::DimensionExpr& e)
 WS*
 WorkshopBuilder::operator()(const Tree::IdentExpr& e)
 {
+  //the identifier's definition can have a where clause, which runs on our
+  //rho
+  m_rhoUsed = true;
+
   return new Workshops::IdentWS(m_system->lookupIdentifiers(), e.text);
 }
 
@@ -153,6 +178,8 @@ WorkshopBuilder::operator()(const Tree::BinaryOpExpr& e)
 WS*
 WorkshopBuilder::operator()(const Tree::BangAppExpr& e)
 {
+  bool outer = begin_rho();
+
   WS* name = apply_visitor(*this, e.name);
   std::vector<WS*> args;
 
@@ -161,12 +188,20 @@ WorkshopBuilder::operator()(const Tree::BangAppExpr& e)
     args.push_back(apply_visitor(*this, expr));
   }
 
-  return new Workshops::BangOpWS(*m_system, name, args);
+  //only a host operator is known not to reach a where clause
+  if (get<Tree::HostOpExpr>(&e.name) == nullptr)
+  {
+    m_rhoUsed = true;
+  }
+
+  return end_rho(outer, new Workshops::BangOpWS(*m_system, name, args));
 }
 
 WS*
 WorkshopBuilder::operator()(const Tree::IfExpr& e)
 {
+  bool outer = begin_rho();
+
   WS* condition = apply_visitor(*this, e.condition);
   WS* then = apply_visitor(*this, e.then);
   WS* else_ = apply_visitor(*this, e.else_);
@@ -182,7 +217,8 @@ WorkshopBuilder::operator()(const Tree::IfExpr& e)
     ));
   }
 
-  return new Workshops::IfWS(condition, then, else_ifs, else_);
+  return end_rho(outer,
+    new Workshops::IfWS(condition, then, else_ifs, else_));
 }
 
 WS* 
@@ -198,22 +234,50 @@ WorkshopBuilder::operator()(const Tree::MakeIntenExpr& e)
   WS* rhs = apply_visitor(*this, e.expr);
   WS* result = new Workshops::MakeIntenWS(*m_system, rhs, binds, e.scope);
 
+  //the binds are evaluated in rho
+  m_rhoUsed = true;
+
   return result;
 }
 
 WS* 
 WorkshopBuilder::operator()(const Tree::EvalIntenExpr& e)
 {
+  bool outer = begin_rho();
+
   WS* rhs = apply_visitor(*this, e.expr);
-  WS* result = new Workshops::EvalIntenWS(rhs);
 
-  return result;
+  //the intension could have been made anywhere
+  m_rhoUsed = true;
+
+  return end_rho(outer, new Workshops::EvalIntenWS(rhs));
+}
+
+WS*
+WorkshopBuilder::build_dimension(const Tree::Expr& e)
+{
+  //a literal dimension always means the same thing, so look it up now
+  //rather than every time that it is evaluated
+  if (auto i = get<mpz_class>(&e))
+  {
+    return new Workshops::DimensionWS(*m_system, 
+      m_system->getDimensionIndex(Types::Intmp::create(*i)));
+  }
+  else if (auto s = get<u32string>(&e))
+  {
+    return new Workshops::DimensionWS(*m_system, 
+      m_system->getDimensionIndex(Types::String::create(*s)));
+  }
+  else
+  {
+    return apply_visitor(*this, e);
+  }
 }
 
 WS*
 WorkshopBuilder::operator()(const Tree::HashExpr& e)
 {
-  WS* expr = apply_visitor(*this, e.e);
+  WS* expr = build_dimension(e.e);
   return new Workshops::HashWS(*m_system, expr, e.cached);
 }
 
@@ -234,19 +298,23 @@ WorkshopBuilder::operator()(const Tree::RegionExpr& e)
 WS*
 WorkshopBuilder::operator()(const Tree::TupleExpr& e)
 {
+  bool outer = begin_rho();
+
   std::list<std::pair<WS*, WS*>> elements;
   for(auto& v : e.pairs)
   {
-    WS* lhs = apply_visitor(*this, v.first);
+    WS* lhs = build_dimension(v.first);
     WS* rhs = apply_visitor(*this, v.second);
     elements.push_back(std::make_pair(lhs, rhs));
   }
-  return new Workshops::TupleWS(*m_system, elements);
+  return end_rho(outer, new Workshops::TupleWS(*m_system, elements));
 }
 
 WS*
 WorkshopBuilder::operator()(const Tree::AtExpr& e)
 {
+  bool outer = begin_rho();
+
   WS* lhs = apply_visitor(*this, e.lhs);
   WS* rhs = apply_visitor(*this, e.rhs);
 
@@ -254,16 +322,16 @@ WorkshopBuilder::operator()(const Tree::AtExpr& e)
   Workshops::TupleWS* tuplerhs = dynamic_cast<Workshops::TupleWS*>(rhs);
   if (tuplerhs != nullptr)
   {
-    WS* result = new 
+    auto result = new 
       Workshops::AtTupleWS(lhs, tuplerhs->getElements(), *m_system);
     tuplerhs->releaseElements();
     delete tuplerhs;
 
-    return result;
+    return end_rho(outer, result);
   }
   else
   {
-    return new Workshops::AtWS(lhs, rhs);
+    return end_rho(outer, new Workshops::AtWS(lhs, rhs));
   }
 }
 
@@ -279,6 +347,9 @@ WorkshopBuilder::operator()(const Tree::BaseAbstractionExpr& e)
 
   WS* body = apply_visitor(*this, e.body);
 
+  //the binds are evaluated in rho
+  m_rhoUsed = true;
+
   return new Workshops::BaseAbstractionWS(m_system, e.dims, 
     e.scope, binds, body);
 }
@@ -295,6 +366,9 @@ WorkshopBuilder::operator()(const Tree::LambdaExpr& e)
     binds.push_back(apply_visitor(*this, b));
   }
 
+  //the binds are evaluated in rho
+  m_rhoUsed = true;
+
   return new Workshops::LambdaAbstractionWS
   (
     m_system,
@@ -315,10 +389,16 @@ WorkshopBuilder::operator()(const Tree::PhiExpr& e)
 WS* 
 WorkshopBuilder::operator()(const Tree::LambdaAppExpr& e)
 {
+  bool outer = begin_rho();
+
   //create a LambdaApplicationWS with the compiled sub expression
   WS* lhs = apply_visitor(*this, e.lhs);
   WS* rhs = apply_visitor(*this, e.rhs);
-  return new Workshops::LambdaApplicationWS(lhs, rhs);
+
+  //the function body runs on our rho
+  m_rhoUsed = true;
+
+  return end_rho(outer, new Workshops::LambdaApplicationWS(lhs, rhs));
 }
 
 WS* 
@@ -341,6 +421,9 @@ WorkshopBuilder::operator()(const Tree::WhereExpr& e)
 
   auto expr = apply_visitor(*this, e.e);
 
+  //the dimensions of a where clause come from rho
+  m_rhoUsed = true;
+
   return new Workshops::WhereWS(e.tagQ, e.psiQ, expr, dims, *m_system);
 }
 
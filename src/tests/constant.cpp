@@ -17,11 +17,16 @@ You should have received a copy of the GNU General Public License
 along with TransLucid; see the file COPYING.  If not see
 <http://www.gnu.org/licenses/>.  */
 
+#include <tl/constant_pool.hpp>
 #include <tl/range.hpp>
 #include <tl/types.hpp>
 #include <tl/fixed_indexes.hpp>
+#include <tl/types/intmp.hpp>
+#include <tl/types/string.hpp>
 
 #include <limits>
+#include <thread>
+#include <vector>
 #include <gmpxx.h>
 
 #define CATCH_CONFIG_MAIN
@@ -166,3 +171,111 @@ TEST_CASE ( "range", "range tests" )
   REQUIRE(r3.upper() != nullptr);
   CHECK(*r3.upper() == 15);
 }
+
+TEST_CASE ( "constant pool", "boxed constants come from the pool" )
+{
+  auto before = TL::ConstantPool::statistics();
+
+  {
+    std::vector<TL::Constant> values;
+    for (int i = 0; i != 1000; ++i)
+    {
+      values.push_back(TL::Types::Intmp::create(i));
+      values.push_back(TL::Types::String::create(U"constant"));
+    }
+
+    CHECK(TL::Types::Intmp::get(values[20]) == 10);
+    CHECK(TL::Types::String::get(values[21]) == U"constant");
+
+    auto during = TL::ConstantPool::statistics();
+    CHECK(during.allocations == before.allocations + 2000);
+    CHECK(during.deallocations == before.deallocations);
+  }
+
+  auto after = TL::ConstantPool::statistics();
+  CHECK(after.deallocations == before.deallocations + 2000);
+
+  //the blocks are reused
+  {
+    TL::Constant c = TL::Types::Intmp::create(42);
+    CHECK(TL::ConstantPool::statistics().reserved == after.reserved);
+  }
+}
+
+TEST_CASE ( "constant pool threads",
+  "constants can be freed by a different thread" )
+{
+  auto before = TL::ConstantPool::statistics();
+
+  std::vector<TL::Constant> values;
+  std::thread t([&values] ()
+    {
+      for (int i = 0; i != 100; ++i)
+      {
+        values.push_back(TL::Types::Intmp::create(i));
+      }
+    }
+  );
+  t.join();
+
+  CHECK(TL::Types::Intmp::get(values.back()) == 99);
+  values.clear();
+
+  auto after = TL::ConstantPool::statistics();
+  CHECK(after.allocations == before.allocations + 100);
+  CHECK(after.deallocations == before.deallocations + 100);
+}
+
+TEST_CASE ( "shared constants",
+  "constants can be copied and destroyed by many threads at once" )
+{
+  auto before = TL::ConstantPool::statistics();
+
+  {
+    std::vector<TL::Constant> values;
+    for (int i = 0; i != 64; ++i)
+    {
+      values.push_back(TL::Types::Intmp::create(i));
+      values.push_back(TL::Types::String::create(U"shared"));
+    }
+
+    TL::SharedConstants shared;
+
+    auto work = [&values] ()
+    {
+      std::vector<TL::Constant> copies;
+      for (int round = 0; round != 200; ++round)
+      {
+        copies = values;
+
+        for (size_t i = 0; i != copies.size(); ++i)
+        {
+          TL::Constant c = copies[i];
+          copies[i] = values[(i + round) % values.size()];
+        }
+
+        copies.clear();
+      }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i != 8; ++i)
+    {
+      threads.push_back(std::thread(work));
+    }
+
+    for (auto& t : threads)
+    {
+      t.join();
+    }
+
+    CHECK(TL::Types::Intmp::get(values[20]) == 10);
+    CHECK(TL::Types::String::get(values[21]) == U"shared");
+    CHECK(values[20].data.ptr->refCount == 1);
+  }
+
+  auto after = TL::ConstantPool::statistics();
+  size_t allocated = after.allocations - before.allocations;
+  size_t freed = after.deallocations - before.deallocations;
+  CHECK(allocated == freed);
+}
@@ -22,16 +22,42 @@ along with TransLucid; see the file COPYING.  If not see
  * System tests.
  */
 
+#include <algorithm>
+#include <fstream>
+
 #include <gmpxx.h>
 
+#include <unistd.h>
+
+#include <tl/assignment.hpp>
+#include <tl/cache.hpp>
+#include <tl/cacheio.hpp>
+#include <tl/closure_cache.hpp>
+#include <tl/ast.hpp>
+#include <tl/constws.hpp>
 #include <tl/context.hpp>
+#include <tl/demand_trace.hpp>
+#include <tl/fixed_indexes.hpp>
 #include <tl/free_variables.hpp>
+#include <tl/hyperdatons/arrayhd.hpp>
+#include <tl/hyperdatons/sharedhd.hpp>
+#include <tl/hyperdatons/sparsehd.hpp>
 #include <tl/line_tokenizer.hpp>
 #include <tl/output.hpp>
 #include <tl/parser_iterator.hpp>
+#include <tl/rho_path.hpp>
 #include <tl/types.hpp>
+#include <tl/types/boolean.hpp>
+#include <tl/types/demand.hpp>
+#include <tl/types/function.hpp>
 #include <tl/types/intmp.hpp>
+#include <tl/types/range.hpp>
+#include <tl/types/special.hpp>
+#include <tl/types/string.hpp>
+#include <tl/types/uuid.hpp>
 #include <tl/system.hpp>
+#include <tl/system_fork.hpp>
+#include <tl/tyinf/type_inference.hpp>
 
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
@@ -406,3 +432,1410 @@ TEST_CASE( "free variables", "find free variables in expressions" )
 
   CHECK(iter == vars.end());
 }
+
+namespace
+{
+  //assign out [0 : 0..3, 1 : 0..2] := #.0 + #.1 * 2
+  void
+  addPointwiseAssignment(TL::System& s, TL::ArrayHD& out)
+  {
+    namespace Tree = TL::Tree;
+
+    TL::dimension_index d0 = 
+      s.getDimensionIndex(TL::Types::Intmp::create(0));
+    TL::dimension_index d1 = 
+      s.getDimensionIndex(TL::Types::Intmp::create(1));
+
+    out.initialise({{d0, 4}, {d1, 3}});
+    s.addOutputHyperdaton(U"out", &out);
+
+    mpz_class zero = 0, three = 3, two = 2;
+
+    s.addDeclaration(TL::Parser::RawInput{U"test", 1, 1,
+      U"fun plus!a!b = intmp_plus.(a,b);;"});
+
+    s.addAssignment(TL::Parser::Equation
+    (
+      U"out",
+      Tree::RegionExpr(
+      {
+        Tree::RegionExpr::Entry
+        {
+          mpz_class(0), TL::Region::Containment::IN,
+          TL::Types::Range::create(TL::Range(&zero, &three))
+        },
+        Tree::RegionExpr::Entry
+        {
+          mpz_class(1), TL::Region::Containment::IN,
+          TL::Types::Range::create(TL::Range(&zero, &two))
+        }
+      }),
+      Tree::Expr(),
+      Tree::LambdaAppExpr(
+        Tree::LambdaAppExpr(Tree::IdentExpr(U"plus"), 
+          Tree::HashExpr(mpz_class(0))),
+        Tree::LambdaAppExpr(
+          Tree::LambdaAppExpr(Tree::IdentExpr(U"times"), 
+            Tree::HashExpr(mpz_class(1))),
+          mpz_class(2)
+        )
+      )
+    ));
+  }
+
+  const TL::BulkKernel&
+  bodyKernel(TL::System& s)
+  {
+    auto& defs = s.getAssignments().at(U"out")->definitions();
+    REQUIRE(defs.size() == 1);
+    REQUIRE(defs.front().bodyKernel);
+    return *defs.front().bodyKernel;
+  }
+}
+
+TEST_CASE( "bulk kernel", "pointwise arithmetic into an array" )
+{
+  TL::System s;
+  TL::ArrayHD out;
+
+  s.addDeclaration(TL::Parser::RawInput{U"test", 1, 1,
+    U"fun times!a!b = intmp_times.(a,b);;"});
+  addPointwiseAssignment(s, out);
+
+  s.go();
+
+  CHECK(bodyKernel(s).cells() == 12);
+
+  const TL::Constant* cell = out.begin();
+  for (int i = 0; i != 4; ++i)
+  {
+    for (int j = 0; j != 3; ++j)
+    {
+      REQUIRE(cell->index() == TL::TYPE_INDEX_INTMP);
+      CHECK(TL::Types::Intmp::get(*cell) == i + j * 2);
+      ++cell;
+    }
+  }
+}
+
+TEST_CASE( "bulk kernel fallback", 
+  "a redefined operator is not computed in bulk" )
+{
+  TL::System s;
+  TL::ArrayHD out;
+
+  s.addDeclaration(TL::Parser::RawInput{U"test", 1, 1,
+    U"fun times!a!b = intmp_plus.(a,b);;"});
+  addPointwiseAssignment(s, out);
+
+  s.go();
+
+  CHECK(bodyKernel(s).cells() == 0);
+
+  const TL::Constant* cell = out.begin();
+  for (int i = 0; i != 4; ++i)
+  {
+    for (int j = 0; j != 3; ++j)
+    {
+      REQUIRE(cell->index() == TL::TYPE_INDEX_INTMP);
+      CHECK(TL::Types::Intmp::get(*cell) == i + j + 2);
+      ++cell;
+    }
+  }
+}
+
+TEST_CASE( "bulk kernel reworded operator",
+  "the operator's definition is resolved, not compared as text" )
+{
+  TL::System s;
+  TL::ArrayHD out;
+
+  s.addDeclaration(TL::Parser::RawInput{U"test", 1, 1,
+    U"fun times!x!y [y imp intmp, x imp intmp] = (intmp_times.(x, y));;"});
+  addPointwiseAssignment(s, out);
+
+  s.go();
+
+  CHECK(bodyKernel(s).cells() == 12);
+}
+
+TEST_CASE( "bulk kernel context",
+  "the kernel doesn't run when the context fixes a dimension of the region" )
+{
+  TL::System s;
+  TL::ArrayHD out;
+
+  s.addDeclaration(TL::Parser::RawInput{U"test", 1, 1,
+    U"fun times!a!b = intmp_times.(a,b);;"});
+  addPointwiseAssignment(s, out);
+
+  TL::dimension_index d0 = s.getDimensionIndex(TL::Types::Intmp::create(0));
+  TL::dimension_index d1 = s.getDimensionIndex(TL::Types::Intmp::create(1));
+
+  mpz_class zero = 0, three = 3, two = 2;
+  TL::Region region
+  {
+    {
+      {d0, {TL::Region::Containment::IN,
+        TL::Types::Range::create(TL::Range(&zero, &three))}},
+      {d1, {TL::Region::Containment::IN,
+        TL::Types::Range::create(TL::Range(&zero, &two))}}
+    }
+  };
+
+  TL::Context k;
+  k.perturb(TL::DIM_TIME, TL::Types::Intmp::create(0));
+  CHECK(bodyKernel(s).evaluate(region, k, out));
+
+  k.perturb(d1, TL::Types::Intmp::create(1));
+  CHECK(!bodyKernel(s).evaluate(region, k, out));
+}
+
+TEST_CASE( "bulk kernel interior redefinition", 
+  "a definition that only applies inside the region is not bypassed" )
+{
+  TL::System s;
+  TL::ArrayHD out;
+
+  s.addDeclaration(TL::Parser::RawInput{U"test", 1, 1,
+    U"fun times!a!b | intmp_ne.(a, 1) = intmp_times.(a,b);;"});
+  s.addDeclaration(TL::Parser::RawInput{U"test", 1, 1,
+    U"fun times!a!b | intmp_eq.(a, 1) = 100;;"});
+  addPointwiseAssignment(s, out);
+
+  s.go();
+
+  CHECK(bodyKernel(s).cells() == 0);
+
+  const TL::Constant* cell = out.begin();
+  for (int i = 0; i != 4; ++i)
+  {
+    for (int j = 0; j != 3; ++j)
+    {
+      REQUIRE(cell->index() == TL::TYPE_INDEX_INTMP);
+      CHECK(TL::Types::Intmp::get(*cell) == i + (j == 1 ? 100 : j * 2));
+      ++cell;
+    }
+  }
+}
+
+TEST_CASE( "incremental instants", 
+  "an assignment is only computed again when what it uses changes" )
+{
+  TL::System s;
+  TL::ArrayHD out;
+
+  s.addDeclaration(TL::Parser::RawInput{U"test", 1, 1,
+    U"fun times!a!b = intmp_times.(a,b);;"});
+  addPointwiseAssignment(s, out);
+
+  const auto& assign = *s.getAssignments().at(U"out");
+
+  s.go();
+  CHECK(assign.evaluated() == 1);
+
+  //nothing that out uses
+  s.addDeclaration(TL::Parser::RawInput{U"test", 2, 1, U"var y = 1;;"});
+  s.go();
+  CHECK(assign.evaluated() == 0);
+
+  //times is used by out
+  s.addDeclaration(TL::Parser::RawInput{U"test", 3, 1,
+    U"fun times!a!b = intmp_plus.(a,b);;"});
+  s.go();
+  CHECK(assign.evaluated() == 1);
+
+  const TL::Constant* cell = out.begin();
+  for (int i = 0; i != 4; ++i)
+  {
+    for (int j = 0; j != 3; ++j)
+    {
+      REQUIRE(cell->index() == TL::TYPE_INDEX_INTMP);
+      CHECK(TL::Types::Intmp::get(*cell) == i + j + 2);
+      ++cell;
+    }
+  }
+
+  //a later definition still wins where it overlaps one that is computed
+  //again
+  namespace Tree = TL::Tree;
+
+  TL::System s2;
+  TL::ArrayHD out2;
+
+  out2.initialise({{s2.getDimensionIndex(TL::Types::Intmp::create(0)), 4}});
+  s2.addOutputHyperdaton(U"out", &out2);
+
+  s2.addDeclaration(TL::Parser::RawInput{U"test", 1, 1, U"var f = 1;;"});
+
+  //out [0 : 0..upper] := body
+  auto addDefinition = [&s2] (mpz_class upper, Tree::Expr body)
+  {
+    mpz_class zero = 0;
+    s2.addAssignment(TL::Parser::Equation
+    (
+      U"out",
+      Tree::RegionExpr(
+      {
+        Tree::RegionExpr::Entry
+        {
+          mpz_class(0), TL::Region::Containment::IN,
+          TL::Types::Range::create(TL::Range(&zero, &upper))
+        }
+      }),
+      Tree::Expr(),
+      body
+    ));
+  };
+
+  addDefinition(3, Tree::IdentExpr(U"f"));
+  addDefinition(1, mpz_class(100));
+
+  auto check = [&out2] (std::initializer_list<int> expected)
+  {
+    const TL::Constant* c = out2.begin();
+    for (int e : expected)
+    {
+      REQUIRE(c->index() == TL::TYPE_INDEX_INTMP);
+      CHECK(TL::Types::Intmp::get(*c) == e);
+      ++c;
+    }
+  };
+
+  s2.go();
+  check({100, 100, 1, 1});
+
+  s2.addDeclaration(TL::Parser::RawInput{U"test", 2, 1, U"var f = 2;;"});
+  s2.go();
+  CHECK(s2.getAssignments().at(U"out")->evaluated() == 2);
+  check({100, 100, 2, 2});
+}
+
+namespace
+{
+  //evaluate x at time with the dimension 0 set to zero
+  TL::Constant
+  variableAt(TL::System& s, int time, int zero)
+  {
+    TL::Context k;
+    k.perturb(TL::DIM_TIME, TL::Types::Intmp::create(time));
+    k.perturb(s.getDimensionIndex(TL::Types::Intmp::create(0)),
+      TL::Types::Intmp::create(zero));
+
+    return (*s.lookupIdentifiers().lookup(U"x"))(k);
+  }
+}
+
+TEST_CASE( "definition history",
+  "find the definitions valid at a time, and forget old ones" )
+{
+  TL::System s;
+
+  s.addDeclaration(TL::Parser::RawInput{U"test", 1, 1, U"var x = 1;;"});
+  s.go();
+  s.addDeclaration(TL::Parser::RawInput{U"test", 2, 1,
+    U"var x [0 : 5] = 2;;"});
+  s.go();
+  s.go();
+  s.addDeclaration(TL::Parser::RawInput{U"test", 3, 1,
+    U"var x [0 : 6] = 3;;"});
+  s.go();
+
+  CHECK(variableAt(s, 0, 5) == TL::Types::Intmp::create(1));
+  CHECK(variableAt(s, 1, 5) == TL::Types::Intmp::create(2));
+  CHECK(variableAt(s, 2, 6) == TL::Types::Intmp::create(1));
+  CHECK(variableAt(s, 3, 6) == TL::Types::Intmp::create(3));
+  CHECK(variableAt(s, 3, 5) == TL::Types::Intmp::create(2));
+
+  s.discardHistory(3);
+
+  CHECK(variableAt(s, 2, 5) == TL::Types::Special::create(TL::SP_UNDEF));
+  CHECK(variableAt(s, 3, 6) == TL::Types::Intmp::create(3));
+  CHECK(variableAt(s, 4, 5) == TL::Types::Intmp::create(2));
+}
+
+TEST_CASE( "kept history",
+  "definitions that ended before the kept instants are forgotten" )
+{
+  TL::System s;
+  s.keepHistory(1);
+
+  TL::Constant first =
+    s.addDeclaration(TL::Parser::RawInput{U"test", 1, 1, U"var x = 1;;"});
+  s.go();
+
+  CHECK(s.addDeclaration(TL::Parser::RawInput{U"test", 2, 1, U"del uuid\"" +
+    TL::Types::String::get(TL::Types::UUID::print(first)) + U"\";;"})
+    == TL::Types::Boolean::create(true));
+  s.addDeclaration(TL::Parser::RawInput{U"test", 3, 1, U"var x = 2;;"});
+  s.go();
+  s.go();
+
+  //the first definition is gone, and the second one was moved down
+  CHECK(variableAt(s, 0, 0) == TL::Types::Special::create(TL::SP_UNDEF));
+  CHECK(variableAt(s, 3, 0) == TL::Types::Intmp::create(2));
+
+  s.addDeclaration(TL::Parser::RawInput{U"test", 4, 1,
+    U"var x [0 : 5] = 3;;"});
+  s.go();
+
+  CHECK(variableAt(s, 4, 0) == TL::Types::Intmp::create(2));
+  CHECK(variableAt(s, 4, 5) == TL::Types::Intmp::create(3));
+}
+
+TEST_CASE( "guard evaluation", "constant and evaluated guards" )
+{
+  TL::System s;
+
+  s.addDeclaration(TL::Parser::RawInput{U"test", 1, 1, U"var x = 1;;"});
+  s.addDeclaration(TL::Parser::RawInput{U"test", 2, 1,
+    U"var x [0 : 5] = 2;;"});
+  s.addDeclaration(TL::Parser::RawInput{U"test", 3, 1,
+    U"var x [0 : #.1] = 3;;"});
+  s.addDeclaration(TL::Parser::RawInput{U"test", 4, 1,
+    U"var x [0 : 6, 1 : 6] = 4;;"});
+  s.go();
+
+  auto x = [&s] (int zero, int one) -> TL::Constant
+  {
+    TL::Context k;
+    k.perturb(TL::DIM_TIME, TL::Types::Intmp::create(0));
+    k.perturb(s.getDimensionIndex(TL::Types::Intmp::create(0)),
+      TL::Types::Intmp::create(zero));
+    k.perturb(s.getDimensionIndex(TL::Types::Intmp::create(1)),
+      TL::Types::Intmp::create(one));
+
+    return (*s.lookupIdentifiers().lookup(U"x"))(k);
+  };
+
+  CHECK(x(0, 1) == TL::Types::Intmp::create(1));
+  CHECK(x(5, 1) == TL::Types::Intmp::create(2));
+  CHECK(x(3, 3) == TL::Types::Intmp::create(3));
+  CHECK(x(6, 6) == TL::Types::Intmp::create(4));
+  CHECK(x(5, 6) == TL::Types::Intmp::create(2));
+
+  //[0 : 5] and [0 : #.1] are the same region here
+  CHECK(x(5, 5) == TL::Types::Special::create(TL::SP_MULTIDEF));
+}
+
+TEST_CASE( "closure reuse", "abstractions with the same bindings are reused" )
+{
+  TL::System s;
+
+  s.addDeclaration(TL::Parser::RawInput{U"test", 1, 1,
+    U"var f = \\x -> x;;"});
+  s.addDeclaration(TL::Parser::RawInput{U"test", 2, 1,
+    U"var g = \\\\x -> x;;"});
+  s.addDeclaration(TL::Parser::RawInput{U"test", 3, 1,
+    U"var x = f!(#.0) ;;"});
+  s.addDeclaration(TL::Parser::RawInput{U"test", 4, 1,
+    U"var y = g (#.0) ;;"});
+  s.go();
+
+  auto before = TL::ClosureCache::statistics();
+
+  for (int i = 0; i != 3; ++i)
+  {
+    TL::Context k;
+    k.perturb(TL::DIM_TIME, TL::Types::Intmp::create(0));
+    k.perturb(s.getDimensionIndex(TL::Types::Intmp::create(0)),
+      TL::Types::Intmp::create(i));
+
+    CHECK((*s.lookupIdentifiers().lookup(U"x"))(k) == 
+      TL::Types::Intmp::create(i));
+    CHECK((*s.lookupIdentifiers().lookup(U"y"))(k) == 
+      TL::Types::Intmp::create(i));
+  }
+
+  auto after = TL::ClosureCache::statistics();
+
+  //each abstraction is only made the first time
+  CHECK(after.created == before.created + 2);
+  CHECK(after.reused == before.reused + 4);
+}
+
+TEST_CASE( "dimension lookup", "literal, small and computed dimensions" )
+{
+  TL::System s;
+
+  //small integers are looked up directly, but they are still the same
+  //dimensions
+  CHECK(s.getDimensionIndex(TL::Types::Intmp::create(0)) == TL::DIM_ZERO);
+  CHECK(s.getDimensionIndex(TL::Types::Intmp::create(5)) ==
+    s.getDimensionIndex(TL::Types::Intmp::create(5)));
+  CHECK(s.getDimensionIndex(TL::Types::Intmp::create(5)) !=
+    s.getDimensionIndex(TL::Types::Intmp::create(300)));
+  CHECK(s.getDimensionIndex(TL::Types::Intmp::create(-5)) ==
+    s.getDimensionIndex(TL::Types::Intmp::create(-5)));
+
+  s.addDeclaration(TL::Parser::RawInput{U"test", 1, 1, U"var d = 5;;"});
+  s.addDeclaration(TL::Parser::RawInput{U"test", 2, 1, U"var x = #.5;;"});
+  s.addDeclaration(TL::Parser::RawInput{U"test", 3, 1, U"var y = #.d;;"});
+  s.addDeclaration(TL::Parser::RawInput{U"test", 4, 1, 
+    U"var z = (x @ [5 <- 2]) @ [d <- 3];;"});
+  s.go();
+
+  TL::Context k;
+  k.perturb(TL::DIM_TIME, TL::Types::Intmp::create(0));
+  k.perturb(s.getDimensionIndex(TL::Types::Intmp::create(5)),
+    TL::Types::Intmp::create(4));
+
+  for (int i = 0; i != 2; ++i)
+  {
+    CHECK((*s.lookupIdentifiers().lookup(U"x"))(k) == 
+      TL::Types::Intmp::create(4));
+    CHECK((*s.lookupIdentifiers().lookup(U"y"))(k) == 
+      TL::Types::Intmp::create(4));
+    CHECK((*s.lookupIdentifiers().lookup(U"z"))(k) == 
+      TL::Types::Intmp::create(2));
+  }
+}
+
+TEST_CASE( "eager compilation", "definitions are compiled before a demand" )
+{
+  TL::System s;
+  s.enableEagerCompile();
+
+  s.addDeclaration(TL::Parser::RawInput{U"test", 1, 1, U"var x = 1;;"});
+  s.addDeclaration(TL::Parser::RawInput{U"test", 2, 1, U"var y = x;;"});
+  s.go();
+
+  //everything was compiled by go
+  CHECK(s.compileAll() == 0);
+
+  s.addDeclaration(TL::Parser::RawInput{U"test", 3, 1, U"var w = y;;"});
+  s.addDeclaration(TL::Parser::RawInput{U"test", 4, 1, U"var z = (;;"});
+
+  //only w is new, and z can't be parsed
+  CHECK(s.compileAll() == 1);
+
+  TL::Context k;
+  k.perturb(TL::DIM_TIME, TL::Types::Intmp::create(1));
+
+  CHECK((*s.lookupIdentifiers().lookup(U"w"))(k) == 
+    TL::Types::Intmp::create(1));
+
+  //the error is still reported when z is demanded
+  CHECK_THROWS((*s.lookupIdentifiers().lookup(U"z"))(k));
+}
+
+TEST_CASE( "parallel type inference", 
+  "independent recursion groups are inferred by several threads" )
+{
+  TL::System s;
+
+  const TL::u32string decls[] = 
+  {
+    U"var a = 1;;", U"var b = true;;", U"var c = a;;", U"var d = b;;",
+    U"var e = f;;", U"var f = e;;", U"var g = \\x -> x;;"
+  };
+
+  for (const auto& decl : decls)
+  {
+    s.addDeclaration(TL::Parser::RawInput{U"test", 1, 1, decl});
+  }
+  s.go();
+
+  std::set<TL::u32string> ids{U"c", U"d", U"e", U"g"};
+
+  auto display = [&s, &ids] (size_t threads)
+    {
+      namespace TI = TL::TypeInference;
+
+      TI::FreshTypeVars fresh;
+      TI::TypeInferrer infer(s, fresh);
+      infer.setThreads(threads);
+
+      infer.infer_system(ids);
+
+      std::map<TL::u32string, 
+        std::tuple<TL::u32string, TL::u32string, TL::u32string>> types;
+      for (const auto& xs : infer.environment())
+      {
+        types[xs.first] = 
+          TI::display_type_scheme(TI::display_type(xs.second), s);
+      }
+
+      //the schemes themselves, with their variables, are the same too
+      std::map<TL::u32string, TL::u32string> schemes;
+      for (const auto& xs : infer.environment())
+      {
+        schemes[xs.first] = TI::print_type(std::get<1>(xs.second), s) + 
+          U" " + std::get<0>(xs.second).print_context(s) + 
+          U" " + std::get<2>(xs.second).print(s);
+      }
+
+      return std::make_pair(types, schemes);
+    };
+
+  auto sequential = display(1);
+
+  //everything that they use is inferred too
+  CHECK(sequential.first.size() == 7);
+  CHECK(sequential.first[U"c"] == sequential.first[U"a"]);
+
+  for (int i = 0; i != 5; ++i)
+  {
+    CHECK(display(4) == sequential);
+  }
+}
+
+TEST_CASE( "constraint graph copies", 
+  "copies of a constraint graph share it until one of them changes" )
+{
+  namespace TI = TL::TypeInference;
+
+  TI::ConstraintGraph C;
+  C.add_to_closure(TI::Constraint{1, 2});
+
+  TI::ConstraintGraph D = C;
+  D.add_to_closure(TI::Constraint{2, 3});
+
+  CHECK(C.less(1, 2));
+  CHECK(!C.less(1, 3));
+  CHECK(C.domain() == std::vector<TI::TypeVariable>({1, 2}));
+
+  CHECK(D.less(1, 3));
+  CHECK(D.successor(1) == std::vector<TI::TypeVariable>({2, 3}));
+  CHECK(D.domain() == std::vector<TI::TypeVariable>({1, 2, 3}));
+
+  //an empty graph takes the other one as it is
+  TI::ConstraintGraph E;
+  E.make_union(D);
+  E.erase_var(3);
+  CHECK(E.domain() == std::vector<TI::TypeVariable>({1, 2}));
+  CHECK(D.domain() == std::vector<TI::TypeVariable>({1, 2, 3}));
+  CHECK(E.predecessor(3).empty());
+}
+
+TEST_CASE( "incremental type inference", 
+  "only the identifiers that changed and what uses them are inferred again" )
+{
+  namespace TI = TL::TypeInference;
+
+  TL::System s;
+
+  const TL::u32string decls[] = 
+  {
+    U"var a = 1;;", U"var b = a;;", U"var c = true;;", U"var d = c;;"
+  };
+
+  for (const auto& decl : decls)
+  {
+    s.addDeclaration(TL::Parser::RawInput{U"test", 1, 1, decl});
+  }
+  s.go();
+
+  TI::FreshTypeVars fresh;
+  TI::TypeInferrer infer(s, fresh);
+
+  infer.infer_system({U"b", U"d"});
+  CHECK(infer.environment().size() == 4);
+
+  //nothing has changed
+  infer.invalidate_changed();
+  CHECK(infer.environment().size() == 4);
+
+  s.addDeclaration(TL::Parser::RawInput{U"test", 1, 1, U"var a = 2;;"});
+
+  infer.invalidate_changed();
+  CHECK(infer.environment().count(U"a") == 0);
+  CHECK(infer.environment().count(U"b") == 0);
+  CHECK(infer.environment().count(U"c") == 1);
+  CHECK(infer.environment().count(U"d") == 1);
+
+  infer.infer_system({U"b", U"d"});
+  CHECK(infer.environment().size() == 4);
+}
+
+TEST_CASE( "system fork", "what-if instants don't change the system" )
+{
+  TL::System s;
+
+  s.addDeclaration(TL::Parser::RawInput{U"test", 1, 1, U"var x = 1;;"});
+  s.go();
+
+  auto whatIf = [] (TL::System& copy) -> TL::u32string
+    {
+      copy.addDeclaration(TL::Parser::RawInput{U"test", 2, 1,
+        U"var x [0 : 5] = 2;;"});
+      copy.go();
+
+      auto x = variableAt(copy, 1, 5);
+      return x == TL::Types::Intmp::create(2) ? U"2" : U"wrong";
+    };
+
+  //each copy starts from the system as it is
+  CHECK(TL::forkEvaluate(s, whatIf) == U"2");
+  CHECK(TL::forkEvaluate(s, whatIf) == U"2");
+
+  CHECK(variableAt(s, 1, 5) == TL::Types::Intmp::create(1));
+
+  CHECK_THROWS_AS(TL::forkEvaluate(s, [] (TL::System&) -> TL::u32string
+    {
+      throw TL::InternalError(U"what-if failed");
+    }), const TL::SystemForkError&);
+}
+
+TEST_CASE( "static dimensionality",
+  "the dimensions that a variable looks at are found before evaluating it" )
+{
+  TL::System s(true);
+
+  s.addDeclaration(TL::Parser::RawInput{U"test", 1, 1, U"var y = #.1;;"});
+  s.addDeclaration(TL::Parser::RawInput{U"test", 2, 1, U"var z = #.2;;"});
+  s.addDeclaration(TL::Parser::RawInput{U"test", 3, 1,
+    U"var x [0 : 5] = y;;"});
+  s.addDeclaration(TL::Parser::RawInput{U"test", 4, 1,
+    U"var w = z @ [2 <- 3];;"});
+  s.go();
+
+  auto dim = [&s] (int d) -> TL::dimension_index
+  {
+    return s.getDimensionIndex(TL::Types::Intmp::create(d));
+  };
+
+  typedef std::vector<TL::dimension_index> Dims;
+
+  CHECK(s.getIdentifierDimensions(U"y") == Dims{dim(1)});
+
+  //x looks at 1 through y
+  auto x = s.getIdentifierDimensions(U"x");
+  CHECK(std::count(x.begin(), x.end(), dim(0)) == 1);
+  CHECK(std::count(x.begin(), x.end(), dim(1)) == 1);
+  CHECK(std::count(x.begin(), x.end(), dim(2)) == 0);
+
+  //the at sets 2 for z
+  CHECK(s.getIdentifierDimensions(U"w").empty());
+
+  TL::Context k;
+  k.perturb(TL::DIM_TIME, TL::Types::Intmp::create(0));
+  k.perturb(dim(0), TL::Types::Intmp::create(5));
+
+  for (int i = 0; i != 3; ++i)
+  {
+    k.perturb(dim(1), TL::Types::Intmp::create(i));
+
+    CHECK((*s.lookupIdentifiers().lookup(U"x"))(k) ==
+      TL::Types::Intmp::create(i));
+    CHECK((*s.lookupIdentifiers().lookup(U"w"))(k) ==
+      TL::Types::Intmp::create(3));
+  }
+
+  //a new definition of y changes what x looks at
+  s.addDeclaration(TL::Parser::RawInput{U"test", 5, 1, U"var y = #.2;;"});
+  x = s.getIdentifierDimensions(U"x");
+  CHECK(std::count(x.begin(), x.end(), dim(2)) == 1);
+}
+
+TEST_CASE( "evaluation memo",
+  "results are reused after a demand while their dimensions are the same" )
+{
+  TL::Workshops::ConstantWS ws(TL::Types::Intmp::create(7));
+  TL::EvaluationMemo memo;
+
+  TL::Context k;
+  k.perturb(1, TL::Types::Intmp::create(1));
+  k.perturb(2, TL::Types::Intmp::create(2));
+
+  TL::Delta d;
+  d.insert(1);
+
+  memo.insert(&ws, k, d, 0,
+    std::make_pair(0, TL::Types::Intmp::create(7)));
+
+  //a demand is never kept
+  memo.insert(&ws, k, d, 1,
+    std::make_pair(1, TL::Types::Demand::create({2})));
+  CHECK(memo.find(&ws, k, d, 1) == nullptr);
+
+  //the next try has more dimensions
+  d.insert(2);
+  auto found = memo.find(&ws, k, d, 0);
+  REQUIRE(found != nullptr);
+  CHECK(found->second == TL::Types::Intmp::create(7));
+
+  //but not the same time
+  CHECK(memo.find(&ws, k, d, 2) == nullptr);
+
+  //or a different value for what it used
+  k.perturb(1, TL::Types::Intmp::create(3));
+  CHECK(memo.find(&ws, k, d, 0) == nullptr);
+
+  //or without that dimension
+  k.perturb(1, TL::Types::Intmp::create(1));
+  TL::Delta other;
+  other.insert(2);
+  CHECK(memo.find(&ws, k, other, 0) == nullptr);
+
+  //the thread that a cache evaluates with finds it
+  TL::Thread w(memo);
+  size_t applied = 0;
+  auto result = TL::memoise(&ws, k, d, w, 0, [&] ()
+    {
+      ++applied;
+      return std::make_pair(size_t(0), TL::Types::Intmp::create(8));
+    });
+
+  CHECK(applied == 0);
+  CHECK(result.second == TL::Types::Intmp::create(7));
+}
+
+TEST_CASE( "memo across demands",
+  "a cached variable that finds its dimensions one at a time applies its "
+  "functions once" )
+{
+  TL::System s(true);
+
+  size_t applied = 0;
+  TL::BuiltinBaseFunction<1> counted(
+    [&applied] (const TL::Constant& c) -> TL::Constant
+    {
+      ++applied;
+      return c;
+    }, {});
+  s.addHostFunction(U"counted", &counted, 1);
+
+  //each dimension is only known once the one before it has been looked
+  //at, so every one of them is a demand and another try
+  s.addDeclaration(TL::Parser::RawInput{U"test", 1, 1, 
+    U"var x = if counted.true then #.(#.(#.(#.0))) else 0 fi;;"});
+  s.go();
+
+  auto dim = [&s] (int d) -> TL::dimension_index
+  {
+    return s.getDimensionIndex(TL::Types::Intmp::create(d));
+  };
+
+  TL::Context k;
+  k.perturb(TL::DIM_TIME, TL::Types::Intmp::create(0));
+  k.perturb(dim(0), TL::Types::Intmp::create(1));
+  k.perturb(dim(1), TL::Types::Intmp::create(2));
+  k.perturb(dim(2), TL::Types::Intmp::create(3));
+  k.perturb(dim(3), TL::Types::Intmp::create(42));
+
+  CHECK((*s.lookupIdentifiers().lookup(U"x"))(k) == 
+    TL::Types::Intmp::create(42));
+  CHECK(applied == 1);
+}
+
+TEST_CASE( "rho path", "paths keep their hash as they change and spill" )
+{
+  TL::RhoPath path;
+  std::vector<TL::RhoPath::value_type> values;
+
+  //go past what is stored inline
+  for (int i = 0; i != 40; ++i)
+  {
+    path.push(0);
+    path.setTop(i % 7);
+    values.push_back(i % 7);
+
+    TL::RhoPath built(values);
+    CHECK(built == path);
+    CHECK(built.hash() == path.hash());
+  }
+
+  TL::RhoPath copy = path;
+  CHECK(copy == path);
+
+  copy.setTop(100);
+  CHECK(copy != path);
+  CHECK(copy.top() == 100);
+
+  //back to the inline entries
+  for (int i = 0; i != 30; ++i)
+  {
+    path.pop();
+    values.pop_back();
+  }
+
+  CHECK(path.size() == 10);
+  CHECK(path == TL::RhoPath(values));
+  CHECK(path.hash() == TL::RhoPath(values).hash());
+  CHECK(path[9] == 9 % 7);
+
+  //the same entries at a different depth are a different path
+  values.pop_back();
+  CHECK(path != TL::RhoPath(values));
+}
+
+TEST_CASE( "rho through a function",
+  "a where clause in a function doesn't share dimensions with its caller" )
+{
+  TL::System s;
+
+  s.addDeclaration(TL::Parser::RawInput{U"test", 1, 1,
+    U"fun special_combine.a.b = a;;"});
+  s.addDeclaration(TL::Parser::RawInput{U"test", 1, 1,
+    U"var p = (\\y -> intmp_plus.(#.d, y)) where dim d <- 100;; end;;"});
+  s.addDeclaration(TL::Parser::RawInput{U"test", 1, 1,
+    U"var h = \\f -> (f!1) where dim e <- 7;; end;;"});
+  s.addDeclaration(TL::Parser::RawInput{U"test", 1, 1, U"var x = h!p;;"});
+  s.go();
+
+  //d is bound in p's where clause and never set, so it isn't e
+  TL::Constant x = variableAt(s, 1, 0);
+  CHECK(x.index() == TL::TYPE_INDEX_SPECIAL);
+}
+
+TEST_CASE( "parallel parsing",
+  "independent declarations are parsed together and added in order" )
+{
+  TL::System s;
+
+  std::vector<TL::Parser::RawInput> inputs
+  {
+    {U"test", 1, 1, U"fun f.y = y;;"},
+    {U"test", 2, 1, U"var a = 1;;"},
+    {U"test", 3, 1, U"var x = f.a;;"},
+    {U"test", 4, 1, U"var z = (;;"},
+  };
+
+  for (const auto& input : inputs)
+  {
+    CHECK(s.independentDeclaration(input));
+  }
+
+  CHECK(!s.independentDeclaration(
+    TL::Parser::RawInput{U"test", 5, 1, U"dim d <- 0;;"}));
+
+  auto parsed = s.parseDeclarations(inputs, 3);
+
+  REQUIRE(parsed.size() == inputs.size());
+  CHECK(parsed[0]);
+  CHECK(parsed[1]);
+  CHECK(parsed[2]);
+
+  //left for adding to report
+  CHECK(!parsed[3]);
+
+  for (size_t i = 0; i != inputs.size(); ++i)
+  {
+    CHECK(s.addDeclaration(inputs[i], parsed[i]).index() == 
+      TL::TYPE_INDEX_UUID);
+  }
+
+  //evaluating before the instant is finished doesn't stop the rest of
+  //its definitions from being seen
+  CHECK(variableAt(s, 0, 5) == TL::Types::Intmp::create(1));
+  s.addDeclaration(TL::Parser::RawInput{U"test", 6, 1,
+    U"var x [0 : 5] = 2;;"});
+  s.go();
+
+  CHECK(variableAt(s, 0, 5) == TL::Types::Intmp::create(2));
+  CHECK(variableAt(s, 0, 6) == TL::Types::Intmp::create(1));
+
+  TL::Context k;
+  k.perturb(TL::DIM_TIME, TL::Types::Intmp::create(0));
+  CHECK_THROWS((*s.lookupIdentifiers().lookup(U"z"))(k));
+}
+
+TEST_CASE( "canonical print", "the host prints the built in types" )
+{
+  TL::System s;
+
+  s.addDeclaration(TL::Parser::RawInput{U"test", 1, 1,
+    U"var a = canonical_print_base.(~42);;"});
+  s.addDeclaration(TL::Parser::RawInput{U"test", 2, 1,
+    U"var b = canonical_print_base.\"q\\\"\\n\\u0001\";;"});
+  s.addDeclaration(TL::Parser::RawInput{U"test", 3, 1,
+    U"var c = canonical_print_base.'\\'';;"});
+  s.addDeclaration(TL::Parser::RawInput{U"test", 4, 1,
+    U"var d = canonical_print_base.true;;"});
+  s.go();
+
+  TL::Context k;
+  k.perturb(TL::DIM_TIME, TL::Types::Intmp::create(0));
+
+  auto printed = [&] (const TL::u32string& x)
+  {
+    return (*s.lookupIdentifiers().lookup(x))(k);
+  };
+
+  //the buffer is reused, so each one is checked again after the others
+  for (int i = 0; i != 2; ++i)
+  {
+    CHECK(printed(U"a") == TL::Types::String::create(U"~42"));
+    CHECK(printed(U"b") == 
+      TL::Types::String::create(U"\"q\\\"\\n\\u0001\""));
+    CHECK(printed(U"c") == TL::Types::String::create(U"'\\''"));
+    CHECK(printed(U"d") == TL::Types::String::create(U"true"));
+  }
+}
+
+TEST_CASE( "demand trace", "demands are kept in a ring buffer" )
+{
+  TL::DemandTrace trace(3);
+
+  TL::Context k;
+  k.perturb(TL::DIM_TIME, TL::Types::Intmp::create(1));
+  TL::Delta delta;
+  delta.insert(TL::DIM_TIME);
+
+  uint32_t x = trace.variable(U"x");
+  uint32_t y = trace.variable(U"y");
+  CHECK(trace.variable(U"x") == x);
+  CHECK(x != y);
+
+  //x demands y twice
+  {
+    TL::DemandTrace::Scope outer(&trace);
+    {
+      TL::DemandTrace::Scope inner(&trace);
+      inner.end(y, k, delta, TL::DemandTrace::OUTCOME_CALC);
+    }
+    {
+      TL::DemandTrace::Scope inner(&trace);
+      inner.end(y, k, delta, TL::DemandTrace::OUTCOME_HIT);
+    }
+    outer.end(x, k, delta, TL::DemandTrace::OUTCOME_CALC);
+  }
+
+  auto records = trace.records();
+  REQUIRE(records.size() == 3);
+  CHECK(records[0].sequence == 2);
+  CHECK(records[0].parent == 1);
+  CHECK(records[1].sequence == 3);
+  CHECK(records[1].parent == 1);
+  CHECK(records[2].sequence == 1);
+  CHECK(records[2].parent == 0);
+  CHECK(records[2].variable == x);
+  CHECK(records[0].context == records[2].context);
+  CHECK(trace.dropped() == 0);
+
+  //an abandoned demand isn't recorded
+  {
+    TL::DemandTrace::Scope left(&trace);
+  }
+  CHECK(trace.records().size() == 3);
+
+  {
+    TL::DemandTrace::Scope last(&trace);
+    last.end(y, k, delta, TL::DemandTrace::OUTCOME_LOOP);
+  }
+
+  records = trace.records();
+  REQUIRE(records.size() == 3);
+  CHECK(trace.dropped() == 1);
+  CHECK(records[0].sequence == 3);
+  CHECK(records[2].sequence == 5);
+  CHECK(records[2].parent == 0);
+  CHECK(records[2].outcome == TL::DemandTrace::OUTCOME_LOOP);
+  CHECK(trace.contexts() == 1);
+
+  //only the contexts of the kept demands have text
+  for (int i = 2; i != 10; ++i)
+  {
+    TL::DemandTrace::Scope demand(&trace);
+    k.perturb(TL::DIM_TIME, TL::Types::Intmp::create(i));
+    demand.end(y, k, delta, TL::DemandTrace::OUTCOME_CALC);
+  }
+  CHECK(trace.contexts() == 3);
+
+  std::string path = "demand_trace_test.trace";
+  REQUIRE(trace.write(path));
+
+  std::ifstream in(path, std::ios::binary);
+  char magic[8];
+  in.read(magic, sizeof(magic));
+  CHECK(std::string(magic, sizeof(magic)) == std::string("TLTRACE\0", 8));
+  in.close();
+  std::remove(path.c_str());
+}
+
+TEST_CASE( "hyperdaton blocks", "a block of points is read and written" )
+{
+  TL::System s;
+  TL::dimension_index d0 = s.getDimensionIndex(TL::Types::Intmp::create(0));
+  TL::dimension_index d1 = s.getDimensionIndex(TL::Types::Intmp::create(1));
+
+  TL::ArrayHD array;
+  array.initialise({{d0, 4}, {d1, 3}});
+
+  //[0 : 1..2, 1 : 0..2]
+  TL::HDBlock block;
+  block.add(d0, 1, 2);
+  block.add(d1, 0, 3);
+  REQUIRE(block.size() == 6);
+
+  std::vector<TL::Constant> values;
+  for (int i = 0; i != 6; ++i)
+  {
+    values.push_back(TL::Types::Intmp::create(i));
+  }
+
+  TL::Context k;
+  array.putBlock(k, block, values.data());
+
+  //the last bound varies fastest
+  for (int i = 0; i != 6; ++i)
+  {
+    TL::Context point;
+    point.perturb(d0, TL::Types::Intmp::create(1 + i / 3));
+    point.perturb(d1, TL::Types::Intmp::create(i % 3));
+    CHECK(array.get(point) == values[i]);
+  }
+
+  CHECK(array.begin()->index() != TL::TYPE_INDEX_INTMP);
+
+  //a row, with the other dimension from the context
+  TL::HDBlock row;
+  row.add(d1, 0, 3);
+  k.perturb(d0, TL::Types::Intmp::create(2));
+
+  std::vector<TL::Constant> got(3);
+  array.getBlock(k, row, got.data());
+  CHECK(got[0] == values[3]);
+  CHECK(got[2] == values[5]);
+
+  //the cache keeps what was put, the rest is undefined
+  TL::CacheIO cache;
+  cache.getBlock(k, row, got.data());
+  CHECK(got[0] == TL::Types::Special::create(TL::SP_UNDEF));
+
+  cache.putBlock(k, row, values.data());
+  cache.getBlock(k, row, got.data());
+  CHECK(got[0] == values[0]);
+  CHECK(got[2] == values[2]);
+
+  k.perturb(d0, TL::Types::Intmp::create(3));
+  cache.getBlock(k, row, got.data());
+  CHECK(got[1] == TL::Types::Special::create(TL::SP_UNDEF));
+
+  //a slice is part of the first bound
+  auto slice = block.slice(1, 1);
+  CHECK(slice.size() == 3);
+  CHECK(slice.bounds().front().lower == 2);
+}
+
+TEST_CASE( "cache io", 
+  "values are found by the dimensions of the first put" )
+{
+  TL::System s;
+  TL::dimension_index d0 = s.getDimensionIndex(TL::Types::Intmp::create(0));
+  TL::dimension_index d1 = s.getDimensionIndex(TL::Types::Intmp::create(1));
+  TL::dimension_index d2 = s.getDimensionIndex(TL::Types::Intmp::create(2));
+
+  auto at = [] (std::initializer_list<std::pair<TL::dimension_index, int>> p)
+  {
+    TL::Context k;
+    for (const auto& v : p)
+    {
+      k.perturb(v.first, TL::Types::Intmp::create(v.second));
+    }
+    return k;
+  };
+
+  auto undef = TL::Types::Special::create(TL::SP_UNDEF);
+  auto value = [] (int i) { return TL::Types::Intmp::create(i); };
+
+  TL::CacheIO cache;
+  CHECK(cache.get(at({{d0, 1}, {d1, 2}})) == undef);
+
+  cache.put(at({{d0, 1}, {d1, 2}}), value(5));
+  CHECK(cache.get(at({{d0, 1}, {d1, 2}})) == value(5));
+  CHECK(cache.get(at({{d0, 1}, {d1, 3}})) == undef);
+
+  //d2 wasn't in the first put, so it doesn't matter, but d1 does
+  CHECK(cache.get(at({{d0, 1}, {d1, 2}, {d2, 7}})) == value(5));
+  CHECK(cache.get(at({{d0, 1}})) == undef);
+
+  //a block gives the same as putting each point
+  TL::HDBlock block;
+  block.add(d0, 2, 3);
+  block.add(d1, 0, 4);
+
+  std::vector<TL::Constant> values;
+  for (int i = 0; i != 12; ++i)
+  {
+    values.push_back(value(i));
+  }
+
+  cache.putBlock(TL::Context(), block, values.data());
+  for (int i = 0; i != 12; ++i)
+  {
+    CHECK(cache.get(at({{d0, 2 + i / 4}, {d1, i % 4}})) == values[i]);
+  }
+
+  std::vector<TL::Constant> got(12);
+  cache.put(at({{d0, 3}, {d1, 1}}), value(100));
+  cache.getBlock(TL::Context(), block, got.data());
+  CHECK(got[5] == value(100));
+  CHECK(got[11] == values[11]);
+
+  //the points of a block in a dimension that the values aren't found by
+  //are all the same value, the last one put
+  TL::HDBlock other;
+  other.add(d2, 0, 3);
+
+  cache.putBlock(at({{d0, 1}, {d1, 2}}), other, values.data());
+  cache.getBlock(at({{d0, 1}, {d1, 2}}), other, got.data());
+  CHECK(got[0] == values[2]);
+  CHECK(got[1] == values[2]);
+
+  //and a block that leaves one of them out isn't found
+  TL::HDBlock partial;
+  partial.add(d0, 2, 2);
+  cache.getBlock(TL::Context(), partial, got.data());
+  CHECK(got[0] == undef);
+  CHECK(got[1] == undef);
+}
+
+TEST_CASE( "shared array hyperdaton", 
+  "another process sees the instants that were committed" )
+{
+  TL::System s;
+  TL::dimension_index d0 = s.getDimensionIndex(TL::Types::Intmp::create(0));
+  TL::dimension_index d1 = s.getDimensionIndex(TL::Types::Intmp::create(1));
+
+  std::string segment = "/tl_system_test_" + std::to_string(getpid());
+
+  TL::SharedArrayHD out(segment, {{d0, "0", 2}, {d1, "1", 3}},
+    TL::SharedArrayHD::ELEMENT_INT64);
+
+  //this is what another process would open
+  TL::SharedArrayHD in(segment, {d0, d1});
+  CHECK(in.size() == 6);
+  CHECK(in.header().rank == 2);
+  CHECK(in.header().bounds[1] == 3);
+  CHECK(std::string(in.header().names[1]) == "1");
+
+  auto at = [&] (int i, int j)
+  {
+    TL::Context k;
+    k.perturb(d0, TL::Types::Intmp::create(i));
+    k.perturb(d1, TL::Types::Intmp::create(j));
+    return k;
+  };
+
+  out.put(at(0, 1), TL::Types::Intmp::create(5));
+  out.put(at(1, 2), TL::Types::Intmp::create(-7));
+
+  //out of bounds and the wrong type are ignored
+  out.put(at(2, 0), TL::Types::Intmp::create(1));
+  out.put(at(0, 0), TL::Types::String::create(U"no"));
+
+  //nothing is seen until it is committed
+  CHECK(in.get(at(0, 1)) == TL::Types::Intmp::create(0));
+
+  out.commit();
+  CHECK(in.header().commits.load() == 1u);
+  CHECK(in.get(at(0, 1)) == TL::Types::Intmp::create(5));
+  CHECK(in.get(at(1, 2)) == TL::Types::Intmp::create(-7));
+  CHECK(in.get(at(0, 0)) == TL::Types::Intmp::create(0));
+  CHECK(in.get(at(2, 0)) == TL::Types::Special::create(TL::SP_UNDEF));
+
+  //the next instant starts with the values of the last one
+  out.put(at(0, 0), TL::Types::Intmp::create(3));
+  CHECK(in.get(at(0, 0)) == TL::Types::Intmp::create(0));
+  out.commit();
+  CHECK(in.get(at(0, 0)) == TL::Types::Intmp::create(3));
+  CHECK(in.get(at(0, 1)) == TL::Types::Intmp::create(5));
+
+  TL::SharedArrayHD::unlink(segment);
+  CHECK_THROWS(TL::SharedArrayHD(segment, {d0, d1}));
+}
+
+TEST_CASE( "sparse array hyperdaton",
+  "only the points that are selected are computed and stored" )
+{
+  namespace Tree = TL::Tree;
+
+  TL::System s;
+  TL::dimension_index d0 = s.getDimensionIndex(TL::Types::Intmp::create(0));
+  TL::dimension_index d1 = s.getDimensionIndex(TL::Types::Intmp::create(1));
+
+  //far too big for an ArrayHD
+  TL::SparseArrayHD out;
+  out.initialise({{d0, 1000000}, {d1, 1000000}});
+  s.addOutputHyperdaton(U"sparse", &out);
+
+  s.addDeclaration(TL::Parser::RawInput{U"test", 1, 1,
+    U"fun plus!a!b = intmp_plus.(a,b);;"});
+  s.addDeclaration(TL::Parser::RawInput{U"test", 2, 1,
+    U"fun mod!a!b = intmp_modulus.(a,b);;"});
+  s.addDeclaration(TL::Parser::RawInput{U"test", 3, 1,
+    U"fun eq!a!b = intmp_eq.(a,b);;"});
+
+  auto call = [] (const char32_t* f, Tree::Expr a, Tree::Expr b)
+  {
+    return Tree::LambdaAppExpr(
+      Tree::LambdaAppExpr(Tree::IdentExpr(f), a), b);
+  };
+
+  //assign sparse [0 : 999990.., 1 is 7] | eq.(mod.#.0.4).0 := plus.#.0.#.1
+  //the upper bound of 0 comes from the hyperdaton
+  mpz_class lower = 999990;
+  s.addAssignment(TL::Parser::Equation
+  (
+    U"sparse",
+    Tree::RegionExpr(
+    {
+      Tree::RegionExpr::Entry
+      {
+        mpz_class(0), TL::Region::Containment::IN,
+        TL::Types::Range::create(TL::Range(&lower, nullptr))
+      },
+      Tree::RegionExpr::Entry
+      {
+        mpz_class(1), TL::Region::Containment::IS, mpz_class(7)
+      }
+    }),
+    call(U"eq", call(U"mod", Tree::HashExpr(mpz_class(0)), mpz_class(4)),
+      mpz_class(0)),
+    call(U"plus", Tree::HashExpr(mpz_class(0)), Tree::HashExpr(mpz_class(1)))
+  ));
+
+  //a point outside of the hyperdaton rules out the whole region, the
+  //unbounded range is never enumerated
+  mpz_class zero = 0;
+  s.addAssignment(TL::Parser::Equation
+  (
+    U"sparse",
+    Tree::RegionExpr(
+    {
+      Tree::RegionExpr::Entry
+      {
+        mpz_class(0), TL::Region::Containment::IS, mpz_class(1000000)
+      },
+      Tree::RegionExpr::Entry
+      {
+        mpz_class(1), TL::Region::Containment::IN,
+        TL::Types::Range::create(TL::Range(&zero, nullptr))
+      }
+    }),
+    Tree::Expr(),
+    mpz_class(1)
+  ));
+
+  s.go();
+
+  CHECK(out.size() == 2);
+
+  auto at = [&] (int i, int j)
+  {
+    TL::Context k;
+    k.perturb(d0, TL::Types::Intmp::create(i));
+    k.perturb(d1, TL::Types::Intmp::create(j));
+    return out.get(k);
+  };
+
+  CHECK(at(999992, 7) == TL::Types::Intmp::create(999999));
+  CHECK(at(999996, 7) == TL::Types::Intmp::create(1000003));
+  CHECK(at(999993, 7) == TL::Types::Special::create(TL::SP_UNDEF));
+  CHECK(at(1000000, 7) == TL::Types::Special::create(TL::SP_UNDEF));
+}
+
+TEST_CASE( "pruned assignment",
+  "constant bounds in the boolean cut down the region" )
+{
+  namespace Tree = TL::Tree;
+
+  TL::System s;
+  TL::dimension_index d0 = s.getDimensionIndex(TL::Types::Intmp::create(0));
+  TL::dimension_index d1 = s.getDimensionIndex(TL::Types::Intmp::create(1));
+
+  TL::SparseArrayHD out;
+  out.initialise({{d0, 1000000}, {d1, 1000000}});
+  s.addOutputHyperdaton(U"sparse", &out);
+
+  s.addDeclaration(TL::Parser::RawInput{U"test", 1, 1,
+    U"fun plus!a!b = intmp_plus.(a,b);;"});
+  s.addDeclaration(TL::Parser::RawInput{U"test", 2, 1,
+    U"fun eq!a!b = intmp_eq.(a,b);;"});
+  s.addDeclaration(TL::Parser::RawInput{U"test", 3, 1,
+    U"fun lt!a!b = intmp_lt.(a,b);;"});
+  s.addDeclaration(TL::Parser::RawInput{U"test", 4, 1,
+    U"fun lte!a!b = intmp_lte.(a,b);;"});
+  s.addDeclaration(TL::Parser::RawInput{U"test", 5, 1,
+    U"fun bool_and a b = if a then b else false fi;;"});
+
+  auto call = [] (const char32_t* f, Tree::Expr a, Tree::Expr b)
+  {
+    return Tree::LambdaAppExpr(
+      Tree::LambdaAppExpr(Tree::IdentExpr(f), a), b);
+  };
+
+  auto both = [] (Tree::Expr a, Tree::Expr b)
+  {
+    return Tree::PhiAppExpr(
+      Tree::PhiAppExpr(Tree::IdentExpr(U"bool_and"), a), b);
+  };
+
+  //assign sparse [0 : 0..999999, 1 : 0..999999] 
+  //  | #.0 == 5 && 3 < #.1 && #.1 <= 7 := plus.#.0.#.1
+  mpz_class zero = 0, last = 999999;
+  s.addAssignment(TL::Parser::Equation
+  (
+    U"sparse",
+    Tree::RegionExpr(
+    {
+      Tree::RegionExpr::Entry
+      {
+        mpz_class(0), TL::Region::Containment::IN,
+        TL::Types::Range::create(TL::Range(&zero, &last))
+      },
+      Tree::RegionExpr::Entry
+      {
+        mpz_class(1), TL::Region::Containment::IN,
+        TL::Types::Range::create(TL::Range(&zero, &last))
+      }
+    }),
+    both(
+      both(
+        call(U"eq", Tree::HashExpr(mpz_class(0)), mpz_class(5)),
+        call(U"lt", mpz_class(3), Tree::HashExpr(mpz_class(1)))),
+      call(U"lte", Tree::HashExpr(mpz_class(1)), mpz_class(7))),
+    call(U"plus", Tree::HashExpr(mpz_class(0)), Tree::HashExpr(mpz_class(1)))
+  ));
+
+  const auto& boolean = 
+    s.getAssignments().at(U"sparse")->definitions().front().booleanExpr;
+
+  auto pruned = [&] ()
+  {
+    TL::Region region
+    {
+      {
+        {d0, {TL::Region::Containment::IN,
+          TL::Types::Range::create(TL::Range(&zero, &last))}},
+        {d1, {TL::Region::Containment::IN,
+          TL::Types::Range::create(TL::Range(&zero, &last))}}
+      }
+    };
+
+    REQUIRE(TL::Assignment::pruneRegion(s, boolean, region));
+    return region;
+  };
+
+  mpz_class five = 5, four = 4, seven = 7;
+  TL::Region expected
+  {
+    {
+      {d0, {TL::Region::Containment::IN,
+        TL::Types::Range::create(TL::Range(&five, &five))}},
+      {d1, {TL::Region::Containment::IN,
+        TL::Types::Range::create(TL::Range(&four, &seven))}}
+    }
+  };
+
+  CHECK(pruned() == expected);
+
+  //the whole region would be 10^12 points
+  s.go();
+
+  CHECK(out.size() == 4);
+
+  TL::Context k;
+  k.perturb(d0, TL::Types::Intmp::create(5));
+  k.perturb(d1, TL::Types::Intmp::create(6));
+  CHECK(out.get(k) == TL::Types::Intmp::create(11));
+
+  //an eq that isn't integer equality doesn't bound anything
+  s.addDeclaration(TL::Parser::RawInput{U"test", 6, 1,
+    U"fun eq!a!b [a imp intmp] = true;;"});
+
+  TL::Region region = pruned();
+  CHECK(!(region == expected));
+}
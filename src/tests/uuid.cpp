@@ -2,11 +2,18 @@
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
+#include <iterator>
 #include <unordered_set>
 
 class RandomIterator
 {
   public:
+  typedef std::input_iterator_tag iterator_category;
+  typedef unsigned int value_type;
+  typedef std::ptrdiff_t difference_type;
+  typedef unsigned int* pointer;
+  typedef unsigned int reference;
+
   RandomIterator(std::random_device* rand)
   : m_rand(rand), m_count(0)
   {}
@@ -19,6 +19,10 @@ along with TransLucid; see the file COPYING.  If not see
 
 #include <tl/variant.hpp>
 
+#include <string>
+#include <type_traits>
+#include <vector>
+
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
 
@@ -132,6 +136,22 @@ TEST_CASE( "recursive_wrapper", "the variant with recursive wrapper" )
   CHECK(stored.x == "goodbye");
 }
 
+TEST_CASE( "recursive_wrapper moves", "containers move instead of copy" )
+{
+  //a vector only moves its elements when it grows if they can't throw
+  CHECK(std::is_nothrow_move_constructible<AST>::value);
+
+  std::vector<AST> links;
+  for (int i = 0; i != 10; ++i)
+  {
+    links.push_back(AST{Link{"link", AST{i}}});
+  }
+
+  const Link& last = TransLucid::get<Link>(links.back());
+  CHECK(last.x == "link");
+  CHECK(TransLucid::get<int>(last.y) == 9);
+}
+
 class ArgsVisitor
 {
   public:
@@ -17,6 +17,7 @@ You should have received a copy of the GNU General Public License
 along with TransLucid; see the file COPYING.  If not see
 <http://www.gnu.org/licenses/>.  */
 
+#include <algorithm>
 #include <iostream>
 
 #include <gmpxx.h>
@@ -64,6 +65,35 @@ DemandHD::put(const Context& k, const Constant& c)
   }
 }
 
+void
+DemandHD::putBlock
+(
+  const Context& k,
+  const HDBlock& block,
+  const Constant* values
+)
+{
+  const auto& bounds = block.bounds();
+
+  //a run of slots is copied straight in
+  if (bounds.size() != 1 || bounds.front().dim != m_slot ||
+      bounds.front().lower < 0)
+  {
+    OutputHD::putBlock(k, block, values);
+    return;
+  }
+
+  size_t first = bounds.front().lower.get_ui();
+  size_t end = first + bounds.front().size;
+
+  if (m_results.size() < end)
+  {
+    m_results.resize(end * 2);
+  }
+
+  std::copy(values, values + bounds.front().size, m_results.begin() + first);
+}
+
 Region
 DemandHD::variance() const
 {
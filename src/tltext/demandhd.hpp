@@ -40,6 +40,10 @@ namespace TransLucid
       void
       put(const Context& k, const Constant& c);
 
+      void
+      putBlock(const Context& k, const HDBlock& block, 
+        const Constant* values);
+
       const Constant&
       operator()(size_t i)
       {
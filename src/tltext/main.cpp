@@ -27,9 +27,11 @@ along with TransLucid; see the file COPYING.  If not see
 #endif
 
 #include <iostream>
-#include "tltext.hpp"
+#include "server.hpp"
+#include <algorithm>
 #include <fstream>
 #include <signal.h>
+#include <thread>
 
 #include <tl/output.hpp>
 
@@ -151,8 +153,13 @@ int main(int argc, char *argv[])
     ("d,debug", _("debug mode"))
     /* TRANSLATORS: the help message for --deps */
     ("deps", _("compute dependencies"))
+    /* TRANSLATORS: the help message for --eager */
+    ("eager", _("compile definitions when they are added"))
     /* TRANSLATORS: the help message for --help */
     ("h,help", _("show this message"))
+    /* TRANSLATORS: the help message for --history */
+    ("history", _("only keep the definitions of this many instants"),
+      cxxopts::value<size_t>())
     /* TRANSLATORS: the help message for --no-builtin-header */
     ("no-builtin-header", _("don't use the standard header"))
     /* TRANSLATORS: the help message for --header */
@@ -162,8 +169,36 @@ int main(int argc, char *argv[])
     ("i,input", _("input file"), cxxopts::value<std::string>())
     /* TRANSLATORS: the help message for --output */
     ("o,output", _("output file"), cxxopts::value<std::string>())
+    /* TRANSLATORS: the help message for --parse-threads */
+    ("parse-threads", _("the number of threads for parsing declarations"),
+      cxxopts::value<size_t>())
+    /* TRANSLATORS: the help message for --server */
+    ("server", _("load the headers once, then run the scripts sent to "
+      "this Unix domain socket"), cxxopts::value<std::string>())
+    /* TRANSLATORS: the help message for --server-jobs */
+    ("server-jobs", _("the number of scripts that the server runs at once"),
+      cxxopts::value<size_t>())
+    /* TRANSLATORS: the help message for --server-cpu */
+    ("server-cpu", _("seconds of cpu time that each script can use"),
+      cxxopts::value<size_t>())
+    /* TRANSLATORS: the help message for --server-memory */
+    ("server-memory", _("megabytes of memory that each script can use"),
+      cxxopts::value<size_t>())
+    /* TRANSLATORS: the help message for --shm-out */
+    ("shm-out", _("an output hyperdaton in shared memory, "
+      "name:segment:type:dim=size,..."),
+      cxxopts::value<std::vector<std::string>>())
+    /* TRANSLATORS: the help message for --trace */
+    ("trace", _("record the demands for cached variables to this file"),
+      cxxopts::value<std::string>())
+    /* TRANSLATORS: the help message for --trace-size */
+    ("trace-size", _("the number of demands that the trace keeps"),
+      cxxopts::value<size_t>())
     /* TRANSLATORS: the help message for --tyinf */
     ("tyinf", _("enable type inference"))
+    /* TRANSLATORS: the help message for --tyinf-threads */
+    ("tyinf-threads", _("the number of threads for type inference (default 1)"),
+      cxxopts::value<size_t>())
     /* TRANSLATORS: the help message for --full-types */
     ("fulltypes", _("print full non-display types"))
     /* TRANSLATORS: the help message for --uuid */
@@ -246,6 +281,46 @@ int main(int argc, char *argv[])
       tltext.debug();
     }
 
+    if (options.count("eager"))
+    {
+      tltext.eager_compile();
+    }
+
+    if (options.count("history"))
+    {
+      tltext.keep_history(options["history"].as<size_t>());
+    }
+
+    if (options.count("tyinf-threads"))
+    {
+      tltext.tyinf_threads(options["tyinf-threads"].as<size_t>());
+    }
+
+    if (options.count("parse-threads"))
+    {
+      tltext.parse_threads(options["parse-threads"].as<size_t>());
+    }
+
+    if (options.count("shm-out") > 0)
+    {
+      for (const auto& spec : 
+        options["shm-out"].as<std::vector<std::string>>())
+      {
+        tltext.shared_output(spec);
+      }
+    }
+
+    if (options.count("trace"))
+    {
+      size_t size = 1 << 20;
+      if (options.count("trace-size"))
+      {
+        size = options["trace-size"].as<size_t>();
+      }
+
+      tltext.trace(options["trace"].as<std::string>(), size);
+    }
+
     if (options.count("fulltypes"))
     {
       tltext.print_full_types(true);
@@ -304,7 +379,35 @@ int main(int argc, char *argv[])
       }
     }
 
-    tltext.run();
+    if (options.count("server"))
+    {
+      TransLucid::TLText::ServerLimits limits
+        {std::max(1u, std::thread::hardware_concurrency()), 0, 0};
+
+      if (options.count("server-jobs"))
+      {
+        limits.jobs = std::max(size_t(1), 
+          options["server-jobs"].as<size_t>());
+      }
+
+      if (options.count("server-cpu"))
+      {
+        limits.cpu = options["server-cpu"].as<size_t>();
+      }
+
+      if (options.count("server-memory"))
+      {
+        limits.memory = options["server-memory"].as<size_t>();
+      }
+
+      TransLucid::TLText::Server server(tltext, 
+        options["server"].as<std::string>(), limits);
+      server.run();
+    }
+    else
+    {
+      tltext.run();
+    }
   }
   catch (const char* c)
   {
@@ -0,0 +1,484 @@
+/* tltext server over a Unix domain socket
+   Copyright (C) 2013 Jarryd Beck
+
+This file is part of TransLucid.
+
+TransLucid is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+TransLucid is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with TransLucid; see the file COPYING.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+#include "server.hpp"
+
+#include <tl/output.hpp>
+#include <tl/system_fork.hpp>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <streambuf>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace TransLucid
+{
+
+namespace TLText
+{
+
+namespace
+{
+  //reads and writes a file descriptor, the writes are buffered until
+  //the stream is flushed so that std::endl sends a line straight away
+  class FdBuffer : public std::streambuf
+  {
+    public:
+    FdBuffer(int fd)
+    : m_fd(fd)
+    {
+      setg(m_in, m_in, m_in);
+      setp(m_out, m_out + sizeof(m_out));
+    }
+
+    ~FdBuffer()
+    {
+      flush();
+    }
+
+    protected:
+    int_type
+    underflow()
+    {
+      ssize_t n = 0;
+      do
+      {
+        n = read(m_fd, m_in, sizeof(m_in));
+      } while (n == -1 && errno == EINTR);
+
+      if (n <= 0)
+      {
+        return traits_type::eof();
+      }
+
+      setg(m_in, m_in, m_in + n);
+      return traits_type::to_int_type(*gptr());
+    }
+
+    int_type
+    overflow(int_type c)
+    {
+      if (flush() == -1)
+      {
+        return traits_type::eof();
+      }
+
+      if (!traits_type::eq_int_type(c, traits_type::eof()))
+      {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+      }
+
+      return traits_type::not_eof(c);
+    }
+
+    int
+    sync()
+    {
+      return flush();
+    }
+
+    private:
+    int
+    flush()
+    {
+      char* p = pbase();
+      while (p != pptr())
+      {
+        ssize_t n = write(m_fd, p, pptr() - p);
+        if (n == -1)
+        {
+          if (errno == EINTR)
+          {
+            continue;
+          }
+          return -1;
+        }
+        p += n;
+      }
+
+      setp(m_out, m_out + sizeof(m_out));
+      return 0;
+    }
+
+    int m_fd;
+    char m_in[4096];
+    char m_out[4096];
+  };
+
+  //the connection of the request that this child is running
+  int clientFd = -1;
+
+  //set when the server is asked to stop
+  volatile sig_atomic_t stopping = 0;
+
+  //SIGCHLD writes to this so that the server stops waiting for a
+  //connection and collects the child straight away
+  int childPipe[2] = {-1, -1};
+
+  void
+  childExited(int)
+  {
+    int saved = errno;
+    ssize_t written = write(childPipe[1], "", 1);
+    (void)written;
+    errno = saved;
+  }
+
+  //the bytes of address space that this process has, 0 if that can't be
+  //found out
+  rlim_t
+  addressSpace()
+  {
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0;
+
+    if (!(statm >> pages))
+    {
+      return 0;
+    }
+
+    return rlim_t(pages) * sysconf(_SC_PAGESIZE);
+  }
+
+  void
+  stopSignal(int)
+  {
+    stopping = 1;
+  }
+
+  void
+  childSignal(int signal)
+  {
+    const char* message = signal == SIGXCPU
+      ? "CPU time limit exceeded\n"
+      : "processing has terminated with a segfault\n";
+
+    ssize_t written = write(clientFd, message, strlen(message));
+    (void)written;
+
+    _exit(1);
+  }
+
+  void
+  setChildSignals()
+  {
+    //the alternate stack set up by main is still there
+    struct sigaction action;
+
+    action.sa_handler = &childSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_ONSTACK;
+
+    sigaction(SIGSEGV, &action, nullptr);
+    sigaction(SIGXCPU, &action, nullptr);
+
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGCHLD, SIG_DFL);
+
+    //a client that goes away makes the writes fail instead
+    signal(SIGPIPE, SIG_IGN);
+  }
+}
+
+Server::Server
+(
+  TLText& tltext,
+  const std::string& path,
+  const ServerLimits& limits
+)
+: m_tltext(tltext)
+, m_path(path)
+, m_limits(limits)
+, m_socket(-1)
+, m_running(0)
+{
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+
+  if (path.size() >= sizeof(address.sun_path))
+  {
+    throw "Socket path is too long";
+  }
+
+  strcpy(address.sun_path, path.c_str());
+
+  //only replace a socket, never anything else
+  struct stat info;
+  if (stat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode))
+  {
+    unlink(path.c_str());
+  }
+
+  m_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (m_socket == -1)
+  {
+    perror("socket");
+    throw "Could not create the server socket";
+  }
+
+  if (bind(m_socket, reinterpret_cast<sockaddr*>(&address),
+        sizeof(address)) == -1)
+  {
+    perror("bind");
+    close(m_socket);
+    throw "Could not bind the server socket";
+  }
+
+  if (listen(m_socket, SOMAXCONN) == -1)
+  {
+    perror("listen");
+    close(m_socket);
+    unlink(path.c_str());
+    throw "Could not listen on the server socket";
+  }
+}
+
+Server::~Server()
+{
+  close(m_socket);
+  unlink(m_path.c_str());
+
+  if (childPipe[0] != -1)
+  {
+    signal(SIGCHLD, SIG_DFL);
+    close(childPipe[0]);
+    close(childPipe[1]);
+    childPipe[0] = childPipe[1] = -1;
+  }
+}
+
+void
+Server::run()
+{
+  m_tltext.prepare();
+
+  //nothing that the parent writes goes to a client
+  signal(SIGPIPE, SIG_IGN);
+
+  //stop waiting for connections so that the socket is cleaned up, this
+  //doesn't restart the wait
+  struct sigaction action;
+  action.sa_handler = &stopSignal;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = 0;
+
+  sigaction(SIGTERM, &action, nullptr);
+  sigaction(SIGINT, &action, nullptr);
+
+  //a child that finishes while the server is waiting for a connection is
+  //collected then, not when the next connection comes
+  if (pipe(childPipe) == -1)
+  {
+    perror("pipe");
+    throw "Could not create the child pipe";
+  }
+
+  for (int end : childPipe)
+  {
+    fcntl(end, F_SETFL, fcntl(end, F_GETFL) | O_NONBLOCK);
+    fcntl(end, F_SETFD, FD_CLOEXEC);
+  }
+
+  action.sa_handler = &childExited;
+  action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+  sigaction(SIGCHLD, &action, nullptr);
+
+  while (!stopping)
+  {
+    //don't take on more than we are allowed to run
+    reap(m_running >= m_limits.jobs);
+
+    pollfd waiting[] = 
+    {
+      {m_socket, POLLIN, 0},
+      {childPipe[0], POLLIN, 0}
+    };
+
+    if (poll(waiting, 2, -1) == -1)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      perror("poll");
+      throw "Could not wait for a connection";
+    }
+
+    if (waiting[1].revents & POLLIN)
+    {
+      char drained[64];
+      while (read(childPipe[0], drained, sizeof(drained)) > 0)
+      {
+      }
+    }
+
+    if (!(waiting[0].revents & POLLIN))
+    {
+      continue;
+    }
+
+    int fd = accept(m_socket, nullptr, nullptr);
+
+    if (fd == -1)
+    {
+      if (errno == EINTR || errno == ECONNABORTED)
+      {
+        continue;
+      }
+
+      perror("accept");
+      throw "Could not accept a connection";
+    }
+
+    try
+    {
+      forkChild([this, fd] () { return serve(fd); });
+      ++m_running;
+    }
+    catch (SystemForkError& e)
+    {
+      std::cerr << e.what() << std::endl;
+    }
+
+    //the child has its own copy now
+    close(fd);
+  }
+}
+
+void
+Server::reap(bool wait)
+{
+  while (m_running > 0)
+  {
+    int status = 0;
+    pid_t pid = waitChild(-1, status, wait, [] () { return stopping != 0; });
+
+    if (pid <= 0)
+    {
+      return;
+    }
+
+    //the child tells the client about the limits that it runs into,
+    //anything else is only seen here
+    if (WIFSIGNALED(status))
+    {
+      std::cerr << "request " << pid << " " << describeExit(status) 
+        << std::endl;
+    }
+
+    --m_running;
+    wait = false;
+  }
+}
+
+int
+Server::serve(int fd)
+{
+  close(m_socket);
+  close(childPipe[0]);
+  close(childPipe[1]);
+
+  clientFd = fd;
+  setChildSignals();
+
+  if (m_limits.cpu != 0)
+  {
+    //SIGXCPU comes first, then the hard limit kills it anyway
+    rlimit cpu{rlim_t(m_limits.cpu), rlim_t(m_limits.cpu + 1)};
+    setrlimit(RLIMIT_CPU, &cpu);
+  }
+
+  if (m_limits.memory != 0)
+  {
+    //the limit is on what the request uses, on top of the copy of the
+    //warmed up system that it starts with
+    rlim_t bytes = addressSpace() + rlim_t(m_limits.memory) * 1024 * 1024;
+    rlimit memory{bytes, bytes};
+    setrlimit(RLIMIT_AS, &memory);
+  }
+
+  int code = 0;
+
+  {
+    //the input and the output need their own state, the input reaching
+    //the end mustn't stop the output
+    FdBuffer buffer(fd);
+    std::istream input(&buffer);
+    std::ostream stream(&buffer);
+
+    m_tltext.set_input(&input, "<server>");
+    m_tltext.set_output(&stream);
+    m_tltext.set_error(&stream);
+
+    try
+    {
+      m_tltext.run();
+    }
+    catch (const char* c)
+    {
+      stream << "terminated with exception: " << c << std::endl;
+      code = 1;
+    }
+    catch (const u32string& error)
+    {
+      stream << "terminated with exception: " << error << std::endl;
+      code = 1;
+    }
+    catch (ReturnError& ret)
+    {
+      code = ret.m_code;
+    }
+    catch (std::exception& e)
+    {
+      stream << "std::exception running system: " << e.what() << std::endl;
+      code = 1;
+    }
+    catch (...)
+    {
+      stream << "error running system" << std::endl;
+      code = 1;
+    }
+
+    stream.flush();
+  }
+
+  close(fd);
+
+  return code;
+}
+
+}
+
+}
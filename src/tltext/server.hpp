@@ -0,0 +1,102 @@
+/* tltext server over a Unix domain socket
+   Copyright (C) 2013 Jarryd Beck
+
+This file is part of TransLucid.
+
+TransLucid is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+TransLucid is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with TransLucid; see the file COPYING.  If not see
+<http://www.gnu.org/licenses/>.  */
+
+/**
+ * @file server.hpp
+ * The tltext server. The headers are loaded once, then every connection
+ * is given a forked copy of the warmed up system. The copy reads a script
+ * from the connection exactly as tltext reads its input, and writes the
+ * output back as it goes. A request can't change what the next one sees.
+ */
+
+#ifndef TLTEXT_SERVER_HPP_INCLUDED
+#define TLTEXT_SERVER_HPP_INCLUDED
+
+#include "tltext.hpp"
+
+#include <cstddef>
+#include <string>
+
+namespace TransLucid
+{
+  namespace TLText
+  {
+    struct ServerLimits
+    {
+      //the most requests that run at once
+      size_t jobs;
+
+      //seconds of cpu time for each request, 0 for no limit
+      size_t cpu;
+
+      //megabytes of address space for each request on top of what the
+      //warmed up system already has, 0 for no limit
+      size_t memory;
+    };
+
+    class Server
+    {
+      public:
+      /**
+       * Listen on the socket @a path. A socket left there by an earlier
+       * server is replaced.
+       */
+      Server
+      (
+        TLText& tltext,
+        const std::string& path,
+        const ServerLimits& limits
+      );
+
+      ~Server();
+
+      Server(const Server&) = delete;
+
+      Server&
+      operator=(const Server&) = delete;
+
+      /**
+       * Prepare the system, then serve requests until SIGTERM or SIGINT.
+       * Throws if the socket stops working.
+       */
+      void
+      run();
+
+      private:
+      //runs the request on fd in a child, returns the code that the
+      //child exits with
+      int
+      serve(int fd);
+
+      //collects the children that have finished, waiting for one if
+      //wait is true
+      void
+      reap(bool wait);
+
+      TLText& m_tltext;
+      std::string m_path;
+      ServerLimits m_limits;
+
+      int m_socket;
+      size_t m_running;
+    };
+  }
+}
+
+#endif
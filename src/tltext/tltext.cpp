@@ -21,6 +21,7 @@ along with TransLucid; see the file COPYING.  If not see
 #include "config.h"
 #endif
 
+#include <tl/builtin_types.hpp>
 #include <tl/free_variables.hpp>
 #include <tl/hyperdatons/multi_arrayhd.hpp>
 #include <tl/line_tokenizer.hpp>
@@ -29,6 +30,8 @@ along with TransLucid; see the file COPYING.  If not see
 #include <tl/tree_printer.hpp>
 #include <tl/types/boolean.hpp>
 #include <tl/types/dimension.hpp>
+#include <tl/types/function.hpp>
+#include <tl/types/intmp.hpp>
 #include <tl/types/string.hpp>
 #include <tl/types/uuid.hpp>
 #include <tl/types_util.hpp>
@@ -41,6 +44,8 @@ along with TransLucid; see the file COPYING.  If not see
 #include <iterator>
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <stdexcept>
 
 #include <boost/format.hpp>
 
@@ -77,6 +82,8 @@ TLText::TLText
  ,m_cached(cached)
  ,m_infer(tyinf)
  ,m_fulltypes(false)
+ ,m_tyinfThreads(1)
+ ,m_parseThreads(1)
  ,m_is(&std::cin)
  ,m_os(&std::cout)
  ,m_error(&std::cerr)
@@ -88,6 +95,9 @@ TLText::TLText
  ,m_depFinder(nullptr)
  ,m_argsHD(0)
  ,m_envHD(0)
+ ,m_freshVars(nullptr)
+ ,m_inferrer(nullptr)
+ ,m_prepared(false)
 {
   m_libtool.addSearchPath(to_u32string(std::string(PREFIX "/share/tl")));
 
@@ -128,6 +138,68 @@ TLText::~TLText()
   delete m_envHD;
   delete m_returnhd;
   delete m_depFinder;
+  delete m_inferrer;
+  delete m_freshVars;
+}
+
+void
+TLText::shared_output(const std::string& spec)
+{
+  std::vector<std::string> parts;
+  std::istringstream is(spec);
+  std::string part;
+  while (std::getline(is, part, ':'))
+  {
+    parts.push_back(part);
+  }
+
+  if (parts.size() != 4)
+  {
+    throw std::runtime_error("expected name:segment:type:bounds, got " + 
+      spec);
+  }
+
+  SharedArrayHD::ElementType type;
+  if (parts[2] == "int64")
+  {
+    type = SharedArrayHD::ELEMENT_INT64;
+  }
+  else if (parts[2] == "float64")
+  {
+    type = SharedArrayHD::ELEMENT_FLOAT64;
+  }
+  else
+  {
+    throw std::runtime_error("unknown element type " + parts[2]);
+  }
+
+  std::vector<SharedArrayHD::Bound> bounds;
+  std::istringstream bis(parts[3]);
+  while (std::getline(bis, part, ','))
+  {
+    auto equals = part.find('=');
+    if (equals == std::string::npos)
+    {
+      throw std::runtime_error("expected dim=size, got " + part);
+    }
+
+    std::string dim = part.substr(0, equals);
+    size_t size = std::stoul(part.substr(equals + 1));
+
+    dimension_index index = 
+      !dim.empty() && std::all_of(dim.begin(), dim.end(), ::isdigit)
+      ? m_system.getDimensionIndex(
+          Types::Intmp::create(mpz_class(dim)))
+      : m_system.getDimensionIndex(utf8_to_utf32(dim));
+
+    bounds.push_back(SharedArrayHD::Bound{index, dim, size});
+  }
+
+  m_sharedHDs.push_back(std::unique_ptr<SharedArrayHD>(
+    new SharedArrayHD(parts[1], bounds, type)));
+
+  m_system.addOutputHyperdaton(utf8_to_utf32(parts[0]), 
+    m_sharedHDs.back().get());
 }
 
 VerboseOutput
@@ -169,11 +241,43 @@ TLText::run()
   {
     *m_error << "Type error: " << e.print(m_system) << std::endl;
   }
+  catch (...)
+  {
+    //the trace is most wanted when something went wrong
+    writeTrace();
+    throw;
+  }
+
+  writeTrace();
 }
 
 void
-TLText::main_loop()
+TLText::writeTrace()
+{
+  DemandTrace* trace = m_system.demandTrace();
+
+  if (m_tracePath.empty() || trace == nullptr)
+  {
+    return;
+  }
+
+  if (!trace->write(m_tracePath))
+  {
+    *m_error << m_myname << ": could not write the trace to " 
+      << m_tracePath << std::endl;
+  }
+}
+
+void
+TLText::prepare()
 {
+  if (m_prepared)
+  {
+    return;
+  }
+
+  m_prepared = true;
+
   setup_hds();
 
   //load up headers
@@ -207,6 +311,193 @@ TLText::main_loop()
 
   //make instant 0 happen
   m_system.go();
+}
+
+namespace
+{
+
+//the built in types that canonical_print_to prints, by the name that the
+//header guards their canonical_print definitions with
+const std::pair<const char32_t*, type_index> hostPrintable[] =
+{
+  {U"intmp", TYPE_INDEX_INTMP},
+  {U"ustring", TYPE_INDEX_USTRING},
+  {U"uchar", TYPE_INDEX_UCHAR},
+  {U"bool", TYPE_INDEX_BOOL},
+  {U"range", TYPE_INDEX_RANGE}
+};
+
+const Tree::IdentExpr*
+getIdent(const Tree::Expr& e)
+{
+  if (auto p = get<Tree::ParenExpr>(&e))
+  {
+    return getIdent(p->e);
+  }
+
+  return get<Tree::IdentExpr>(&e);
+}
+
+//is canonical_print_base still the host function that the system defines
+bool
+isHostPrint(System& system)
+{
+  Tree::Expr tree = system.getIdentifierTree(U"canonical_print_base");
+  const Tree::Expr* e = &tree;
+
+  if (auto bestfit = get<Tree::ConditionalBestfitExpr>(e))
+  {
+    if (bestfit->declarations.size() != 1 ||
+        get<Tree::nil>(&std::get<1>(bestfit->declarations.front())) 
+          == nullptr ||
+        get<Tree::nil>(&std::get<2>(bestfit->declarations.front())) 
+          == nullptr)
+    {
+      return false;
+    }
+
+    e = &std::get<3>(bestfit->declarations.front());
+  }
+
+  auto host = get<Tree::HostOpExpr>(e);
+  return host != nullptr && host->name == U"canonical_print_base_0";
+}
+
+//the built in types whose canonical print is the one that the host does,
+//a type is only printed by the host when exactly one canonical_print
+//definition is guarded by imp on that type and it just calls
+//canonical_print_base, and every other definition is less specific or
+//is for some other type. Anything that can't be told apart from the
+//header's definitions means that everything goes through canonical_print
+std::set<type_index>
+findHostPrinted(System& system)
+{
+  if (!isHostPrint(system))
+  {
+    return {};
+  }
+
+  std::map<u32string, int> base;
+  std::set<u32string> replaced;
+
+  for (const auto& decl : system.getFunctionDefinitions(U"canonical_print"))
+  {
+    if (decl.args.size() != 1 || get<Tree::nil>(&decl.boolean) == nullptr)
+    {
+      return {};
+    }
+
+    if (get<Tree::nil>(&decl.guard) != nullptr)
+    {
+      continue;
+    }
+
+    auto region = get<Tree::RegionExpr>(&decl.guard);
+    if (region == nullptr || region->entries.size() != 1)
+    {
+      return {};
+    }
+
+    const auto& entry = region->entries.front();
+    auto arg = getIdent(std::get<0>(entry));
+    auto rhs = getIdent(std::get<2>(entry));
+
+    if (arg == nullptr || rhs == nullptr || 
+        arg->text != decl.args.front().second)
+    {
+      return {};
+    }
+
+    //the header's definitions for the infinities
+    if (std::get<1>(entry) == Region::Containment::IS &&
+        (rhs->text == U"infty" || rhs->text == U"neginfty"))
+    {
+      continue;
+    }
+
+    if (std::get<1>(entry) != Region::Containment::IMP)
+    {
+      return {};
+    }
+
+    auto app = get<Tree::BangAppExpr>(&decl.expr);
+    auto fn = app == nullptr ? nullptr : getIdent(app->name);
+    auto param = app == nullptr || app->args.size() != 1 
+      ? nullptr : getIdent(app->args.front());
+
+    if (fn != nullptr && fn->text == U"canonical_print_base" &&
+        param != nullptr && param->text == arg->text)
+    {
+      ++base[rhs->text];
+    }
+    else
+    {
+      replaced.insert(rhs->text);
+    }
+  }
+
+  std::set<type_index> printed;
+  for (const auto& type : hostPrintable)
+  {
+    auto iter = base.find(type.first);
+    if (iter != base.end() && iter->second == 1 && 
+        replaced.find(type.first) == replaced.end())
+    {
+      printed.insert(type.second);
+    }
+  }
+
+  return printed;
+}
+
+}
+
+void
+TLText::printDemand(const Constant& c, size_t time)
+{
+  if (m_hostPrinted.find(c.index()) != m_hostPrinted.end())
+  {
+    m_printBuffer.clear();
+    canonical_print_to(m_printBuffer, c);
+    output(*m_os, OUTPUT_SILENT) << m_printBuffer << std::endl;
+    return;
+  }
+
+  //the header's canonical_print decides how this is printed
+  Constant result;
+  auto print = m_system.lookupIdentifiers().lookup(U"canonical_print");
+
+  if (print != nullptr)
+  {
+    Context& k = m_system.getDefaultContext();
+    ContextPerturber p(k, {{DIM_TIME, Types::Intmp::create(time)}});
+
+    result = applyFunction<FUN_VALUE>(k, (*print)(k), c);
+  }
+
+  if (result.index() == TYPE_INDEX_USTRING)
+  {
+    output(*m_os, OUTPUT_SILENT) << Types::String::get(result) << std::endl;
+  }
+  else
+  {
+    output(*m_error, OUTPUT_SILENT) 
+      << "Error: canonical_print didn't return a string" 
+      << std::endl;
+    output(*m_error, OUTPUT_SILENT) << "Type index: " << result.index() 
+      << std::endl;
+    if (result.index() == TYPE_INDEX_SPECIAL)
+    {
+      output(*m_error, OUTPUT_SILENT) << "special: " << 
+        get_constant<Special>(result) << std::endl;
+    }
+  }
+}
+
+void
+TLText::main_loop()
+{
+  prepare();
 
   *m_error << m_initialOut << std::endl;
   *m_is >> std::noskipws;
@@ -271,7 +562,8 @@ TLText::main_loop()
           ),
           Tree::Expr(),
 
-          Tree::LambdaAppExpr(Tree::IdentExpr(U"canonical_print"), e)
+          //printed by printDemand
+          e
 
           //Tree::AtExpr(
           //  Tree::IdentExpr(U"CANONICAL_PRINT"),
@@ -284,6 +576,9 @@ TLText::main_loop()
       computeDependencies();
       typeInference(exprs);
 
+      //before the instant ends and the definitions can change
+      m_hostPrinted = findHostPrinted(m_system);
+
       //run the demands
       m_system.go();
 
@@ -297,24 +592,7 @@ TLText::main_loop()
         output(*m_os, OUTPUT_STANDARD) << 
         //TRANSLATORS: verbose output, which demand we are printing
           boost::format(_("// demand %1%")) % s << std::endl;
-        const auto& c = (*m_demands)(s);
-        if (c.index() == TYPE_INDEX_USTRING)
-        {
-          output(*m_os, OUTPUT_SILENT) << Types::String::get(c) << std::endl;
-        }
-        else
-        {
-          output(*m_error, OUTPUT_SILENT) 
-            << "Error: canonical_print didn't return a string" 
-            << std::endl;
-          output(*m_error, OUTPUT_SILENT) << "Type index: " << c.index() 
-            << std::endl;
-          if (c.index() == TYPE_INDEX_SPECIAL)
-          {
-            output(*m_error, OUTPUT_SILENT) << "special: " << 
-              get_constant<Special>(c) << std::endl;
-          }
-        }
+        printDemand((*m_demands)(s), time);
       }
 
       output(*m_os, OUTPUT_STANDARD) << 
@@ -359,6 +637,9 @@ TLText::processDefinitions
   bool parseExpressions = true;
   bool first = true;
 
+  //declarations waiting to be parsed together
+  std::vector<Parser::RawInput> pending;
+
   bool done = false;
   while (!done)
   {
@@ -368,57 +649,28 @@ TLText::processDefinitions
       case LineType::LINE:
       //parse a line with the system
       {
-        #if 0
-        Parser::U32Iterator lineBegin(
-          Parser::makeUTF32Iterator(line.text.begin()));
-        Parser::U32Iterator lineEnd(
-          Parser::makeUTF32Iterator(line.text.end())
-        );
-
-        Parser::StreamPosIterator posbegin(lineBegin, streamName,
-          line.line,line.character);
-        Parser::StreamPosIterator posend(lineEnd);
-        #endif
-
-        try
+        Parser::RawInput input
         {
-          //auto result = 
-          //  m_system.parseLine(posbegin, posend, m_verbose, m_debug);
-          auto result = m_system.addDeclaration(
-            Parser::RawInput
-            {
-              streamName,
-              line.line,
-              line.character,
-              line.text
-            }
-          );
+          streamName,
+          line.line,
+          line.character,
+          line.text
+        };
 
-
-          if (m_cached)
+        if (m_parseThreads > 1)
+        {
+          if (m_system.independentDeclaration(input))
           {
-            //how do I do this?
-            if (result.index() == TYPE_INDEX_UUID)
-            {
-              m_system.cacheObject(Types::UUID::get(result));
-            }
+            pending.push_back(input);
+            break;
           }
 
-          if (m_uuids)
-          {
-            //print out whatever we got back
-            output(*m_os, OUTPUT_STANDARD) << m_system.printConstant(result)
-              << std::endl;
-          }
-        }
-        catch (TransLucid::Parser::ParseError& e)
-        {
-          const Parser::Position& pos = e.m_pos;
-          output(*m_error, OUTPUT_SILENT) << m_myname << ":" << 
-            streamName << ":" 
-            << pos.line << ":" 
-            << pos.character << ":" << e.what() << std::endl;
+          //anything else could change how the rest is parsed, so the
+          //declarations before it go in first
+          addPending(pending);
         }
+
+        addDefinition(input, nullptr);
       }
       break;
 
@@ -443,9 +695,66 @@ TLText::processDefinitions
     first = false;
   }
 
+  addPending(pending);
+
   return std::make_pair(instantValid, parseExpressions);
 }
 
+void
+TLText::addPending(std::vector<Parser::RawInput>& pending)
+{
+  if (pending.empty())
+  {
+    return;
+  }
+
+  auto parsed = m_system.parseDeclarations(pending, m_parseThreads);
+
+  for (size_t i = 0; i != pending.size(); ++i)
+  {
+    addDefinition(pending[i], parsed[i]);
+  }
+
+  pending.clear();
+}
+
+void
+TLText::addDefinition
+(
+  const Parser::RawInput& input,
+  const std::shared_ptr<Parser::Line>& parsed
+)
+{
+  try
+  {
+    auto result = m_system.addDeclaration(input, parsed);
+
+    if (m_cached)
+    {
+      //how do I do this?
+      if (result.index() == TYPE_INDEX_UUID)
+      {
+        m_system.cacheObject(Types::UUID::get(result));
+      }
+    }
+
+    if (m_uuids)
+    {
+      //print out whatever we got back
+      output(*m_os, OUTPUT_STANDARD) << m_system.printConstant(result)
+        << std::endl;
+    }
+  }
+  catch (TransLucid::Parser::ParseError& e)
+  {
+    const Parser::Position& pos = e.m_pos;
+    output(*m_error, OUTPUT_SILENT) << m_myname << ":" << 
+      input.source << ":" 
+      << pos.line << ":" 
+      << pos.character << ":" << e.what() << std::endl;
+  }
+}
+
 std::vector<Tree::Expr>
 TLText::processExpressions
 (
@@ -620,11 +929,20 @@ TLText::typeInference(const std::vector<Tree::Expr>& exprs)
 
   if (m_infer)
   {
-    TypeInference::FreshTypeVars fresh;
-    TypeInference::TypeInferrer infer(m_system, fresh);
+    if (m_inferrer == nullptr)
+    {
+      m_freshVars = new TypeInference::FreshTypeVars;
+      m_inferrer = new TypeInference::TypeInferrer(m_system, *m_freshVars);
+
+      predefined_types(*m_inferrer);
+    }
+
+    auto& infer = *m_inferrer;
 
-    predefined_types(infer);
+    infer.setThreads(m_tyinfThreads);
 
+    //everything that hasn't changed since the last instant keeps its type
+    infer.invalidate_changed();
     infer.infer_system(freeVars);
 
     for (const auto& e : exprs)
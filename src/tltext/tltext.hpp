@@ -21,9 +21,11 @@ along with TransLucid; see the file COPYING.  If not see
 #include <tl/dependencies.hpp>
 #include <tl/hyperdatons/multi_arrayhd_fwd.hpp>
 #include <tl/hyperdatons/envhd.hpp>
+#include <tl/hyperdatons/sharedhd.hpp>
 #include <tl/library.hpp>
 #include <tl/system.hpp>
 #include <iostream>
+#include <memory>
 
 #include "demandhd.hpp"
 
@@ -45,6 +47,7 @@ namespace TransLucid
 
   namespace TypeInference
   {
+    class FreshTypeVars;
     class TypeInferrer;
   }
 
@@ -175,6 +178,14 @@ namespace TransLucid
       void 
       run();
 
+      /**
+       * Load the headers and run instant 0. run() does this itself if it
+       * hasn't been done yet, so that the work can be done once and then
+       * shared by forked copies.
+       */
+      void
+      prepare();
+
       /**
        * Set the input stream. Sets the stream to use as input.
        * @param is The input stream.
@@ -235,6 +246,21 @@ namespace TransLucid
         m_cached = cached;
       }
 
+      void
+      eager_compile(bool eager = true)
+      {
+        m_system.enableEagerCompile(eager);
+      }
+
+      /**
+       * Only keep the definitions of the last @a instants instants.
+       */
+      void
+      keep_history(size_t instants)
+      {
+        m_system.keepHistory(instants);
+      }
+
       void
       compute_deps()
       {
@@ -250,6 +276,47 @@ namespace TransLucid
         m_fulltypes = full;
       }
 
+      /**
+       * Record the demands for cached variables, the last @a size of them
+       * are written to @a path when the run finishes.
+       */
+      void
+      trace(const std::string& path, size_t size)
+      {
+        m_tracePath = path;
+        m_system.enableDemandTrace(size);
+      }
+
+      /**
+       * Add an output hyperdaton in shared memory. @a spec is
+       * name:segment:type:dim=size,dim=size... where type is int64 or
+       * float64, and a dim that is a number is that numbered dimension.
+       */
+      void
+      shared_output(const std::string& spec);
+
+      /**
+       * Infer independent recursion groups with @a threads workers. The
+       * default is one. Fresh type variables are numbered in the order the
+       * workers ask for them, so with more than one thread the names in
+       * the printed types can change from run to run.
+       */
+      void
+      tyinf_threads(size_t threads)
+      {
+        m_tyinfThreads = threads;
+      }
+
+      /**
+       * Parse runs of independent declarations with this many threads.
+       * With one thread every declaration is added as it is read.
+       */
+      void
+      parse_threads(size_t threads)
+      {
+        m_parseThreads = threads;
+      }
+
       private:
       std::string m_myname;
 
@@ -259,6 +326,12 @@ namespace TransLucid
       bool m_cached;
       bool m_infer;
       bool m_fulltypes;
+      size_t m_tyinfThreads;
+      size_t m_parseThreads;
+
+      std::string m_tracePath;
+
+      std::vector<std::unique_ptr<SharedArrayHD>> m_sharedHDs;
 
       std::istream* m_is;
       std::ostream* m_os;
@@ -289,9 +362,25 @@ namespace TransLucid
       std::pair<bool, bool>
       processDefinitions(LineTokenizer& line, const u32string& streamName);
 
+      //adds one declaration, reporting any errors, parsed is what
+      //parseDeclarations gave for it if anything
+      void
+      addDefinition
+      (
+        const Parser::RawInput& input,
+        const std::shared_ptr<Parser::Line>& parsed
+      );
+
+      //parses the waiting declarations together and adds them in order
+      void
+      addPending(std::vector<Parser::RawInput>& pending);
+
       std::vector<Tree::Expr>
       processExpressions(LineTokenizer& line, const u32string& streamName);
 
+      void
+      writeTrace();
+
       void
       setup_clargs();
 
@@ -316,6 +405,15 @@ namespace TransLucid
       void
       main_loop();
 
+      //prints the value of one demand, the types in m_hostPrinted are
+      //printed straight into m_printBuffer, everything else goes through
+      //the canonical_print in the header
+      void
+      printDemand(const Constant& c, size_t time);
+
+      std::set<type_index> m_hostPrinted;
+      u32string m_printBuffer;
+
       DemandHD* m_demands;
       DemandHD* m_returnhd;
 
@@ -326,6 +424,13 @@ namespace TransLucid
       std::vector<std::string> m_clargs;
       ArrayNHD<u32string, 1>* m_argsHD;
       EnvHD* m_envHD;
+
+      //the types are kept from one instant to the next, so only what
+      //changes has to be inferred again
+      TypeInference::FreshTypeVars* m_freshVars;
+      TypeInference::TypeInferrer* m_inferrer;
+
+      bool m_prepared;
     };
 
     enum TLtextReturnCode
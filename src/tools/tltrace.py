@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+
+# summarises a demand trace written by tltext --trace
+#
+# tltrace.py trace           print a summary of the trace
+# tltrace.py --folded trace  print the stacks of the demands in the folded
+#                            format that flamegraph.pl reads, the count of
+#                            each stack is the nanoseconds spent in it
+
+import argparse
+import collections
+import struct
+import sys
+
+MAGIC = b"TLTRACE\0"
+VERSION = 1
+
+OUTCOMES = ["hit", "calc", "demand", "loop"]
+
+Record = collections.namedtuple("Record",
+  ["sequence", "parent", "nanoseconds", "context", "variable", "outcome"])
+
+RECORD = struct.Struct("<QQQQIB")
+
+class Trace:
+  def __init__(self, data):
+    self.data = data
+    self.pos = 0
+
+    if self.read(len(MAGIC)) != MAGIC:
+      raise ValueError("not a demand trace")
+
+    version = self.number("<I")
+    if version != VERSION:
+      raise ValueError("unknown trace version %d" % version)
+
+    self.total = self.number("<Q")
+    self.dropped = self.number("<Q")
+
+    self.variables = [self.string() for i in range(self.number("<I"))]
+
+    self.contexts = {}
+    for i in range(self.number("<I")):
+      key = self.number("<Q")
+      self.contexts[key] = self.string()
+
+    self.records = []
+    for i in range(self.number("<Q")):
+      fields = RECORD.unpack_from(self.data, self.pos)
+      self.pos += RECORD.size
+      self.records.append(Record(*fields))
+
+  def read(self, n):
+    result = self.data[self.pos:self.pos + n]
+    self.pos += n
+    return result
+
+  def number(self, fmt):
+    value, = struct.unpack_from(fmt, self.data, self.pos)
+    self.pos += struct.calcsize(fmt)
+    return value
+
+  def string(self):
+    return self.read(self.number("<I")).decode("utf-8")
+
+  def name(self, record):
+    return self.variables[record.variable]
+
+  def context(self, record):
+    return self.contexts.get(record.context, "?")
+
+def children(trace):
+  result = collections.defaultdict(list)
+  for r in trace.records:
+    if r.parent != 0:
+      result[r.parent].append(r)
+  return result
+
+def milliseconds(ns):
+  return "%.3f" % (ns / 1e6)
+
+def summary(trace, top):
+  print("demands: %d, kept: %d, dropped: %d" %
+    (trace.total, len(trace.records), trace.dropped))
+
+  outcomes = collections.Counter(r.outcome for r in trace.records)
+  print("  " + ", ".join("%s: %d" % (OUTCOMES[o], outcomes[o])
+    for o in range(len(OUTCOMES))))
+
+  #the same variable in the same context
+  demands = collections.Counter()
+  time = collections.Counter()
+  calcs = collections.Counter()
+  for r in trace.records:
+    key = (r.variable, r.context)
+    demands[key] += 1
+    time[key] += r.nanoseconds
+    if r.outcome == 1:
+      calcs[key] += 1
+
+  print()
+  print("hottest contexts:")
+  print("  %8s %12s  %s" % ("demands", "ms", "variable @ context"))
+  for key, count in demands.most_common(top):
+    print("  %8d %12s  %s @ %s" % (count, milliseconds(time[key]),
+      trace.variables[key[0]], trace.contexts.get(key[1], "?")))
+
+  print()
+  print("computed more than once:")
+  redundant = [(count, key) for key, count in calcs.items() if count > 1]
+  redundant.sort(reverse = True)
+  if not redundant:
+    print("  nothing")
+  for count, key in redundant[:top]:
+    print("  %8d  %s @ %s" % (count, trace.variables[key[0]],
+      trace.contexts.get(key[1], "?")))
+
+  #how many demands each demand for a variable makes
+  made = children(trace)
+  fanout = collections.defaultdict(list)
+  for r in trace.records:
+    fanout[r.variable].append(len(made[r.sequence]))
+
+  print()
+  print("demand fan-out:")
+  print("  %8s %8s %8s  %s" % ("demands", "mean", "max", "variable"))
+  rows = sorted(fanout.items(), key = lambda v: -sum(v[1]))
+  for variable, counts in rows[:top]:
+    print("  %8d %8.2f %8d  %s" % (len(counts),
+      sum(counts) / float(len(counts)), max(counts),
+      trace.variables[variable]))
+
+def folded(trace, out):
+  bysequence = dict((r.sequence, r) for r in trace.records)
+  made = children(trace)
+
+  stacks = collections.Counter()
+  for r in trace.records:
+    inner = sum(c.nanoseconds for c in made[r.sequence])
+    spent = max(r.nanoseconds - inner, 0)
+
+    #a parent that wasn't kept ends the stack
+    names = []
+    current = r
+    while current is not None:
+      names.append(trace.name(current))
+      current = bysequence.get(current.parent)
+
+    stacks[";".join(reversed(names))] += spent
+
+  for stack, spent in sorted(stacks.items()):
+    out.write("%s %d\n" % (stack, spent))
+
+def main():
+  parser = argparse.ArgumentParser(description = "summarise a demand trace")
+  parser.add_argument("trace", help = "the file written by tltext --trace")
+  parser.add_argument("--folded", action = "store_true",
+    help = "print the stacks for a flame graph instead")
+  parser.add_argument("--top", type = int, default = 10,
+    help = "how many of each to print")
+  args = parser.parse_args()
+
+  with open(args.trace, "rb") as f:
+    trace = Trace(f.read())
+
+  if args.folded:
+    folded(trace, sys.stdout)
+  else:
+    summary(trace, args.top)
+
+if __name__ == "__main__":
+  main()